@@ -3,6 +3,15 @@
 // Simple in-memory database for our CRUD operations
 class ItemStore
 {
+public:
+    // What a client sends for an item, everything but the ID
+    struct Fields
+    {
+        std::string name;
+        std::string description;
+        double price = 0;
+    };
+
 private:
     struct Item
     {
@@ -11,24 +20,33 @@ private:
         std::string description;
         double price;
 
+        HH_WEB_JSON_FIELDS(Item, id, name, description, price)
+
         // Convert to JSON string
         std::string to_json() const
         {
-            std::stringstream ss;
-            ss << "{";
-            ss << "\"id\": " << id << ",";
-            ss << "\"name\": \"" << name << "\",";
-            ss << "\"description\": \"" << description << "\",";
-            ss << "\"price\": " << price;
-            ss << "}";
-            return ss.str();
+            hh_web::json_writer json;
+            json.value(*this);
+            return json.take();
         }
     };
 
-    std::map<int, Item> items;
+    using item_map = std::map<int, Item>;
+
+    item_map items;
     int next_id = 1;
     std::mutex mtx; // For thread safety
 
+    // Names and descriptions, changed under mtx along with items; searching only takes the
+    // index's own shared lock
+    hh_web::search_index index;
+
+    void index_item(hh_web::search_index::batch &indexing, const Item &item)
+    {
+        // a word in the name counts twice as much as one in the description
+        indexing.put(item.id, {{item.name, 2}, {item.description, 1}});
+    }
+
 public:
     // Create - returns the ID of the newly created item
     int create(const std::string &name, const std::string &description, double price)
@@ -37,6 +55,8 @@ public:
         int id = next_id++;
         Item item{id, name, description, price};
         items[id] = item;
+        hh_web::search_index::batch indexing(index);
+        index_item(indexing, item);
         return id;
     }
 
@@ -56,6 +76,38 @@ public:
         return items[id];
     }
 
+    // Read - like get, but a missing item is an empty optional rather than an exception
+    std::optional<Item> find(int id)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = items.find(id);
+        if (it == items.end())
+        {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    // Read - the best matches of a query in names and descriptions, with their BM25 scores
+    std::vector<std::pair<Item, double>> search(std::string_view query, std::size_t limit)
+    {
+        // ranked on the index alone, mtx is only taken to copy the hits
+        std::vector<hh_web::search_hit> hits = index.search(query, limit);
+        std::vector<std::pair<Item, double>> result;
+        result.reserve(hits.size());
+
+        std::lock_guard<std::mutex> lock(mtx);
+        for (const auto &hit : hits)
+        {
+            auto it = items.find(static_cast<int>(hit.id));
+            if (it != items.end())
+            {
+                result.emplace_back(it->second, hit.score);
+            }
+        }
+        return result;
+    }
+
     // Read - get all items
     std::vector<Item> get_all()
     {
@@ -82,6 +134,23 @@ public:
                 "Not Found");
         }
         items[id] = Item{id, name, description, price};
+        hh_web::search_index::batch indexing(index);
+        index_item(indexing, items[id]);
+    }
+
+    // Update - like update, returns false when the item does not exist
+    bool try_update(int id, const std::string &name, const std::string &description, double price)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = items.find(id);
+        if (it == items.end())
+        {
+            return false;
+        }
+        it->second = Item{id, name, description, price};
+        hh_web::search_index::batch indexing(index);
+        index_item(indexing, it->second);
+        return true;
     }
 
     // Delete - remove an item
@@ -98,6 +167,104 @@ public:
                 "Not Found");
         }
         items.erase(id);
+        index.remove(id);
+    }
+
+    // Delete - like remove, returns false when the item does not exist
+    bool try_remove(int id)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (items.erase(id) == 0)
+        {
+            return false;
+        }
+        index.remove(id);
+        return true;
+    }
+
+    // The bulk operations below take the lock once per batch instead of once per item.
+    // Memory is allocated and freed outside it (map nodes, strings, result vectors), so
+    // the lock is only held to link, overwrite or unlink nodes.
+
+    // Create - many items, returns their IDs in the order of batch
+    std::vector<int> create_many(std::vector<Fields> batch)
+    {
+        // Nodes are built in a scratch map and extracted, they get their IDs under the lock
+        item_map staged;
+        std::vector<item_map::node_type> nodes;
+        nodes.reserve(batch.size());
+        for (std::size_t i = 0; i < batch.size(); ++i)
+        {
+            auto it = staged.emplace_hint(staged.end(), static_cast<int>(i),
+                                          Item{0, std::move(batch[i].name), std::move(batch[i].description), batch[i].price});
+            nodes.push_back(staged.extract(it));
+        }
+        std::vector<int> ids;
+        ids.reserve(nodes.size());
+
+        std::lock_guard<std::mutex> lock(mtx);
+        hh_web::search_index::batch indexing(index);
+        for (auto &node : nodes)
+        {
+            int id = next_id++;
+            node.key() = id;
+            node.mapped().id = id;
+            // IDs only grow, so every new item belongs at the end: the hint makes that O(1)
+            auto it = items.insert(items.end(), std::move(node));
+            index_item(indexing, it->second);
+            ids.push_back(id);
+        }
+        return ids;
+    }
+
+    // Update - many items, result i tells whether batch[i] existed and was updated
+    std::vector<bool> update_many(std::vector<std::pair<int, Fields>> batch)
+    {
+        std::vector<bool> updated;
+        updated.reserve(batch.size());
+
+        std::lock_guard<std::mutex> lock(mtx);
+        hh_web::search_index::batch indexing(index);
+        for (auto &[id, fields] : batch)
+        {
+            auto it = items.find(id);
+            if (it == items.end())
+            {
+                updated.push_back(false);
+                continue;
+            }
+            // swapped rather than assigned, the old strings are freed with batch after unlocking
+            std::swap(it->second.name, fields.name);
+            std::swap(it->second.description, fields.description);
+            it->second.price = fields.price;
+            index_item(indexing, it->second);
+            updated.push_back(true);
+        }
+        return updated;
+    }
+
+    // Delete - many items, result i tells whether ids[i] existed and was removed
+    std::vector<bool> remove_many(const std::vector<int> &ids)
+    {
+        std::vector<bool> removed;
+        removed.reserve(ids.size());
+        // Unlinked nodes are kept until the lock is released and freed then
+        std::vector<item_map::node_type> unlinked;
+        unlinked.reserve(ids.size());
+
+        std::lock_guard<std::mutex> lock(mtx);
+        hh_web::search_index::batch indexing(index);
+        for (int id : ids)
+        {
+            auto node = items.extract(id);
+            removed.push_back(!node.empty());
+            if (!node.empty())
+            {
+                indexing.remove(id);
+                unlinked.push_back(std::move(node));
+            }
+        }
+        return removed;
     }
 };
 
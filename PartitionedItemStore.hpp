@@ -0,0 +1,151 @@
+#pragma once
+
+// The item store split into partitions, one per shard of a hh_web::shard_group. Each shard
+// thread owns its partition outright: there is no mutex, and the partition's memory stays in
+// that core's cache. Operations on one item are sent to the shard owning its ID, listing all
+// items asks every shard for its part and merges the answers.
+class PartitionedItemStore
+{
+private:
+    struct Item
+    {
+        int id;
+        std::string name;
+        std::string description;
+        double price;
+
+        HH_WEB_JSON_FIELDS(Item, id, name, description, price)
+
+        // Convert to JSON string
+        std::string to_json() const
+        {
+            hh_web::json_writer json;
+            json.value(*this);
+            return json.take();
+        }
+    };
+
+    // Only touched by its shard, on its own cache lines so neighbours do not share any
+    struct alignas(64) Partition
+    {
+        std::map<int, Item> items;
+        int next_local = 0;
+    };
+
+    hh_web::shard_group &shards;
+    std::vector<Partition> partitions;
+
+    // IDs encode their owner: partition p hands out p + 1, p + 1 + n, p + 1 + 2n, ...
+    unsigned int owner_of(int id) const
+    {
+        return shards.shard_of(static_cast<std::uint64_t>(id - 1));
+    }
+
+    int next_id(unsigned int shard)
+    {
+        return partitions[shard].next_local++ * static_cast<int>(shards.size()) + static_cast<int>(shard) + 1;
+    }
+
+public:
+    explicit PartitionedItemStore(hh_web::shard_group &shards) : shards(shards), partitions(shards.size())
+    {
+    }
+
+    // Create - on the calling shard, or spread round robin when called from elsewhere
+    int create(std::string name, std::string description, double price)
+    {
+        static thread_local unsigned int turn = 0;
+        unsigned int shard = shards.current_shard();
+        if (shard == hh_web::shard_group::no_shard)
+        {
+            shard = turn++ % shards.size();
+        }
+        return shards.invoke_on(shard, [this, shard, name = std::move(name), description = std::move(description), price]() mutable
+                                {
+                                    int id = next_id(shard);
+                                    partitions[shard].items.emplace_hint(partitions[shard].items.end(), id,
+                                                                         Item{id, std::move(name), std::move(description), price});
+                                    return id; });
+    }
+
+    // Read - a missing item is an empty optional
+    std::optional<Item> find(int id)
+    {
+        if (id < 1)
+        {
+            return std::nullopt;
+        }
+        unsigned int shard = owner_of(id);
+        return shards.invoke_on(shard, [this, shard, id]() -> std::optional<Item>
+                                {
+                                    auto &items = partitions[shard].items;
+                                    auto it = items.find(id);
+                                    if (it == items.end())
+                                    {
+                                        return std::nullopt;
+                                    }
+                                    return it->second; });
+    }
+
+    // Read - get all items, every shard copies out its partition in parallel
+    std::vector<Item> get_all()
+    {
+        auto parts = shards.invoke_on_all([this](unsigned int shard)
+                                          {
+                                              std::vector<Item> part;
+                                              part.reserve(partitions[shard].items.size());
+                                              for (const auto &[id, item] : partitions[shard].items)
+                                              {
+                                                  part.push_back(item);
+                                              }
+                                              return part; });
+
+        std::size_t total = 0;
+        for (const auto &part : parts)
+        {
+            total += part.size();
+        }
+        std::vector<Item> result;
+        result.reserve(total);
+        for (auto &part : parts)
+        {
+            std::move(part.begin(), part.end(), std::back_inserter(result));
+        }
+        // IDs of the partitions interleave, each part is sorted already
+        std::sort(result.begin(), result.end(), [](const Item &a, const Item &b)
+                  { return a.id < b.id; });
+        return result;
+    }
+
+    // Update - returns false when the item does not exist
+    bool try_update(int id, std::string name, std::string description, double price)
+    {
+        if (id < 1)
+        {
+            return false;
+        }
+        unsigned int shard = owner_of(id);
+        return shards.invoke_on(shard, [this, shard, id, name = std::move(name), description = std::move(description), price]() mutable
+                                {
+                                    auto &items = partitions[shard].items;
+                                    auto it = items.find(id);
+                                    if (it == items.end())
+                                    {
+                                        return false;
+                                    }
+                                    it->second = Item{id, std::move(name), std::move(description), price};
+                                    return true; });
+    }
+
+    // Delete - returns false when the item does not exist
+    bool try_remove(int id)
+    {
+        if (id < 1)
+        {
+            return false;
+        }
+        unsigned int shard = owner_of(id);
+        return shards.invoke_on(shard, [this, shard, id]()
+                                { return partitions[shard].items.erase(id) > 0; });
+    }
+};
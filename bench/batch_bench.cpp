@@ -0,0 +1,209 @@
+/**
+ * Benchmark: fetching ten items with ten GET requests vs one batch request.
+ *
+ * An http2_listener on loopback hands every request to a worker pool, which runs it through a
+ * web_router as web_server does: GET /api/items/:id answers a small JSON item, POST /api/batch
+ * is a web_batch_route over the same router. A client on one keep-alive HTTP/1.1 connection
+ * fetches ten items per round, either as ten GETs one after the other or as one batch (run
+ * serially and in parallel on the workers). [rtt_us] adds a simulated network round trip per
+ * request on the client, as a mobile client pays it. Microseconds per round of ten items and
+ * server CPU time per round are reported.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./batch_bench [rounds] [rtt_us]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../includes/http2_listener.hpp"
+#include "../includes/web_batch.hpp"
+#include "../includes/web_request.hpp"
+#include "../includes/web_response.hpp"
+#include "../includes/web_router.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static int connect_tcp(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<std::uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static double cpu_seconds()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/// Reads one response delimited by Content-Length, keeps what follows in input
+static bool read_response(int fd, std::string &input, std::vector<char> &buffer)
+{
+    while (true)
+    {
+        std::size_t end = input.find("\r\n\r\n");
+        if (end != std::string::npos)
+        {
+            std::size_t field = input.find("Content-Length: ");
+            std::size_t length = field < end ? std::strtoul(input.c_str() + field + 16, nullptr, 10) : 0;
+            if (input.size() >= end + 4 + length)
+            {
+                input.erase(0, end + 4 + length);
+                return true;
+            }
+        }
+        ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+        if (received <= 0)
+            return false;
+        input.append(buffer.data(), static_cast<std::size_t>(received));
+    }
+}
+
+static bool round_trip(int fd, const std::string &request, std::string &input, std::vector<char> &buffer, int rtt_us)
+{
+    if (rtt_us > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(rtt_us));
+    return send(fd, request.data(), request.size(), MSG_NOSIGNAL) >= 0 && read_response(fd, input, buffer);
+}
+
+struct round_result
+{
+    double us_per_round = 0;
+    double cpu_us_per_round = 0;
+};
+
+template <typename F>
+static round_result measure(int rounds, F &&fetch)
+{
+    double cpu_before = cpu_seconds();
+    auto start = bench_clock::now();
+    for (int i = 0; i < rounds; ++i)
+    {
+        if (!fetch())
+        {
+            std::printf("request failed\n");
+            break;
+        }
+    }
+    round_result result;
+    result.us_per_round = std::chrono::duration<double, std::micro>(bench_clock::now() - start).count() / rounds;
+    result.cpu_us_per_round = (cpu_seconds() - cpu_before) * 1e6 / rounds;
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? std::atoi(argv[1]) : 2000;
+    int rtt_us = argc > 2 ? std::atoi(argv[2]) : 0;
+
+    auto router = std::make_shared<hh_web::web_router<>>();
+    router->get("/api/items/:id", {[](std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+                                   {
+                                       std::string id = req->get_path_params().front().second;
+                                       res->send_json("{\"id\": " + id + ", \"name\": \"Item " + id + "\", \"price\": 9.99}");
+                                       return hh_web::exit_code::EXIT; }});
+
+    hh_web::thread_pool workers(4);
+    auto pipeline = [router](std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+    {
+        if (!router->handle_request(req, res))
+        {
+            res->set_status(404, "Not Found");
+            res->send_text("404 Not Found");
+        }
+        res->send();
+    };
+    hh_web::batch_config serial;
+    serial.parallel = false;
+    router->add_route(std::make_shared<hh_web::web_batch_route<>>("/api/batch", hh_web::batch_config{}, pipeline, &workers));
+    router->add_route(std::make_shared<hh_web::web_batch_route<>>("/api/batch-serial", serial, pipeline, &workers));
+
+    hh_web::http2_listener listener(0, "127.0.0.1");
+    listener.set_request_callback([&workers, &listener, pipeline](const hh_web::http2_stream_ref &ref, hh_web::http2_request &&request)
+                                  {
+                                      hh_web::synthetic_request message;
+                                      message.method = std::move(request.method);
+                                      message.uri = std::move(request.path);
+                                      message.version = "HTTP/1.1";
+                                      message.headers = std::move(request.headers);
+                                      message.body = std::move(request.body);
+                                      auto req = std::make_shared<hh_web::web_request>(std::move(message));
+                                      auto res = std::make_shared<hh_web::web_response>([&listener, ref](hh_web::synthetic_response &&sent)
+                                                                                        {
+                                                                                            hh_web::http2_response answer;
+                                                                                            answer.status = sent.status;
+                                                                                            answer.headers = std::move(sent.headers);
+                                                                                            answer.body = std::move(sent.body);
+                                                                                            listener.post(ref, std::move(answer)); });
+                                      workers.enqueue([pipeline, req, res]()
+                                                      { pipeline(req, res); });
+                                      return nullptr; });
+    if (!listener.start())
+        return 1;
+
+    std::string batch_body = "{\"requests\": [";
+    std::vector<std::string> singles;
+    for (int i = 1; i <= 10; ++i)
+    {
+        batch_body += std::string(i > 1 ? "," : "") + "{\"path\": \"/api/items/" + std::to_string(i) + "\"}";
+        singles.push_back("GET /api/items/" + std::to_string(i) + " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    }
+    batch_body += "]}";
+    auto batch_request = [&batch_body](const char *path)
+    {
+        return std::string("POST ") + path + " HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\nContent-Length: " +
+               std::to_string(batch_body.size()) + "\r\n\r\n" + batch_body;
+    };
+    std::string parallel_request = batch_request("/api/batch"), serial_request = batch_request("/api/batch-serial");
+
+    int fd = connect_tcp(listener.get_port());
+    std::vector<char> buffer(16384);
+    std::string input;
+
+    std::printf("%d rounds of 10 items, simulated round trip %d us\n", rounds, rtt_us);
+    auto print = [](const char *name, const round_result &result)
+    {
+        std::printf("%-22s %9.1f us per round   %7.1f us CPU per round\n", name, result.us_per_round, result.cpu_us_per_round);
+    };
+    print("10 GET requests", measure(rounds, [&]()
+                                     {
+                                         for (const auto &single : singles)
+                                         {
+                                             if (!round_trip(fd, single, input, buffer, rtt_us))
+                                                 return false;
+                                         }
+                                         return true; }));
+    print("1 batch, serial", measure(rounds, [&]()
+                                     { return round_trip(fd, serial_request, input, buffer, rtt_us); }));
+    print("1 batch, parallel", measure(rounds, [&]()
+                                       { return round_trip(fd, parallel_request, input, buffer, rtt_us); }));
+
+    close(fd);
+    workers.stop_workers();
+    listener.stop();
+    return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * Benchmark: answering an unmatched route with a response built per request vs a canned one.
+ *
+ * "rebuilt" answers the way example.cpp's 404 handler used to: status, Content-Type and the
+ * inline HTML page are set on the response for every hit, and the HTTP/1.1 bytes are
+ * serialized from them as http2_listener does for any response. "canned" sends a
+ * canned_response rendered once (web_response::send_canned) and appends its pre-serialized
+ * bytes with only the Connection header added. Both run through web_response objects with a
+ * synthetic target, as requests of the HTTP/2 or Unix socket listener do. Nanoseconds per
+ * response are reported, for the web_response step and the serialization step.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./canned_response_bench [responses]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "../includes/canned_response.hpp"
+#include "../includes/web_response.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static const char *not_found_page = R"(
+            <!DOCTYPE html>
+            <html lang="en">
+            <head>
+                <meta charset="UTF-8">
+                <meta name="viewport" content="width=device-width, initial-scale=1.0">
+                <title>404 Not Found</title>
+                <link rel="stylesheet" href="/style.css">
+            </head>
+            <body>
+                <div class="container">
+                    <h1>404 Not Found</h1>
+                    <p>The requested resource could not be found on this server.</p>
+                    <a href="/">Go to Home</a>
+                </div>
+            </body>
+            </html>
+)";
+
+/// HTTP/1.1 bytes from status, headers and body, as http2_listener::respond_http1 writes them
+static void serialize(std::string &out, const hh_web::synthetic_response &response)
+{
+    out += "HTTP/1.1 " + std::to_string(response.status) + " " + response.message + "\r\n";
+    for (const auto &header : response.headers)
+        out += header.first + ": " + header.second + "\r\n";
+    out += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+    out += "Connection: keep-alive\r\n\r\n";
+    out += response.body;
+}
+
+template <typename F>
+static double measure(int responses, F &&respond)
+{
+    auto start = bench_clock::now();
+    for (int i = 0; i < responses; ++i)
+        respond();
+    return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / responses;
+}
+
+int main(int argc, char **argv)
+{
+    int responses = argc > 1 ? std::atoi(argv[1]) : 500000;
+    auto canned = std::make_shared<const hh_web::canned_response>(404, "Not Found", not_found_page, "text/html");
+
+    std::size_t bytes = 0;
+    std::string out;
+    out.reserve(4096);
+
+    double rebuilt = measure(responses, [&]()
+                             {
+                                 auto response = std::make_shared<hh_web::web_response>([&](hh_web::synthetic_response &&sent)
+                                                                                        {
+                                                                                            out.clear();
+                                                                                            serialize(out, sent);
+                                                                                            bytes += out.size(); });
+                                 response->set_status(404, "Not Found");
+                                 std::string page = not_found_page;
+                                 response->send_html(page); });
+
+    double sent_canned = measure(responses, [&]()
+                                 {
+                                     auto response = std::make_shared<hh_web::web_response>([&](hh_web::synthetic_response &&sent)
+                                                                                            {
+                                                                                                out.clear();
+                                                                                                sent.canned->append_http1(out, true);
+                                                                                                bytes += out.size(); });
+                                     response->send_canned(canned); });
+
+    hh_web::synthetic_response built;
+    built.status = 404;
+    built.message = "Not Found";
+    built.headers = {{"Content-Type", "text/html"}};
+    built.body = not_found_page;
+    double serialize_rebuilt = measure(responses, [&]()
+                                       {
+                                           out.clear();
+                                           serialize(out, built);
+                                           bytes += out.size(); });
+    double serialize_canned = measure(responses, [&]()
+                                      {
+                                          out.clear();
+                                          canned->append_http1(out, true);
+                                          bytes += out.size(); });
+
+    std::printf("%d responses of a %zu byte 404 page\n", responses, canned->get_body().size());
+    std::printf("web_response + bytes:  rebuilt %7.0f ns   canned %7.0f ns\n", rebuilt, sent_canned);
+    std::printf("bytes only:            rebuilt %7.0f ns   canned %7.0f ns\n", serialize_rebuilt, serialize_canned);
+    std::printf("(%zu bytes written)\n", bytes);
+    return 0;
+}
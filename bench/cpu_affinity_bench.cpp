@@ -0,0 +1,150 @@
+/**
+ * Benchmark: thread placement with hh_web::cpu_topology.
+ *
+ * Part 1 builds a simulated two-socket machine (2 nodes x 8 CPUs, an "eth0" with four
+ * queue IRQs spread over both sockets) under a temporary root and prints the placement
+ * web_server would use: reactor CPUs following the NIC queues, shared workers one per
+ * CPU, reactor-local workers on their reactor's node.
+ *
+ * Part 2 measures on the live machine what the placement avoids: the round trip of a
+ * cache line bounced between two threads, unpinned, pinned to neighbouring CPUs of one
+ * node and pinned to CPUs on different nodes (when the machine has more than one).
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./cpu_affinity_bench [round trips]
+ */
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../includes/cpu_topology.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static void write_file(const std::string &path, const std::string &content)
+{
+    std::string directory = path.substr(0, path.rfind('/'));
+    std::string partial;
+    for (std::size_t slash = 1; slash != std::string::npos; slash = directory.find('/', slash + 1))
+    {
+        partial = directory.substr(0, slash);
+        mkdir(partial.c_str(), 0755);
+    }
+    mkdir(directory.c_str(), 0755);
+    std::ofstream(path) << content << "\n";
+}
+
+static std::string simulate_two_sockets()
+{
+    char pattern[] = "/tmp/hh_topology_XXXXXX";
+    std::string root = mkdtemp(pattern);
+    write_file(root + "/sys/devices/system/cpu/online", "0-15");
+    write_file(root + "/sys/devices/system/node/node0/cpulist", "0-7");
+    write_file(root + "/sys/devices/system/node/node1/cpulist", "8-15");
+    write_file(root + "/proc/interrupts",
+               "           CPU0       CPU1\n"
+               " 24:          0          0   PCI-MSI 524288-edge      eth0\n"
+               " 25:       1000          0   PCI-MSI 524289-edge      eth0-TxRx-0\n"
+               " 26:          0       1000   PCI-MSI 524290-edge      eth0-TxRx-1\n"
+               " 27:          0       1000   PCI-MSI 524291-edge      eth0-TxRx-2\n"
+               " 28:          0       1000   PCI-MSI 524292-edge      eth0-TxRx-3\n"
+               " 30:          5          0   PCI-MSI 1048576-edge      nvme0q0\n");
+    write_file(root + "/proc/irq/24/smp_affinity_list", "0-15");
+    write_file(root + "/proc/irq/25/effective_affinity_list", "0");
+    write_file(root + "/proc/irq/26/effective_affinity_list", "8");
+    write_file(root + "/proc/irq/27/smp_affinity_list", "1");
+    write_file(root + "/proc/irq/28/smp_affinity_list", "9");
+    return root;
+}
+
+static void print_cpus(const char *label, const std::vector<int> &cpus)
+{
+    std::printf("%-28s", label);
+    for (int cpu : cpus)
+        std::printf(" %d", cpu);
+    std::printf("\n");
+}
+
+/// Average round trip in nanoseconds of a flag bounced between two threads
+static double ping_pong(const std::vector<int> &first, const std::vector<int> &second, int rounds)
+{
+    alignas(64) std::atomic<int> turn{0};
+    std::thread partner([&]()
+                        {
+                            if (!second.empty())
+                                hh_web::cpu_topology::pin_current_thread(second);
+                            for (int i = 0; i < rounds; ++i)
+                            {
+                                while (turn.load(std::memory_order_acquire) != 1)
+                                {
+                                }
+                                turn.store(0, std::memory_order_release);
+                            } });
+
+    if (!first.empty())
+        hh_web::cpu_topology::pin_current_thread(first);
+    auto start = bench_clock::now();
+    for (int i = 0; i < rounds; ++i)
+    {
+        turn.store(1, std::memory_order_release);
+        while (turn.load(std::memory_order_acquire) != 0)
+        {
+        }
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+    partner.join();
+    return elapsed / rounds;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? std::atoi(argv[1]) : 200000;
+
+    std::string root = simulate_two_sockets();
+    hh_web::cpu_topology simulated = hh_web::cpu_topology::detect(root);
+    hh_web::cpu_affinity affinity;
+    affinity.nic_interface = "eth0";
+    affinity.root = root;
+
+    std::printf("Simulated topology in %s: %zu nodes\n", root.c_str(), simulated.get_node_count());
+    print_cpus("eth0 queue CPUs:", simulated.nic_queue_cpus("eth0"));
+    std::vector<int> plan = simulated.plan(affinity);
+    print_cpus("placement plan:", plan);
+    for (unsigned int reactor = 0; reactor < 4; ++reactor)
+    {
+        std::vector<int> local;
+        for (int cpu : plan)
+        {
+            if (simulated.node_of(cpu) == simulated.node_of(plan[reactor]))
+                local.push_back(cpu);
+        }
+        std::printf("reactor %u on CPU %-2d (node %d), local workers on:", reactor, plan[reactor], simulated.node_of(plan[reactor]));
+        for (int cpu : local)
+            std::printf(" %d", cpu);
+        std::printf("\n");
+    }
+
+    hh_web::cpu_topology live = hh_web::cpu_topology::detect();
+    const std::vector<int> &online = live.get_online_cpus();
+    std::printf("\nLive machine: %zu CPUs, %zu nodes, cache line round trip over %d rounds\n", online.size(), live.get_node_count(), rounds);
+    if (online.size() < 2)
+    {
+        std::printf("needs at least two CPUs, skipped\n");
+        return 0;
+    }
+
+    std::printf("%-28s %10.1f ns\n", "unpinned", ping_pong({}, {}, rounds));
+    std::vector<int> node0 = live.cpus_of_node(0);
+    if (node0.size() >= 2)
+        std::printf("%-28s %10.1f ns\n", "same node (neighbours)", ping_pong({node0[0]}, {node0[1]}, rounds));
+    if (live.get_node_count() >= 2)
+        std::printf("%-28s %10.1f ns\n", "across nodes", ping_pong({node0[0]}, {live.cpus_of_node(1)[0]}, rounds));
+    return 0;
+}
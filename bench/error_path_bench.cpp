@@ -0,0 +1,130 @@
+/**
+ * Benchmark: cost of answering an expected error by throwing vs by returning a web_result.
+ *
+ * A web_router with the route GET /api/items/:id is fed requests with a malformed ID, as the
+ * stress test's hostile traffic sends them. In "throwing" mode the handler parses the ID the
+ * way example.cpp used to (std::stoi, web_exception on failure, caught and written in the
+ * handler), in "result" mode it is a result_handler returning web_error::bad_request. Valid
+ * IDs go through the same handlers as a reference. [threads] threads dispatch at once, since
+ * unwinding also contends on the unwinder's locks; with more threads than CPUs the times grow
+ * accordingly. Nanoseconds per request are reported.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./error_path_bench [requests per thread] [threads]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../includes/web_router.hpp"
+#include "../includes/web_result.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+using router_t = hh_web::web_router<>;
+
+static std::string find_id(const std::shared_ptr<hh_web::web_request> &request)
+{
+    for (const auto &[key, value] : request->get_path_params())
+    {
+        if (key == "id")
+            return value;
+    }
+    return "";
+}
+
+static hh_web::exit_code throwing_handler(std::shared_ptr<hh_web::web_request> request, std::shared_ptr<hh_web::web_response> response)
+{
+    try
+    {
+        std::string value = find_id(request);
+        int id;
+        try
+        {
+            id = std::stoi(value);
+        }
+        catch (const std::exception &e)
+        {
+            throw hh_web::web_exception("Invalid ID parameter: " + value, "BAD_REQUEST", "get_id_from_request", 400, "Bad Request");
+        }
+        response->set_status(200, "OK");
+        response->set_body("{\"id\": " + std::to_string(id) + "}");
+        return hh_web::exit_code::EXIT;
+    }
+    catch (hh_web::web_exception &e)
+    {
+        response->set_status(e.get_status_code(), e.get_status_message());
+        response->set_content_type("application/json");
+        response->set_body("{\"error\": \"" + std::string(e.what()) + "\"}");
+        return hh_web::exit_code::EXIT;
+    }
+}
+
+static hh_web::web_result returning_handler(std::shared_ptr<hh_web::web_request> request, std::shared_ptr<hh_web::web_response> response)
+{
+    std::string value = find_id(request);
+    int id = 0;
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), id);
+    if (error != std::errc() || end != value.data() + value.size())
+        return hh_web::web_error::bad_request("Invalid ID parameter: " + value);
+
+    response->set_status(200, "OK");
+    response->set_body("{\"id\": " + std::to_string(id) + "}");
+    return hh_web::exit_code::EXIT;
+}
+
+/// Wall time per request of one thread, with threads dispatching through the router at once
+static double run(router_t &router, const std::string &uri, int requests, int threads)
+{
+    std::atomic<long> answered{0};
+    auto start = bench_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&]()
+                             {
+                                 for (int i = 0; i < requests; ++i)
+                                 {
+                                     hh_web::synthetic_request message;
+                                     message.method = "GET";
+                                     message.uri = uri;
+                                     auto request = std::make_shared<hh_web::web_request>(std::move(message));
+                                     auto response = std::make_shared<hh_web::web_response>(
+                                         [](hh_web::synthetic_response &&) {});
+                                     if (router.handle_request(request, response))
+                                         answered.fetch_add(1, std::memory_order_relaxed);
+                                 } });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    if (answered.load() != static_cast<long>(requests) * threads)
+        std::printf("  (only %ld of %ld requests answered)\n", answered.load(), static_cast<long>(requests) * threads);
+    return seconds * 1e9 / requests;
+}
+
+int main(int argc, char **argv)
+{
+    int requests = argc > 1 ? std::atoi(argv[1]) : 200000;
+    int threads = argc > 2 ? std::atoi(argv[2]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    router_t throwing;
+    throwing.get("/api/items/:id", {throwing_handler});
+    router_t returning;
+    returning.get("/api/items/:id", {hh_web::result_handler<>(returning_handler)});
+
+    std::printf("%d requests per thread, %d threads, wall ns per request of one thread\n", requests, threads);
+    for (int t : {1, threads})
+    {
+        std::printf("%2d thread(s)  bad id:   throwing %8.0f ns   result %8.0f ns\n", t,
+                    run(throwing, "/api/items/null", requests, t), run(returning, "/api/items/null", requests, t));
+        std::printf("%2d thread(s)  valid id: throwing %8.0f ns   result %8.0f ns\n", t,
+                    run(throwing, "/api/items/42", requests, t), run(returning, "/api/items/42", requests, t));
+    }
+    return 0;
+}
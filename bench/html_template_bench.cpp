@@ -0,0 +1,221 @@
+/**
+ * Benchmark: rendering a dashboard page with a compiled html_template vs building it per request.
+ *
+ * The page has a head, a navigation bar, a table of [rows] items (id, name, description,
+ * price) and a footer. It is produced three ways:
+ * - "element tree": a tree of elements with attributes and children is built and serialized
+ *   for every request, the way libs/html-builder produces pages (modelled here with a minimal
+ *   element type so the benchmark builds without the submodule)
+ * - "concatenation": std::string operator+ over the markup, as example.cpp's handlers do
+ * - "html_template": compiled once, rendered into a reused buffer
+ * Microseconds per page and the page size are reported for a small and a large table.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./html_template_bench [pages]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../includes/html_template.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+struct item
+{
+    int id;
+    std::string name;
+    std::string description;
+
+    /// Formatted up front: number formatting costs the same for all three and would dominate
+    std::string price;
+};
+
+/// An element with attributes and children, serialized recursively
+class element
+{
+private:
+    std::string tag;
+    std::vector<std::pair<std::string, std::string>> attributes;
+    std::vector<std::unique_ptr<element>> children;
+    std::string text;
+
+public:
+    explicit element(std::string tag, std::string text = "") : tag(std::move(tag)), text(std::move(text)) {}
+
+    element &set_attribute(std::string name, std::string value)
+    {
+        attributes.emplace_back(std::move(name), std::move(value));
+        return *this;
+    }
+
+    element &add_child(std::unique_ptr<element> child)
+    {
+        children.push_back(std::move(child));
+        return *children.back();
+    }
+
+    element &add(std::string tag, std::string text = "")
+    {
+        return add_child(std::make_unique<element>(std::move(tag), std::move(text)));
+    }
+
+    void serialize(std::string &out) const
+    {
+        out += "<" + tag;
+        for (const auto &[name, value] : attributes)
+        {
+            out += " " + name + "=\"";
+            hh_web::append_escaped_html(out, value);
+            out += "\"";
+        }
+        out += ">";
+        if (tag == "meta" || tag == "link")
+            return;
+        hh_web::append_escaped_html(out, text);
+        for (const auto &child : children)
+            child->serialize(out);
+        out += "</" + tag + ">";
+    }
+};
+
+static const char *nav_links[][2] = {{"/", "Home"}, {"/items", "Items"}, {"/orders", "Orders"}, {"/reports", "Reports"}, {"/settings", "Settings"}};
+
+static std::string with_element_tree(const std::string &user, const std::vector<item> &items)
+{
+    element html("html");
+    html.set_attribute("lang", "en");
+    auto &head = html.add("head");
+    head.add("meta").set_attribute("charset", "UTF-8");
+    head.add("title", "Item Store Dashboard");
+    head.add("link").set_attribute("rel", "stylesheet").set_attribute("href", "/style.css");
+    auto &body = html.add("body");
+    auto &nav = body.add("nav");
+    nav.set_attribute("class", "top");
+    for (const auto &link : nav_links)
+        nav.add("a", link[1]).set_attribute("href", link[0]);
+    auto &container = body.add("div");
+    container.set_attribute("class", "container");
+    container.add("h1", "Welcome back, " + user);
+    container.add("p", std::to_string(items.size()) + " items in the store");
+    auto &table = container.add("table");
+    table.set_attribute("class", "items");
+    auto &header = table.add("tr");
+    for (const char *name : {"ID", "Name", "Description", "Price"})
+        header.add("th", name);
+    for (const auto &entry : items)
+    {
+        auto &row = table.add("tr");
+        row.set_attribute("data-id", std::to_string(entry.id));
+        row.add("td", std::to_string(entry.id));
+        row.add("td").add("a", entry.name).set_attribute("href", "/items/" + std::to_string(entry.id));
+        row.add("td", entry.description);
+        row.add("td", entry.price);
+    }
+    body.add("footer", "Item Store API - all responses are JSON");
+
+    std::string out = "<!DOCTYPE html>";
+    html.serialize(out);
+    return out;
+}
+
+static std::string escaped(const std::string &text)
+{
+    std::string out;
+    hh_web::append_escaped_html(out, text);
+    return out;
+}
+
+static std::string with_concatenation(const std::string &user, const std::vector<item> &items)
+{
+    std::string out = "<!DOCTYPE html><html lang=\"en\"><head><meta charset=\"UTF-8\"><title>Item Store Dashboard</title>"
+                      "<link rel=\"stylesheet\" href=\"/style.css\"></head><body><nav class=\"top\">";
+    for (const auto &link : nav_links)
+        out += std::string("<a href=\"") + link[0] + "\">" + link[1] + "</a>";
+    out += "</nav><div class=\"container\"><h1>Welcome back, " + escaped(user) + "</h1><p>" + std::to_string(items.size()) +
+           " items in the store</p><table class=\"items\"><tr><th>ID</th><th>Name</th><th>Description</th><th>Price</th></tr>";
+    for (const auto &entry : items)
+    {
+        std::string id = std::to_string(entry.id);
+        out += "<tr data-id=\"" + id + "\"><td>" + id + "</td><td><a href=\"/items/" + id + "\">" + escaped(entry.name) +
+               "</a></td><td>" + escaped(entry.description) + "</td><td>" + entry.price + "</td></tr>";
+    }
+    out += "</table></div><footer>Item Store API - all responses are JSON</footer></body></html>";
+    return out;
+}
+
+static const char *dashboard_source = R"(<!DOCTYPE html><html lang="en"><head><meta charset="UTF-8"><title>{{app}} Dashboard</title><link rel="stylesheet" href="/style.css"></head><body><nav class="top">{{#links}}<a href="{{href}}">{{label}}</a>{{/links}}</nav><div class="container"><h1>Welcome back, {{user}}</h1><p>{{count}} items in the store</p><table class="items"><tr><th>ID</th><th>Name</th><th>Description</th><th>Price</th></tr>{{#items}}<tr data-id="{{id}}"><td>{{id}}</td><td><a href="/items/{{id}}">{{name}}</a></td><td>{{description}}</td><td>{{price}}</td></tr>{{/items}}</table></div><footer>{{app}} API - all responses are JSON</footer></body></html>)";
+
+struct dashboard
+{
+    hh_web::html_template page = hh_web::html_template::compile(dashboard_source, {{"app", "Item Store"}});
+    std::size_t links = page.slot("links"), href = page.slot("href"), label = page.slot("label"), user = page.slot("user");
+    std::size_t count = page.slot("count"), items = page.slot("items"), id = page.slot("id"), name = page.slot("name");
+    std::size_t description = page.slot("description"), price = page.slot("price");
+
+    void render(const std::string &who, const std::vector<item> &entries, std::string &out) const
+    {
+        auto ctx = page.context();
+        for (const auto &link : nav_links)
+        {
+            auto &entry = ctx.add(links);
+            entry.set(href, link[0]);
+            entry.set(label, link[1]);
+        }
+        ctx.set(user, who);
+        ctx.set(count, std::to_string(entries.size()));
+        for (const auto &entry : entries)
+        {
+            auto &row = ctx.add(items);
+            row.set(id, std::to_string(entry.id));
+            row.set(name, entry.name);
+            row.set(description, entry.description);
+            row.set(price, entry.price);
+        }
+        page.render(ctx, out);
+    }
+};
+
+template <typename F>
+static double measure(int pages, std::size_t &size, F &&render)
+{
+    auto start = bench_clock::now();
+    for (int i = 0; i < pages; ++i)
+        size = render().size();
+    return std::chrono::duration<double, std::micro>(bench_clock::now() - start).count() / pages;
+}
+
+int main(int argc, char **argv)
+{
+    int pages = argc > 1 ? std::atoi(argv[1]) : 20000;
+    dashboard compiled;
+    std::string user = "Hamza <admin>";
+
+    std::printf("%d pages per run, us per page\n", pages);
+    for (int rows : {10, 100})
+    {
+        std::vector<item> items;
+        for (int i = 1; i <= rows; ++i)
+            items.push_back({i, "Item " + std::to_string(i), "Description of item \"" + std::to_string(i) + "\" & more", std::to_string(i) + ".99"});
+
+        std::size_t tree_size = 0, concat_size = 0, template_size = 0;
+        std::string buffer;
+        double tree = measure(pages, tree_size, [&]()
+                              { return with_element_tree(user, items); });
+        double concat = measure(pages, concat_size, [&]()
+                                { return with_concatenation(user, items); });
+        double templated = measure(pages, template_size, [&]() -> const std::string &
+                                   {
+                                       buffer.clear();
+                                       compiled.render(user, items, buffer);
+                                       return buffer; });
+        std::printf("%3d rows (%6zu bytes):  element tree %7.2f   concatenation %7.2f   html_template %7.2f\n",
+                    rows, template_size, tree, concat, templated);
+        if (tree_size != template_size || concat_size != template_size)
+            std::printf("  page sizes differ: %zu / %zu / %zu\n", tree_size, concat_size, template_size);
+    }
+    return 0;
+}
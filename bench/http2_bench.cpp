@@ -0,0 +1,301 @@
+/**
+ * Benchmark: many concurrent requests over one HTTP/2 connection vs one HTTP/1.1 connection each.
+ *
+ * An http2_listener on loopback hands every request to a worker pool, which answers with a
+ * small text body, as web_server does with its handlers. Two h2load-style clients then run
+ * the same number of requests with the same number in flight:
+ * - h2: one connection, up to [concurrency] streams open at a time
+ * - http/1.1: [concurrency] client threads, each opening a connection per request
+ *   (Connection: close, the default of web_response)
+ * Requests per second, latency percentiles and connections opened are reported.
+ * Before the runs, the HPACK decoder is checked against malformed header blocks.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./http2_bench [requests] [concurrency]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../includes/http2_listener.hpp"
+#include "../includes/thread_pool.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+struct run_result
+{
+    double seconds = 0;
+    double p50 = 0;
+    double p99 = 0;
+    std::size_t completed = 0;
+    std::size_t connections = 0;
+};
+
+static int connect_to(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<std::uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool send_all(int fd, const std::string &data)
+{
+    std::size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t written = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0)
+            return false;
+        sent += static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+static void summarize(std::vector<double> &latencies, run_result &result)
+{
+    std::sort(latencies.begin(), latencies.end());
+    result.completed = latencies.size();
+    if (latencies.empty())
+        return;
+    result.p50 = latencies[latencies.size() / 2];
+    result.p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+}
+
+/// The decoder must reject each block, false (and a message) when one is accepted
+static bool check_decoder()
+{
+    std::vector<std::pair<const char *, std::vector<std::uint8_t>>> blocks;
+
+    // indexed field whose index has 12 zero-valued continuation bytes: the shift would pass 63
+    std::vector<std::uint8_t> zero_continuations{0xff};
+    zero_continuations.insert(zero_continuations.end(), 12, 0x80);
+    zero_continuations.push_back(0x01);
+    blocks.push_back({"index with 12 continuation bytes", zero_continuations});
+
+    blocks.push_back({"index with 6 continuation bytes", {0xff, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01}});
+    blocks.push_back({"index above 2^32", {0xff, 0xff, 0xff, 0xff, 0xff, 0x7f}});
+    blocks.push_back({"truncated index", {0xff, 0x80}});
+
+    bool passed = true;
+    for (const auto &block : blocks)
+    {
+        hh_web::hpack_decoder decoder;
+        std::vector<hh_web::hpack_header> headers;
+        if (decoder.decode(block.second.data(), block.second.size(), headers))
+        {
+            std::printf("hpack_decoder accepted a malformed block: %s\n", block.first);
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+/// One connection, requests pipelined as streams while fewer than concurrency are open
+static run_result run_http2(int port, int requests, int concurrency)
+{
+    run_result result;
+    int fd = connect_to(port);
+    if (fd < 0)
+        return result;
+
+    hh_web::hpack_encoder encoder;
+    hh_web::hpack_decoder decoder;
+    std::string out(hh_web::http2_frame::PREFACE, hh_web::http2_frame::PREFACE_SIZE);
+    hh_web::http2_frame::write_settings(out, {{hh_web::http2_setting::INITIAL_WINDOW_SIZE, 1u << 20}});
+    hh_web::http2_frame::write_window_update(out, 0, (1u << 24) - hh_web::http2_frame::DEFAULT_WINDOW_SIZE);
+
+    std::unordered_map<std::uint32_t, bench_clock::time_point> open;
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    std::uint32_t next_stream = 1;
+    int issued = 0;
+    std::string input;
+    std::vector<char> buffer(1 << 16);
+
+    auto start = bench_clock::now();
+    while (static_cast<int>(latencies.size()) < requests)
+    {
+        while (issued < requests && static_cast<int>(open.size()) < concurrency)
+        {
+            std::string block = encoder.encode({{":method", "GET"},
+                                                {":scheme", "http"},
+                                                {":authority", "127.0.0.1"},
+                                                {":path", "/items/" + std::to_string(issued)},
+                                                {"user-agent", "http2_bench"},
+                                                {"accept", "*/*"}});
+            hh_web::http2_frame::write_headers(out, next_stream, block, true, hh_web::http2_frame::DEFAULT_MAX_FRAME_SIZE);
+            open[next_stream] = bench_clock::now();
+            next_stream += 2;
+            issued++;
+        }
+        if (!out.empty())
+        {
+            if (!send_all(fd, out))
+                break;
+            out.clear();
+        }
+
+        ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+        if (received <= 0)
+            break;
+        input.append(buffer.data(), static_cast<std::size_t>(received));
+
+        std::size_t offset = 0;
+        std::uint32_t consumed = 0;
+        while (input.size() - offset >= hh_web::http2_frame::HEADER_SIZE)
+        {
+            auto *bytes = reinterpret_cast<const std::uint8_t *>(input.data() + offset);
+            hh_web::http2_frame frame = hh_web::http2_frame::parse(bytes);
+            if (input.size() - offset < hh_web::http2_frame::HEADER_SIZE + frame.length)
+                break;
+            const std::uint8_t *payload = bytes + hh_web::http2_frame::HEADER_SIZE;
+            auto type = static_cast<hh_web::http2_frame_type>(frame.type);
+            bool ended = false;
+
+            if (type == hh_web::http2_frame_type::SETTINGS && !(frame.flags & hh_web::http2_flags::ACK))
+            {
+                hh_web::http2_frame::write_settings(out, {}, true);
+            }
+            else if (type == hh_web::http2_frame_type::HEADERS)
+            {
+                std::vector<hh_web::hpack_header> headers;
+                decoder.decode(payload, frame.length, headers);
+                ended = frame.flags & hh_web::http2_flags::END_STREAM;
+            }
+            else if (type == hh_web::http2_frame_type::DATA)
+            {
+                consumed += frame.length;
+                ended = frame.flags & hh_web::http2_flags::END_STREAM;
+            }
+
+            if (ended)
+            {
+                auto it = open.find(frame.stream_id);
+                if (it != open.end())
+                {
+                    latencies.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - it->second).count());
+                    open.erase(it);
+                }
+            }
+            offset += hh_web::http2_frame::HEADER_SIZE + frame.length;
+        }
+        input.erase(0, offset);
+        if (consumed > 0)
+            hh_web::http2_frame::write_window_update(out, 0, consumed);
+    }
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    result.connections = 1;
+    close(fd);
+
+    summarize(latencies, result);
+    return result;
+}
+
+/// concurrency threads, each opening one connection per request
+static run_result run_http1(int port, int requests, int concurrency)
+{
+    run_result result;
+    std::vector<double> latencies;
+    std::mutex latencies_mutex;
+    std::atomic<int> next{0};
+
+    auto start = bench_clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < concurrency; ++c)
+    {
+        clients.emplace_back([&]()
+                             {
+                                 std::vector<double> local;
+                                 std::vector<char> buffer(4096);
+                                 int i;
+                                 while ((i = next.fetch_add(1)) < requests)
+                                 {
+                                     auto begin = bench_clock::now();
+                                     int fd = connect_to(port);
+                                     if (fd < 0)
+                                         continue;
+                                     std::string request = "GET /items/" + std::to_string(i) + " HTTP/1.1\r\nHost: 127.0.0.1\r\nUser-Agent: http2_bench\r\nAccept: */*\r\nConnection: close\r\n\r\n";
+                                     if (send_all(fd, request))
+                                     {
+                                         // the server closes after the response, as asked
+                                         while (recv(fd, buffer.data(), buffer.size(), 0) > 0)
+                                         {
+                                         }
+                                         local.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count());
+                                     }
+                                     close(fd);
+                                 }
+                                 std::lock_guard<std::mutex> lock(latencies_mutex);
+                                 latencies.insert(latencies.end(), local.begin(), local.end()); });
+    }
+    for (auto &client : clients)
+        client.join();
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    result.connections = latencies.size();
+
+    summarize(latencies, result);
+    return result;
+}
+
+static void print(const char *name, const run_result &result)
+{
+    std::printf("%-10s %8zu requests %9.0f req/s   p50 %8.1f us   p99 %8.1f us   %6zu connections\n",
+                name, result.completed, result.completed / result.seconds, result.p50, result.p99, result.connections);
+    std::fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int requests = argc > 1 ? std::atoi(argv[1]) : 20000;
+    int concurrency = argc > 2 ? std::atoi(argv[2]) : 100;
+    if (!check_decoder())
+        return 1;
+
+    // workers are joined before the listener they post to is destroyed
+    hh_web::http2_listener listener(0, "127.0.0.1");
+    hh_web::thread_pool workers(std::max(2u, std::thread::hardware_concurrency()));
+    listener.set_request_callback([&](const hh_web::http2_stream_ref &ref, hh_web::http2_request &&request)
+                                  {
+                                      std::string path = std::move(request.path);
+                                      workers.enqueue([&listener, ref, path]()
+                                                      {
+                                                          hh_web::http2_response response;
+                                                          response.headers = {{"Content-Type", "text/plain"}};
+                                                          response.body = "item " + path + "\n";
+                                                          listener.post(ref, std::move(response)); });
+                                      return nullptr; });
+    if (!listener.start())
+        return 1;
+
+    std::printf("%d requests, %d in flight, %u CPUs\n", requests, concurrency, std::thread::hardware_concurrency());
+    print("h2", run_http2(listener.get_port(), requests, concurrency));
+    print("http/1.1", run_http1(listener.get_port(), requests, concurrency));
+
+    listener.stop();
+    return 0;
+}
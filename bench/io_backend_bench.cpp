@@ -0,0 +1,321 @@
+/**
+ * Benchmark: syscalls per request of an epoll loop vs an io_uring loop.
+ *
+ * Both servers answer a fixed keep-alive HTTP response on 127.0.0.1. The epoll server
+ * is the classic loop (epoll_wait, accept4, epoll_ctl, read until EAGAIN, write per
+ * connection). The io_uring server uses hh_web::io_uring_ring with one multishot accept
+ * into a sparse registered file table, multishot recv from a provided buffer ring and
+ * sends batched with everything else into one io_uring_enter per loop iteration.
+ *
+ * Every syscall the server thread makes is counted, the clients run on other threads.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./io_backend_bench [connections] [requests per connection]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../includes/io_uring_ring.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static const char REQUEST[] = "GET / HTTP/1.1\r\nHost: bench\r\n\r\n";
+static const char RESPONSE[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: keep-alive\r\n\r\nok";
+static constexpr std::size_t RESPONSE_SIZE = sizeof(RESPONSE) - 1;
+
+/// Up to this many pipelined responses are sent with one send
+static constexpr std::size_t MAX_BATCH = 64;
+static std::string response_batch;
+
+struct server_stats
+{
+    std::size_t syscalls = 0;
+    std::size_t requests = 0;
+};
+
+/// Counts complete requests in a byte stream, carrying a partial "\r\n\r\n" match across reads
+struct request_counter
+{
+    int matched = 0;
+
+    std::size_t feed(const char *data, std::size_t size)
+    {
+        static const char END[] = "\r\n\r\n";
+        std::size_t complete = 0;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            if (data[i] == END[matched])
+                matched++;
+            else
+                matched = data[i] == '\r' ? 1 : 0;
+            if (matched == 4)
+            {
+                complete++;
+                matched = 0;
+            }
+        }
+        return complete;
+    }
+};
+
+static int make_listener(int &port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    listen(fd, 1024);
+    socklen_t length = sizeof(address);
+    getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length);
+    port = ntohs(address.sin_port);
+    return fd;
+}
+
+static void run_epoll_server(int listener, const std::atomic<bool> &stop, server_stats &stats)
+{
+    int epoll_fd = epoll_create1(0);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listener;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &event);
+    stats.syscalls += 2;
+
+    std::vector<request_counter> counters(65536);
+    epoll_event events[256];
+    char buffer[4096];
+    while (!stop.load())
+    {
+        int ready = epoll_wait(epoll_fd, events, 256, 100);
+        stats.syscalls++;
+        for (int i = 0; i < ready; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listener)
+            {
+                while (true)
+                {
+                    int client = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK);
+                    stats.syscalls++;
+                    if (client < 0)
+                        break;
+                    counters[client] = request_counter();
+                    epoll_event client_event{};
+                    client_event.events = EPOLLIN;
+                    client_event.data.fd = client;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client, &client_event);
+                    stats.syscalls++;
+                }
+                continue;
+            }
+
+            std::size_t pending = 0;
+            bool closed = false;
+            while (true)
+            {
+                ssize_t received = read(fd, buffer, sizeof(buffer));
+                stats.syscalls++;
+                if (received <= 0)
+                {
+                    closed = received == 0;
+                    break;
+                }
+                pending += counters[fd].feed(buffer, static_cast<std::size_t>(received));
+            }
+
+            stats.requests += pending;
+            while (pending > 0)
+            {
+                std::size_t batch = pending < MAX_BATCH ? pending : MAX_BATCH;
+                write(fd, response_batch.data(), batch * RESPONSE_SIZE);
+                stats.syscalls++;
+                pending -= batch;
+            }
+            if (closed)
+            {
+                close(fd);
+                stats.syscalls++;
+            }
+        }
+    }
+    close(epoll_fd);
+}
+
+enum : std::uint64_t
+{
+    OP_ACCEPT = 1,
+    OP_RECV = 2,
+    OP_SEND = 3,
+    OP_CLOSE = 4
+};
+
+static std::uint64_t tag(std::uint64_t op, std::uint32_t slot)
+{
+    return (op << 32) | slot;
+}
+
+static void arm_recv(hh_web::io_uring_ring &ring, std::uint32_t slot)
+{
+    io_uring_sqe *sqe = ring.get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = static_cast<int>(slot);
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = 0;
+    sqe->user_data = tag(OP_RECV, slot);
+}
+
+static void run_uring_server(int listener, const std::atomic<bool> &stop, server_stats &stats)
+{
+    hh_web::io_uring_ring ring(512);
+    ring.register_sparse_files(4096);
+    ring.register_buffer_ring(0, 1024, 4096);
+    std::vector<request_counter> counters(4096);
+
+    io_uring_sqe *accept = ring.get_sqe();
+    accept->opcode = IORING_OP_ACCEPT;
+    accept->fd = listener;
+    accept->ioprio = IORING_ACCEPT_MULTISHOT;
+    accept->file_index = IORING_FILE_INDEX_ALLOC;
+    accept->user_data = tag(OP_ACCEPT, 0);
+
+    while (!stop.load())
+    {
+        ring.submit(1);
+        ring.for_each_completion([&](const io_uring_cqe &cqe)
+                                 {
+                                     std::uint64_t op = cqe.user_data >> 32;
+                                     std::uint32_t slot = static_cast<std::uint32_t>(cqe.user_data);
+                                     if (op == OP_ACCEPT && cqe.res >= 0)
+                                     {
+                                         counters[cqe.res] = request_counter();
+                                         arm_recv(ring, static_cast<std::uint32_t>(cqe.res));
+                                     }
+                                     else if (op == OP_RECV)
+                                     {
+                                         if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER))
+                                         {
+                                             auto buffer_id = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                                             std::size_t pending = counters[slot].feed(ring.buffer_data(0, buffer_id), static_cast<std::size_t>(cqe.res));
+                                             ring.recycle_buffer(0, buffer_id);
+                                             stats.requests += pending;
+                                             while (pending > 0)
+                                             {
+                                                 std::size_t batch = pending < MAX_BATCH ? pending : MAX_BATCH;
+                                                 io_uring_sqe *send = ring.get_sqe();
+                                                 send->opcode = IORING_OP_SEND;
+                                                 send->fd = static_cast<int>(slot);
+                                                 send->flags = IOSQE_FIXED_FILE;
+                                                 send->addr = reinterpret_cast<std::uint64_t>(response_batch.data());
+                                                 send->len = static_cast<std::uint32_t>(batch * RESPONSE_SIZE);
+                                                 send->user_data = tag(OP_SEND, slot);
+                                                 pending -= batch;
+                                             }
+                                         }
+
+                                         if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS))
+                                         {
+                                             io_uring_sqe *close_sqe = ring.get_sqe();
+                                             close_sqe->opcode = IORING_OP_CLOSE;
+                                             close_sqe->file_index = slot + 1;
+                                             close_sqe->user_data = tag(OP_CLOSE, slot);
+                                         }
+                                         else if (!(cqe.flags & IORING_CQE_F_MORE))
+                                         {
+                                             arm_recv(ring, slot);
+                                         }
+                                     } });
+    }
+    stats.syscalls = ring.get_enter_calls();
+}
+
+static void run_clients(int port, int connections, int requests_per_connection)
+{
+    std::vector<std::thread> clients;
+    for (int c = 0; c < connections; ++c)
+    {
+        clients.emplace_back([port, requests_per_connection]()
+                             {
+                                 int fd = socket(AF_INET, SOCK_STREAM, 0);
+                                 sockaddr_in address{};
+                                 address.sin_family = AF_INET;
+                                 address.sin_port = htons(static_cast<std::uint16_t>(port));
+                                 address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                                 if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+                                 {
+                                     close(fd);
+                                     return;
+                                 }
+                                 char buffer[4096];
+                                 for (int r = 0; r < requests_per_connection; ++r)
+                                 {
+                                     write(fd, REQUEST, sizeof(REQUEST) - 1);
+                                     std::size_t got = 0;
+                                     while (got < RESPONSE_SIZE)
+                                     {
+                                         ssize_t n = read(fd, buffer, sizeof(buffer));
+                                         if (n <= 0)
+                                             break;
+                                         got += static_cast<std::size_t>(n);
+                                     }
+                                 }
+                                 close(fd); });
+    }
+    for (auto &client : clients)
+        client.join();
+}
+
+static void bench(const char *name, void (*server)(int, const std::atomic<bool> &, server_stats &), int connections, int requests)
+{
+    int port = 0;
+    int listener = make_listener(port);
+    std::atomic<bool> stop{false};
+    server_stats stats;
+    std::thread server_thread([&]()
+                              { server(listener, stop, stats); });
+
+    auto start = bench_clock::now();
+    run_clients(port, connections, requests);
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    // wake a loop blocked in the kernel so it sees the stop flag
+    stop.store(true);
+    run_clients(port, 1, 0);
+    server_thread.join();
+    close(listener);
+
+    std::printf("%-9s: %zu requests, %.0f req/s, %.2f syscalls/request\n", name, stats.requests,
+                stats.requests / seconds, stats.requests ? static_cast<double>(stats.syscalls) / stats.requests : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    int connections = argc > 1 ? std::atoi(argv[1]) : 64;
+    int requests = argc > 2 ? std::atoi(argv[2]) : 2000;
+    for (std::size_t i = 0; i < MAX_BATCH; ++i)
+        response_batch += RESPONSE;
+
+    bench("epoll", run_epoll_server, connections, requests);
+
+    hh_web::io_uring_features features = hh_web::io_uring_ring::probe();
+    if (!features.complete())
+    {
+        std::printf("io_uring: not available or missing features on this kernel, skipped\n");
+        return 0;
+    }
+    bench("io_uring", run_uring_server, connections, requests);
+    return 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * Benchmark: importing items into example.cpp's ItemStore one at a time vs in batches.
+ *
+ * "create" is what N POST /api/items requests do to the store: N lock acquisitions, each
+ * allocating its map node while holding the lock. "create_many" takes the lock once per
+ * batch, with nodes and result vectors allocated before. Both run with one importing thread
+ * and with several, where every acquisition can contend; the HTTP side is left out so the
+ * table shows the store alone. remove_many is timed against try_remove the same way.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./item_store_bench [items] [threads]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../includes/json_writer.hpp"
+#include "../includes/search_index.hpp"
+#include "../includes/web_exceptions.hpp"
+#include "../ItemStore.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static ItemStore::Fields make_fields(int i)
+{
+    return {"Item " + std::to_string(i), "A plain description of item number " + std::to_string(i) + " in the store", i + 0.99};
+}
+
+/// Items per second when threads each import items / threads items in batches of batch_size (0: create())
+static double import_rate(int items, int threads, int batch_size)
+{
+    ItemStore store;
+    int per_thread = items / threads;
+    // the fields are made up front, the timed part only hands them to the store
+    std::vector<std::vector<ItemStore::Fields>> inputs(threads);
+    for (int t = 0; t < threads; ++t)
+    {
+        for (int i = 0; i < per_thread; ++i)
+            inputs[t].push_back(make_fields(t * per_thread + i));
+    }
+
+    auto start = bench_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&store, &input = inputs[t], batch_size]()
+                             {
+                                 if (batch_size == 0)
+                                 {
+                                     for (auto &fields : input)
+                                         store.create(fields.name, fields.description, fields.price);
+                                     return;
+                                 }
+                                 for (std::size_t i = 0; i < input.size(); i += batch_size)
+                                 {
+                                     std::size_t end = std::min(input.size(), i + batch_size);
+                                     store.create_many(std::vector<ItemStore::Fields>(std::make_move_iterator(input.begin() + i),
+                                                                                      std::make_move_iterator(input.begin() + end)));
+                                 } });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return per_thread * threads / seconds;
+}
+
+/// Items per second removing every item of a full store, in batches of batch_size (0: try_remove())
+static double remove_rate(int items, int batch_size)
+{
+    ItemStore store;
+    std::vector<ItemStore::Fields> input;
+    for (int i = 0; i < items; ++i)
+        input.push_back(make_fields(i));
+    std::vector<int> ids = store.create_many(std::move(input));
+
+    auto start = bench_clock::now();
+    if (batch_size == 0)
+    {
+        for (int id : ids)
+            store.try_remove(id);
+    }
+    else
+    {
+        for (std::size_t i = 0; i < ids.size(); i += batch_size)
+            store.remove_many(std::vector<int>(ids.begin() + i, ids.begin() + std::min(ids.size(), i + batch_size)));
+    }
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return items / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    int items = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int threads = argc > 2 ? std::atoi(argv[2]) : 4;
+
+    std::printf("%d items, thousand items per second\n", items);
+    for (int count : {1, threads})
+    {
+        std::printf("%d importing thread(s):  create %8.0f", count, import_rate(items, count, 0) / 1000);
+        for (int batch : {100, 1000, 10000})
+            std::printf("   create_many(%5d) %8.0f", batch, import_rate(items, count, batch) / 1000);
+        std::printf("\n");
+    }
+
+    std::printf("removing:             try_remove %8.0f", remove_rate(items, 0) / 1000);
+    for (int batch : {100, 1000, 10000})
+        std::printf("   remove_many(%5d) %8.0f", batch, remove_rate(items, batch) / 1000);
+    std::printf("\n");
+    return 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * Benchmark: validate_json throughput on request-sized bodies.
+ *
+ * Three bodies of about 64 KiB: a compact item list (the shape of example.cpp's POST and
+ * PUT bodies, repeated), the same list pretty-printed with indentation, and a document
+ * dominated by long text fields. Each is validated repeatedly and MB/s is reported, next to
+ * body_has_malicious_content, the scan example.cpp's json_cheacker already runs over every
+ * body. A body that is malformed near its start shows the early exit.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./json_validator_bench [runs]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "../includes/json_validator.hpp"
+#include "../includes/web_utilities.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static std::string item_list(bool pretty, std::size_t target)
+{
+    const char *indent = pretty ? "\n        " : "";
+    std::string out = pretty ? "[\n" : "[";
+    for (int i = 1; out.size() < target; ++i)
+    {
+        if (i > 1)
+            out += pretty ? ",\n" : ",";
+        out += std::string(pretty ? "    {" : "{") + indent + "\"id\": " + std::to_string(i) + "," + indent +
+               "\"name\": \"Item " + std::to_string(i) + "\"," + indent +
+               "\"description\": \"Description of item " + std::to_string(i) + "\"," + indent +
+               "\"price\": " + std::to_string(i) + ".99" + (pretty ? "\n    }" : "}");
+    }
+    return out + (pretty ? "\n]" : "]");
+}
+
+static std::string text_heavy(std::size_t target)
+{
+    std::string out = "{\"posts\": [";
+    for (int i = 0; out.size() < target; ++i)
+    {
+        if (i > 0)
+            out += ",";
+        out += "{\"title\": \"Post " + std::to_string(i) + "\", \"body\": \"";
+        for (int j = 0; j < 8; ++j)
+            out += "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor. ";
+        out += "\"}";
+    }
+    return out + "]}";
+}
+
+template <typename F>
+static double megabytes_per_second(int runs, std::size_t size, F &&check)
+{
+    auto start = bench_clock::now();
+    for (int i = 0; i < runs; ++i)
+        check();
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return static_cast<double>(size) * runs / seconds / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? std::atoi(argv[1]) : 2000;
+    const std::size_t size = 64 * 1024;
+
+    struct
+    {
+        const char *name;
+        std::string body;
+    } bodies[] = {{"compact item list", item_list(false, size)}, {"pretty item list", item_list(true, size)}, {"text heavy", text_heavy(size)}};
+
+    std::printf("%d runs per body, MB/s\n", runs);
+    int valid = 0;
+    for (const auto &[name, body] : bodies)
+    {
+        double validated = megabytes_per_second(runs, body.size(), [&]()
+                                                { valid += static_cast<bool>(hh_web::validate_json(body)); });
+        double scanned = megabytes_per_second(runs, body.size(), [&]()
+                                              { valid += hh_web::body_has_malicious_content(body); });
+        std::printf("%-18s (%6zu bytes):  validate_json %8.0f   body_has_malicious_content %8.0f\n", name, body.size(), validated, scanned);
+    }
+
+    std::string malformed = bodies[0].body;
+    malformed[40] = '}';
+    auto start = bench_clock::now();
+    hh_web::json_validation result;
+    for (int i = 0; i < runs; ++i)
+        result = hh_web::validate_json(malformed);
+    double ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / runs;
+    std::printf("malformed at byte 40 of %zu: rejected in %.0f ns (%s)\n", malformed.size(), ns, result.describe().c_str());
+    std::printf("(%d)\n", valid);
+    return 0;
+}
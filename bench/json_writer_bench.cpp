@@ -0,0 +1,141 @@
+/**
+ * Benchmark: serializing the item list as example.cpp's GET /api/items does, before and after.
+ *
+ * "stringstream" is the old ItemStore::Item::to_json() joined by a stringstream (no escaping
+ * at all, 6 significant digits for prices). "json_writer" writes the same items with an
+ * HH_WEB_JSON_FIELDS declaration into one buffer, escaping names and descriptions. A second
+ * table compares escaping long strings: json_writer's SSE2 scan vs a byte-at-a-time loop.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./json_writer_bench [documents]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../includes/json_writer.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+struct item
+{
+    int id;
+    std::string name;
+    std::string description;
+    double price;
+
+    HH_WEB_JSON_FIELDS(item, id, name, description, price)
+
+    std::string to_json() const
+    {
+        std::stringstream ss;
+        ss << "{";
+        ss << "\"id\": " << id << ",";
+        ss << "\"name\": \"" << name << "\",";
+        ss << "\"description\": \"" << description << "\",";
+        ss << "\"price\": " << price;
+        ss << "}";
+        return ss.str();
+    }
+};
+
+static std::string with_stringstream(const std::vector<item> &items)
+{
+    std::stringstream ss;
+    ss << "[";
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        ss << items[i].to_json();
+        if (i < items.size() - 1)
+            ss << ",";
+    }
+    ss << "]";
+    return ss.str();
+}
+
+/// One comparison per byte, the way an escaper without a vector scan works
+static void escape_bytewise(std::string &out, std::string_view text)
+{
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+                out += "\\u001f";
+            else
+                out.push_back(c);
+        }
+    }
+}
+
+template <typename F>
+static double measure(int runs, std::size_t &size, F &&run)
+{
+    auto start = bench_clock::now();
+    for (int i = 0; i < runs; ++i)
+        size = run();
+    return std::chrono::duration<double, std::micro>(bench_clock::now() - start).count() / runs;
+}
+
+int main(int argc, char **argv)
+{
+    int documents = argc > 1 ? std::atoi(argv[1]) : 20000;
+
+    std::printf("%d documents per run, us per document\n", documents);
+    for (int count : {10, 100})
+    {
+        std::vector<item> items;
+        for (int i = 1; i <= count; ++i)
+            items.push_back({i, "Item " + std::to_string(i), "A plain description of item number " + std::to_string(i) + " in the store", i + 0.99});
+
+        std::size_t stream_size = 0, writer_size = 0;
+        std::string buffer;
+        double streamed = measure(documents, stream_size, [&]()
+                                  { return with_stringstream(items).size(); });
+        double written = measure(documents, writer_size, [&]()
+                                 {
+                                     hh_web::json_writer json;
+                                     json.value(items);
+                                     buffer = json.take();
+                                     return buffer.size(); });
+        std::printf("%3d items:  stringstream %7.2f (%6zu bytes)   json_writer %7.2f (%6zu bytes)\n",
+                    count, streamed, stream_size, written, writer_size);
+    }
+
+    std::printf("escaping, ns per string\n");
+    for (std::size_t length : {16, 256, 4096})
+    {
+        std::string text;
+        while (text.size() < length)
+            text += "Most strings in an API response are plain text without anything to escape, \"some\" have quotes.\n";
+        text.resize(length);
+
+        std::string out;
+        std::size_t size = 0;
+        int runs = documents * 10;
+        double bytewise = measure(runs, size, [&]()
+                                  {
+                                      out.clear();
+                                      escape_bytewise(out, text);
+                                      return out.size(); }) * 1000;
+        double scanned = measure(runs, size, [&]()
+                                 {
+                                     out.clear();
+                                     hh_web::append_escaped_json(out, text);
+                                     return out.size(); }) * 1000;
+        std::printf("%5zu bytes:  byte at a time %8.1f   append_escaped_json %8.1f\n", length, bytewise, scanned);
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * Benchmark: latency of short requests next to CPU-heavy ones, with and without an offload executor.
+ *
+ * A generator submits requests to a request pool at a fixed interval, 95% short (spin 20us)
+ * and 5% heavy (spin 4ms). In "shared" mode the heavy work runs on the request worker, in
+ * "offload" mode the worker hands it to a separate pool and waits inside a blocking_scope,
+ * as web_server::offload_and_wait() does. The latency of the short requests (submission to
+ * completion) is reported.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./offload_bench [requests] [interval us] [request workers] [offload workers]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../includes/thread_pool.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static void spin(std::chrono::microseconds duration)
+{
+    auto end = bench_clock::now() + duration;
+    while (bench_clock::now() < end)
+    {
+    }
+}
+
+struct run_result
+{
+    double p50 = 0;
+    double p99 = 0;
+    double p999 = 0;
+    unsigned int peak_workers = 0;
+};
+
+static run_result run(bool offload, int requests, int interval_us, unsigned int request_workers, unsigned int offload_workers)
+{
+    std::vector<double> latencies;
+    std::mutex latencies_mutex;
+    std::atomic<int> remaining{requests};
+    run_result result;
+
+    {
+        std::unique_ptr<hh_web::thread_pool> heavy_pool;
+        if (offload)
+            heavy_pool = std::make_unique<hh_web::thread_pool>(offload_workers);
+        hh_web::thread_pool pool(request_workers);
+
+        auto next = bench_clock::now();
+        for (int i = 0; i < requests; ++i)
+        {
+            bool heavy = i % 20 == 19;
+            auto submitted = bench_clock::now();
+            pool.enqueue([&, heavy, submitted]()
+                         {
+                             if (!heavy)
+                             {
+                                 spin(std::chrono::microseconds(20));
+                                 double latency = std::chrono::duration<double, std::micro>(bench_clock::now() - submitted).count();
+                                 std::lock_guard<std::mutex> lock(latencies_mutex);
+                                 latencies.push_back(latency);
+                             }
+                             else if (heavy_pool)
+                             {
+                                 auto done = std::make_shared<std::promise<void>>();
+                                 auto finished = done->get_future();
+                                 heavy_pool->enqueue([done]()
+                                                     {
+                                                         spin(std::chrono::microseconds(4000));
+                                                         done->set_value(); });
+                                 hh_web::thread_pool::blocking_scope blocking;
+                                 finished.wait();
+                             }
+                             else
+                             {
+                                 spin(std::chrono::microseconds(4000));
+                             }
+                             remaining--; });
+
+            next += std::chrono::microseconds(interval_us);
+            std::this_thread::sleep_until(next);
+        }
+        while (remaining.load() > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        result.peak_workers = pool.get_peak_thread_count();
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&](double p)
+    { return latencies[std::min(latencies.size() - 1, static_cast<std::size_t>(p * latencies.size()))]; };
+    result.p50 = at(0.5);
+    result.p99 = at(0.99);
+    result.p999 = at(0.999);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int requests = argc > 1 ? std::atoi(argv[1]) : 20000;
+    int interval_us = argc > 2 ? std::atoi(argv[2]) : 200;
+    unsigned int request_workers = argc > 3 ? std::atoi(argv[3]) : std::max(2u, std::thread::hardware_concurrency() / 2);
+    unsigned int offload_workers = argc > 4 ? std::atoi(argv[4]) : std::max(1u, std::thread::hardware_concurrency() / 2);
+
+    std::printf("%d requests every %d us, 5%% heavy (4ms), %u request workers, %u offload workers\n",
+                requests, interval_us, request_workers, offload_workers);
+    std::printf("%-10s %10s %10s %10s %14s\n", "mode", "p50 us", "p99 us", "p99.9 us", "peak workers");
+    for (bool offload : {false, true})
+    {
+        run_result result = run(offload, requests, interval_us, request_workers, offload_workers);
+        std::printf("%-10s %10.1f %10.1f %10.1f %14u\n", offload ? "offload" : "shared",
+                    result.p50, result.p99, result.p999, result.peak_workers);
+    }
+    return 0;
+}
@@ -0,0 +1,306 @@
+/**
+ * Benchmark: forwarding through proxy_upstream vs a connection per forwarded request.
+ *
+ * Two local echo upstreams (keep-alive HTTP/1.1, thread per connection) answer every
+ * request with its path and body. [concurrency] threads, standing in for the workers
+ * running proxy routes, then forward the same number of requests three ways:
+ * - connect per request: each forward opens, uses and closes an upstream connection, as
+ *   a handler bringing its own client does
+ * - proxy_upstream: round robin over the pooled keep-alive connections of its web_client
+ * - failover: the same, with one upstream going down halfway through; the health checks
+ *   and the retry on another upstream keep the requests succeeding
+ * Requests per second, latency percentiles, failures and upstream connections are reported.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./proxy_bench [requests] [concurrency]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../includes/web_proxy.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+struct run_result
+{
+    double seconds = 0;
+    double p50 = 0;
+    double p99 = 0;
+    std::size_t completed = 0;
+    std::size_t failed = 0;
+    std::size_t connections = 0;
+};
+
+/// Keep-alive echo upstream, answers "<path> <body>"; stop() also drops the open connections
+class echo_upstream
+{
+private:
+    int listen_fd = -1;
+    int port = 0;
+    std::thread acceptor;
+    std::atomic<std::size_t> accepted{0};
+    std::mutex open_mutex;
+    std::vector<int> open;
+
+    void serve(int fd)
+    {
+        serve_requests(fd);
+        std::lock_guard<std::mutex> lock(open_mutex);
+        open.erase(std::find(open.begin(), open.end(), fd));
+        close(fd);
+    }
+
+    static void serve_requests(int fd)
+    {
+        std::string input;
+        std::vector<char> buffer(16384);
+        while (true)
+        {
+            std::size_t end;
+            while ((end = input.find("\r\n\r\n")) == std::string::npos)
+            {
+                ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+                if (received <= 0)
+                    return;
+                input.append(buffer.data(), static_cast<std::size_t>(received));
+            }
+            std::string head = input.substr(0, end);
+            input.erase(0, end + 4);
+
+            std::size_t length = 0;
+            std::size_t field = head.find("Content-Length: ");
+            if (field != std::string::npos)
+                length = std::strtoul(head.c_str() + field + 16, nullptr, 10);
+            while (input.size() < length)
+            {
+                ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+                if (received <= 0)
+                    return;
+                input.append(buffer.data(), static_cast<std::size_t>(received));
+            }
+
+            std::size_t path_start = head.find(' ') + 1;
+            std::string body = head.substr(path_start, head.find(' ', path_start) - path_start) + " " + input.substr(0, length);
+            input.erase(0, length);
+            bool close_after = head.find("Connection: close") != std::string::npos;
+            std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) +
+                                   (close_after ? "\r\nConnection: close" : "") + "\r\n\r\n" + body;
+            if (send(fd, response.data(), response.size(), MSG_NOSIGNAL) < 0 || close_after)
+                return;
+        }
+    }
+
+public:
+    bool start()
+    {
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), length) < 0 || listen(listen_fd, SOMAXCONN) < 0 ||
+            getsockname(listen_fd, reinterpret_cast<sockaddr *>(&address), &length) < 0)
+            return false;
+        port = ntohs(address.sin_port);
+
+        acceptor = std::thread([this]()
+                               {
+                                   int fd;
+                                   while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0)
+                                   {
+                                       int one = 1;
+                                       setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                                       accepted++;
+                                       {
+                                           std::lock_guard<std::mutex> lock(open_mutex);
+                                           open.push_back(fd);
+                                       }
+                                       std::thread(&echo_upstream::serve, this, fd).detach();
+                                   } });
+        return true;
+    }
+
+    /// Stop accepting and shut every open connection down, the serving threads then return
+    void stop()
+    {
+        shutdown(listen_fd, SHUT_RDWR);
+        close(listen_fd);
+        if (acceptor.joinable())
+            acceptor.join();
+        {
+            std::lock_guard<std::mutex> lock(open_mutex);
+            for (int fd : open)
+                shutdown(fd, SHUT_RDWR);
+        }
+        // the serving threads are detached, wait until they have let go of this object
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(open_mutex);
+                if (open.empty())
+                    return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    int get_port() const
+    {
+        return port;
+    }
+
+    std::size_t get_accepted() const
+    {
+        return accepted.load();
+    }
+};
+
+template <typename F>
+static run_result run(int requests, int concurrency, F &&forward)
+{
+    run_result result;
+    std::vector<double> latencies;
+    std::mutex latencies_mutex;
+    std::atomic<int> next{0};
+    std::atomic<std::size_t> failed{0};
+
+    auto start = bench_clock::now();
+    std::vector<std::thread> workers;
+    for (int c = 0; c < concurrency; ++c)
+    {
+        workers.emplace_back([&]()
+                             {
+                                 std::vector<double> local;
+                                 int i;
+                                 while ((i = next.fetch_add(1)) < requests)
+                                 {
+                                     auto begin = bench_clock::now();
+                                     if (forward(i))
+                                         local.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count());
+                                     else
+                                         failed++;
+                                 }
+                                 std::lock_guard<std::mutex> lock(latencies_mutex);
+                                 latencies.insert(latencies.end(), local.begin(), local.end()); });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    result.failed = failed.load();
+
+    std::sort(latencies.begin(), latencies.end());
+    result.completed = latencies.size();
+    if (!latencies.empty())
+    {
+        result.p50 = latencies[latencies.size() / 2];
+        result.p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    }
+    return result;
+}
+
+/// One blocking connection per forwarded request, alternating between the upstreams
+static bool forward_connect_per_request(const std::vector<int> &ports, int i)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<std::uint16_t>(ports[i % ports.size()]));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bool ok = false;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0)
+    {
+        std::string request = "POST /orders/" + std::to_string(i) + " HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 2\r\nConnection: close\r\n\r\n{}";
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) > 0)
+        {
+            char buffer[4096];
+            std::string response;
+            ssize_t received;
+            while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+                response.append(buffer, static_cast<std::size_t>(received));
+            ok = response.compare(0, 12, "HTTP/1.1 200") == 0;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+static bool forward_pooled(hh_web::proxy_upstream &upstream, int i)
+{
+    hh_web::client_request request;
+    request.method = "PUT";
+    request.body = "{}";
+    return upstream.forward(std::move(request), "/orders/" + std::to_string(i)).status == 200;
+}
+
+static void print(const char *name, const run_result &result)
+{
+    std::printf("%-20s %8zu ok %6zu failed %9.0f req/s   p50 %8.1f us   p99 %8.1f us   %6zu upstream connections\n",
+                name, result.completed, result.failed, result.completed / result.seconds, result.p50, result.p99, result.connections);
+    std::fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int requests = argc > 1 ? std::atoi(argv[1]) : 20000;
+    int concurrency = argc > 2 ? std::atoi(argv[2]) : 32;
+
+    echo_upstream first, second;
+    if (!first.start() || !second.start())
+        return 1;
+    std::vector<int> ports = {first.get_port(), second.get_port()};
+    auto accepted = [&]()
+    {
+        return first.get_accepted() + second.get_accepted();
+    };
+
+    std::printf("%d requests, %d in flight, %u CPUs\n", requests, concurrency, std::thread::hardware_concurrency());
+
+    std::size_t before = accepted();
+    run_result naive = run(requests, concurrency, [&](int i)
+                           { return forward_connect_per_request(ports, i); });
+    naive.connections = accepted() - before;
+    print("connect per request", naive);
+
+    hh_web::proxy_config config;
+    config.servers = {"http://127.0.0.1:" + std::to_string(ports[0]), "http://127.0.0.1:" + std::to_string(ports[1])};
+    config.health_path = "/health";
+    config.health_interval = std::chrono::milliseconds(100);
+    config.unhealthy_after = 2;
+    config.client.max_connections_per_host = static_cast<std::size_t>(concurrency);
+    {
+        hh_web::proxy_upstream upstream(config);
+
+        before = accepted();
+        run_result pooled = run(requests, concurrency, [&](int i)
+                                { return forward_pooled(upstream, i); });
+        pooled.connections = accepted() - before;
+        print("proxy_upstream", pooled);
+
+        before = accepted();
+        std::thread outage([&]()
+                           {
+                               std::this_thread::sleep_for(std::chrono::duration<double>(pooled.seconds / 2));
+                               second.stop(); });
+        run_result failover = run(requests, concurrency, [&](int i)
+                                  { return forward_pooled(upstream, i); });
+        outage.join();
+        failover.connections = accepted() - before;
+        print("failover", failover);
+        std::printf("healthy upstreams after the outage: %zu of 2\n", upstream.get_healthy_count());
+    }
+
+    first.stop();
+    return 0;
+}
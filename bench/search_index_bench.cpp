@@ -0,0 +1,160 @@
+/**
+ * Benchmark: searching items by name and description, index vs full scan.
+ *
+ * Builds a search_index over synthetic items, names of 2-4 and descriptions of 8-20 words
+ * drawn from a Zipf-distributed vocabulary (a few words in most items, most words in a few),
+ * then times top-10 queries with rare, medium and common terms and with several terms.
+ * "scan" is what searching took without the index: a case-insensitive substring test of
+ * every item's name and description, as a handler walking ItemStore::get_all() would do.
+ * The last table replaces a tenth of the items and searches again, with dead postings in
+ * the lists.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./search_index_bench [items]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../includes/search_index.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+struct item
+{
+    std::string name;
+    std::string description;
+};
+
+/// Word i of the vocabulary, short for frequent words as in natural text
+static std::string word(std::size_t i)
+{
+    std::string text;
+    do
+    {
+        text.push_back(static_cast<char>('a' + i % 26));
+        i /= 26;
+    } while (i > 0);
+    return text + "o";
+}
+
+class zipf
+{
+private:
+    std::vector<double> cumulative;
+
+public:
+    explicit zipf(std::size_t words)
+    {
+        double sum = 0;
+        for (std::size_t i = 1; i <= words; ++i)
+            cumulative.push_back(sum += 1.0 / i);
+        for (double &value : cumulative)
+            value /= sum;
+    }
+
+    std::size_t operator()(std::mt19937 &random) const
+    {
+        double u = std::uniform_real_distribution<double>(0, 1)(random);
+        return static_cast<std::size_t>(std::lower_bound(cumulative.begin(), cumulative.end(), u) - cumulative.begin());
+    }
+};
+
+static std::string sentence(std::mt19937 &random, const zipf &words, int min_words, int max_words)
+{
+    int count = std::uniform_int_distribution<int>(min_words, max_words)(random);
+    std::string text;
+    for (int i = 0; i < count; ++i)
+    {
+        if (i > 0)
+            text.push_back(' ');
+        text += word(words(random));
+    }
+    return text;
+}
+
+static bool contains_word(const std::string &text, const std::string &needle)
+{
+    auto it = std::search(text.begin(), text.end(), needle.begin(), needle.end(), [](char a, char b)
+                          { return (a | 0x20) == (b | 0x20); });
+    return it != text.end();
+}
+
+/// p50 and p99 of a query in microseconds
+static void time_query(const hh_web::search_index &index, const std::string &label, const std::string &query)
+{
+    std::vector<double> times;
+    std::size_t hits = 0;
+    for (int run = 0; run < 200; ++run)
+    {
+        auto start = bench_clock::now();
+        hits = index.search(query, 10).size();
+        times.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    std::printf("  %-28s %-22s p50 %8.1f us   p99 %8.1f us   %zu hits\n", label.c_str(), ("\"" + query + "\"").c_str(),
+                times[times.size() / 2], times[times.size() * 99 / 100], hits);
+}
+
+static void time_queries(const hh_web::search_index &index)
+{
+    time_query(index, "rare term (rank 15000)", word(15000));
+    time_query(index, "medium term (rank 500)", word(500));
+    time_query(index, "common term (rank 3)", word(3));
+    time_query(index, "most common term", word(0));
+    time_query(index, "two medium terms", word(400) + " " + word(700));
+    time_query(index, "common + rare term", word(2) + " " + word(12000));
+    time_query(index, "three common terms", word(0) + " " + word(1) + " " + word(5));
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    std::mt19937 random(42);
+    zipf words(20000);
+
+    std::vector<item> items;
+    items.reserve(count);
+    for (int i = 0; i < count; ++i)
+        items.push_back({sentence(random, words, 2, 4), sentence(random, words, 8, 20)});
+
+    hh_web::search_index index;
+    auto start = bench_clock::now();
+    {
+        hh_web::search_index::batch indexing(index);
+        for (int i = 0; i < count; ++i)
+            indexing.put(i + 1, {{items[i].name, 2}, {items[i].description, 1}});
+    }
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    std::printf("%d items indexed in %.2f s (%.0f items/s), %zu terms, %.1f MB of postings\n", count, seconds, count / seconds,
+                index.term_count(), index.posting_bytes() / 1e6);
+
+    std::printf("top 10 by BM25:\n");
+    time_queries(index);
+
+    std::string needle = word(500);
+    start = bench_clock::now();
+    std::size_t matches = 0;
+    for (const item &entry : items)
+        matches += contains_word(entry.name, needle) || contains_word(entry.description, needle);
+    std::printf("  %-28s %-22s once     %8.1f us   %zu matches, unranked\n", "scan (medium term)", ("\"" + needle + "\"").c_str(),
+                std::chrono::duration<double, std::micro>(bench_clock::now() - start).count(), matches);
+
+    int replaced = count / 10;
+    start = bench_clock::now();
+    for (int i = 0; i < replaced; ++i)
+    {
+        int id = std::uniform_int_distribution<int>(1, count)(random);
+        std::string name = sentence(random, words, 2, 4), description = sentence(random, words, 8, 20);
+        index.put(id, {{name, 2}, {description, 1}});
+    }
+    seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    std::printf("%d items replaced one by one in %.2f s (%.0f items/s), %.1f MB of postings\n", replaced, seconds, replaced / seconds,
+                index.posting_bytes() / 1e6);
+    time_queries(index);
+    return 0;
+}
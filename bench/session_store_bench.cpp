@@ -0,0 +1,215 @@
+/**
+ * Benchmark: sessions in an ad hoc map behind one mutex vs session_store.
+ *
+ * "ad hoc" is what apps do without the store: an unordered_map from session ID to values,
+ * one mutex, nothing ever removed.
+ *
+ * - throughput: N threads reading (80%) and writing (20%) values of random sessions out of
+ *   100k, million operations per second. The store's shards spread the lock; scaling only
+ *   shows on a machine with at least as many cores as threads.
+ * - churn: 2M requests, 10% from new clients that never come back (a session is created and
+ *   a value set), the rest on 10k returning clients. The ad hoc map keeps every session; the
+ *   store is limited to 50k sessions and evicts the least recently used.
+ * - expiry: 10k sessions with a 1 s TTL, used continuously for 3 s while the timing wheel
+ *   ticks, then left alone. Timer callbacks fired vs accesses, and how many sessions are
+ *   left a little over a TTL after the last access.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./session_store_bench
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../includes/session_store.hpp"
+#include "../includes/timing_wheel.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+class adhoc_store
+{
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::map<std::string, std::string>> sessions;
+
+public:
+    std::string create()
+    {
+        std::string id = hh_web::session_store::generate_id();
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions[id];
+        return id;
+    }
+
+    std::optional<std::string> get(const std::string &id, const std::string &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto session = sessions.find(id);
+        if (session == sessions.end())
+            return std::nullopt;
+        auto value = session->second.find(key);
+        if (value == session->second.end())
+            return std::nullopt;
+        return value->second;
+    }
+
+    bool set(const std::string &id, const std::string &key, std::string value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto session = sessions.find(id);
+        if (session == sessions.end())
+            return false;
+        session->second[key] = std::move(value);
+        return true;
+    }
+
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return sessions.size();
+    }
+};
+
+/// Million operations per second of threads running body(thread index) at the same time
+template <typename F>
+static double run_threads(int threads, int ops, F &&body)
+{
+    auto start = bench_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back([&body, t]()
+                             { body(t); });
+    for (auto &worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return static_cast<double>(threads) * ops / seconds / 1e6;
+}
+
+template <typename Store>
+static double throughput(Store &store, const std::vector<std::string> &ids, int threads, int ops)
+{
+    return run_threads(threads, ops, [&store, &ids, ops](int t)
+                       {
+                           std::mt19937 random(t);
+                           for (int i = 0; i < ops; ++i)
+                           {
+                               const std::string &id = ids[random() % ids.size()];
+                               if (random() % 5 == 0)
+                                   store.set(id, "cart", "item-" + std::to_string(i));
+                               else
+                                   store.get(id, "user");
+                           } });
+}
+
+template <typename Store>
+static void churn(Store &store, int requests)
+{
+    std::mt19937 random(7);
+    std::vector<std::string> returning;
+    for (int i = 0; i < 10000; ++i)
+    {
+        returning.push_back(store.create());
+        store.set(returning.back(), "user", "user-" + std::to_string(i));
+    }
+    for (int i = 0; i < requests; ++i)
+    {
+        if (random() % 10 == 0)
+        {
+            std::string id = store.create();
+            store.set(id, "landing", "/products?page=" + std::to_string(i));
+        }
+        else
+        {
+            store.get(returning[random() % returning.size()], "user");
+        }
+    }
+}
+
+int main()
+{
+    constexpr int sessions = 100000;
+    constexpr int ops = 500000;
+
+    std::printf("throughput (M ops/s), 80%% reads, %d sessions\n", sessions);
+    std::printf("  %-8s %12s %14s\n", "threads", "ad hoc", "session_store");
+    for (int threads : {1, 2, 4, 8})
+    {
+        adhoc_store adhoc;
+        hh_web::session_config config;
+        config.max_sessions = sessions * 2;
+        hh_web::session_store store(config);
+        std::vector<std::string> adhoc_ids, store_ids;
+        for (int i = 0; i < sessions; ++i)
+        {
+            adhoc_ids.push_back(adhoc.create());
+            adhoc.set(adhoc_ids.back(), "user", "user-" + std::to_string(i));
+            store_ids.push_back(store.create());
+            store.set(store_ids.back(), "user", "user-" + std::to_string(i));
+        }
+        double a = throughput(adhoc, adhoc_ids, threads, ops / threads);
+        double s = throughput(store, store_ids, threads, ops / threads);
+        std::printf("  %-8d %12.2f %14.2f\n", threads, a, s);
+    }
+
+    std::printf("churn: 2M requests, 10%% from clients that never return\n");
+    {
+        adhoc_store adhoc;
+        auto start = bench_clock::now();
+        churn(adhoc, 2000000);
+        double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+        std::printf("  ad hoc         %.2f s, %zu sessions kept\n", seconds, adhoc.size());
+
+        hh_web::session_config config;
+        config.max_sessions = 50000;
+        hh_web::session_store store(config);
+        start = bench_clock::now();
+        churn(store, 2000000);
+        seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+        std::printf("  session_store  %.2f s, %zu sessions kept (%.1f MB), %zu evicted\n", seconds, store.size(), store.bytes() / 1e6,
+                    store.get_evicted());
+    }
+
+    std::printf("expiry: 10k sessions, 1 s TTL, used for 3 s\n");
+    {
+        hh_web::timing_wheel wheel(std::chrono::milliseconds(10));
+        std::atomic<bool> running{true};
+        std::atomic<std::size_t> fired{0};
+        std::thread ticker([&wheel, &running, &fired]()
+                           {
+                               while (running.load())
+                               {
+                                   fired += wheel.advance();
+                                   std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                               } });
+
+        hh_web::session_config config;
+        config.ttl = std::chrono::seconds(1);
+        hh_web::session_store store(config, &wheel);
+        std::vector<std::string> ids;
+        for (int i = 0; i < 10000; ++i)
+            ids.push_back(store.create());
+
+        std::size_t accesses = 0;
+        auto start = bench_clock::now();
+        while (bench_clock::now() - start < std::chrono::seconds(3))
+        {
+            for (const std::string &id : ids)
+                store.touch(id);
+            accesses += ids.size();
+        }
+        std::size_t fired_while_used = fired.load();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+        std::printf("  %zu accesses, %zu timer callbacks while used, %zu sessions left 1.2 s later, %zu expired\n", accesses,
+                    fired_while_used, store.size(), store.get_expired());
+        running = false;
+        ticker.join();
+    }
+    return 0;
+}
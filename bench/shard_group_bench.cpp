@@ -0,0 +1,128 @@
+/**
+ * Benchmark: the example item store behind one mutex vs partitioned over a shard_group.
+ *
+ * Every thread runs a 50/50 mix of reads (find) and writes (try_update) on random items
+ * of a store preloaded with 100k items. Three setups per thread count:
+ *
+ * - "mutex": N threads on ItemStore, every operation takes the one mutex and touches
+ *   whichever map nodes the other threads touched last.
+ * - "shard-local": N shards of a PartitionedItemStore, each running the mix on its own
+ *   partition (the seastar case, where the request already arrived on the owning core):
+ *   no lock and no shared cache line.
+ * - "messaged": N client threads sending each operation to the owning shard of N, the
+ *   case of web_server's request workers steering to shards; the difference to
+ *   shard-local is the cost of the hop.
+ *
+ * Scaling only shows on a machine with at least as many cores as threads (times two for
+ * "messaged"). Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./shard_group_bench [ops per thread]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../includes/json_writer.hpp"
+#include "../includes/search_index.hpp"
+#include "../includes/shard_group.hpp"
+#include "../includes/web_exceptions.hpp"
+#include "../ItemStore.hpp"
+#include "../PartitionedItemStore.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+constexpr int preloaded = 100000;
+
+/// Million operations per second of threads running body(thread index) at the same time
+template <typename F>
+static double run_threads(int threads, int ops, F &&body)
+{
+    auto start = bench_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back([&body, t]()
+                             { body(t); });
+    for (auto &worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return static_cast<double>(threads) * ops / seconds / 1e6;
+}
+
+template <typename Store>
+static void mix(Store &store, int ops, std::mt19937 &random, int first_id, int stride, int count)
+{
+    std::uniform_int_distribution<int> pick(0, count - 1);
+    for (int i = 0; i < ops; ++i)
+    {
+        int id = first_id + pick(random) * stride;
+        if (i & 1)
+            store.try_update(id, "Updated item", "Updated description", i);
+        else
+            store.find(id);
+    }
+}
+
+static double mutex_store(int threads, int ops)
+{
+    ItemStore store;
+    for (int i = 0; i < preloaded; ++i)
+        store.create("Item " + std::to_string(i), "A plain description", i + 0.99);
+    return run_threads(threads, ops, [&store, ops](int t)
+                       {
+                           std::mt19937 random(t);
+                           mix(store, ops, random, 1, 1, preloaded); });
+}
+
+static double partitioned_store(int threads, int ops, bool messaged)
+{
+    hh_web::shard_group shards(threads, false);
+    PartitionedItemStore store(shards);
+    // before start() the creates run inline, spread round robin over the partitions
+    for (int i = 0; i < preloaded; ++i)
+        store.create("Item " + std::to_string(i), "A plain description", i + 0.99);
+    shards.start();
+
+    if (messaged)
+    {
+        return run_threads(threads, ops, [&store, ops](int t)
+                           {
+                               std::mt19937 random(t);
+                               mix(store, ops, random, 1, 1, preloaded); });
+    }
+
+    // each shard runs the mix on the IDs it owns, all calls stay on the shard
+    int per_shard = preloaded / threads;
+    auto start = bench_clock::now();
+    auto done = shards.invoke_on_all([&store, ops, per_shard, threads](unsigned int shard)
+                                     {
+                                         std::mt19937 random(shard);
+                                         mix(store, ops, random, static_cast<int>(shard) + 1, threads, per_shard);
+                                         return true; });
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return done.size() * static_cast<double>(ops) / seconds / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    int ops = argc > 1 ? std::atoi(argv[1]) : 500000;
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+
+    std::printf("%d operations per thread (50%% find, 50%% try_update), %u cores, million ops per second\n", ops, cores);
+    std::printf("threads      mutex  shard-local   messaged\n");
+    for (int threads : {1, 2, 4, 8})
+    {
+        double locked = mutex_store(threads, ops);
+        double local = partitioned_store(threads, ops, false);
+        double messaged = partitioned_store(threads, ops / 10, true);
+        std::printf("%7d  %9.2f  %11.2f  %9.2f\n", threads, locked, local, messaged);
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+/**
+ * Benchmark: request latency on 127.0.0.1 under each hh_web::socket_options field.
+ *
+ * The server is a plain blocking loop, one thread per connection, that answers each request
+ * the way a framework without corking does: the header block and the body in two writes.
+ * Its listener is tuned with socket_options::apply_to_listener(), exactly as web_server
+ * does, and the accepted sockets inherit from it.
+ *
+ * Two client patterns are measured for each configuration:
+ * - keep-alive: one connection, sequential request/response round trips (Nagle, busy-poll, buffers)
+ * - connect: a new connection per request, connect to full response (DEFER_ACCEPT, FASTOPEN)
+ *
+ * The FASTOPEN row only differs when net.ipv4.tcp_fastopen has the server bit (2) set, the
+ * client sends its request with MSG_FASTOPEN in every configuration of the connect pattern.
+ * SO_BUSY_POLL only busy-polls on a NIC with NAPI, on loopback it shows the option's overhead.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./socket_options_bench [round trips]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../includes/socket_options.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static const char REQUEST[] = "GET / HTTP/1.1\r\nHost: bench\r\n\r\n";
+static const char HEADERS[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: keep-alive\r\n\r\n";
+static const char BODY[] = "ok";
+static constexpr std::size_t RESPONSE_SIZE = sizeof(HEADERS) - 1 + sizeof(BODY) - 1;
+
+/// Answer every request on the connection with two writes until the client closes
+static void serve_connection(int fd)
+{
+    char buffer[4096];
+    int matched = 0;
+    static const char END[] = "\r\n\r\n";
+    while (true)
+    {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            break;
+        for (ssize_t i = 0; i < n; ++i)
+        {
+            matched = buffer[i] == END[matched] ? matched + 1 : (buffer[i] == '\r' ? 1 : 0);
+            if (matched == 4)
+            {
+                matched = 0;
+                send(fd, HEADERS, sizeof(HEADERS) - 1, MSG_NOSIGNAL);
+                send(fd, BODY, sizeof(BODY) - 1, MSG_NOSIGNAL);
+            }
+        }
+    }
+    close(fd);
+}
+
+struct bench_server
+{
+    int listener = -1;
+    int port = 0;
+    std::thread acceptor;
+
+    explicit bench_server(const hh_web::socket_options &options)
+    {
+        listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(listener, 1024) < 0)
+        {
+            std::perror("listen");
+            std::exit(1);
+        }
+        socklen_t length = sizeof(address);
+        getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length);
+        port = ntohs(address.sin_port);
+
+        options.apply_to_listener(listener);
+
+        acceptor = std::thread([this]()
+                               {
+                                   while (true)
+                                   {
+                                       int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                                       if (fd < 0)
+                                           break;
+                                       std::thread(serve_connection, fd).detach();
+                                   } });
+    }
+
+    ~bench_server()
+    {
+        shutdown(listener, SHUT_RDWR);
+        close(listener);
+        acceptor.join();
+    }
+};
+
+static sockaddr_in loopback(int port)
+{
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return address;
+}
+
+static bool read_response(int fd)
+{
+    char buffer[512];
+    std::size_t received = 0;
+    while (received < RESPONSE_SIZE)
+    {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            return false;
+        received += n;
+    }
+    return true;
+}
+
+/// Sequential round trips on one connection, latency of each in microseconds
+static std::vector<double> keep_alive_round_trips(int port, int count)
+{
+    std::vector<double> samples;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in address = loopback(port);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+        return samples;
+
+    for (int i = 0; i < count; ++i)
+    {
+        auto start = bench_clock::now();
+        send(fd, REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL);
+        if (!read_response(fd))
+            break;
+        samples.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - start).count());
+    }
+    close(fd);
+    return samples;
+}
+
+/// A new connection per request, connect to full response in microseconds
+static std::vector<double> connect_round_trips(int port, int count)
+{
+    std::vector<double> samples;
+    sockaddr_in address = loopback(port);
+    for (int i = 0; i < count; ++i)
+    {
+        auto start = bench_clock::now();
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        ssize_t sent = sendto(fd, REQUEST, sizeof(REQUEST) - 1, MSG_FASTOPEN | MSG_NOSIGNAL,
+                              reinterpret_cast<sockaddr *>(&address), sizeof(address));
+        if (sent < 0)
+        {
+            // no client TFO: plain connect + send
+            if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+            {
+                close(fd);
+                break;
+            }
+            send(fd, REQUEST, sizeof(REQUEST) - 1, MSG_NOSIGNAL);
+        }
+        bool ok = read_response(fd);
+        close(fd);
+        if (!ok)
+            break;
+        samples.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - start).count());
+    }
+    return samples;
+}
+
+static double percentile(std::vector<double> samples, double p)
+{
+    if (samples.empty())
+        return 0;
+    std::sort(samples.begin(), samples.end());
+    return samples[std::min(samples.size() - 1, static_cast<std::size_t>(p * samples.size()))];
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? std::atoi(argv[1]) : 500;
+
+    struct configuration
+    {
+        const char *name;
+        hh_web::socket_options options;
+    };
+
+    // Nagle plus delayed ACKs dominates every split write, so each option past the first two is
+    // measured on top of tcp_nodelay to show its own effect
+    std::vector<configuration> configurations(7);
+    configurations[0].name = "defaults";
+    configurations[1].name = "tcp_nodelay";
+    configurations[2].name = "+defer_accept 1s";
+    configurations[2].options.defer_accept_seconds = 1;
+    configurations[3].name = "+fastopen 256";
+    configurations[3].options.fastopen_queue_length = 256;
+    configurations[4].name = "+busy_poll 50us";
+    configurations[4].options.busy_poll_microseconds = 50;
+    configurations[5].name = "+buffers 16KiB";
+    configurations[5].options.receive_buffer_bytes = 16 * 1024;
+    configurations[5].options.send_buffer_bytes = 16 * 1024;
+    configurations[6].name = "+incoming_cpu 0";
+    configurations[6].options.incoming_cpu = 0;
+    for (std::size_t i = 1; i < configurations.size(); ++i)
+        configurations[i].options.tcp_nodelay = true;
+
+    std::printf("%d round trips per pattern, latency in microseconds\n", count);
+    std::printf("%-18s %12s %12s %12s %12s\n", "options", "ka p50", "ka p99", "conn p50", "conn p99");
+    for (auto &configuration : configurations)
+    {
+        bench_server server(configuration.options);
+        auto keep_alive = keep_alive_round_trips(server.port, count);
+        auto per_connection = connect_round_trips(server.port, count / 4);
+        std::printf("%-18s %12.1f %12.1f %12.1f %12.1f\n", configuration.name,
+                    percentile(keep_alive, 0.5), percentile(keep_alive, 0.99),
+                    percentile(per_connection, 0.5), percentile(per_connection, 0.99));
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * Benchmark for hh_web::timing_wheel.
+ *
+ * Arms 100k timers (one per simulated connection), re-arms every one of them
+ * several times as an idle timeout would be on every read, cancels a part of them
+ * and lets the rest expire. The same workload is run against an ordered-set timer
+ * queue (the usual heap/tree approach) for comparison.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./timing_wheel_bench
+ */
+#include <chrono>
+#include <cstdio>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "../includes/timing_wheel.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+static constexpr std::size_t TIMERS = 100000;
+static constexpr int RESETS_PER_TIMER = 10;
+
+static double ns_per_op(bench_clock::duration elapsed, std::size_t ops)
+{
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / ops;
+}
+
+static void bench_wheel()
+{
+    hh_web::timing_wheel wheel(std::chrono::milliseconds(10));
+    std::vector<hh_web::timing_wheel::timer_id> ids(TIMERS);
+    std::size_t fired = 0;
+
+    auto t0 = bench_clock::now();
+    for (std::size_t i = 0; i < TIMERS; ++i)
+        ids[i] = wheel.schedule(std::chrono::milliseconds(1000 + i % 5000), [&fired]()
+                                { fired++; });
+    auto t1 = bench_clock::now();
+
+    for (int round = 0; round < RESETS_PER_TIMER; ++round)
+        for (std::size_t i = 0; i < TIMERS; ++i)
+            wheel.reset(ids[i], std::chrono::milliseconds(2000 + (i * 7 + round) % 5000));
+    auto t2 = bench_clock::now();
+
+    for (std::size_t i = 0; i < TIMERS; i += 4)
+        wheel.cancel(ids[i]);
+    auto t3 = bench_clock::now();
+
+    wheel.advance(bench_clock::now() + std::chrono::seconds(10));
+    auto t4 = bench_clock::now();
+
+    std::printf("timing_wheel : schedule %.1f ns/op, reset %.1f ns/op, cancel %.1f ns/op, expire %.1f ns/timer (%zu fired)\n",
+                ns_per_op(t1 - t0, TIMERS), ns_per_op(t2 - t1, TIMERS * RESETS_PER_TIMER),
+                ns_per_op(t3 - t2, TIMERS / 4), ns_per_op(t4 - t3, fired ? fired : 1), fired);
+}
+
+static void bench_ordered_set()
+{
+    // (expiry in ms, timer index)
+    std::set<std::pair<long long, std::size_t>> queue;
+    std::vector<long long> expiry(TIMERS);
+    std::size_t fired = 0;
+
+    auto t0 = bench_clock::now();
+    for (std::size_t i = 0; i < TIMERS; ++i)
+    {
+        expiry[i] = 1000 + i % 5000;
+        queue.emplace(expiry[i], i);
+    }
+    auto t1 = bench_clock::now();
+
+    for (int round = 0; round < RESETS_PER_TIMER; ++round)
+        for (std::size_t i = 0; i < TIMERS; ++i)
+        {
+            queue.erase({expiry[i], i});
+            expiry[i] = 2000 + (i * 7 + round) % 5000;
+            queue.emplace(expiry[i], i);
+        }
+    auto t2 = bench_clock::now();
+
+    for (std::size_t i = 0; i < TIMERS; i += 4)
+        queue.erase({expiry[i], i});
+    auto t3 = bench_clock::now();
+
+    while (!queue.empty() && queue.begin()->first <= 10000)
+    {
+        queue.erase(queue.begin());
+        fired++;
+    }
+    auto t4 = bench_clock::now();
+
+    std::printf("ordered set  : schedule %.1f ns/op, reset %.1f ns/op, cancel %.1f ns/op, expire %.1f ns/timer (%zu fired)\n",
+                ns_per_op(t1 - t0, TIMERS), ns_per_op(t2 - t1, TIMERS * RESETS_PER_TIMER),
+                ns_per_op(t3 - t2, TIMERS / 4), ns_per_op(t4 - t3, fired ? fired : 1), fired);
+}
+
+int main()
+{
+    std::printf("%zu timers, %d resets per timer\n", TIMERS, RESETS_PER_TIMER);
+    bench_wheel();
+    bench_ordered_set();
+    return 0;
+}
@@ -0,0 +1,203 @@
+/**
+ * Benchmark: keep-alive HTTP/1.1 requests over loopback TCP vs a Unix domain socket.
+ *
+ * Two http2_listeners hand every request to the same worker pool, which answers with a
+ * small text body, as web_server does with its handlers: one on 127.0.0.1, one on a Unix
+ * domain socket (web_server::use_unix_socket). [concurrency] client threads, standing in
+ * for the connections of a local proxy, each keep one connection and send their requests
+ * over it one after the other. Requests per second, latency percentiles and the CPU time
+ * of the whole process per request are reported.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./unix_socket_bench [requests] [concurrency]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../includes/http2_listener.hpp"
+#include "../includes/thread_pool.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+struct run_result
+{
+    double seconds = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double cpu_us_per_request = 0;
+    std::size_t completed = 0;
+};
+
+static int connect_tcp(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<std::uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int connect_unix(const std::string &path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static double cpu_seconds()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/// Reads one response delimited by Content-Length, keeps what follows in input
+static bool read_response(int fd, std::string &input, std::vector<char> &buffer)
+{
+    while (true)
+    {
+        std::size_t end = input.find("\r\n\r\n");
+        if (end != std::string::npos)
+        {
+            std::size_t field = input.find("Content-Length: ");
+            std::size_t length = field < end ? std::strtoul(input.c_str() + field + 16, nullptr, 10) : 0;
+            if (input.size() >= end + 4 + length)
+            {
+                input.erase(0, end + 4 + length);
+                return true;
+            }
+        }
+        ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+        if (received <= 0)
+            return false;
+        input.append(buffer.data(), static_cast<std::size_t>(received));
+    }
+}
+
+/// concurrency threads, each sending its share of the requests over one keep-alive connection
+static run_result run(const std::function<int()> &connect_once, int requests, int concurrency)
+{
+    run_result result;
+    std::vector<double> latencies;
+    std::mutex latencies_mutex;
+    std::atomic<int> next{0};
+
+    double cpu_before = cpu_seconds();
+    auto start = bench_clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < concurrency; ++c)
+    {
+        clients.emplace_back([&]()
+                             {
+                                 std::vector<double> local;
+                                 std::vector<char> buffer(4096);
+                                 std::string input;
+                                 int fd = connect_once();
+                                 int i;
+                                 while (fd >= 0 && (i = next.fetch_add(1)) < requests)
+                                 {
+                                     auto begin = bench_clock::now();
+                                     std::string request = "GET /items/" + std::to_string(i) + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+                                     if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) < 0 || !read_response(fd, input, buffer))
+                                         break;
+                                     local.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count());
+                                 }
+                                 if (fd >= 0)
+                                     close(fd);
+                                 std::lock_guard<std::mutex> lock(latencies_mutex);
+                                 latencies.insert(latencies.end(), local.begin(), local.end()); });
+    }
+    for (auto &client : clients)
+        client.join();
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    result.completed = latencies.size();
+    if (!latencies.empty())
+    {
+        result.p50 = latencies[latencies.size() / 2];
+        result.p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+        result.cpu_us_per_request = (cpu_seconds() - cpu_before) * 1e6 / latencies.size();
+    }
+    return result;
+}
+
+static void print(const char *name, const run_result &result)
+{
+    std::printf("%-12s %8zu requests %9.0f req/s   p50 %8.1f us   p99 %8.1f us   %6.1f us CPU per request\n",
+                name, result.completed, result.completed / result.seconds, result.p50, result.p99, result.cpu_us_per_request);
+    std::fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int requests = argc > 1 ? std::atoi(argv[1]) : 50000;
+    int concurrency = argc > 2 ? std::atoi(argv[2]) : 16;
+    std::string path = "/tmp/hh_web_unix_socket_bench." + std::to_string(getpid()) + ".sock";
+
+    // workers are joined before the listeners they post to are destroyed
+    hh_web::http2_listener tcp(0, "127.0.0.1");
+    hh_web::http2_listener local(0, "127.0.0.1");
+    local.set_unix_socket(path, 0600);
+    hh_web::thread_pool workers(std::max(2u, std::thread::hardware_concurrency()));
+    for (hh_web::http2_listener *listener : {&tcp, &local})
+    {
+        listener->set_request_callback([&workers, listener](const hh_web::http2_stream_ref &ref, hh_web::http2_request &&request)
+                                       {
+                                           std::string path = std::move(request.path);
+                                           workers.enqueue([listener, ref, path]()
+                                                           {
+                                                               hh_web::http2_response response;
+                                                               response.headers = {{"Content-Type", "text/plain"}};
+                                                               response.body = "item " + path + "\n";
+                                                               listener->post(ref, std::move(response)); });
+                                           return nullptr; });
+        if (!listener->start())
+            return 1;
+    }
+
+    std::printf("%d requests, %d keep-alive connections, %u CPUs\n", requests, concurrency, std::thread::hardware_concurrency());
+    print("tcp loopback", run([&]()
+                              { return connect_tcp(tcp.get_port()); },
+                              requests, concurrency));
+    print("unix socket", run([&]()
+                             { return connect_unix(path); },
+                             requests, concurrency));
+
+    workers.stop_workers();
+    local.stop();
+    tcp.stop();
+    return 0;
+}
@@ -0,0 +1,283 @@
+/**
+ * Benchmark: outbound calls with the pooled web_client vs a blocking connect per call.
+ *
+ * Two local stand-ins answer every request with a small text body:
+ * - a keep-alive HTTP/1.1 server (thread per connection)
+ * - an http2_listener, speaking h2c
+ * The same number of calls, with the same number in flight, then go out three ways:
+ * - blocking: [concurrency] threads, each connecting, sending and reading per call, as a
+ *   handler bringing its own client does
+ * - pooled http/1.1: web_client against the keep-alive server
+ * - pooled h2: web_client against the http2_listener, one multiplexed connection
+ * Calls per second, latency percentiles and connections opened are reported.
+ *
+ * Build with -DHH_WEB_BUILD_BENCHMARKS=ON and run ./web_client_bench [requests] [concurrency]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../includes/http2_listener.hpp"
+#include "../includes/thread_pool.hpp"
+#include "../includes/web_client.hpp"
+
+using bench_clock = std::chrono::steady_clock;
+
+struct run_result
+{
+    double seconds = 0;
+    double p50 = 0;
+    double p99 = 0;
+    std::size_t completed = 0;
+    std::size_t connections = 0;
+};
+
+static void summarize(std::vector<double> &latencies, run_result &result)
+{
+    std::sort(latencies.begin(), latencies.end());
+    result.completed = latencies.size();
+    if (latencies.empty())
+        return;
+    result.p50 = latencies[latencies.size() / 2];
+    result.p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+}
+
+/// Keep-alive HTTP/1.1 stand-in, one thread per connection, closes when asked to
+class keep_alive_server
+{
+private:
+    int listen_fd = -1;
+    int port = 0;
+    std::thread acceptor;
+
+    static void serve(int fd)
+    {
+        std::string input;
+        std::vector<char> buffer(16384);
+        while (true)
+        {
+            std::size_t end;
+            while ((end = input.find("\r\n\r\n")) == std::string::npos)
+            {
+                ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+                if (received <= 0)
+                {
+                    close(fd);
+                    return;
+                }
+                input.append(buffer.data(), static_cast<std::size_t>(received));
+            }
+            std::string head = input.substr(0, end);
+            input.erase(0, end + 4);
+
+            std::size_t path_start = head.find(' ') + 1;
+            std::string body = "item " + head.substr(path_start, head.find(' ', path_start) - path_start) + "\n";
+            bool close_after = head.find("Connection: close") != std::string::npos;
+            std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) +
+                                   (close_after ? "\r\nConnection: close" : "") + "\r\n\r\n" + body;
+            if (send(fd, response.data(), response.size(), MSG_NOSIGNAL) < 0 || close_after)
+            {
+                close(fd);
+                return;
+            }
+        }
+    }
+
+public:
+    bool start()
+    {
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), length) < 0 || listen(listen_fd, SOMAXCONN) < 0 ||
+            getsockname(listen_fd, reinterpret_cast<sockaddr *>(&address), &length) < 0)
+            return false;
+        port = ntohs(address.sin_port);
+
+        acceptor = std::thread([this]()
+                               {
+                                   int fd;
+                                   while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0)
+                                   {
+                                       int one = 1;
+                                       setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                                       std::thread(serve, fd).detach();
+                                   } });
+        return true;
+    }
+
+    void stop()
+    {
+        shutdown(listen_fd, SHUT_RDWR);
+        close(listen_fd);
+        if (acceptor.joinable())
+            acceptor.join();
+    }
+
+    int get_port() const
+    {
+        return port;
+    }
+};
+
+/// concurrency threads, each opening one connection per call
+static run_result run_blocking(int port, int requests, int concurrency)
+{
+    run_result result;
+    std::vector<double> latencies;
+    std::mutex latencies_mutex;
+    std::atomic<int> next{0};
+
+    auto start = bench_clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < concurrency; ++c)
+    {
+        clients.emplace_back([&]()
+                             {
+                                 std::vector<double> local;
+                                 std::vector<char> buffer(4096);
+                                 int i;
+                                 while ((i = next.fetch_add(1)) < requests)
+                                 {
+                                     auto begin = bench_clock::now();
+                                     int fd = socket(AF_INET, SOCK_STREAM, 0);
+                                     sockaddr_in address{};
+                                     address.sin_family = AF_INET;
+                                     address.sin_port = htons(static_cast<std::uint16_t>(port));
+                                     address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                                     if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0)
+                                     {
+                                         std::string request = "GET /items/" + std::to_string(i) + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+                                         if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) > 0)
+                                         {
+                                             while (recv(fd, buffer.data(), buffer.size(), 0) > 0)
+                                             {
+                                             }
+                                             local.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count());
+                                         }
+                                     }
+                                     close(fd);
+                                 }
+                                 std::lock_guard<std::mutex> lock(latencies_mutex);
+                                 latencies.insert(latencies.end(), local.begin(), local.end()); });
+    }
+    for (auto &client : clients)
+        client.join();
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    result.connections = latencies.size();
+
+    summarize(latencies, result);
+    return result;
+}
+
+/// concurrency calls kept in flight through the client, each callback issues the next call
+static run_result run_pooled(hh_web::web_client &client, const std::string &base, int requests, int concurrency)
+{
+    run_result result;
+    std::vector<double> latencies;
+    latencies.reserve(requests);
+    std::atomic<int> issued{0};
+    int done = 0;
+    std::promise<void> finished;
+    std::size_t opened = client.get_connections_opened();
+
+    // callbacks all run on the client's loop thread, latencies and done need no lock
+    std::function<void()> issue = [&]()
+    {
+        int i = issued.fetch_add(1);
+        if (i >= requests)
+            return;
+        auto begin = bench_clock::now();
+        hh_web::client_request request;
+        request.url = base + "/items/" + std::to_string(i);
+        client.request(std::move(request), [&, begin](hh_web::client_response &&response)
+                       {
+                           if (response.ok())
+                               latencies.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - begin).count());
+                           else
+                               std::fprintf(stderr, "call failed: %s\n", response.error.c_str());
+                           if (++done == requests)
+                               finished.set_value();
+                           else
+                               issue(); });
+    };
+
+    auto start = bench_clock::now();
+    for (int c = 0; c < concurrency && c < requests; ++c)
+        issue();
+    finished.get_future().wait();
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    result.connections = client.get_connections_opened() - opened;
+
+    summarize(latencies, result);
+    return result;
+}
+
+static void print(const char *name, const run_result &result)
+{
+    std::printf("%-16s %8zu calls %9.0f calls/s   p50 %8.1f us   p99 %8.1f us   %6zu connections\n",
+                name, result.completed, result.completed / result.seconds, result.p50, result.p99, result.connections);
+    std::fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    int requests = argc > 1 ? std::atoi(argv[1]) : 20000;
+    int concurrency = argc > 2 ? std::atoi(argv[2]) : 32;
+
+    keep_alive_server http1;
+    if (!http1.start())
+        return 1;
+
+    // workers are joined before the listener they post to is destroyed
+    hh_web::http2_listener h2(0, "127.0.0.1");
+    hh_web::thread_pool workers(std::max(2u, std::thread::hardware_concurrency()));
+    h2.set_request_callback([&](const hh_web::http2_stream_ref &ref, hh_web::http2_request &&request)
+                            {
+                                std::string path = std::move(request.path);
+                                workers.enqueue([&h2, ref, path]()
+                                                {
+                                                    hh_web::http2_response response;
+                                                    response.headers = {{"Content-Type", "text/plain"}};
+                                                    response.body = "item " + path + "\n";
+                                                    h2.post(ref, std::move(response)); });
+                                return nullptr; });
+    if (!h2.start())
+        return 1;
+
+    std::string http1_base = "http://127.0.0.1:" + std::to_string(http1.get_port());
+    std::string h2_base = "http://127.0.0.1:" + std::to_string(h2.get_port());
+
+    hh_web::web_client_config config;
+    config.max_connections_per_host = static_cast<std::size_t>(concurrency);
+    hh_web::web_client client(config);
+    client.use_http2("127.0.0.1:" + std::to_string(h2.get_port()));
+    client.start();
+
+    std::printf("%d calls, %d in flight, %u CPUs\n", requests, concurrency, std::thread::hardware_concurrency());
+    print("blocking", run_blocking(http1.get_port(), requests, concurrency));
+    print("pooled http/1.1", run_pooled(client, http1_base, requests, concurrency));
+    print("pooled h2", run_pooled(client, h2_base, requests, concurrency));
+
+    client.stop();
+    workers.stop_workers();
+    h2.stop();
+    http1.stop();
+    return 0;
+}
@@ -4,8 +4,15 @@
 #include <memory>
 #include <map>
 #include <mutex>
+#include <optional>
+#include <charconv>
 #include <fstream>
 #include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <string_view>
 
 #include "libs/json/json-parser.hpp"
 #include "libs/html-builder/html-builder.hpp"
@@ -17,65 +24,49 @@ using hh_web::methods::GET;
 using hh_web::methods::POST;
 using hh_web::methods::PUT;
 #include "ItemStore.hpp"
+#include "PartitionedItemStore.hpp"
 
-int get_id_from_request(const std::shared_ptr<hh_web::web_request> &req)
+// Bad or missing IDs are everyday input (hostile clients send plenty), so they come back
+// as a web_error instead of an exception
+hh_web::web_expected<int> get_id_from_request(const std::shared_ptr<hh_web::web_request> &req)
 {
     auto params = req->get_path_params();
     for (const auto &[key, value] : params)
     {
         if (key == "id")
         {
-            try
+            int id = 0;
+            auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), id);
+            if (error != std::errc() || end != value.data() + value.size())
             {
-                return std::stoi(value);
-            }
-            catch (const std::exception &e)
-            {
-                throw hh_web::web_exception(
-                    "Invalid ID parameter: " + value,
-                    "BAD_REQUEST",
-                    "get_id_from_request",
-                    400,
-                    "Bad Request");
+                return hh_web::web_error::bad_request("Invalid ID parameter: " + value);
             }
+            return id;
         }
     }
-    throw hh_web::web_exception(
-        "ID parameter missing",
-        "BAD_REQUEST",
-        "get_id_from_request",
-        400,
-        "Bad Request");
+    return hh_web::web_error::bad_request("ID parameter missing");
 }
 
-hh_web::exit_code delete_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+hh_web::web_result delete_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
 {
-    try
-    {
-        int id = get_id_from_request(req);
-        get_item_store().remove(id);
-
-        // For HTTP 204 No Content:
-        // 1. Set the status code
-        // 2. DO NOT set Content-Type
-        // 3. DO NOT set a body (even empty string)
-        res->set_status(204, "No Content");
-
-        // That's it! Don't add any content for 204 responses
-        return hh_web::exit_code::EXIT;
-    }
-    catch (hh_web::web_exception &e)
+    auto id = get_id_from_request(req);
+    if (!id)
     {
-        res->set_status(e.get_status_code(), e.get_status_message());
-        res->send_json("{\"error\": \"" + std::string("Item Not Found") + "\"}");
-        return hh_web::exit_code::EXIT;
+        return id.error();
     }
-    catch (const std::exception &e)
+    if (!get_item_store().try_remove(*id))
     {
-        res->set_status(500, "Internal Server Error");
-        res->send_json("{\"error\": \"Failed to delete item\"}");
-        return hh_web::exit_code::EXIT;
+        return hh_web::web_error::not_found("Item Not Found");
     }
+
+    // For HTTP 204 No Content:
+    // 1. Set the status code
+    // 2. DO NOT set Content-Type
+    // 3. DO NOT set a body (even empty string)
+    res->set_status(204, "No Content");
+
+    // That's it! Don't add any content for 204 responses
+    return hh_web::exit_code::EXIT;
 }
 
 hh_web::exit_code CORS(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
@@ -106,22 +97,12 @@ hh_web::exit_code get_all_items_handler(std::shared_ptr<hh_web::web_request> req
     {
         auto items = get_item_store().get_all();
 
-        // Build JSON array response
-        std::stringstream ss;
-        ss << "[";
-        for (size_t i = 0; i < items.size(); ++i)
-        {
-            ss << items[i].to_json();
-            if (i < items.size() - 1)
-            {
-                ss << ",";
-            }
-        }
-        ss << "]";
+        // Written straight into the body, names and descriptions escaped
+        hh_web::json_writer json;
+        json.value(items);
 
         res->set_status(200, "OK");
-        res->set_content_type("application/json");
-        res->set_body(ss.str());
+        res->send_json(json);
         return hh_web::exit_code::EXIT;
     }
     catch (const std::exception &e)
@@ -132,178 +113,503 @@ hh_web::exit_code get_all_items_handler(std::shared_ptr<hh_web::web_request> req
         return hh_web::exit_code::EXIT;
     }
 }
-hh_web::exit_code get_specific_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+hh_web::web_result get_specific_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
 {
-    try
+    auto id = get_id_from_request(req);
+    if (!id)
     {
-        int id = get_id_from_request(req);
-        auto item = get_item_store().get(id);
+        return id.error();
+    }
+    auto item = get_item_store().find(*id);
+    if (!item)
+    {
+        return hh_web::web_error::not_found("Item not found");
+    }
 
-        res->set_status(200, "OK");
-        res->set_content_type("application/json");
-        res->set_body(item.to_json());
-        return hh_web::exit_code::EXIT;
+    res->set_status(200, "OK");
+    res->set_content_type("application/json");
+    res->set_body(item->to_json());
+    return hh_web::exit_code::EXIT;
+}
+
+// Ranked by the store's full-text index, a search does not scan the items
+hh_web::web_result search_items_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    std::string query = req->get_query_parameter("q");
+    if (query.empty())
+    {
+        return hh_web::web_error::bad_request("Query parameter q missing");
     }
-    catch (hh_web::web_exception &e)
+    std::size_t limit = 10;
+    std::string limit_text = req->get_query_parameter("limit");
+    if (!limit_text.empty())
     {
-        res->set_status(e.get_status_code(), e.get_status_message());
-        res->set_content_type("application/json");
-        res->set_body("{\"error\": \"" + std::string(e.what()) + "\"}");
-        return hh_web::exit_code::EXIT;
+        auto [end, error] = std::from_chars(limit_text.data(), limit_text.data() + limit_text.size(), limit);
+        if (error != std::errc() || end != limit_text.data() + limit_text.size() || limit == 0 || limit > 100)
+        {
+            return hh_web::web_error::bad_request("limit must be between 1 and 100");
+        }
     }
-    catch (const std::exception &e)
+
+    hh_web::json_writer json;
+    json.begin_object();
+    json.member("query", query);
+    json.key("results").begin_array();
+    for (const auto &[item, score] : get_item_store().search(query, limit))
     {
-        res->set_status(500, "Internal Server Error");
-        res->set_content_type("application/json");
-        res->set_body("{\"error\": \"Failed to retrieve item\"}");
-        return hh_web::exit_code::EXIT;
+        json.begin_object();
+        json.member("id", item.id);
+        json.member("name", item.name);
+        json.member("description", item.description);
+        json.member("price", item.price);
+        json.member("score", score);
+        json.end_object();
     }
+    json.end_array();
+    json.end_object();
+
+    res->set_status(200, "OK");
+    res->send_json(json);
+    return hh_web::exit_code::EXIT;
 }
 
-hh_web::exit_code create_new_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+using item_fields = ItemStore::Fields;
+
+// The JSON library reports malformed bodies and missing fields by throwing, so this is the
+// one place left that catches; everything after it stays on the result path
+hh_web::web_expected<item_fields> parse_item_fields(const std::string &body)
 {
     try
     {
-        std::string name, description;
-        double price;
+        auto json = parse(body);
+        item_fields fields;
+        fields.name = getter::get_string(json["name"]);
+        fields.description = getter::get_string(json["description"]);
+        fields.price = getter::get_number(json["price"]);
+        return fields;
+    }
+    catch (const std::exception &e)
+    {
+        return hh_web::web_error::bad_request("Invalid item JSON");
+    }
+}
 
-        auto json = parse(req->get_body());
+hh_web::web_result create_new_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    auto fields = parse_item_fields(req->get_body());
+    if (!fields)
+    {
+        return fields.error();
+    }
 
-        name = getter::get_string(json["name"]);
-        description = getter::get_string(json["description"]);
-        price = getter::get_number(json["price"]);
+    int id = get_item_store().create(fields->name, fields->description, fields->price);
+    auto item = get_item_store().find(id);
+    if (!item)
+    {
+        return hh_web::web_error::internal("Failed To Create Item");
+    }
 
-        int id = get_item_store().create(name, description, price);
-        auto item = get_item_store().get(id);
+    res->set_status(201, "Created");
+    res->set_content_type("application/json");
+    res->set_body(item->to_json());
+    return hh_web::exit_code::EXIT;
+}
 
-        auto x = item.to_json();
+hh_web::web_result update_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    auto id = get_id_from_request(req);
+    if (!id)
+    {
+        return id.error();
+    }
+    auto fields = parse_item_fields(req->get_body());
+    if (!fields)
+    {
+        return fields.error();
+    }
 
-        res->set_status(201, "Created");
-        res->set_content_type("application/json");
-        res->set_body(item.to_json());
-        return hh_web::exit_code::EXIT;
+    if (!get_item_store().try_update(*id, fields->name, fields->description, fields->price))
+    {
+        return hh_web::web_error::not_found("Item not found");
     }
-    catch (hh_web::web_exception &e)
+    auto item = get_item_store().find(*id);
+    if (!item)
     {
-        res->set_status(e.get_status_code(), e.get_status_message());
-        res->set_content_type("application/json");
-        JsonObject json_error;
-        json_error.insert("error", maker::make_string("Failed To Create Item"));
-        res->set_body(json_error.stringify());
-        return hh_web::exit_code::EXIT;
+        return hh_web::web_error::not_found("Item not found");
     }
-    catch (const std::exception &e)
+
+    res->set_status(200, "OK");
+    res->set_content_type("application/json");
+    res->set_body(item->to_json());
+    return hh_web::exit_code::EXIT;
+}
+
+// The bulk routes take a JSON array and answer 200 with one result per element, in order:
+// {"succeeded": 1, "failed": 1, "results": [{"status": 201, "id": 7}, {"status": 400, "error": "Invalid item JSON"}]}
+// Each status is what the single-item route would have answered. A bad element fails on its
+// own, the store is called once for all the others.
+constexpr std::size_t max_bulk_items = 10000;
+
+struct bulk_result
+{
+    int status = 200;
+    int id = 0; // 0 when the element had no usable ID
+    std::string error;
+};
+
+hh_web::web_expected<std::vector<std::string_view>> get_bulk_elements(const std::string &body)
+{
+    auto elements = hh_web::json_array_elements(body);
+    if (!elements)
     {
-        res->set_status(500, "Internal Server Error");
-        res->set_content_type("application/json");
-        JsonObject json_error;
-        json_error.insert("error", maker::make_string("Failed To Create Item, Internal Server Error"));
-        res->set_body(json_error.stringify());
-        return hh_web::exit_code::EXIT;
+        return hh_web::web_error::bad_request("Bulk body must be a JSON array");
     }
+    if (elements->size() > max_bulk_items)
+    {
+        return hh_web::web_error(413, "Payload Too Large", "Bulk requests hold at most " + std::to_string(max_bulk_items) + " items");
+    }
+    return std::move(*elements);
 }
 
-hh_web::exit_code update_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+hh_web::web_result send_bulk_results(const std::shared_ptr<hh_web::web_response> &res, const std::vector<bulk_result> &results)
 {
-    try
+    std::size_t failed = std::count_if(results.begin(), results.end(), [](const bulk_result &result)
+                                       { return result.status >= 400; });
+
+    hh_web::json_writer json;
+    json.begin_object();
+    json.member("succeeded", results.size() - failed);
+    json.member("failed", failed);
+    json.key("results").begin_array();
+    for (const auto &result : results)
     {
-        int id = get_id_from_request(req);
-        std::string name, description;
-        double price;
+        json.begin_object();
+        json.member("status", result.status);
+        if (result.id != 0)
+        {
+            json.member("id", result.id);
+        }
+        if (!result.error.empty())
+        {
+            json.member("error", result.error);
+        }
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
 
-        auto json = parse(req->get_body());
-        name = getter::get_string(json["name"]);
-        description = getter::get_string(json["description"]);
-        price = getter::get_number(json["price"]);
+    res->set_status(200, "OK");
+    res->send_json(json);
+    return hh_web::exit_code::EXIT;
+}
 
-        get_item_store().update(id, name, description, price);
-        auto item = get_item_store().get(id);
+hh_web::web_result bulk_create_items_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    std::string body = req->get_body();
+    auto elements = get_bulk_elements(body);
+    if (!elements)
+    {
+        return elements.error();
+    }
 
-        res->set_status(200, "OK");
-        res->set_content_type("application/json");
-        res->set_body(item.to_json());
-        return hh_web::exit_code::EXIT;
+    std::vector<bulk_result> results(elements->size());
+    std::vector<item_fields> batch;
+    std::vector<std::size_t> positions; // positions[i]: the element batch[i] came from
+    batch.reserve(elements->size());
+    positions.reserve(elements->size());
+    for (std::size_t i = 0; i < elements->size(); ++i)
+    {
+        auto fields = parse_item_fields(std::string((*elements)[i]));
+        if (!fields)
+        {
+            results[i] = {fields.error().status_code, 0, fields.error().message};
+            continue;
+        }
+        batch.push_back(std::move(*fields));
+        positions.push_back(i);
     }
-    catch (hh_web::web_exception &e)
+
+    std::vector<int> ids = get_item_store().create_many(std::move(batch));
+    for (std::size_t i = 0; i < ids.size(); ++i)
     {
-        res->set_status(e.get_status_code(), e.get_status_message());
-        res->set_content_type("application/json");
-        JsonObject json_error;
-        json_error.insert("error", maker::make_string("Failed To Update Item"));
-        res->set_body(json_error.stringify());
-        return hh_web::exit_code::EXIT;
+        results[positions[i]] = {201, ids[i], ""};
+    }
+    return send_bulk_results(res, results);
+}
+
+// Like parse_item_fields, with the "id" each element of a bulk update carries
+hh_web::web_expected<std::pair<int, item_fields>> parse_item_update(const std::string &body)
+{
+    try
+    {
+        auto json = parse(body);
+        double id = getter::get_number(json["id"]);
+        if (id < 1 || id > std::numeric_limits<int>::max() || id != static_cast<int>(id))
+        {
+            return hh_web::web_error::bad_request("Invalid ID");
+        }
+        item_fields fields;
+        fields.name = getter::get_string(json["name"]);
+        fields.description = getter::get_string(json["description"]);
+        fields.price = getter::get_number(json["price"]);
+        return std::make_pair(static_cast<int>(id), std::move(fields));
     }
     catch (const std::exception &e)
     {
-        res->set_status(500, "Internal Server Error");
-        res->set_content_type("application/json");
-        JsonObject json_error;
-        json_error.insert("error", maker::make_string("Failed To Update Item"));
-        res->set_body(json_error.stringify());
-        return hh_web::exit_code::EXIT;
+        return hh_web::web_error::bad_request("Invalid item JSON");
     }
 }
 
-hh_web::exit_code index_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+hh_web::web_result bulk_update_items_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    std::string body = req->get_body();
+    auto elements = get_bulk_elements(body);
+    if (!elements)
+    {
+        return elements.error();
+    }
+
+    std::vector<bulk_result> results(elements->size());
+    std::vector<std::pair<int, item_fields>> batch;
+    std::vector<std::size_t> positions;
+    batch.reserve(elements->size());
+    positions.reserve(elements->size());
+    for (std::size_t i = 0; i < elements->size(); ++i)
+    {
+        auto update = parse_item_update(std::string((*elements)[i]));
+        if (!update)
+        {
+            results[i] = {update.error().status_code, 0, update.error().message};
+            continue;
+        }
+        results[i].id = update->first;
+        batch.push_back(std::move(*update));
+        positions.push_back(i);
+    }
+
+    std::vector<bool> updated = get_item_store().update_many(std::move(batch));
+    for (std::size_t i = 0; i < updated.size(); ++i)
+    {
+        bulk_result &result = results[positions[i]];
+        result.status = updated[i] ? 200 : 404;
+        result.error = updated[i] ? "" : "Item not found";
+    }
+    return send_bulk_results(res, results);
+}
+
+// Body: an array of IDs, [1, 2, 3]
+hh_web::web_result bulk_delete_items_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    std::string body = req->get_body();
+    auto elements = get_bulk_elements(body);
+    if (!elements)
+    {
+        return elements.error();
+    }
+
+    std::vector<bulk_result> results(elements->size());
+    std::vector<int> ids;
+    std::vector<std::size_t> positions;
+    ids.reserve(elements->size());
+    positions.reserve(elements->size());
+    for (std::size_t i = 0; i < elements->size(); ++i)
+    {
+        std::string_view element = (*elements)[i];
+        int id = 0;
+        auto [end, error] = std::from_chars(element.data(), element.data() + element.size(), id);
+        if (error != std::errc() || end != element.data() + element.size())
+        {
+            results[i] = {400, 0, "Invalid ID: " + std::string(element)};
+            continue;
+        }
+        ids.push_back(id);
+        positions.push_back(i);
+    }
+
+    std::vector<bool> removed = get_item_store().remove_many(ids);
+    for (std::size_t i = 0; i < removed.size(); ++i)
+    {
+        results[positions[i]] = {removed[i] ? 204 : 404, ids[i], removed[i] ? "" : "Item not found"};
+    }
+    return send_bulk_results(res, results);
+}
+
+// With ITEM_STORE_SHARDS=N the server runs N shards, each owning a partition of a second
+// store served under /api/sharded/items. The handlers parse and answer on the request
+// workers, only the store operation goes to the shard owning the item.
+std::unique_ptr<PartitionedItemStore> partitioned_store;
+
+hh_web::exit_code sharded_get_all_items_handler(std::shared_ptr<hh_web::web_request>, std::shared_ptr<hh_web::web_response> res)
 {
+    hh_web::json_writer json;
+    json.value(partitioned_store->get_all());
+    res->set_status(200, "OK");
+    res->send_json(json);
+    return hh_web::exit_code::EXIT;
+}
 
-    std::string html_doc = R"(
-        
-        <!DOCTYPE html>
-        <html lang="en">
-        <head>
-            <meta charset="UTF-8">
-            <meta name="viewport" content="width=device-width, initial-scale=1.0">
-            <title>Item Store API</title>
-            <link rel="stylesheet" href="/style.css">
-        </head>
-        <body>
-            <div class="container">
-                <h1>Welcome to the Item Store API</h1>
-                <p>This is a simple RESTful API for managing items.</p>
-                <h2>Available Endpoints:</h2>
-                <ul>
-                    <li><strong>GET /api/items</strong> - Retrieve all items</li>
-                    <li><strong>GET /api/items/:id</strong> - Retrieve a specific item by ID</li>
-                    <li><strong>POST /api/items</strong> - Create a new item (JSON body required)</li>
-                    <li><strong>PUT /api/items/:id</strong> - Update an existing item by ID (JSON body required)</li>
-                    <li><strong>DELETE /api/items/:id</strong> - Delete an item by ID</li>
-                </ul>
-                <h2>Example JSON Body for POST/PUT:</h2>
-                <pre>
-                {   
-                    "name": "Item Name",
-                    "description": "Item Description",
-                    "price": 19.99  
-                    }
-                </pre>
-                <p>Replace <code>:id</code> with the actual item ID.</p>
-                <p>All responses are in JSON format.</p>
-            </div>
-        </body>
-        </html>
-
-    )";
+hh_web::web_result sharded_get_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    auto id = get_id_from_request(req);
+    if (!id)
+    {
+        return id.error();
+    }
+    auto item = partitioned_store->find(*id);
+    if (!item)
+    {
+        return hh_web::web_error::not_found("Item not found");
+    }
 
     res->set_status(200, "OK");
-    res->send_html(html_doc);
+    res->set_content_type("application/json");
+    res->set_body(item->to_json());
     return hh_web::exit_code::EXIT;
 }
 
-hh_web::exit_code un_matched_route_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+hh_web::web_result sharded_create_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
 {
-    res->set_status(404, "Not Found");
+    auto fields = parse_item_fields(req->get_body());
+    if (!fields)
+    {
+        return fields.error();
+    }
+
+    int id = partitioned_store->create(fields->name, fields->description, fields->price);
+    hh_web::json_writer json;
+    json.begin_object();
+    json.member("id", id);
+    json.member("name", fields->name);
+    json.member("description", fields->description);
+    json.member("price", fields->price);
+    json.end_object();
+
+    res->set_status(201, "Created");
+    res->send_json(json);
+    return hh_web::exit_code::EXIT;
+}
 
-    // For API requests, return JSON
-    if (req->get_path().substr(0, 5) == "/api/")
+hh_web::web_result sharded_update_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    auto id = get_id_from_request(req);
+    if (!id)
     {
-        res->set_content_type("application/json");
-        res->set_body("{\"error\": \"Resource not found\"}");
+        return id.error();
     }
-    else
+    auto fields = parse_item_fields(req->get_body());
+    if (!fields)
     {
-        // For web requests, return HTML
-        std::string four04 = R"(
+        return fields.error();
+    }
+    if (!partitioned_store->try_update(*id, fields->name, fields->description, fields->price))
+    {
+        return hh_web::web_error::not_found("Item not found");
+    }
+
+    hh_web::json_writer json;
+    json.begin_object();
+    json.member("id", *id);
+    json.member("name", fields->name);
+    json.member("description", fields->description);
+    json.member("price", fields->price);
+    json.end_object();
+
+    res->set_status(200, "OK");
+    res->send_json(json);
+    return hh_web::exit_code::EXIT;
+}
+
+hh_web::web_result sharded_delete_item_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    auto id = get_id_from_request(req);
+    if (!id)
+    {
+        return id.error();
+    }
+    if (!partitioned_store->try_remove(*id))
+    {
+        return hh_web::web_error::not_found("Item Not Found");
+    }
+    res->set_status(204, "No Content");
+    return hh_web::exit_code::EXIT;
+}
+
+// Compiled once, each request only fills in the item rows
+const auto index_page = hh_web::html_template::compile(R"(<!DOCTYPE html>
+<html lang="en">
+<head>
+    <meta charset="UTF-8">
+    <meta name="viewport" content="width=device-width, initial-scale=1.0">
+    <title>{{app}}</title>
+    <link rel="stylesheet" href="/style.css">
+</head>
+<body>
+    <div class="container">
+        <h1>Welcome to the {{app}}</h1>
+        <p>This is a simple RESTful API for managing items.</p>
+        <h2>Available Endpoints:</h2>
+        <ul>
+            <li><strong>GET /api/items</strong> - Retrieve all items</li>
+            <li><strong>GET /api/items/search?q=...&amp;limit=10</strong> - Search names and descriptions, best matches first</li>
+            <li><strong>GET /api/items/:id</strong> - Retrieve a specific item by ID</li>
+            <li><strong>POST /api/items</strong> - Create a new item (JSON body required)</li>
+            <li><strong>PUT /api/items/:id</strong> - Update an existing item by ID (JSON body required)</li>
+            <li><strong>DELETE /api/items/:id</strong> - Delete an item by ID</li>
+            <li><strong>POST /api/items/bulk</strong> - Create many items (JSON array of items)</li>
+            <li><strong>PUT /api/items/bulk</strong> - Update many items (JSON array of items with their "id")</li>
+            <li><strong>DELETE /api/items/bulk</strong> - Delete many items (JSON array of IDs)</li>
+            <li><strong>GET /api/session</strong> - Count your visits in a cookie session</li>
+            <li><strong>DELETE /api/session</strong> - End your session</li>
+        </ul>
+        <h2>Items in the store:</h2>
+        <ul>
+            {{#items}}<li><a href="/api/items/{{id}}">{{name}}</a> - {{description}} ({{price}})</li>
+            {{/items}}{{^items}}<li>No items yet</li>{{/items}}
+        </ul>
+        <h2>Example JSON Body for POST/PUT:</h2>
+        <pre>
+        {
+            "name": "Item Name",
+            "description": "Item Description",
+            "price": 19.99
+        }
+        </pre>
+        <p>Replace <code>:id</code> with the actual item ID.</p>
+        <p>All responses are in JSON format.</p>
+    </div>
+</body>
+</html>
+)",
+                                                       {{"app", "Item Store API"}});
+
+hh_web::exit_code index_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    static const std::size_t items = index_page.slot("items"), id = index_page.slot("id"), name = index_page.slot("name"),
+                             description = index_page.slot("description"), price = index_page.slot("price");
+
+    auto ctx = index_page.context();
+    for (const auto &item : get_item_store().get_all())
+    {
+        char formatted[32];
+        std::snprintf(formatted, sizeof(formatted), "%.2f", item.price);
+
+        auto &row = ctx.add(items);
+        row.set(id, std::to_string(item.id));
+        row.set(name, item.name);
+        row.set(description, item.description);
+        row.set(price, formatted);
+    }
+
+    res->set_status(200, "OK");
+    res->send_template(index_page, ctx);
+    return hh_web::exit_code::EXIT;
+}
+
+// Rendered once: unmatched routes are what scanners and bots hit most, so nothing is built per request
+const auto api_not_found = std::make_shared<const hh_web::canned_response>(
+    404, "Not Found", "{\"error\": \"Resource not found\"}", "application/json");
+
+const auto page_not_found = std::make_shared<const hh_web::canned_response>(404, "Not Found", R"(
            
             <!DOCTYPE html>
             <html lang="en">
@@ -321,46 +627,34 @@ hh_web::exit_code un_matched_route_handler(std::shared_ptr<hh_web::web_request>
                 </div>
             </body>
             </html>
-)";
+)",
+    "text/html");
 
-        res->send_html(four04);
+hh_web::exit_code un_matched_route_handler(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    // For API requests, return JSON, for web requests HTML
+    if (req->get_path().compare(0, 5, "/api/") == 0)
+    {
+        res->send_canned(api_not_found);
+    }
+    else
+    {
+        res->send_canned(page_not_found);
     }
 
     return hh_web::exit_code::EXIT;
 }
 
-hh_web::exit_code json_cheacker(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+hh_web::web_result json_cheacker(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response>)
 {
-    try
-    {
-        if (hh_web::body_has_malicious_content(req->get_body()))
-        {
-            hh_web::logger::error("Malicious content detected");
-            hh_web::logger::error("Body:\n" + req->get_body());
-            hh_web::logger::error("\n\n");
-            throw hh_web::web_exception("Malicious content detected", 500, "Internal Server Error");
-        }
-        return hh_web::exit_code::CONTINUE;
-    }
-    catch (hh_web::web_exception &e)
+    if (hh_web::body_has_malicious_content(req->get_body()))
     {
-        res->set_status(e.get_status_code(), e.get_status_message());
-        res->set_content_type("application/json");
-        JsonObject json_error;
-        json_error.insert("error", maker::make_string("Malicious content detected"));
-        res->set_body(json_error.stringify());
-
-        return hh_web::exit_code::EXIT;
+        hh_web::logger::error("Malicious content detected");
+        hh_web::logger::error("Body:\n" + req->get_body());
+        hh_web::logger::error("\n\n");
+        return hh_web::web_error::internal("Malicious content detected");
     }
-    catch (const std::exception &e)
-    {
-        res->set_status(400, "Bad Request");
-        res->set_content_type("application/json");
-        res->set_body("{\"error\": \"Invalid JSON format\"}");
-        return hh_web::exit_code::EXIT;
-    }
-
-    return hh_web::exit_code::EXIT;
+    return hh_web::exit_code::CONTINUE;
 }
 
 // Main application entry point
@@ -383,6 +677,9 @@ int main()
         // Create server instance
         auto server = std::make_shared<hh_web::web_server<>>(port, host);
 
+        // Drop requests that could not be answered within 5 seconds (503 if still queued, 504 if running)
+        server->use_request_timeout(std::chrono::milliseconds(5000));
+
         // Create API router
         auto api_router = std::make_shared<hh_web::web_router<>>();
 
@@ -398,34 +695,101 @@ int main()
 
         api_router->add_route(all_items_route);
 
+        // Handlers returning hh_web::web_result answer expected errors (bad IDs, unknown items,
+        // malformed JSON) without throwing, result_handler adapts them to the route's handler type
+        using hh_web::json_body_validator;
+        using hh_web::result_handler;
+
+        // POST/PUT/DELETE /api/items/bulk - many items per request, one store lock per batch.
+        // Registered before /api/items/:id, which would take "bulk" for an ID. Bodies up to 4 MiB
+        // (hh_http::config::MAX_BODY_SIZE has to allow them too)
+        auto bulk_body = json_body_validator<>(64, 4 * 1024 * 1024);
+        api_router->add_route(std::make_shared<web_route<>>(POST, "/api/items/bulk", V({bulk_body, result_handler(json_cheacker), result_handler(bulk_create_items_handler)})));
+        api_router->add_route(std::make_shared<web_route<>>(PUT, "/api/items/bulk", V({bulk_body, result_handler(json_cheacker), result_handler(bulk_update_items_handler)})));
+        api_router->delete_("/api/items/bulk", V({bulk_body, result_handler(json_cheacker), result_handler(bulk_delete_items_handler)}));
+
+        // GET /api/items/search?q=blue+pen&limit=10 - full-text search, before /api/items/:id for the same reason
+        api_router->get("/api/items/search", V({result_handler(search_items_handler)}));
+
         // GET /api/items/:id - Get specific item
-        auto specific_item_route = std::make_shared<web_route<>>(GET, "/api/items/:id", V({get_specific_item_handler}));
+        auto specific_item_route = std::make_shared<web_route<>>(GET, "/api/items/:id", V({result_handler(get_specific_item_handler)}));
 
         api_router->add_route(specific_item_route);
 
-        // POST /api/items - Create new item
-        auto create_new_item_route = std::make_shared<web_route<>>(POST, "/api/items", V({json_cheacker, create_new_item_handler}));
+        // POST /api/items - Create new item; malformed JSON is answered with 400 before anything parses it
+        auto create_new_item_route = std::make_shared<web_route<>>(POST, "/api/items", V({json_body_validator<>(), result_handler(json_cheacker), result_handler(create_new_item_handler)}));
         api_router->add_route(create_new_item_route);
 
         // PUT /api/items/:id - Update item
-        auto update_item_route = std::make_shared<web_route<>>(PUT, "/api/items/:id", V({json_cheacker, update_item_handler}));
+        auto update_item_route = std::make_shared<web_route<>>(PUT, "/api/items/:id", V({json_body_validator<>(), result_handler(json_cheacker), result_handler(update_item_handler)}));
         api_router->add_route(update_item_route);
 
         // DELETE /api/items/:id - Delete item
-        api_router->delete_("/api/items/:id", V({delete_item_handler}));
+        api_router->delete_("/api/items/:id", V({result_handler(delete_item_handler)}));
 
         auto index = std::make_shared<web_route<>>(GET, "/", V({index_handler}));
 
         api_router->add_route(index);
 
+        // Optional shared-nothing store: ITEM_STORE_SHARDS=4 ./app
+        const char *shard_count = std::getenv("ITEM_STORE_SHARDS");
+        if (shard_count && std::atoi(shard_count) > 0)
+        {
+            server->use_shards(static_cast<unsigned int>(std::atoi(shard_count)));
+            partitioned_store = std::make_unique<PartitionedItemStore>(*server->get_shards());
+
+            api_router->get("/api/sharded/items", V({sharded_get_all_items_handler}));
+            api_router->get("/api/sharded/items/:id", V({result_handler(sharded_get_item_handler)}));
+            api_router->post("/api/sharded/items", V({json_body_validator<>(), result_handler(json_cheacker), result_handler(sharded_create_item_handler)}));
+            api_router->put("/api/sharded/items/:id", V({json_body_validator<>(), result_handler(json_cheacker), result_handler(sharded_update_item_handler)}));
+            api_router->delete_("/api/sharded/items/:id", V({result_handler(sharded_delete_item_handler)}));
+        }
+
+        // Sessions: one "session" cookie per client, expired through the server's timing wheel after
+        // 30 unused minutes; beyond 100000 sessions the least recently used are evicted. Declared
+        // after the server, so it is destroyed before the wheel it uses
+        hh_web::session_store sessions(hh_web::session_config(), &server->get_timers());
+
+        // GET /api/session - this client's visits, counted in its session
+        api_router->get("/api/session", V({hh_web::session_middleware<>(sessions), [&sessions](std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+                                           {
+                                               int visits = 0;
+                                               sessions.update(req->get_param(hh_web::session_store::id_param), [&visits](hh_web::session_store::values_t &values)
+                                                               {
+                                                                   visits = std::atoi(values["visits"].c_str()) + 1;
+                                                                   values["visits"] = std::to_string(visits); });
+
+                                               hh_web::json_writer json;
+                                               json.begin_object();
+                                               json.member("visits", visits);
+                                               json.member("sessions", sessions.size());
+                                               json.end_object();
+                                               res->set_status(200, "OK");
+                                               res->send_json(json);
+                                               return hh_web::exit_code::EXIT; }}));
+
+        // DELETE /api/session - end the session and drop its cookie
+        api_router->delete_("/api/session", V({[&sessions](std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+                                               {
+                                                   const std::string &cookie = sessions.get_config().cookie_name;
+                                                   sessions.destroy(req->get_cookie(cookie));
+                                                   res->add_cookie(cookie, "", "Path=/; Max-Age=0");
+                                                   res->set_status(204, "No Content");
+                                                   return hh_web::exit_code::EXIT; }}));
+
         // Register router with server
         server->use_router(api_router);
 
         // Register static files directory
         server->use_static("static");
 
-        // Custom 404 handler
+        // POST /api/batch - several item requests in one round trip, e.g.
+        // {"requests": [{"path": "/api/items/1"}, {"path": "/api/items/2"}]}
+        server->use_batch("/api/batch");
+
+        // Custom 404 handler, missing static files get the same page
         server->use_default(un_matched_route_handler);
+        server->get_canned_responses().set(page_not_found);
 
         server->use_headers_received([](HEADER_RECEIVED_PARAMS)
                                      { hh_web::logger::info("Headers received");
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+namespace hh_web
+{
+    /**
+     * @brief Cooperative cancellation token carried by every web_request.
+     *
+     * The token records the moment the request was received and an optional
+     * deadline. The deadline may only ever be tightened: server defaults, the
+     * request's timeout header and per-route timeouts each call set_timeout(),
+     * and the earliest one wins.
+     *
+     * The framework checks the token when a request is dequeued from the worker
+     * pool and between middleware/handler steps. Long running handlers should poll
+     * is_cancelled() themselves and stop early when it returns true.
+     *
+     * @note All methods are thread-safe, the token may be handed to other threads
+     *       as long as the owning request is alive (or the shared_ptr is kept).
+     */
+    class cancellation_token
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+    private:
+        /// Time the request was received, timeouts are measured from this point
+        const clock::time_point created_at;
+
+        /// Deadline as ticks since the clock epoch, max() means "no deadline"
+        std::atomic<clock::rep> deadline_ticks;
+
+        /// Set once the token got cancelled explicitly or its deadline passed
+        mutable std::atomic<bool> cancelled;
+
+    public:
+        /// Create a token without a deadline, the creation time is taken as now
+        cancellation_token()
+            : created_at(clock::now()), deadline_ticks(clock::time_point::max().time_since_epoch().count()), cancelled(false)
+        {
+        }
+
+        cancellation_token(const cancellation_token &) = delete;
+        cancellation_token &operator=(const cancellation_token &) = delete;
+
+        /**
+         * @brief Tighten the deadline to created_at + timeout.
+         * @param timeout Maximum time the request may take, measured from its arrival
+         * @note Non-positive timeouts are ignored, a later deadline never replaces an earlier one.
+         *       Timeouts reaching past the end of the clock saturate to "no deadline".
+         */
+        void set_timeout(std::chrono::milliseconds timeout) noexcept
+        {
+            if (timeout.count() <= 0)
+                return;
+
+            // created_at + timeout would overflow the clock's ticks
+            auto headroom = std::chrono::duration_cast<std::chrono::milliseconds>(clock::time_point::max() - created_at);
+            if (timeout >= headroom)
+                return;
+
+            clock::rep candidate = (created_at + timeout).time_since_epoch().count();
+            clock::rep current = deadline_ticks.load(std::memory_order_relaxed);
+            while (candidate < current &&
+                   !deadline_ticks.compare_exchange_weak(current, candidate, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        /// @brief Check whether a deadline was set at all
+        bool has_deadline() const noexcept
+        {
+            return deadline_ticks.load(std::memory_order_relaxed) != clock::time_point::max().time_since_epoch().count();
+        }
+
+        /// @brief Get the current deadline, clock::time_point::max() when there is none
+        clock::time_point get_deadline() const noexcept
+        {
+            return clock::time_point(clock::duration(deadline_ticks.load(std::memory_order_relaxed)));
+        }
+
+        /// @brief Get the time the request was received
+        clock::time_point get_created_at() const noexcept
+        {
+            return created_at;
+        }
+
+        /// @brief Time left until the deadline, zero when expired, milliseconds::max() when there is no deadline
+        std::chrono::milliseconds remaining() const noexcept
+        {
+            if (!has_deadline())
+                return std::chrono::milliseconds::max();
+
+            auto now = clock::now();
+            auto deadline = get_deadline();
+            if (now >= deadline)
+                return std::chrono::milliseconds(0);
+            return std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+        }
+
+        /// @brief Cancel the request explicitly, subsequent is_cancelled() calls return true
+        void cancel() noexcept
+        {
+            cancelled.store(true, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Check whether the request should stop.
+         * @return true if cancel() was called or the deadline has passed
+         */
+        bool is_cancelled() const noexcept
+        {
+            if (cancelled.load(std::memory_order_relaxed))
+                return true;
+
+            if (has_deadline() && clock::now() >= get_deadline())
+            {
+                cancelled.store(true, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+    };
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hh_web
+{
+    /**
+     * @brief A response rendered once and sent as it is, e.g. a 404 page.
+     *
+     * Status, headers (Content-Type and Content-Length included) and body are fixed at
+     * construction and serialized into one immutable HTTP/1.1 buffer. Writers that own the
+     * bytes (the HTTP/1.1 side of http2_listener) append the buffer and only add the
+     * Connection header of the connection; the others take status, headers and body as built.
+     *
+     * Shared between threads through std::shared_ptr<const canned_response>.
+     */
+    class canned_response
+    {
+    private:
+        int status_code;
+        std::string status_message;
+        std::vector<std::pair<std::string, std::string>> headers;
+
+        /// Status line and header lines, each ending with CRLF, then the body
+        std::string wire;
+
+        /// Size of the status and header lines in wire, the body follows
+        std::size_t head_size = 0;
+
+    public:
+        /**
+         * @brief Render a response.
+         * @param status_code HTTP status code
+         * @param status_message HTTP status message
+         * @param body Response body
+         * @param content_type Content-Type of the body
+         * @param headers Further headers, e.g. Cache-Control; Connection is added per connection
+         */
+        canned_response(int status_code, std::string status_message, const std::string &body,
+                        const std::string &content_type = "text/plain",
+                        std::vector<std::pair<std::string, std::string>> headers = {});
+
+        int get_status_code() const noexcept
+        {
+            return status_code;
+        }
+
+        const std::string &get_status_message() const noexcept
+        {
+            return status_message;
+        }
+
+        /// @brief All headers, Content-Type and Content-Length included
+        const std::vector<std::pair<std::string, std::string>> &get_headers() const noexcept
+        {
+            return headers;
+        }
+
+        /// @brief Status line and header lines, without the empty line ending the head
+        std::string_view get_head() const noexcept
+        {
+            return std::string_view(wire.data(), head_size);
+        }
+
+        std::string_view get_body() const noexcept
+        {
+            return std::string_view(wire.data() + head_size, wire.size() - head_size);
+        }
+
+        /**
+         * @brief Append the response as HTTP/1.1 bytes.
+         * @param out Output buffer of the connection
+         * @param keep_alive Whether the connection stays open (Connection: keep-alive or close)
+         * @param head_only Leave out the body, for HEAD requests
+         */
+        void append_http1(std::string &out, bool keep_alive, bool head_only = false) const;
+    };
+
+    /**
+     * @brief Canned responses by status code, plus named pages.
+     *
+     * Comes with plain-text responses ("404 Not Found") for 400, 404, 405, 408, 413, 429,
+     * 500, 502, 503 and 504, which web_server sends for unmatched routes, unknown methods,
+     * expired deadlines and unhandled exceptions. Replace them to change those answers for
+     * the whole server:
+     * @code
+     * server->get_canned_responses().set(404, "Not Found", not_found_html, "text/html");
+     * server->get_canned_responses().set_page("maintenance", std::make_shared<hh_web::canned_response>(503, "Service Unavailable", page, "text/html"));
+     * @endcode
+     *
+     * @note Thread-safe. Entries are meant to be set before serving, lookups take a shared lock.
+     */
+    class canned_responses
+    {
+    private:
+        mutable std::shared_mutex mutex;
+        mutable std::unordered_map<int, std::shared_ptr<const canned_response>> by_status;
+        std::unordered_map<std::string, std::shared_ptr<const canned_response>> pages;
+
+    public:
+        /// @brief Registry with the default plain-text responses
+        canned_responses();
+
+        canned_responses(const canned_responses &) = delete;
+        canned_responses &operator=(const canned_responses &) = delete;
+
+        /// @brief Render and register the response for a status code, replacing the current one
+        void set(int status_code, const std::string &status_message, const std::string &body, const std::string &content_type = "text/plain");
+
+        /// @brief Register a response under its status code
+        void set(std::shared_ptr<const canned_response> response);
+
+        /// @brief Register a response under a name, for pages that are not the answer to a status
+        void set_page(const std::string &name, std::shared_ptr<const canned_response> response);
+
+        /**
+         * @brief The response for a status code.
+         * @return The registered response, or a plain-text "<code> <message>" rendered on
+         *         first use and kept; the default 500 for codes outside 100-599
+         */
+        std::shared_ptr<const canned_response> get(int status_code, const std::string &status_message = "") const;
+
+        /// @brief The page registered under name, nullptr if there is none
+        std::shared_ptr<const canned_response> get_page(const std::string &name) const;
+    };
+}
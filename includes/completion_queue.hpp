@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+#include "mpsc_queue.hpp"
+#include "web_response.hpp"
+
+namespace hh_web
+{
+    /**
+     * @brief Finished responses on their way from the workers back to their reactor.
+     *
+     * With web_server::use_completion_queue() a worker does not write to the socket when a
+     * handler sends: web_response::send() only finalizes the headers, and once the request
+     * is done the response is pushed here. Each reactor owns one queue and one I/O thread
+     * that sleeps on an eventfd, drains everything that accumulated and writes it out in one
+     * batch. All writes of a reactor's connections are then made by a single thread instead
+     * of whichever worker finished, and workers never wait on a socket.
+     *
+     * @note The eventfd is only written when the queue goes from idle to signalled, a burst of
+     *       completions costs one wakeup.
+     * @note hh_http gives no access to its event loop, so the flusher is a thread of its own, not
+     *       the reactor's loop. It calls http_response::send() and end() from that thread, exactly
+     *       as workers do without the queue, and relies on hh_http's support for that. Each
+     *       response is still its own send(), batching only saves wakeups and worker time.
+     *       Per response, web_response serializes send() and complete() under its send lock.
+     */
+    class completion_queue
+    {
+    private:
+        mpsc_queue<std::shared_ptr<web_response>> queue;
+
+        /// Wakes the flusher thread
+        int event_fd = -1;
+
+        /// Set by the first push after a drain started, cleared by the flusher
+        std::atomic<bool> signalled{false};
+
+        std::thread flusher;
+        std::atomic<bool> running{false};
+
+        std::atomic<std::size_t> flushed{0};
+        std::atomic<std::size_t> batches{0};
+
+        void run();
+
+    public:
+        completion_queue() = default;
+        ~completion_queue();
+
+        completion_queue(const completion_queue &) = delete;
+        completion_queue &operator=(const completion_queue &) = delete;
+
+        /**
+         * @brief Hand a finished response to the flusher, callable from any thread.
+         * @note Responses pushed while the queue is stopped are completed on the calling thread.
+         * @param response The response to write and end
+         */
+        void push(std::shared_ptr<web_response> response);
+
+        /**
+         * @brief Write and end every queued response.
+         * @note Consumer side, called by the flusher thread (and by stop()).
+         * @return Number of responses completed
+         */
+        std::size_t flush();
+
+        /// @brief Create the eventfd and start the flusher thread, does nothing if already running
+        void start();
+
+        /**
+         * @brief Stop the flusher thread after completing what is queued.
+         * @note Stop the producers (the workers) first, the eventfd stays open until destruction.
+         */
+        void stop();
+
+        /// @brief Check whether the flusher thread is running
+        bool is_running() const
+        {
+            return running.load();
+        }
+
+        /// @brief Number of responses written so far
+        std::size_t get_flushed() const
+        {
+            return flushed.load();
+        }
+
+        /// @brief Number of non-empty batches, get_flushed() / get_batches() is the average batch size
+        std::size_t get_batches() const
+        {
+            return batches.load();
+        }
+    };
+}
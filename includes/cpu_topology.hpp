@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hh_web
+{
+    /**
+     * @brief Where the server's threads should run (web_server::use_cpu_affinity).
+     */
+    struct cpu_affinity
+    {
+        /// CPUs the server may use, empty for every online CPU
+        std::vector<int> cpus;
+
+        /// Pin each listen loop (reactor) to one CPU
+        bool pin_reactors = true;
+
+        /// Pin the workers, shared pool workers to one CPU each, reactor-local workers to their reactor's NUMA node
+        bool pin_workers = true;
+
+        /// Network interface whose receive queues' IRQ affinity the reactors follow (e.g. "eth0"), empty to ignore
+        std::string nic_interface;
+
+        /// Prefix for /sys and /proc, empty for the live system, a directory to run on a simulated topology
+        std::string root;
+    };
+
+    /**
+     * @brief CPU and NUMA layout of the machine, read from sysfs and procfs.
+     *
+     * Knows the online CPUs, which NUMA node each belongs to and, for a network interface,
+     * on which CPUs its queue interrupts are delivered. plan() turns that into an ordered
+     * list of CPUs for the server's threads: CPUs serving the NIC queues first (so a
+     * connection's packets and its reactor share a core), then the others node by node,
+     * so neighbouring threads share a node and its memory.
+     *
+     * @note All paths are prefixed with a root directory, a copy of the relevant files
+     *       simulates another machine (e.g. a two-socket box on a laptop).
+     */
+    class cpu_topology
+    {
+    private:
+        std::string root;
+
+        std::vector<int> online;
+
+        /// CPUs of each NUMA node, a single node holding every CPU without NUMA information
+        std::vector<std::vector<int>> nodes;
+
+        /// Node of each CPU, indexed by CPU number, -1 for unknown CPUs
+        std::vector<int> cpu_node;
+
+    public:
+        /**
+         * @brief Read the topology.
+         * @param root Prefix for /sys and /proc, empty for the live system
+         */
+        static cpu_topology detect(const std::string &root = "");
+
+        /**
+         * @brief Parse a kernel CPU list such as "0-3,8,10-11".
+         * @return The CPUs in ascending order, empty for an empty or malformed list
+         */
+        static std::vector<int> parse_cpu_list(const std::string &list);
+
+        /**
+         * @brief Pin a thread to a set of CPUs.
+         * @return false if the set is empty or the kernel rejected it (logged)
+         */
+        static bool pin_thread(std::thread::native_handle_type thread, const std::vector<int> &cpus);
+
+        /// @brief Pin the calling thread to a set of CPUs
+        static bool pin_current_thread(const std::vector<int> &cpus);
+
+        /// @brief Get the online CPUs in ascending order
+        const std::vector<int> &get_online_cpus() const
+        {
+            return online;
+        }
+
+        /// @brief Get the number of NUMA nodes (1 without NUMA)
+        std::size_t get_node_count() const
+        {
+            return nodes.size();
+        }
+
+        /// @brief Get the CPUs of a NUMA node, empty for an unknown node
+        std::vector<int> cpus_of_node(std::size_t node) const;
+
+        /// @brief Get the NUMA node of a CPU, -1 if unknown
+        int node_of(int cpu) const;
+
+        /**
+         * @brief CPUs handling the interrupts of an interface's queues, in queue order.
+         * @note Reads /proc/interrupts for IRQs named after the interface (e.g. "eth0-TxRx-3") and
+         *       takes the first CPU of each IRQ's effective (or configured) affinity.
+         */
+        std::vector<int> nic_queue_cpus(const std::string &interface) const;
+
+        /**
+         * @brief Order the allowed CPUs for placing threads.
+         * @return NIC queue CPUs first (if an interface is set), then the remaining CPUs grouped by node
+         */
+        std::vector<int> plan(const cpu_affinity &affinity) const;
+    };
+}
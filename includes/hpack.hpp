@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hh_web
+{
+    /// A header as HPACK sees it, names are lowercase
+    using hpack_header = std::pair<std::string, std::string>;
+
+    /**
+     * @brief HPACK primitives (RFC 7541): static table, integers, string literals and Huffman coding.
+     */
+    class hpack
+    {
+    public:
+        /// Number of entries in the static table, dynamic entries start at index STATIC_TABLE_SIZE + 1
+        static constexpr std::size_t STATIC_TABLE_SIZE = 61;
+
+        /// Per-entry overhead counted against the dynamic table size
+        static constexpr std::size_t ENTRY_OVERHEAD = 32;
+
+        /// Default (and advertised) dynamic table size
+        static constexpr std::size_t DEFAULT_TABLE_SIZE = 4096;
+
+        /// @brief Static table entry for a 1-based index (1..STATIC_TABLE_SIZE)
+        static const hpack_header &static_entry(std::size_t index);
+
+        /**
+         * @brief Find a header in the static table.
+         * @param name_index Receives the index of the first entry with the name, 0 if none
+         * @return Index of the entry matching name and value, 0 if none
+         */
+        static std::size_t find_static(const std::string &name, const std::string &value, std::size_t &name_index);
+
+        /**
+         * @brief Append an integer with an N-bit prefix.
+         * @param first_byte_flags Bits above the prefix of the first byte (the representation type)
+         */
+        static void encode_integer(std::string &out, std::uint64_t value, int prefix_bits, std::uint8_t first_byte_flags);
+
+        /**
+         * @brief Read an integer with an N-bit prefix.
+         * @param pos Position of the first byte, advanced past the integer
+         * @return false on truncated or oversized input, or more than 5 continuation bytes
+         */
+        static bool decode_integer(const std::uint8_t *data, std::size_t size, std::size_t &pos, int prefix_bits, std::uint64_t &value);
+
+        /// @brief Append a string literal, Huffman coded when that is shorter
+        static void encode_string(std::string &out, const std::string &value);
+
+        /// @brief Read a string literal, false on malformed input
+        static bool decode_string(const std::uint8_t *data, std::size_t size, std::size_t &pos, std::string &value);
+
+        /// @brief Length of the Huffman encoding of a string in bytes
+        static std::size_t huffman_length(const std::string &value);
+
+        /// @brief Append the Huffman encoding of a string, padded with the EOS prefix
+        static void huffman_encode(std::string &out, const std::string &value);
+
+        /**
+         * @brief Decode a Huffman coded string.
+         * @return false for an EOS symbol in the data or padding that is longer than 7 bits or not all ones
+         */
+        static bool huffman_decode(const std::uint8_t *data, std::size_t size, std::string &out);
+    };
+
+    /**
+     * @brief HPACK dynamic table, newest entry first.
+     */
+    class hpack_table
+    {
+    private:
+        std::deque<hpack_header> entries;
+        std::size_t size = 0;
+        std::size_t max_size = hpack::DEFAULT_TABLE_SIZE;
+
+        void evict_to(std::size_t limit);
+
+    public:
+        /// @brief Insert an entry, evicting old ones; an entry larger than the table empties it
+        void add(const hpack_header &header);
+
+        /// @brief Change the maximum size, evicting as needed
+        void set_max_size(std::size_t bytes);
+
+        std::size_t get_max_size() const
+        {
+            return max_size;
+        }
+
+        std::size_t get_size() const
+        {
+            return size;
+        }
+
+        std::size_t get_count() const
+        {
+            return entries.size();
+        }
+
+        /**
+         * @brief Look up a header by HPACK index (static entries first, then this table).
+         * @return nullptr for an index outside both tables
+         */
+        const hpack_header *get(std::size_t index) const;
+
+        /**
+         * @brief Find a header in the static table and this table.
+         * @param name_index Receives an index with the same name, 0 if none
+         * @return Index of a full match, 0 if none
+         */
+        std::size_t find(const std::string &name, const std::string &value, std::size_t &name_index) const;
+    };
+
+    /**
+     * @brief Decodes header blocks of one connection direction.
+     */
+    class hpack_decoder
+    {
+    private:
+        hpack_table table;
+
+        /// Upper bound for table size updates, the SETTINGS_HEADER_TABLE_SIZE this side advertised
+        std::size_t max_table_size = hpack::DEFAULT_TABLE_SIZE;
+
+    public:
+        /// @brief Set the table size limit this endpoint advertised
+        void set_max_table_size(std::size_t bytes)
+        {
+            max_table_size = bytes;
+        }
+
+        /**
+         * @brief Decode a complete header block.
+         * @param max_list_size Limit for the decoded header list (names + values + 32 per field)
+         * @return false on a compression error, the connection must then be closed
+         */
+        bool decode(const std::uint8_t *data, std::size_t size, std::vector<hpack_header> &headers, std::size_t max_list_size = SIZE_MAX);
+
+        const hpack_table &get_table() const
+        {
+            return table;
+        }
+    };
+
+    /**
+     * @brief Encodes header blocks of one connection direction.
+     *
+     * Uses the static table, indexes repeated headers in the dynamic table and sends
+     * volatile values (content-length, :path, etags) without indexing. Credentials
+     * (authorization, cookie, set-cookie) are sent never-indexed.
+     */
+    class hpack_encoder
+    {
+    private:
+        hpack_table table;
+
+        /// Table size update to announce at the start of the next block, SIZE_MAX if none
+        std::size_t pending_size_update = SIZE_MAX;
+
+        /// Smallest size since the last block, announced first when lower than the final one
+        std::size_t pending_minimum_size = SIZE_MAX;
+
+    public:
+        /// @brief Apply the peer's SETTINGS_HEADER_TABLE_SIZE (capped at the default size)
+        void set_max_table_size(std::size_t bytes);
+
+        /// @brief Encode a header list into one header block
+        std::string encode(const std::vector<hpack_header> &headers);
+
+        const hpack_table &get_table() const
+        {
+            return table;
+        }
+    };
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hh_web
+{
+    class html_template;
+
+    namespace detail
+    {
+        /// The compiled form of a template, see src/html_template.cpp
+        struct template_program;
+
+        /// Walks a compiled program, see src/html_template.cpp
+        struct template_renderer;
+    }
+
+    /// @brief Append text to out with &, <, >, " and ' replaced by their HTML entities
+    void append_escaped_html(std::string &out, std::string_view text);
+
+    /**
+     * @brief The values one rendering of an html_template fills its slots with.
+     *
+     * Values are stored by slot, so a context is tied to the template it was made for
+     * (html_template::context()). Slots may be set by name or, cheaper, by the index
+     * html_template::slot() resolved once at startup.
+     *
+     * Sections get a child context per item (add()) or are switched on for this context
+     * (show()). Inside a section, slots missing from the item are looked up in its parents.
+     *
+     * @note A context must not be moved or copied once items were added to it, the items
+     *       refer to it as their parent.
+     */
+    class template_context
+    {
+    private:
+        friend class html_template;
+        friend struct detail::template_renderer;
+
+        /// Kept alive by the root context, items only point at it
+        std::shared_ptr<const detail::template_program> owned;
+        const detail::template_program *program;
+        const template_context *parent;
+
+        /// Values set on this context by slot index, unset ones are looked up in the parent;
+        /// a context sets few slots, so a short list beats a table sized for every slot
+        std::vector<std::pair<std::size_t, std::string>> values;
+
+        /// Items of each section by slot index, created on first use; a deque keeps items in place
+        std::vector<std::unique_ptr<std::deque<template_context>>> items;
+
+        /// Sections switched on for this context by slot index, sized on first use
+        std::vector<bool> shown;
+
+        explicit template_context(std::shared_ptr<const detail::template_program> program);
+        template_context(const detail::template_program *program, const template_context *parent);
+
+        const std::string *find(std::size_t slot) const;
+
+    public:
+        /// @brief Set a slot by name, unknown names are ignored
+        void set(std::string_view name, std::string value);
+
+        /// @brief Set a slot by the index html_template::slot() returned
+        void set(std::size_t slot, std::string value);
+
+        /**
+         * @brief Add an item to a section, the section is rendered once per item.
+         * @return The item's context, valid as long as this context
+         */
+        template_context &add(std::string_view section);
+        template_context &add(std::size_t section);
+
+        /// @brief Render a section once with this context (or, with false, stop doing so)
+        void show(std::string_view section, bool visible = true);
+        void show(std::size_t section, bool visible = true);
+    };
+
+    /**
+     * @brief An HTML template compiled into static chunks and dynamic slots.
+     *
+     * The source is parsed once, at startup, into a flat program: static chunks (the
+     * template's own markup, stored back to back in one shared buffer) and slots that are
+     * filled per rendering. Rendering walks the program and appends to the caller's buffer,
+     * nothing is parsed, looked up by name or built as a tree per request.
+     *
+     * Syntax, a subset of Mustache:
+     * - `{{name}}`: the value of a slot, HTML-escaped
+     * - `{{{name}}}`: the value of a slot as it is, e.g. a fragment rendered by another template
+     * - `{{#name}}...{{/name}}`: a section, rendered once per item added to it, or once when shown
+     * - `{{^name}}...{{/name}}`: an inverted section, rendered when the section has no items and is not shown
+     * - `{{!comment}}`: left out
+     *
+     * Constants given to compile() (an application name, asset URLs) are escaped and folded
+     * into the static chunks right away.
+     *
+     * @code
+     * static const auto page = hh_web::html_template::compile(R"(<h1>{{title}}</h1>
+     * <ul>{{#items}}<li>{{name}}: {{price}}</li>{{/items}}{{^items}}<li>No items</li>{{/items}}</ul>)");
+     *
+     * auto ctx = page.context();
+     * ctx.set("title", "Items");
+     * for (const auto &item : store.get_all())
+     * {
+     *     auto &row = ctx.add("items");
+     *     row.set("name", item.name);
+     *     row.set("price", std::to_string(item.price));
+     * }
+     * res->send_template(page, ctx);
+     * @endcode
+     *
+     * @note Copies share the compiled program. Rendering is const and thread-safe.
+     */
+    class html_template
+    {
+    private:
+        std::shared_ptr<const detail::template_program> compiled;
+
+        explicit html_template(std::shared_ptr<const detail::template_program> compiled);
+
+    public:
+        /// Returned by slot() for names the template does not use
+        static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+        /**
+         * @brief Compile a template.
+         * @param source The template
+         * @param constants Values known at startup, substituted (and escaped) once
+         * @throws web_exception (TEMPLATE_SYNTAX) for an unclosed tag or mismatched section
+         */
+        static html_template compile(std::string_view source, const std::unordered_map<std::string, std::string> &constants = {});
+
+        /// @brief Compile the template stored in a file, throws web_exception (TEMPLATE_NOT_FOUND) if it cannot be read
+        static html_template from_file(const std::string &path, const std::unordered_map<std::string, std::string> &constants = {});
+
+        /// @brief A fresh context for rendering this template
+        template_context context() const;
+
+        /// @brief Index of a slot or section, for template_context::set(std::size_t, ...); npos if the template has no such name
+        std::size_t slot(std::string_view name) const;
+
+        /// @brief Bytes of static markup, a lower bound of the rendered size
+        std::size_t static_size() const noexcept;
+
+        /// @brief Append the rendering to out, e.g. a response body being built
+        void render(const template_context &ctx, std::string &out) const;
+
+        /// @brief The rendering as a string
+        std::string render(const template_context &ctx) const;
+
+        /// @brief Write the rendering to a stream
+        void render(const template_context &ctx, std::ostream &out) const;
+    };
+}
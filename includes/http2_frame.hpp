@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hh_web
+{
+    /// Frame types (RFC 9113 section 6)
+    enum class http2_frame_type : std::uint8_t
+    {
+        DATA = 0x0,
+        HEADERS = 0x1,
+        PRIORITY = 0x2,
+        RST_STREAM = 0x3,
+        SETTINGS = 0x4,
+        PUSH_PROMISE = 0x5,
+        PING = 0x6,
+        GOAWAY = 0x7,
+        WINDOW_UPDATE = 0x8,
+        CONTINUATION = 0x9
+    };
+
+    /// Error codes carried by RST_STREAM and GOAWAY
+    enum class http2_error : std::uint32_t
+    {
+        NO_ERROR = 0x0,
+        PROTOCOL_ERROR = 0x1,
+        INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3,
+        SETTINGS_TIMEOUT = 0x4,
+        STREAM_CLOSED = 0x5,
+        FRAME_SIZE_ERROR = 0x6,
+        REFUSED_STREAM = 0x7,
+        CANCEL = 0x8,
+        COMPRESSION_ERROR = 0x9,
+        CONNECT_ERROR = 0xa,
+        ENHANCE_YOUR_CALM = 0xb,
+        INADEQUATE_SECURITY = 0xc,
+        HTTP_1_1_REQUIRED = 0xd
+    };
+
+    /// SETTINGS parameters
+    enum class http2_setting : std::uint16_t
+    {
+        HEADER_TABLE_SIZE = 0x1,
+        ENABLE_PUSH = 0x2,
+        MAX_CONCURRENT_STREAMS = 0x3,
+        INITIAL_WINDOW_SIZE = 0x4,
+        MAX_FRAME_SIZE = 0x5,
+        MAX_HEADER_LIST_SIZE = 0x6
+    };
+
+    /// Frame flags, their meaning depends on the frame type
+    namespace http2_flags
+    {
+        constexpr std::uint8_t END_STREAM = 0x1;
+        constexpr std::uint8_t ACK = 0x1;
+        constexpr std::uint8_t END_HEADERS = 0x4;
+        constexpr std::uint8_t PADDED = 0x8;
+        constexpr std::uint8_t PRIORITY = 0x20;
+    }
+
+    /**
+     * @brief The 9-byte header in front of every frame, and writers for the frames a server sends.
+     */
+    struct http2_frame
+    {
+        static constexpr std::size_t HEADER_SIZE = 9;
+
+        /// Connection preface every client sends first
+        static constexpr const char *PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+        static constexpr std::size_t PREFACE_SIZE = 24;
+
+        static constexpr std::uint32_t DEFAULT_WINDOW_SIZE = 65535;
+        static constexpr std::uint32_t MAX_WINDOW_SIZE = 0x7fffffff;
+        static constexpr std::uint32_t DEFAULT_MAX_FRAME_SIZE = 16384;
+        static constexpr std::uint32_t MAX_FRAME_SIZE_LIMIT = 16777215;
+
+        std::uint32_t length = 0;
+        std::uint8_t type = 0;
+        std::uint8_t flags = 0;
+        std::uint32_t stream_id = 0;
+
+        /// @brief Read a frame header from HEADER_SIZE bytes
+        static http2_frame parse(const std::uint8_t *data);
+
+        /// @brief Append a frame header
+        static void write_header(std::string &out, std::uint32_t length, http2_frame_type type, std::uint8_t flags, std::uint32_t stream_id);
+
+        /// @brief Append a SETTINGS frame, an empty list with ack=true is the acknowledgement
+        static void write_settings(std::string &out, const std::vector<std::pair<http2_setting, std::uint32_t>> &settings, bool ack = false);
+
+        static void write_window_update(std::string &out, std::uint32_t stream_id, std::uint32_t increment);
+        static void write_rst_stream(std::string &out, std::uint32_t stream_id, http2_error error);
+        static void write_goaway(std::string &out, std::uint32_t last_stream_id, http2_error error, const std::string &debug = "");
+        static void write_ping(std::string &out, const std::uint8_t *opaque, bool ack);
+
+        /// @brief Append a DATA frame carrying at most one frame's worth of payload
+        static void write_data(std::string &out, std::uint32_t stream_id, const char *data, std::size_t size, bool end_stream);
+
+        /// @brief Append a header block as HEADERS plus CONTINUATION frames no larger than max_frame_size
+        static void write_headers(std::string &out, std::uint32_t stream_id, const std::string &block, bool end_stream, std::size_t max_frame_size);
+
+        /// @brief Read a 32-bit big endian value
+        static std::uint32_t read_u32(const std::uint8_t *data)
+        {
+            return (static_cast<std::uint32_t>(data[0]) << 24) | (static_cast<std::uint32_t>(data[1]) << 16) |
+                   (static_cast<std::uint32_t>(data[2]) << 8) | data[3];
+        }
+
+        /// @brief Append a 32-bit big endian value
+        static void write_u32(std::string &out, std::uint32_t value)
+        {
+            out.push_back(static_cast<char>(value >> 24));
+            out.push_back(static_cast<char>(value >> 16));
+            out.push_back(static_cast<char>(value >> 8));
+            out.push_back(static_cast<char>(value));
+        }
+    };
+}
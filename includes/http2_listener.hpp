@@ -0,0 +1,368 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "mpsc_queue.hpp"
+#include "cancellation_token.hpp"
+#include "http2_session.hpp"
+#include "io_uring_ring.hpp"
+#include "timing_wheel.hpp"
+
+namespace hh_web
+{
+    /// Identifies a request on an http2_listener: its connection and stream (0 for an HTTP/1.1 request)
+    struct http2_stream_ref
+    {
+        std::uint64_t connection = 0;
+        std::uint32_t stream_id = 0;
+    };
+
+    /**
+     * @brief Cleartext HTTP/2 (h2c) endpoint with its own event loop, on epoll or io_uring.
+     *
+     * Accepts connections on its own port, or on a Unix domain socket (set_unix_socket()), and
+     * detects the protocol from the first bytes:
+     * - the HTTP/2 connection preface (prior knowledge) starts an http2_session right away
+     * - an HTTP/1.1 request with "Upgrade: h2c" and HTTP2-Settings is answered with
+     *   101 Switching Protocols and continues as stream 1 of an HTTP/2 connection
+     * - any other HTTP/1.1 request is served, and the connection kept alive for the next one
+     *   unless the client asked to close it; pipelined requests are answered in order
+     *
+     * Every complete request is passed to the request callback on the loop thread, which
+     * hands it off (e.g. to a worker pool) and returns the request's cancellation token.
+     * Responses are posted back from any thread with post(); they are queued lock-free and
+     * the loop is woken through an eventfd, so all socket writes happen on the loop thread.
+     * When a client resets a stream or drops the connection, the tokens of the affected
+     * requests are cancelled.
+     *
+     * With set_io_uring() the loop runs on an io_uring_ring instead of epoll: one multishot
+     * accept, one multishot recv per connection reading into a provided buffer ring, and sends
+     * submitted in the same io_uring_enter that waits for the next completions.
+     *
+     * Every connection has one timer on the listener's timing_wheel, reset on every read, for
+     * its next deadline: the idle timeout while no request of it is being handled, and the
+     * header and body timeouts of a request the client is still sending. Those run from the
+     * request's first byte and the end of its headers, so trickling bytes does not extend
+     * them. While more than max_queued_output bytes wait to be written, nothing is read, so a
+     * client that never reads cannot make the server queue answers without bound.
+     *
+     * @note Connections closed on a timeout get a GOAWAY first when they speak HTTP/2.
+     */
+    class http2_listener
+    {
+    public:
+        /// Receives a request and returns its cancellation token (may be null)
+        using request_callback = std::function<std::shared_ptr<cancellation_token>(const http2_stream_ref &, http2_request &&)>;
+
+    private:
+        enum class protocol
+        {
+            DETECT,
+            HTTP2,
+            HTTP1
+        };
+
+        struct connection
+        {
+            int fd = -1;
+            std::uint64_t id = 0;
+            protocol mode = protocol::DETECT;
+
+            /// Bytes read before the protocol was known, and the HTTP/1.1 request
+            std::string input;
+            std::unique_ptr<http2_session> session;
+
+            /// HTTP/1.1 output, HTTP/2 output lives in the session
+            std::string output;
+            std::size_t output_offset = 0;
+            bool close_after_write = false;
+            bool writable_armed = false;
+            bool readable_armed = true;
+
+            /// More than max_queued_output bytes wait to be written, nothing is read meanwhile
+            bool reading_paused = false;
+
+            /// io_uring: a multishot recv is armed
+            bool recv_armed = false;
+
+            /// io_uring: bytes of the send in flight, the kernel reads them until it completes
+            std::string sending;
+            std::size_t sending_offset = 0;
+            bool send_in_flight = false;
+
+            /// The HTTP/1.1 request was a HEAD request, its response carries no body
+            bool head_request = false;
+
+            /// The connection is closed after the response of the current HTTP/1.1 request
+            bool close_after_response = false;
+
+            /// Peer of a Unix domain socket connection
+            std::optional<peer_credentials> peer;
+
+            /// Tokens of the requests dispatched and not answered yet, by stream id
+            std::unordered_map<std::uint32_t, std::weak_ptr<cancellation_token>> pending;
+
+            /// Last read or write
+            std::chrono::steady_clock::time_point last_activity;
+
+            /// HTTP/1.1 request being received: since its first byte (or the accept) and since the end of its headers, zero when none is
+            std::chrono::steady_clock::time_point request_started;
+            std::chrono::steady_clock::time_point body_started;
+
+            /// Timer of the connection's next deadline, and the deadline it is armed for
+            timing_wheel::timer_id timer = 0;
+            std::chrono::steady_clock::time_point timer_deadline;
+
+            /// A timeout passed and the GOAWAY is being written, the next one closes the connection
+            bool expiring = false;
+        };
+
+        /// A response (or a reset, without response) travelling from a worker to the loop
+        struct completion
+        {
+            http2_stream_ref ref;
+            std::optional<http2_response> response;
+        };
+
+        int port;
+        std::string host;
+        http2_settings settings;
+
+        /// Path of the Unix domain socket to listen on instead of host:port, empty for TCP
+        std::string unix_path;
+        unsigned int unix_permissions = 0660;
+        std::chrono::milliseconds idle_timeout{std::chrono::seconds(30)};
+        std::chrono::milliseconds header_timeout{std::chrono::seconds(10)};
+        std::chrono::milliseconds body_timeout{std::chrono::seconds(30)};
+        std::size_t max_queued_output = 1u << 20;
+
+        request_callback on_request;
+
+        int listen_fd = -1;
+        int epoll_fd = -1;
+        int event_fd = -1;
+
+        /// Run the loop on io_uring when the kernel has what it needs
+        bool io_uring_requested = false;
+
+        /// The io_uring loop's ring, null on epoll
+        std::unique_ptr<io_uring_ring> ring;
+
+        /// Target of the read keeping the eventfd armed on the ring
+        std::uint64_t wake_count = 0;
+
+        /// Sends still in flight when their connection closed, freed by their completion
+        std::unordered_map<std::uint64_t, std::string> retired_sends;
+
+        std::thread loop;
+        std::atomic<bool> running{false};
+
+        std::unordered_map<std::uint64_t, connection> connections;
+        std::unordered_map<int, std::uint64_t> connection_of_fd;
+        std::uint64_t next_connection_id = 1;
+
+        mpsc_queue<completion> completions;
+        std::atomic<bool> signalled{false};
+
+        /// Connection deadlines, advanced by the loop thread
+        timing_wheel timers;
+
+        std::atomic<std::size_t> connections_accepted{0};
+        std::atomic<std::size_t> requests_received{0};
+
+        bool listen_tcp();
+        bool listen_unix();
+
+        void run();
+        void accept_connections();
+        void add_connection(int fd);
+        void handle_readable(connection &conn);
+        void handle_writable(connection &conn);
+
+        /**
+         * @brief Pass received bytes to the connection's protocol.
+         * @return false once nothing more should be read: the connection was closed, or
+         *         it closes after writing what is queued
+         */
+        bool receive(connection &conn, const char *data, std::size_t size);
+
+        /// Set up the ring, false (logged) to stay on epoll
+        bool start_io_uring();
+        void run_io_uring();
+        void on_io_uring_completion(const io_uring_cqe &cqe);
+        void arm_accept();
+        void arm_recv(connection &conn);
+        void cancel_recv(const connection &conn);
+        void arm_wake();
+        void arm_tick();
+        void submit_send(connection &conn);
+        void push_completion(completion &&item);
+        void drain_completions();
+
+        /// The connection's next deadline, time_point::max() when none applies
+        std::chrono::steady_clock::time_point next_deadline(const connection &conn) const;
+
+        /// Arm or push back the connection's timer to its next deadline
+        void arm_timer(connection &conn);
+        void on_timer(std::uint64_t id);
+
+        /// Close a connection whose deadline passed, HTTP/2 ones after a GOAWAY
+        void expire(connection &conn);
+
+        /// Note that the HTTP/1.1 request in input is incomplete, its deadlines start
+        void await_request(connection &conn);
+
+        std::size_t queued_output(const connection &conn) const;
+
+        /// Pause reading while queued output is over max_queued_output, resume below it
+        void throttle(connection &conn);
+
+        /// Pick the protocol from the first bytes, false once the connection should be closed
+        bool detect(connection &conn);
+        void create_session(connection &conn);
+
+        /**
+         * @brief Parse a complete HTTP/1.1 request from conn.input.
+         * @param keep_alive Set to whether the connection may carry another request afterwards
+         * @return 1 when complete, 0 when more bytes are needed, -1 for a malformed request
+         */
+        int parse_http1(connection &conn, http2_request &request, std::size_t &consumed, bool &keep_alive) const;
+
+        /// Dispatch the next buffered HTTP/1.1 request once the previous one is answered
+        void next_http1(connection &conn);
+
+        void dispatch(connection &conn, std::uint32_t stream_id, http2_request &&request);
+        void respond_http1(connection &conn, const http2_response &response);
+        void respond_canned(connection &conn, const canned_response &canned, const std::vector<hpack_header> &headers);
+        void flush(connection &conn);
+        void close_connection(std::uint64_t id);
+        void update_events(connection &conn, bool want_write);
+
+    public:
+        /**
+         * @brief Create the listener, nothing is bound until start().
+         * @param port Port for h2c connections (0 for any free port, see get_port())
+         * @param host Address to bind to
+         * @param settings Settings every HTTP/2 connection advertises
+         */
+        http2_listener(int port, const std::string &host, const http2_settings &settings = http2_settings{});
+        ~http2_listener();
+
+        http2_listener(const http2_listener &) = delete;
+        http2_listener &operator=(const http2_listener &) = delete;
+
+        /// @brief Set the callback receiving the requests, before start()
+        void set_request_callback(request_callback callback)
+        {
+            on_request = std::move(callback);
+        }
+
+        /// @brief Close connections silent for this long while none of their requests is being handled, before start()
+        void set_idle_timeout(std::chrono::milliseconds timeout)
+        {
+            idle_timeout = timeout;
+        }
+
+        /**
+         * @brief Deadlines of a request the client is still sending, before start().
+         * @note Over HTTP/2 the header timeout applies to any frame or header block received in
+         *       part, the body timeout to each stream still receiving its body.
+         * @param header Time for the request line and headers, from the first byte (the accept for a new connection)
+         * @param body Time for the body, from the end of the headers
+         */
+        void set_read_timeouts(std::chrono::milliseconds header, std::chrono::milliseconds body)
+        {
+            header_timeout = header;
+            body_timeout = body;
+        }
+
+        /// @brief Stop reading from a connection while more than this many bytes wait to be written to it, before start()
+        void set_max_queued_output(std::size_t bytes)
+        {
+            max_queued_output = bytes;
+        }
+
+        /**
+         * @brief Run the loop on io_uring instead of epoll, before start().
+         * @note start() falls back to epoll (logged) when the kernel lacks multishot accept and
+         *       recv or provided buffer rings, see io_uring_ring::probe().
+         * @param enabled true for io_uring
+         */
+        void set_io_uring(bool enabled)
+        {
+            io_uring_requested = enabled;
+        }
+
+        /// @brief Check whether the running loop is on io_uring
+        bool is_io_uring() const
+        {
+            return ring != nullptr;
+        }
+
+        /**
+         * @brief Listen on a Unix domain socket instead of host:port, before start().
+         * @note A stale socket file at the path is replaced, stop() removes it. Requests carry
+         *       the credentials of the connecting process (http2_request::peer).
+         * @param path Filesystem path of the socket
+         * @param permissions Mode of the socket file, decides who may connect
+         */
+        void set_unix_socket(const std::string &path, unsigned int permissions = 0660)
+        {
+            unix_path = path;
+            unix_permissions = permissions;
+        }
+
+        /**
+         * @brief Bind, listen and start the loop thread.
+         * @return false if the socket could not be bound, the error is logged
+         */
+        bool start();
+
+        /// @brief Stop the loop and close every connection, does nothing if not running
+        void stop();
+
+        /**
+         * @brief Send the response of a request, callable from any thread.
+         * @note Dropped when the connection is gone or the stream was reset meanwhile.
+         */
+        void post(const http2_stream_ref &ref, http2_response &&response);
+
+        /// @brief Abort a request without response (RST_STREAM, or closing an HTTP/1.1 connection)
+        void post_reset(const http2_stream_ref &ref);
+
+        /// @brief Port the listener is bound to, meaningful after start()
+        int get_port() const
+        {
+            return port;
+        }
+
+        /// @brief Path of the Unix domain socket, empty when listening on TCP
+        const std::string &get_unix_path() const
+        {
+            return unix_path;
+        }
+
+        bool is_running() const
+        {
+            return running.load();
+        }
+
+        std::size_t get_connections_accepted() const
+        {
+            return connections_accepted.load();
+        }
+
+        std::size_t get_requests_received() const
+        {
+            return requests_received.load();
+        }
+    };
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "hpack.hpp"
+#include "http2_frame.hpp"
+#include "peer_credentials.hpp"
+#include "canned_response.hpp"
+
+namespace hh_web
+{
+    /// A complete request received on one HTTP/2 stream
+    struct http2_request
+    {
+        std::uint32_t stream_id = 0;
+        std::string method;
+        std::string scheme;
+        std::string authority;
+        std::string path;
+
+        /// Regular headers (lowercase names), trailers are appended after them
+        std::vector<hpack_header> headers;
+        std::string body;
+
+        /// Set by http2_listener for connections accepted on a Unix domain socket
+        std::optional<peer_credentials> peer;
+    };
+
+    /// The response for one stream
+    struct http2_response
+    {
+        int status = 200;
+
+        /// Header names may use any case; connection-specific headers (Connection, Keep-Alive,
+        /// Transfer-Encoding, Upgrade) are dropped since HTTP/2 does not allow them
+        std::vector<hpack_header> headers;
+        std::string body;
+        std::vector<hpack_header> trailers;
+
+        /// HTTP/1.1 only: a canned response written from its pre-serialized bytes instead of
+        /// status and body, headers are written after its own
+        std::shared_ptr<const canned_response> canned;
+    };
+
+    /// What this endpoint advertises and enforces
+    struct http2_settings
+    {
+        std::uint32_t max_concurrent_streams = 100;
+
+        /// Receive window of each stream (at least 65535)
+        std::uint32_t initial_window_size = 1u << 20;
+
+        /// Receive window of the whole connection
+        std::uint32_t connection_window_size = 1u << 24;
+
+        std::uint32_t max_frame_size = http2_frame::DEFAULT_MAX_FRAME_SIZE;
+        std::uint32_t max_header_list_size = 65536;
+
+        /// Larger request bodies are answered with 413
+        std::size_t max_body_size = 1u << 20;
+
+        /// RST_STREAM frames a client may send per second, beyond it the connection is closed with ENHANCE_YOUR_CALM
+        std::uint32_t max_resets_per_second = 200;
+    };
+
+    /**
+     * @brief Server side of one HTTP/2 connection, independent of the socket it runs on.
+     *
+     * The transport feeds received bytes to receive() and writes whatever get_output()
+     * holds. The session checks the preface, exchanges SETTINGS, decodes header blocks
+     * with a per-connection HPACK context, multiplexes up to max_concurrent_streams
+     * streams and enforces flow control in both directions: request bodies are credited
+     * back with WINDOW_UPDATE as they arrive, response bodies are sent as far as the
+     * connection and stream windows allow and resumed when the peer opens them.
+     *
+     * A request is reported through the request callback once its stream is half-closed
+     * by the client; respond() may be called later, in any order across streams. A stream
+     * the client resets while its request is handled still counts against
+     * max_concurrent_streams until respond() or reset() is called for it, so HEADERS and
+     * RST_STREAM pairs cannot queue unbounded work ("rapid reset"); a client resetting
+     * more than max_resets_per_second streams gets GOAWAY(ENHANCE_YOUR_CALM).
+     *
+     * @note Not thread safe, a connection's session is driven by a single thread.
+     */
+    class http2_session
+    {
+    public:
+        using settings = http2_settings;
+
+        using request_callback = std::function<void(http2_request &&)>;
+        using reset_callback = std::function<void(std::uint32_t)>;
+
+    private:
+        struct stream
+        {
+            http2_request request;
+            bool head_request = false;
+            bool remote_closed = false;
+            bool local_closed = false;
+            bool dispatched = false;
+
+            /// The body grew past max_body_size, answered with 413 without waiting for the rest
+            bool rejected = false;
+
+            std::int64_t send_window = http2_frame::DEFAULT_WINDOW_SIZE;
+            std::int64_t receive_window = 0;
+
+            /// Response body not sent yet for lack of flow control window
+            std::string pending_body;
+            std::size_t pending_offset = 0;
+            std::vector<hpack_header> pending_trailers;
+            bool sending = false;
+        };
+
+        settings local;
+        request_callback on_request;
+        reset_callback on_reset;
+
+        hpack_decoder decoder;
+        hpack_encoder encoder;
+
+        std::unordered_map<std::uint32_t, stream> streams;
+        std::uint32_t last_stream_id = 0;
+
+        /// Streams reset while their request was handled, counted against max_concurrent_streams until answered
+        std::unordered_set<std::uint32_t> detached;
+
+        /// Streams still receiving their request body and when their headers completed, the first is the oldest
+        std::map<std::uint32_t, std::chrono::steady_clock::time_point> receiving;
+
+        /// Since when a frame or header block has been partially received, zero when none is
+        std::chrono::steady_clock::time_point incomplete_since;
+
+        /// Client RST_STREAMs in the current one-second window
+        std::chrono::steady_clock::time_point reset_window;
+        std::uint32_t resets_in_window = 0;
+
+        std::uint32_t peer_initial_window_size = http2_frame::DEFAULT_WINDOW_SIZE;
+        std::uint32_t peer_max_frame_size = http2_frame::DEFAULT_MAX_FRAME_SIZE;
+        std::int64_t connection_send_window = http2_frame::DEFAULT_WINDOW_SIZE;
+        std::int64_t connection_receive_window = http2_frame::DEFAULT_WINDOW_SIZE;
+
+        std::string input;
+        std::size_t input_offset = 0;
+        bool preface_received = false;
+        bool settings_received = false;
+
+        /// Header block being assembled from HEADERS + CONTINUATION frames
+        std::uint32_t continuation_stream = 0;
+        bool continuation_end_stream = false;
+        std::string header_block;
+
+        std::string output;
+        std::size_t output_offset = 0;
+
+        bool goaway_sent = false;
+        bool goaway_received = false;
+        bool failed = false;
+
+        std::size_t requests_received = 0;
+
+        bool connection_error(http2_error error, const std::string &reason);
+        void stream_error(std::uint32_t stream_id, http2_error error);
+        void close_stream(std::unordered_map<std::uint32_t, stream>::iterator it);
+
+        /// Close a stream torn down by a reset, keeping its slot while the request is handled; true if the request callback's owner should be told
+        bool abandon_stream(std::unordered_map<std::uint32_t, stream>::iterator it);
+        void try_close(std::uint32_t stream_id);
+
+        bool handle_frame(const http2_frame &frame, const std::uint8_t *payload);
+        bool handle_data(const http2_frame &frame, const std::uint8_t *payload);
+        bool handle_headers(const http2_frame &frame, const std::uint8_t *payload);
+        bool handle_continuation(const http2_frame &frame, const std::uint8_t *payload);
+        bool handle_header_block(std::uint32_t stream_id, bool end_stream);
+        bool handle_settings(const http2_frame &frame, const std::uint8_t *payload);
+        bool apply_setting(std::uint16_t id, std::uint32_t value);
+        bool handle_window_update(const http2_frame &frame, const std::uint8_t *payload);
+        bool handle_rst_stream(const http2_frame &frame, const std::uint8_t *payload);
+
+        /// Build the request from a decoded header list, false for a malformed request
+        bool build_request(std::vector<hpack_header> &&headers, http2_request &request) const;
+
+        void dispatch(std::uint32_t stream_id, stream &state);
+        void flush_stream(std::uint32_t stream_id, stream &state);
+        void flush_blocked_streams();
+        void credit_receive_windows(stream *state);
+
+    public:
+        /**
+         * @brief Create the session of a new connection.
+         * @param on_request Called for every complete request
+         * @param local Settings this endpoint advertises
+         */
+        explicit http2_session(request_callback on_request, const settings &local = settings{});
+
+        /// @brief Called when the client resets a stream whose request was already reported
+        void set_reset_callback(reset_callback callback)
+        {
+            on_reset = std::move(callback);
+        }
+
+        /// @brief Queue the server preface (SETTINGS and the connection window) for a prior-knowledge connection
+        void start();
+
+        /**
+         * @brief Continue a connection upgraded from HTTP/1.1 (Upgrade: h2c).
+         * @note Queues the server preface and reports the upgraded request as stream 1. The client
+         *       preface is still expected through receive() after the 101 response.
+         * @param settings_header Value of the request's HTTP2-Settings header (base64url SETTINGS payload)
+         * @param first The HTTP/1.1 request, becomes stream 1
+         * @return false if the HTTP2-Settings value is malformed
+         */
+        bool start_upgraded(const std::string &settings_header, http2_request &&first);
+
+        /**
+         * @brief Process received bytes.
+         * @return false on a connection error, a GOAWAY is queued and the connection should be
+         *         closed once get_output() was written
+         */
+        bool receive(const char *data, std::size_t size);
+
+        /**
+         * @brief Send the response of a stream, as far as flow control allows right now.
+         * @note For a stream the client reset meanwhile, nothing is sent and its slot is freed.
+         */
+        void respond(std::uint32_t stream_id, const http2_response &response);
+
+        /// @brief Abort a stream with RST_STREAM, or free the slot of one the client reset meanwhile
+        void reset(std::uint32_t stream_id, http2_error error);
+
+        /// @brief Stop accepting streams (GOAWAY), open streams are still completed
+        void shutdown();
+
+        /// @brief Bytes waiting to be written
+        const char *get_output() const
+        {
+            return output.data() + output_offset;
+        }
+
+        std::size_t get_output_size() const
+        {
+            return output.size() - output_offset;
+        }
+
+        /// @brief Drop written bytes from the output
+        void consume_output(std::size_t bytes);
+
+        /// @brief Streams that are open or still sending their response
+        std::size_t get_open_streams() const
+        {
+            return streams.size();
+        }
+
+        /// @brief Streams reset by the client whose request is still being handled
+        std::size_t get_detached_streams() const
+        {
+            return detached.size();
+        }
+
+        /// @brief Since when a frame or header block has been partially received, empty when none is
+        std::optional<std::chrono::steady_clock::time_point> get_incomplete_since() const
+        {
+            if (incomplete_since == std::chrono::steady_clock::time_point())
+                return std::nullopt;
+            return incomplete_since;
+        }
+
+        /// @brief When the oldest stream still receiving its request body got its headers, empty when none is
+        std::optional<std::chrono::steady_clock::time_point> get_body_started() const
+        {
+            if (receiving.empty())
+                return std::nullopt;
+            return receiving.begin()->second;
+        }
+
+        std::size_t get_requests_received() const
+        {
+            return requests_received;
+        }
+
+        /// @brief true once the connection can be closed: after GOAWAY or an error, with nothing left to send
+        bool is_done() const
+        {
+            return (failed || ((goaway_sent || goaway_received) && streams.empty())) && get_output_size() == 0;
+        }
+    };
+}
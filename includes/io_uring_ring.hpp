@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <linux/io_uring.h>
+
+namespace hh_web
+{
+    /// io_uring features the running kernel offers, filled by io_uring_ring::probe()
+    struct io_uring_features
+    {
+        bool available = false;         ///< io_uring_setup works (kernel support, not disabled by sysctl or seccomp)
+        bool accept = false;            ///< IORING_OP_ACCEPT
+        bool recv_send = false;         ///< IORING_OP_RECV and IORING_OP_SEND
+        bool multishot_accept = false;  ///< One accept SQE keeps producing connections (5.19)
+        bool provided_buffers = false;  ///< Provided buffer rings (IORING_REGISTER_PBUF_RING, 5.19)
+        bool registered_files = false;  ///< Sparse fixed file tables with direct descriptors (5.19)
+        bool multishot_recv = false;    ///< One recv SQE keeps producing data (6.0)
+
+        /// @brief Everything a networking loop needs
+        bool complete() const
+        {
+            return available && accept && recv_send && multishot_accept && provided_buffers && registered_files && multishot_recv;
+        }
+
+        /// @brief What a loop on plain descriptors needs (http2_listener's): complete() without registered files
+        bool socket_loop() const
+        {
+            return available && accept && recv_send && multishot_accept && provided_buffers && multishot_recv;
+        }
+    };
+
+    /**
+     * @brief Minimal io_uring instance on raw syscalls, no liburing dependency.
+     *
+     * Wraps the setup and the memory mapped submission/completion rings, provided buffer
+     * rings and sparse registered file tables. Nothing is submitted implicitly: get_sqe()
+     * hands out entries, submit() makes the kernel see all of them with one io_uring_enter,
+     * so a loop iteration batches every accept, recv and send it prepared.
+     *
+     * @note Not thread-safe, a ring belongs to the thread running its loop.
+     */
+    class io_uring_ring
+    {
+    private:
+        int ring_fd = -1;
+
+        void *sq_map = nullptr;
+        std::size_t sq_map_size = 0;
+        void *cq_map = nullptr;
+        std::size_t cq_map_size = 0;
+        io_uring_sqe *sqes = nullptr;
+        std::size_t sqes_size = 0;
+
+        unsigned *sq_head = nullptr;
+        unsigned *sq_tail = nullptr;
+        unsigned sq_mask = 0;
+        unsigned sq_entries = 0;
+        unsigned *sq_array = nullptr;
+        /// Entries handed out by get_sqe() and not yet published to the kernel
+        unsigned sqe_tail = 0;
+
+        unsigned *cq_head = nullptr;
+        unsigned *cq_tail = nullptr;
+        unsigned cq_mask = 0;
+        io_uring_cqe *cqes = nullptr;
+
+        struct buffer_group
+        {
+            std::uint16_t id = 0;
+            io_uring_buf_ring *ring = nullptr;
+            std::size_t ring_size = 0;
+            std::vector<char> storage;
+            unsigned count = 0;
+            unsigned size = 0;
+            unsigned short tail = 0;
+        };
+        std::vector<buffer_group> groups;
+
+        /// Number of io_uring_enter calls, the only syscall of the hot path
+        std::size_t enter_calls = 0;
+
+        buffer_group *find_group(std::uint16_t group);
+        void unmap();
+
+    public:
+        /**
+         * @brief Create a ring.
+         * @param entries Submission queue size, rounded up to a power of two by the kernel
+         * @param flags IORING_SETUP_* flags
+         * @throws web_exception if io_uring is not available
+         */
+        explicit io_uring_ring(unsigned entries, unsigned flags = 0);
+        ~io_uring_ring();
+
+        io_uring_ring(const io_uring_ring &) = delete;
+        io_uring_ring &operator=(const io_uring_ring &) = delete;
+
+        /// @brief Check what the running kernel supports, never throws
+        static io_uring_features probe();
+
+        /**
+         * @brief Get a zeroed submission entry.
+         * @note When the submission queue is full the pending entries are submitted first.
+         */
+        io_uring_sqe *get_sqe();
+
+        /**
+         * @brief Publish the prepared entries and optionally wait for completions, in one syscall.
+         * @param wait_nr Number of completions to wait for
+         * @return Number of entries consumed by the kernel, negative errno on failure
+         */
+        int submit(unsigned wait_nr = 0);
+
+        /**
+         * @brief Run a callback for every available completion and consume them.
+         * @param callback Called with each io_uring_cqe
+         * @return Number of completions processed
+         */
+        template <typename F>
+        unsigned for_each_completion(F &&callback)
+        {
+            unsigned head = *cq_head;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            unsigned seen = 0;
+            for (; head != tail; ++head, ++seen)
+                callback(cqes[head & cq_mask]);
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            return seen;
+        }
+
+        /**
+         * @brief Register an empty fixed file table that direct accepts allocate into.
+         * @param count Number of slots
+         * @return true on success
+         */
+        bool register_sparse_files(unsigned count);
+
+        /**
+         * @brief Register a provided buffer ring that recv with IOSQE_BUFFER_SELECT picks from.
+         * @param group Buffer group id
+         * @param count Number of buffers, a power of two
+         * @param size Size of each buffer
+         * @return true on success
+         */
+        bool register_buffer_ring(std::uint16_t group, unsigned count, unsigned size);
+
+        /// @brief Data of a provided buffer, the buffer id comes from cqe.flags >> IORING_CQE_BUFFER_SHIFT
+        const char *buffer_data(std::uint16_t group, std::uint16_t buffer_id);
+
+        /// @brief Hand a consumed buffer back to the kernel
+        void recycle_buffer(std::uint16_t group, std::uint16_t buffer_id);
+
+        /// @brief Ring file descriptor
+        int get_fd() const
+        {
+            return ring_fd;
+        }
+
+        /// @brief Number of io_uring_enter calls made so far
+        std::size_t get_enter_calls() const
+        {
+            return enter_calls;
+        }
+    };
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "web_types.hpp"
+#include "web_result.hpp"
+
+namespace hh_web
+{
+    /// @brief Why validate_json() rejected a document
+    enum class json_error
+    {
+        NONE,
+        EMPTY,
+        TOO_DEEP,
+        UNEXPECTED_CHARACTER,
+        UNEXPECTED_END,
+        UNTERMINATED_STRING,
+        CONTROL_CHARACTER,
+        INVALID_ESCAPE,
+        INVALID_UTF8,
+        INVALID_NUMBER,
+        INVALID_LITERAL,
+        TRAILING_CONTENT
+    };
+
+    /// @brief Nesting validate_json() accepts at most, whatever max_depth says
+    constexpr std::size_t json_max_supported_depth = 1024;
+
+    /// @brief Outcome of validate_json(): the first error and where it was found
+    struct json_validation
+    {
+        json_error error = json_error::NONE;
+
+        /// Byte offset of the error in the document
+        std::size_t offset = 0;
+
+        explicit operator bool() const noexcept
+        {
+            return error == json_error::NONE;
+        }
+
+        /// @brief "unterminated string at offset 12", for logs and error responses
+        std::string describe() const;
+    };
+
+    /**
+     * @brief Check that text is one well-formed JSON document (RFC 8259), nested at most max_depth deep.
+     *
+     * One pass, no allocation: object/array nesting is tracked in a fixed bit stack. String
+     * contents and whitespace runs, most of a typical body, are scanned 16 bytes at a time
+     * with SSE2 where available; structure, numbers and literals are checked byte by byte.
+     * Strings must be valid UTF-8 (no overlong forms, surrogates or code points past U+10FFFF).
+     *
+     * @param text The document
+     * @param max_depth Deepest nesting of objects and arrays allowed, capped at json_max_supported_depth
+     */
+    json_validation validate_json(std::string_view text, std::size_t max_depth = 64);
+
+    /**
+     * @brief Split a JSON array into the text of its elements, without parsing them.
+     *
+     * For bulk endpoints: each element can be handed to a parser, and fail, on its own. The
+     * views point into text and have no surrounding whitespace.
+     *
+     * @param text A document that passed validate_json()
+     * @return The elements in order, std::nullopt when the document is not an array
+     */
+    std::optional<std::vector<std::string_view>> json_array_elements(std::string_view text);
+
+    /**
+     * @brief Middleware rejecting request bodies that are not well-formed JSON.
+     *
+     * Put it before handlers that parse the body: malformed or too deeply nested bodies are
+     * answered with 400 {"error": "Invalid JSON: <reason> at offset N"} before a parser
+     * builds anything. Bodies larger than max_size are answered with 413.
+     *
+     * @code
+     * router->post("/api/items", {hh_web::json_body_validator<>(), create_handler});
+     * @endcode
+     *
+     * @tparam T Type for request objects (must derive from web_request)
+     * @tparam G Type for response objects (must derive from web_response)
+     * @param max_depth Deepest nesting allowed
+     * @param max_size Largest body accepted, in bytes
+     */
+    template <typename T = web_request, typename G = web_response>
+    web_request_handler_t<T, G> json_body_validator(std::size_t max_depth = 64, std::size_t max_size = 1024 * 1024)
+    {
+        return [max_depth, max_size](std::shared_ptr<T> request, std::shared_ptr<G> response) -> exit_code
+        {
+            std::string body = request->get_body();
+            if (body.size() > max_size)
+            {
+                write_error(response, web_error(413, "Payload Too Large", "JSON body exceeds " + std::to_string(max_size) + " bytes"));
+                return exit_code::EXIT;
+            }
+            json_validation result = validate_json(body, max_depth);
+            if (result)
+                return exit_code::CONTINUE;
+            write_error(response, web_error::bad_request("Invalid JSON: " + result.describe()));
+            return exit_code::EXIT;
+        };
+    }
+}
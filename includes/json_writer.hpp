@@ -0,0 +1,388 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hh_web
+{
+    /// @brief Append text to out as the contents of a JSON string: ", \ and control characters escaped
+    void append_escaped_json(std::string &out, std::string_view text);
+
+    /**
+     * @brief Writes JSON straight into a buffer.
+     *
+     * There is no document tree and no stream: every call appends its bytes to the buffer
+     * (the writer's own, or one the caller passes, e.g. a response body being built), and
+     * commas are placed by the writer. Strings are escaped with a 16-byte SIMD scan where
+     * SSE2 is available, numbers are formatted with std::to_chars.
+     *
+     * With a sink, the buffer is handed over in chunks of about chunk_size bytes as it fills
+     * and the rest on flush(), so a large document can be streamed without being held whole.
+     *
+     * @code
+     * hh_web::json_writer json;
+     * json.begin_object();
+     * json.key("count").value(items.size());
+     * json.key("items").value(items); // vectors, maps, optionals and HH_WEB_JSON_FIELDS structs
+     * json.end_object();
+     * res->send_json(json);
+     * @endcode
+     *
+     * @note The writer does not check that begin and end calls match or that keys are only
+     *       written inside objects; it writes what it is told.
+     */
+    class json_writer
+    {
+    public:
+        using sink_t = std::function<void(std::string_view)>;
+
+    private:
+        std::string owned;
+        std::string *out;
+        sink_t sink;
+        std::size_t chunk_size = 0;
+
+        /// A value was written at this level, the next one needs a comma
+        bool need_comma = false;
+
+        void separate()
+        {
+            if (need_comma)
+                out->push_back(',');
+            need_comma = true;
+        }
+
+        void maybe_flush()
+        {
+            if (sink && out->size() >= chunk_size)
+                flush();
+        }
+
+        void write_signed(std::int64_t number);
+        void write_unsigned(std::uint64_t number);
+        void write_double(double number);
+        void write_float(float number);
+
+    public:
+        /// @brief Write into the writer's own buffer, see str() and take()
+        json_writer() : out(&owned)
+        {
+        }
+
+        /// @brief Append to out, which must outlive the writer
+        explicit json_writer(std::string &out) : out(&out)
+        {
+        }
+
+        /// @brief Hand the output to sink in chunks of about chunk_size bytes, the rest on flush()
+        explicit json_writer(sink_t sink, std::size_t chunk_size = 16 * 1024)
+            : out(&owned), sink(std::move(sink)), chunk_size(chunk_size)
+        {
+            owned.reserve(chunk_size + chunk_size / 4);
+        }
+
+        json_writer(const json_writer &) = delete;
+        json_writer &operator=(const json_writer &) = delete;
+
+        json_writer &begin_object()
+        {
+            separate();
+            out->push_back('{');
+            need_comma = false;
+            return *this;
+        }
+
+        json_writer &end_object()
+        {
+            out->push_back('}');
+            need_comma = true;
+            maybe_flush();
+            return *this;
+        }
+
+        json_writer &begin_array()
+        {
+            separate();
+            out->push_back('[');
+            need_comma = false;
+            return *this;
+        }
+
+        json_writer &end_array()
+        {
+            out->push_back(']');
+            need_comma = true;
+            maybe_flush();
+            return *this;
+        }
+
+        /// @brief Write a member name, the next call writes its value
+        json_writer &key(std::string_view name)
+        {
+            separate();
+            out->push_back('"');
+            append_escaped_json(*out, name);
+            out->append("\":", 2);
+            need_comma = false;
+            return *this;
+        }
+
+        json_writer &value(std::string_view text)
+        {
+            separate();
+            out->push_back('"');
+            append_escaped_json(*out, text);
+            out->push_back('"');
+            maybe_flush();
+            return *this;
+        }
+
+        json_writer &value(const std::string &text)
+        {
+            return value(std::string_view(text));
+        }
+
+        json_writer &value(const char *text)
+        {
+            return text ? value(std::string_view(text)) : null();
+        }
+
+        json_writer &value(bool flag)
+        {
+            separate();
+            flag ? out->append("true", 4) : out->append("false", 5);
+            return *this;
+        }
+
+        json_writer &value(std::nullptr_t)
+        {
+            return null();
+        }
+
+        json_writer &null()
+        {
+            separate();
+            out->append("null", 4);
+            return *this;
+        }
+
+        /// @brief Write already serialized JSON as a value, e.g. a cached fragment
+        json_writer &raw(std::string_view json)
+        {
+            separate();
+            out->append(json.data(), json.size());
+            maybe_flush();
+            return *this;
+        }
+
+        /**
+         * @brief Write numbers, optionals (null when empty), sequences (arrays), maps with
+         *        string keys (objects) and structs declared with HH_WEB_JSON_FIELDS.
+         *
+         * Non-finite floating point numbers are written as null.
+         */
+        template <typename T>
+        json_writer &value(const T &item);
+
+        /// @brief Write a member, key(name).value(item)
+        template <typename T>
+        json_writer &member(std::string_view name, const T &item)
+        {
+            key(name);
+            return value(item);
+        }
+
+        /// @brief Hand everything written so far to the sink; without a sink, nothing happens
+        void flush()
+        {
+            if (!sink || owned.empty())
+                return;
+            sink(owned);
+            owned.clear();
+        }
+
+        /// @brief The output written so far (what has not been flushed to a sink)
+        const std::string &str() const noexcept
+        {
+            return *out;
+        }
+
+        /// @brief Move the output written so far out of the buffer, the writer starts over
+        std::string take()
+        {
+            std::string result = std::move(*out);
+            out->clear();
+            need_comma = false;
+            return result;
+        }
+    };
+
+    namespace detail
+    {
+        template <typename T, typename = void>
+        struct has_write_json : std::false_type
+        {
+        };
+
+        template <typename T>
+        struct has_write_json<T, std::void_t<decltype(write_json(std::declval<json_writer &>(), std::declval<const T &>()))>> : std::true_type
+        {
+        };
+
+        template <typename T, typename = void>
+        struct is_json_sequence : std::false_type
+        {
+        };
+
+        template <typename T>
+        struct is_json_sequence<T, std::void_t<decltype(std::begin(std::declval<const T &>())), decltype(std::end(std::declval<const T &>()))>>
+            : std::true_type
+        {
+        };
+
+        template <typename T>
+        struct is_json_map : std::false_type
+        {
+        };
+
+        template <typename V, typename C, typename A>
+        struct is_json_map<std::map<std::string, V, C, A>> : std::true_type
+        {
+        };
+
+        template <typename V, typename H, typename E, typename A>
+        struct is_json_map<std::unordered_map<std::string, V, H, E, A>> : std::true_type
+        {
+        };
+
+        template <typename T>
+        struct is_optional : std::false_type
+        {
+        };
+
+        template <typename T>
+        struct is_optional<std::optional<T>> : std::true_type
+        {
+        };
+    }
+
+    template <typename T>
+    json_writer &json_writer::value(const T &item)
+    {
+        if constexpr (detail::has_write_json<T>::value)
+        {
+            write_json(*this, item);
+        }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        {
+            separate();
+            write_signed(item);
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            separate();
+            write_unsigned(item);
+        }
+        else if constexpr (std::is_same_v<T, float>)
+        {
+            separate();
+            write_float(item);
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            separate();
+            write_double(static_cast<double>(item));
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            value(static_cast<std::underlying_type_t<T>>(item));
+        }
+        else if constexpr (std::is_convertible_v<const T &, std::string_view>)
+        {
+            value(std::string_view(item));
+        }
+        else if constexpr (detail::is_optional<T>::value)
+        {
+            item ? value(*item) : null();
+        }
+        else if constexpr (detail::is_json_map<T>::value)
+        {
+            begin_object();
+            for (const auto &[name, entry] : item)
+                member(name, entry);
+            end_object();
+        }
+        else if constexpr (detail::is_json_sequence<T>::value)
+        {
+            begin_array();
+            for (const auto &entry : item)
+                value(entry);
+            end_array();
+        }
+        else
+        {
+            static_assert(detail::has_write_json<T>::value, "No JSON form for this type, declare one with HH_WEB_JSON_FIELDS");
+        }
+        return *this;
+    }
+}
+
+/// Calls m(field) for each field, up to 16
+#define HH_WEB_JSON_EXPAND(x) x
+#define HH_WEB_JSON_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, name, ...) name
+#define HH_WEB_JSON_EACH_1(m, x) m(x)
+#define HH_WEB_JSON_EACH_2(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_1(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_3(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_2(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_4(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_3(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_5(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_4(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_6(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_5(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_7(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_6(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_8(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_7(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_9(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_8(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_10(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_9(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_11(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_10(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_12(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_11(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_13(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_12(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_14(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_13(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_15(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_14(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH_16(m, x, ...) m(x) HH_WEB_JSON_EXPAND(HH_WEB_JSON_EACH_15(m, __VA_ARGS__))
+#define HH_WEB_JSON_EACH(m, ...)                                                                           \
+    HH_WEB_JSON_EXPAND(HH_WEB_JSON_PICK(__VA_ARGS__, HH_WEB_JSON_EACH_16, HH_WEB_JSON_EACH_15,             \
+                                        HH_WEB_JSON_EACH_14, HH_WEB_JSON_EACH_13, HH_WEB_JSON_EACH_12,     \
+                                        HH_WEB_JSON_EACH_11, HH_WEB_JSON_EACH_10, HH_WEB_JSON_EACH_9,      \
+                                        HH_WEB_JSON_EACH_8, HH_WEB_JSON_EACH_7, HH_WEB_JSON_EACH_6,        \
+                                        HH_WEB_JSON_EACH_5, HH_WEB_JSON_EACH_4, HH_WEB_JSON_EACH_3,        \
+                                        HH_WEB_JSON_EACH_2, HH_WEB_JSON_EACH_1)(m, __VA_ARGS__))
+#define HH_WEB_JSON_MEMBER(field) writer.member(#field, value.field);
+
+/**
+ * @brief Declare, inside a struct, how it is written as a JSON object: one member per field,
+ *        named like the field, in the given order (up to 16 fields).
+ *
+ * @code
+ * struct item
+ * {
+ *     int id;
+ *     std::string name;
+ *     double price;
+ *     HH_WEB_JSON_FIELDS(item, id, name, price)
+ * };
+ * @endcode
+ */
+#define HH_WEB_JSON_FIELDS(type, ...)                                                 \
+    friend void write_json(hh_web::json_writer &writer, const type &value)            \
+    {                                                                                 \
+        writer.begin_object();                                                        \
+        HH_WEB_JSON_EACH(HH_WEB_JSON_MEMBER, __VA_ARGS__)                             \
+        writer.end_object();                                                          \
+    }
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hh_web
+{
+    /**
+     * @brief Hands the listening sockets of a running server to its replacement process.
+     *
+     * Used by web_server::use_hot_restart. The running (old) process offers its listening
+     * sockets on a Unix domain socket; a freshly started (new) process connects to it and
+     * receives them with SCM_RIGHTS:
+     *
+     * 1. old: offer() binds the handoff path and waits for a connection.
+     * 2. new: take_over() connects and receives the old listening sockets.
+     * 3. new: binds its own listeners (SO_REUSEPORT, same port), then complete() attaches a
+     *    reuseport steering program through the received sockets, so the kernel sends every
+     *    new connection of the group to the new listeners, and tells the old process it is ready.
+     * 4. old: on_taken_over runs, the old process keeps accepting what is already queued on
+     *    its sockets, drains its in-flight requests and exits.
+     * 5. new: when the handoff connection closes (old process gone) the steering program is
+     *    detached again and the kernel balances over the new listeners only.
+     *
+     * No connection is refused at any point: the old sockets stay open until the new ones
+     * are in the group, and they stop receiving connections before they are closed.
+     *
+     * @note Linux only. Both processes must bind with SO_REUSEPORT under the same user, the
+     *       handoff socket is created with mode 0600 and peers with another uid are rejected.
+     * @note Connections still in the SYN queue of an old listener when it closes are reset
+     *       unless net.ipv4.tcp_migrate_req is enabled (Linux 5.14+), which moves them to the
+     *       new listeners; the old side waits for its accept queue to stay empty to keep this rare.
+     */
+    class listener_handoff
+    {
+    public:
+        /// Called in the old process once the new one serves, receives the old listening sockets
+        using taken_over_callback_t = std::function<void(const std::vector<int> &)>;
+
+    private:
+        /// Unix socket path the handoff happens on
+        std::string path;
+        /// Port of the listening sockets
+        int port = 0;
+
+        /// Old side: listening Unix socket, new side: unused
+        int handoff_listener = -1;
+        /// Connection between the old and the new process, kept open until the old process exits
+        int connection = -1;
+
+        /// New side: listening sockets received from the old process
+        std::vector<int> inherited;
+
+        /// Old side: accept thread, new side: thread waiting for the old process to go away
+        std::thread worker;
+        std::atomic<bool> running{false};
+
+        void serve_offer(taken_over_callback_t on_taken_over);
+
+    public:
+        listener_handoff() = default;
+        ~listener_handoff();
+
+        listener_handoff(const listener_handoff &) = delete;
+        listener_handoff &operator=(const listener_handoff &) = delete;
+
+        /**
+         * @brief Find the listening TCP sockets of this process bound to a port.
+         * @note Scans /proc/self/fd, duplicates of the same socket are reported once.
+         * @param port Local port of the sockets
+         * @param listening_only false to also report sockets that are bound but not listening yet
+         * @return File descriptors of the sockets
+         */
+        static std::vector<int> find_listeners(int port, bool listening_only = true);
+
+        /**
+         * @brief Count the connections waiting in the accept queues of listening sockets.
+         * @param listeners Listening sockets to inspect
+         * @return Sum of the accept queue lengths
+         */
+        static std::size_t pending_connections(const std::vector<int> &listeners);
+
+        /**
+         * @brief Old side: offer this process' listening sockets on a Unix socket path.
+         * @note Runs a background thread, the handoff happens at most once.
+         * @param path Filesystem path of the handoff socket, an existing stale socket file is replaced
+         * @param port Port of the listening sockets to hand over
+         * @param on_taken_over Called on the handoff thread once the new process serves
+         * @return true if the handoff socket is listening
+         */
+        bool offer(const std::string &path, int port, taken_over_callback_t on_taken_over);
+
+        /**
+         * @brief New side: receive the listening sockets of the process serving on a path.
+         * @param path Filesystem path of the handoff socket
+         * @param port Port the sockets are expected to listen on
+         * @param timeout Maximum time to wait for the old process
+         * @return Number of sockets received, 0 when no process offers a handoff (cold start)
+         */
+        std::size_t take_over(const std::string &path, int port, std::chrono::milliseconds timeout = std::chrono::milliseconds(5000));
+
+        /**
+         * @brief New side: steer new connections to this process and release the old one.
+         * @note Call once this process' own listeners are bound, does nothing after a cold start.
+         * @param new_listeners Number of listening sockets this process added to the group
+         */
+        void complete(unsigned int new_listeners);
+
+        /// @brief Check whether take_over() received sockets that complete() has not released yet
+        bool has_inherited() const
+        {
+            return !inherited.empty();
+        }
+
+        /// @brief Stop the background thread and close the handoff sockets (the old process exits after this)
+        void close();
+    };
+}
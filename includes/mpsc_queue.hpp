@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace hh_web
+{
+    /**
+     * @brief Unbounded lock-free multi-producer single-consumer queue.
+     *
+     * A linked list with a stub node (Vyukov's intrusive MPSC design). push() is one
+     * atomic exchange and never blocks or spins, pop() is only called by the consumer
+     * and never touches the producers' end of the list.
+     *
+     * @note A pop() racing with a push() that has exchanged the head but not linked its
+     *       node yet reports the queue as empty. Producers therefore signal the consumer
+     *       after pushing, so such an item is picked up on the next wakeup.
+     * @note Only one thread may call pop() at a time.
+     *
+     * @tparam T Item type, must be default constructible and movable
+     */
+    template <typename T>
+    class mpsc_queue
+    {
+    private:
+        struct node
+        {
+            std::atomic<node *> next{nullptr};
+            T value;
+
+            node() = default;
+            explicit node(T &&value) : value(std::move(value)) {}
+        };
+
+        /// Last pushed node, producers swap themselves in here
+        std::atomic<node *> head;
+
+        /// Stub node in front of the oldest item, owned by the consumer
+        node *tail;
+
+    public:
+        mpsc_queue()
+        {
+            node *stub = new node();
+            head.store(stub, std::memory_order_relaxed);
+            tail = stub;
+        }
+
+        ~mpsc_queue()
+        {
+            T discarded;
+            while (pop(discarded))
+            {
+            }
+            delete tail;
+        }
+
+        mpsc_queue(const mpsc_queue &) = delete;
+        mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+        /**
+         * @brief Add an item, callable from any thread.
+         * @param value The item to enqueue
+         */
+        void push(T value)
+        {
+            node *item = new node(std::move(value));
+            node *previous = head.exchange(item, std::memory_order_acq_rel);
+            previous->next.store(item, std::memory_order_release);
+        }
+
+        /**
+         * @brief Take the oldest item, consumer thread only.
+         * @param out Receives the item
+         * @return false if the queue is (momentarily) empty
+         */
+        bool pop(T &out)
+        {
+            node *next = tail->next.load(std::memory_order_acquire);
+            if (!next)
+                return false;
+
+            out = std::move(next->value);
+            next->value = T();
+            delete tail;
+            tail = next;
+            return true;
+        }
+    };
+}
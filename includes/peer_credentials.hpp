@@ -0,0 +1,19 @@
+#pragma once
+
+#include <sys/types.h>
+
+namespace hh_web
+{
+    /**
+     * @brief Identity of the process on the other end of a Unix domain socket connection.
+     *
+     * Taken by the kernel when the peer connected (SO_PEERCRED), so it cannot be forged by
+     * the client. Middleware may use it to trust only a known local proxy, e.g. by uid.
+     */
+    struct peer_credentials
+    {
+        pid_t pid = 0;
+        uid_t uid = 0;
+        gid_t gid = 0;
+    };
+}
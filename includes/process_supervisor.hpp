@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <csignal>
+#include <functional>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace hh_web
+{
+    /**
+     * @brief Master side of the prefork mode, keeps N worker processes alive.
+     *
+     * The supervisor forks the workers from the calling process, so everything set up
+     * before run() (routes, routers, static directories, the listening socket if it is
+     * already bound) is inherited copy-on-write and nothing is initialized twice.
+     *
+     * The master then only waits for signals:
+     * - SIGCHLD: a worker exited, if it was not asked to, a replacement is forked into its slot.
+     *   Workers that die right after starting are restarted with a back-off to avoid fork loops.
+     * - SIGHUP: rolling reload, one slot at a time a fresh worker is forked, then the old one gets
+     *   SIGTERM and is given drain_timeout to finish its in-flight requests before SIGKILL.
+     * - SIGTERM / SIGINT: graceful shutdown, all workers get SIGTERM, run() returns once they exited.
+     *
+     * @note run() must be called while the process is still single threaded, fork() only copies
+     *       the calling thread. Workers start with the signal mask the caller had before run().
+     */
+    class process_supervisor
+    {
+    public:
+        /// Body of a worker process, receives its slot index, the return value is the exit code
+        using worker_main_t = std::function<int(unsigned int)>;
+
+    private:
+        struct worker_slot
+        {
+            pid_t pid = -1;
+            std::chrono::steady_clock::time_point started;
+            bool retiring = false; ///< Asked to exit (reload/shutdown), do not restart it
+        };
+
+        unsigned int worker_count;
+        worker_main_t worker_main;
+        std::chrono::milliseconds drain_timeout;
+        std::vector<worker_slot> slots;
+        bool shutting_down = false;
+
+        /// Signal mask before run() blocked the supervisor signals, restored in the workers
+        sigset_t original_mask;
+
+        /// Fork a worker into the given slot, never returns in the child
+        pid_t spawn(unsigned int slot);
+
+        /// Reap exited workers and restart the ones that were not retiring
+        void reap();
+
+        /// Replace the workers one by one, draining each old worker
+        void rolling_reload();
+
+        /// Stop all workers and wait for them
+        void shutdown();
+
+        /// Send SIGTERM and wait up to drain_timeout (plus a grace second) before SIGKILL
+        void retire(pid_t pid);
+
+    public:
+        /**
+         * @brief Create a supervisor.
+         * @param worker_count Number of worker processes to keep alive
+         * @param worker_main Function run by every worker process
+         * @param drain_timeout Time a retiring worker gets to finish its in-flight requests
+         */
+        process_supervisor(unsigned int worker_count, worker_main_t worker_main, std::chrono::milliseconds drain_timeout);
+
+        process_supervisor(const process_supervisor &) = delete;
+        process_supervisor &operator=(const process_supervisor &) = delete;
+
+        /**
+         * @brief Fork the workers and supervise them until SIGTERM/SIGINT.
+         * @return 0 in the master after a graceful shutdown, workers exit inside run() and never return
+         */
+        int run();
+    };
+}
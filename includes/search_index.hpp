@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace hh_web
+{
+    /// @brief One text field of a document, its terms counted weight times (a name can outweigh a description)
+    struct search_field
+    {
+        std::string_view text;
+        std::uint32_t weight = 1;
+    };
+
+    /// @brief A document found by search_index::search()
+    struct search_hit
+    {
+        std::int64_t id;
+        double score;
+    };
+
+    /**
+     * @brief Incremental full-text index with BM25 ranking and top-k retrieval.
+     *
+     * Documents are identified by the application's IDs and can be added, replaced and
+     * removed at any time; searches see every change made before them. Text is split into
+     * terms at anything that is not a letter or digit, ASCII letters are lowercased and
+     * non-ASCII (UTF-8) bytes are kept as part of a term.
+     *
+     * Each term has a posting list of the documents containing it, sorted and compressed:
+     * blocks of 128 postings, each a varint doc gap and a varint term frequency, with the
+     * block's last document and the few (frequency, length) pairs bounding its postings'
+     * scores kept uncompressed.
+     * Queries match any of their terms and are ranked by BM25. Evaluation goes document by
+     * document over the query's lists (MaxScore): once k results are known, lists whose best
+     * possible score cannot lift a document past the k-th are only probed, and blocks whose
+     * bound is too low are skipped without being decoded.
+     *
+     * Replacing or removing a document marks its postings dead instead of rewriting the
+     * lists, a list is rebuilt once half of it is dead and the whole index once half of its
+     * document slots are, both amortized over the changes that caused them.
+     *
+     * @note Thread safe: searches share a lock, changes take it exclusively. A batch holds it
+     *       for many changes.
+     */
+    class search_index
+    {
+    public:
+        /// BM25 term frequency saturation
+        static constexpr double k1 = 1.2;
+
+        /// BM25 document length normalization
+        static constexpr double b = 0.75;
+
+        /// Postings per compressed block
+        static constexpr std::size_t block_size = 128;
+
+        /// Longest term kept, longer ones are cut (and still match their prefix)
+        static constexpr std::size_t max_term_length = 64;
+
+    private:
+        /// A (frequency, document length) pair bounding postings of a block
+        struct bound_point
+        {
+            std::uint32_t frequency;
+            std::uint32_t length;
+        };
+
+        /// Most points kept per block, more are merged into looser ones
+        static constexpr std::size_t max_bound_points = 4;
+
+        struct block
+        {
+            std::uint32_t last_doc = 0;
+
+            /// Byte offset of the block's first posting in data
+            std::uint32_t offset = 0;
+
+            /**
+             * Every posting of the block has no higher frequency and no shorter document than
+             * one of these points. Taking (highest frequency, shortest document) alone is a loose
+             * bound when they come from different postings, and blocks of common terms would
+             * hardly ever be skipped.
+             */
+            bound_point points[max_bound_points];
+            std::uint32_t point_count = 0;
+        };
+
+        struct posting_list
+        {
+            std::vector<std::uint8_t> data;
+            std::vector<block> blocks;
+
+            /// Postings in data, dead ones included
+            std::uint32_t count = 0;
+
+            /// Postings of replaced or removed documents
+            std::uint32_t dead = 0;
+        };
+
+        /// A live document: its slot and the terms it has a posting in
+        struct document
+        {
+            std::uint32_t slot;
+            std::vector<std::uint32_t> terms;
+        };
+
+        std::unordered_map<std::string, std::uint32_t> dictionary;
+        std::vector<posting_list> lists;
+
+        /// Per slot, slots are handed out in increasing order so lists stay sorted by appending
+        std::vector<std::int64_t> slot_ids;
+        std::vector<std::uint32_t> slot_lengths;
+        std::vector<std::uint8_t> slot_alive;
+
+        std::unordered_map<std::int64_t, document> documents;
+        std::uint64_t total_length = 0;
+
+        mutable std::shared_mutex mutex;
+
+        /// Reads one posting list during a search
+        class cursor;
+
+        void put_locked(std::int64_t id, std::initializer_list<search_field> fields);
+        bool remove_locked(std::int64_t id);
+        /// Best BM25 frequency part of any posting in the block
+        static double block_bound(const block &entry, double average_length);
+        static void add_bound(block &entry, std::uint32_t frequency, std::uint32_t length);
+        void append(posting_list &list, std::uint32_t slot, std::uint32_t frequency, std::uint32_t length);
+        void rebuild_list(posting_list &list, const std::vector<std::uint32_t> *renumbered);
+        void compact();
+
+    public:
+        /**
+         * @brief Several changes under one exclusive lock, e.g. a bulk import.
+         * @note Searches wait until the batch is destroyed.
+         */
+        class batch
+        {
+        private:
+            search_index &index;
+            std::unique_lock<std::shared_mutex> lock;
+
+        public:
+            explicit batch(search_index &index) : index(index), lock(index.mutex)
+            {
+            }
+
+            /// @brief Add a document or replace its text
+            void put(std::int64_t id, std::initializer_list<search_field> fields)
+            {
+                index.put_locked(id, fields);
+            }
+
+            /// @brief Remove a document, false if it was not indexed
+            bool remove(std::int64_t id)
+            {
+                return index.remove_locked(id);
+            }
+        };
+
+        search_index() = default;
+
+        search_index(const search_index &) = delete;
+        search_index &operator=(const search_index &) = delete;
+
+        /**
+         * @brief Split text into terms as the index does.
+         * @param text Any text, a document field or a query
+         * @param out Receives the terms in order, repeated terms repeated
+         */
+        static void tokenize(std::string_view text, std::vector<std::string> &out);
+
+        /**
+         * @brief Add a document or replace its text.
+         * @param id The application's ID
+         * @param fields Its text, e.g. {{name, 2}, {description}}
+         */
+        void put(std::int64_t id, std::initializer_list<search_field> fields)
+        {
+            batch(*this).put(id, fields);
+        }
+
+        /// @brief Add a document or replace its text, one field of weight 1
+        void put(std::int64_t id, std::string_view text)
+        {
+            batch(*this).put(id, {search_field{text, 1}});
+        }
+
+        /// @brief Remove a document, false if it was not indexed
+        bool remove(std::int64_t id)
+        {
+            return batch(*this).remove(id);
+        }
+
+        /**
+         * @brief The best matches of a query.
+         * @param query Terms to look for, a document matches if it contains any of them
+         * @param limit Most results returned
+         * @return Matches by descending BM25 score, equal scores by ascending order of indexing
+         */
+        std::vector<search_hit> search(std::string_view query, std::size_t limit = 10) const;
+
+        /// @brief Number of indexed documents
+        std::size_t size() const
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            return documents.size();
+        }
+
+        /// @brief Number of distinct terms seen
+        std::size_t term_count() const
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            return dictionary.size();
+        }
+
+        /// @brief Bytes taken by the compressed posting lists
+        std::size_t posting_bytes() const;
+    };
+}
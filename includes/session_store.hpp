@@ -0,0 +1,256 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "timing_wheel.hpp"
+#include "web_types.hpp"
+
+namespace hh_web
+{
+    /// @brief Limits and cookie of a session_store
+    struct session_config
+    {
+        /// Name of the cookie holding the session ID
+        std::string cookie_name = "session";
+
+        /// Attributes sent with the cookie when a session is created
+        std::string cookie_attributes = "Path=/; HttpOnly; SameSite=Lax";
+
+        /// Lifetime of an unused session, each access starts it over; create() may give a session its own
+        std::chrono::seconds ttl{1800};
+
+        /// Most sessions kept, the least recently used are evicted beyond it
+        std::size_t max_sessions = 100000;
+
+        /// Most memory taken by sessions (IDs, values and bookkeeping, estimated), evicted like max_sessions
+        std::size_t max_bytes = 64 * 1024 * 1024;
+
+        /// Independently locked partitions, sessions are spread over them by ID
+        unsigned int shards = 16;
+
+        /// Create a session for requests without a valid session cookie, otherwise they pass without one
+        bool create_missing = true;
+    };
+
+    /**
+     * @brief Concurrent session store with per-session TTL and LRU eviction.
+     *
+     * Sessions are spread over independently locked shards by a hash of their ID, so
+     * requests of different sessions rarely wait for each other. Each shard keeps its
+     * sessions in least-recently-used order; a shard over its share of max_sessions or
+     * max_bytes evicts from the cold end, so memory stays bounded however many clients
+     * come and go.
+     *
+     * A session expires when it was not used for its TTL. Accesses only move the expiry
+     * time forward; with a timing_wheel, every session has one timer that, when it fires,
+     * either removes the session or is re-armed for the time left. A session used all the
+     * time costs one wheel operation per TTL, not one per access. Without a wheel, expired
+     * sessions are dropped when they are next looked up or evicted by LRU.
+     *
+     * IDs are 128 random bits from the system's secure random source, as 32 hex digits.
+     *
+     * @note Thread safe. The store must outlive the requests using it, and the wheel the
+     *       store. Timers still armed when the store is destroyed are cancelled, one already
+     *       running does nothing.
+     */
+    class session_store
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        /// A session's data
+        using values_t = std::map<std::string, std::string>;
+
+        /// Request parameter in which session_middleware() passes the session ID
+        static constexpr const char *id_param = "session_id";
+
+    private:
+        struct entry
+        {
+            std::string id;
+            values_t values;
+            clock::time_point expires;
+            std::chrono::milliseconds ttl;
+
+            /// Estimated memory of the session, what max_bytes counts
+            std::size_t bytes = 0;
+            timing_wheel::timer_id timer = 0;
+        };
+
+        /// On its own cache lines, shards locked by different threads do not share any
+        struct alignas(64) shard
+        {
+            std::mutex mutex;
+
+            /// Most recently used first
+            std::list<entry> lru;
+
+            /// Keys view the IDs of the entries, which list nodes keep in place
+            std::unordered_map<std::string_view, std::list<entry>::iterator> index;
+            std::size_t bytes = 0;
+        };
+
+        /// What timers reach through a weak_ptr, gone once the store is destroyed
+        struct state
+        {
+            session_config config;
+            timing_wheel *timers;
+            std::vector<std::unique_ptr<shard>> shards;
+            std::size_t shard_sessions;
+            std::size_t shard_bytes;
+
+            std::atomic<std::size_t> expired{0};
+            std::atomic<std::size_t> evicted{0};
+        };
+
+        std::shared_ptr<state> core;
+
+        static std::size_t shard_of(const state &core, const std::string &id);
+
+        /// The live session or null; drops it when expired, moves it to the front and restarts its TTL otherwise
+        static entry *use(state &core, shard &part, const std::string &id, clock::time_point now);
+
+        /// Remove a session from its shard, the caller holds the shard lock
+        static void unlink(state &core, shard &part, std::list<entry>::iterator it);
+
+        /// Evict least recently used sessions until the shard is within its limits, the front one is kept
+        static void enforce_limits(state &core, shard &part);
+
+        /// Timer callback: remove the session if it expired, re-arm its timer otherwise
+        static void on_timer(const std::weak_ptr<state> &weak, std::size_t shard_index, const std::string &id);
+
+        static void arm(const std::shared_ptr<state> &core, std::size_t shard_index, entry &session, std::chrono::milliseconds delay);
+
+        static std::size_t estimate_bytes(const entry &session);
+
+    public:
+        /**
+         * @brief Create the store.
+         * @param config Limits and cookie
+         * @param timers Wheel expiring sessions, e.g. web_server::get_timers(); null to expire them lazily
+         */
+        explicit session_store(session_config config = session_config(), timing_wheel *timers = nullptr);
+
+        /// @brief Cancel the sessions' timers
+        ~session_store();
+
+        session_store(const session_store &) = delete;
+        session_store &operator=(const session_store &) = delete;
+
+        /// @brief A new session ID: 32 hex digits of secure randomness
+        static std::string generate_id();
+
+        /**
+         * @brief Start a session.
+         * @param ttl Its lifetime when unused, zero for the configured one
+         * @return The new session's ID
+         */
+        std::string create(std::chrono::seconds ttl = std::chrono::seconds(0));
+
+        /// @brief Check whether a session is live, and restart its TTL if it is
+        bool touch(const std::string &id);
+
+        /// @brief One value of a session, empty when the session or the key does not exist
+        std::optional<std::string> get(const std::string &id, const std::string &key);
+
+        /// @brief All values of a session, empty when the session does not exist
+        std::optional<values_t> get_all(const std::string &id);
+
+        /// @brief Set a value, false when the session does not exist
+        bool set(const std::string &id, const std::string &key, std::string value);
+
+        /// @brief Remove a value, false when the session or the key does not exist
+        bool erase(const std::string &id, const std::string &key);
+
+        /**
+         * @brief Change a session's values in one step, e.g. read-modify-write a counter.
+         * @note change runs under the shard's lock: keep it short and do not call the store from it.
+         * @param id The session
+         * @param change Called with the session's values
+         * @return false when the session does not exist
+         */
+        bool update(const std::string &id, const std::function<void(values_t &)> &change);
+
+        /// @brief Give a session a new TTL, counted from now; false when it does not exist
+        bool set_ttl(const std::string &id, std::chrono::seconds ttl);
+
+        /// @brief End a session, e.g. on logout; false when it did not exist
+        bool destroy(const std::string &id);
+
+        /// @brief Number of sessions, expired ones not removed yet included
+        std::size_t size() const;
+
+        /// @brief Estimated memory taken by the sessions
+        std::size_t bytes() const;
+
+        /// @brief Number of sessions removed because their TTL passed
+        std::size_t get_expired() const
+        {
+            return core->expired.load(std::memory_order_relaxed);
+        }
+
+        /// @brief Number of sessions evicted to stay within max_sessions and max_bytes
+        std::size_t get_evicted() const
+        {
+            return core->evicted.load(std::memory_order_relaxed);
+        }
+
+        /// @brief The store's configuration
+        const session_config &get_config() const
+        {
+            return core->config;
+        }
+    };
+
+    /**
+     * @brief Middleware attaching a session to each request.
+     *
+     * Reads the session ID from the configured cookie (web_request::get_cookie). For a live
+     * session, its TTL is restarted and its ID passed to the handlers as the request parameter
+     * session_store::id_param. Without one, a session is created and its cookie set on the
+     * response, unless create_missing is off. Handlers then use the store with that ID.
+     *
+     * @code
+     * hh_web::session_store sessions(hh_web::session_config(), &server->get_timers());
+     * router->get("/api/cart", {hh_web::session_middleware<>(sessions), [&sessions](auto req, auto res)
+     *                          {
+     *                              auto cart = sessions.get(req->get_param(hh_web::session_store::id_param), "cart");
+     *                              ...
+     *                          }});
+     * @endcode
+     *
+     * @tparam T Type for request objects (must derive from web_request)
+     * @tparam G Type for response objects (must derive from web_response)
+     * @param store The sessions, must outlive the router
+     */
+    template <typename T = web_request, typename G = web_response>
+    web_request_handler_t<T, G> session_middleware(session_store &store)
+    {
+        return [&store](std::shared_ptr<T> request, std::shared_ptr<G> response) -> exit_code
+        {
+            const session_config &config = store.get_config();
+            std::string id = request->get_cookie(config.cookie_name);
+            if (id.empty() || !store.touch(id))
+            {
+                if (!config.create_missing)
+                    return exit_code::CONTINUE;
+                id = store.create();
+                response->add_cookie(config.cookie_name, id, config.cookie_attributes);
+            }
+            request->set_param(session_store::id_param, id);
+            return exit_code::CONTINUE;
+        };
+    }
+}
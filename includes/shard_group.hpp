@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "mpsc_queue.hpp"
+#include "thread_pool.hpp"
+
+namespace hh_web
+{
+    /**
+     * @brief Threads that each own one partition of some data, reached by message passing.
+     *
+     * Shared-nothing in the manner of Seastar: data is split by key into one partition per
+     * shard and only the shard's thread touches it, so partitions need no locks and their
+     * cache lines stay in one core's cache instead of bouncing between the cores that take
+     * turns on a mutex. Other threads send a shard work as a message, a closure pushed onto
+     * the shard's lock-free inbox, and get the result back through a future. Operations over
+     * every partition (listing everything) send one message per shard and combine the answers.
+     *
+     * A shard runs its messages one at a time; messages sent by one thread run in the order
+     * they were sent. An idle shard sleeps and is woken by the next message.
+     *
+     * @code
+     * hh_web::shard_group shards(4);
+     * std::vector<std::map<int, Item>> partitions(shards.size());
+     * unsigned int owner = shards.shard_of(id);
+     * Item item = shards.invoke_on(owner, [&partitions, owner, id]()
+     *                              { return partitions[owner].at(id); });
+     * @endcode
+     *
+     * @note A shard must not wait for another shard (invoke_on from inside a message): two
+     *       shards waiting for each other deadlock. Use post() between shards.
+     * @note Before start() and after stop() messages run right away on the calling thread,
+     *       so data can be set up before the shards run.
+     */
+    class shard_group
+    {
+    public:
+        using task_t = std::function<void()>;
+
+        /// current_shard() of threads that are not shards of any group
+        static constexpr unsigned int no_shard = ~0u;
+
+    private:
+        /// On its own cache lines, producers of one shard do not disturb the others
+        struct alignas(64) shard
+        {
+            mpsc_queue<task_t> inbox;
+
+            /// Messages pushed and not yet run, what an idle shard waits for
+            std::atomic<std::size_t> pending{0};
+
+            /// Set while the shard sleeps, producers only take the mutex to wake it then
+            std::atomic<bool> idle{false};
+            std::mutex mutex;
+            std::condition_variable wake;
+
+            std::thread thread;
+            std::atomic<std::size_t> processed{0};
+        };
+
+        std::vector<std::unique_ptr<shard>> shards;
+
+        /// CPU of shard i is cpus[i % cpus.size()], empty to leave shards unpinned
+        std::vector<int> cpus;
+
+        std::mutex start_mutex;
+        std::atomic<bool> running{false};
+        std::atomic<bool> stopping{false};
+
+        void run(unsigned int index);
+
+        /// Whether a message for the shard runs on the calling thread: not running, or already there
+        bool runs_here(unsigned int index) const;
+
+    public:
+        /**
+         * @brief Create the group.
+         * @param count Number of shards, at least one
+         * @param start_now Start the shard threads right away, pass false to start them later with start()
+         */
+        explicit shard_group(unsigned int count, bool start_now = true);
+
+        /// @brief Stop the shards after they ran what was sent to them
+        ~shard_group();
+
+        shard_group(const shard_group &) = delete;
+        shard_group &operator=(const shard_group &) = delete;
+
+        /**
+         * @brief Pin shard i to cpus[i % cpus.size()].
+         * @note Call before start(). Partitions a shard allocates after pinning are placed on its
+         *       CPU's NUMA node (first-touch).
+         */
+        void set_cpus(std::vector<int> cpus);
+
+        /// @brief Start the shard threads, does nothing if they are already running
+        void start();
+
+        /// @brief Stop the shard threads after they ran what was sent to them
+        void stop();
+
+        /// @brief Check whether the shard threads are running
+        bool is_running() const
+        {
+            return running.load();
+        }
+
+        /// @brief Number of shards
+        unsigned int size() const
+        {
+            return static_cast<unsigned int>(shards.size());
+        }
+
+        /// @brief The shard owning a key
+        unsigned int shard_of(std::uint64_t key) const
+        {
+            return static_cast<unsigned int>(key % shards.size());
+        }
+
+        /// @brief Index of the shard the calling thread is, no_shard for other threads
+        unsigned int current_shard() const;
+
+        /// @brief Number of messages a shard ran so far
+        std::size_t get_processed(unsigned int index) const
+        {
+            return shards[index % shards.size()]->processed.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Send a shard a message without waiting for it.
+         * @note Exceptions thrown by the task are logged.
+         * @param index The shard
+         * @param task Runs on the shard's thread
+         */
+        void post(unsigned int index, task_t task);
+
+        /**
+         * @brief Run a function on a shard.
+         * @note Called on the shard itself, the function runs right away.
+         * @param index The shard
+         * @param task Callable without arguments
+         * @return Future of the task's result, exceptions are delivered through it
+         */
+        template <typename F>
+        auto submit_to(unsigned int index, F &&task) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+        {
+            using result_type = std::invoke_result_t<std::decay_t<F>>;
+            auto packaged = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(task));
+            std::future<result_type> result = packaged->get_future();
+
+            if (runs_here(index))
+                (*packaged)();
+            else
+                post(index, [packaged]()
+                     { (*packaged)(); });
+            return result;
+        }
+
+        /**
+         * @brief Run a function on a shard and wait for its result.
+         * @note A pool worker waits inside a thread_pool::blocking_scope, the pool may start a
+         *       compensating worker meanwhile.
+         * @param index The shard
+         * @param task Callable without arguments
+         * @return The task's result, its exception is rethrown here
+         */
+        template <typename F>
+        auto invoke_on(unsigned int index, F &&task) -> std::invoke_result_t<std::decay_t<F>>
+        {
+            if (runs_here(index))
+                return std::forward<F>(task)();
+
+            auto result = submit_to(index, std::forward<F>(task));
+            if (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                thread_pool::blocking_scope blocking;
+                result.wait();
+            }
+            return result.get();
+        }
+
+        /**
+         * @brief Run a function on every shard and collect the results, e.g. to list every partition.
+         * @note The messages are sent to all shards first, so the shards work in parallel.
+         * @param task Called with the shard's index, must return a value
+         * @return The results, indexed by shard. The first exception is rethrown after all finished.
+         */
+        template <typename F>
+        auto invoke_on_all(F &&task) -> std::vector<std::invoke_result_t<std::decay_t<F> &, unsigned int>>
+        {
+            using result_type = std::invoke_result_t<std::decay_t<F> &, unsigned int>;
+            static_assert(!std::is_void_v<result_type>, "invoke_on_all needs a function returning a value, use post() on each shard otherwise");
+
+            std::vector<std::future<result_type>> pending;
+            pending.reserve(shards.size());
+            for (unsigned int index = 0; index < size(); ++index)
+            {
+                // task outlives the messages, every future is waited for before returning
+                pending.push_back(submit_to(index, [&task, index]()
+                                            { return task(index); }));
+            }
+
+            bool ready = std::all_of(pending.begin(), pending.end(), [](const std::future<result_type> &result)
+                                     { return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+            if (!ready)
+            {
+                thread_pool::blocking_scope blocking;
+                for (auto &result : pending)
+                    result.wait();
+            }
+            std::vector<result_type> results;
+            results.reserve(pending.size());
+            for (auto &result : pending)
+                results.push_back(result.get());
+            return results;
+        }
+    };
+}
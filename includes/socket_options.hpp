@@ -0,0 +1,50 @@
+#pragma once
+
+#include <optional>
+
+namespace hh_web
+{
+    /**
+     * @brief Socket level tuning for the server's listening sockets.
+     *
+     * Every field is optional, unset fields leave the kernel default alone. The options are
+     * applied to the listening sockets as soon as they listen (web_server::use_socket_options).
+     * On Linux accepted connections inherit TCP_NODELAY, the buffer sizes and SO_BUSY_POLL from
+     * their listener, so these also hold for every connection; TCP_DEFER_ACCEPT, TCP_FASTOPEN
+     * and SO_INCOMING_CPU are listener options by nature.
+     */
+    struct socket_options
+    {
+        /// TCP_NODELAY: disable Nagle, small writes (a header followed by a body) leave immediately
+        std::optional<bool> tcp_nodelay;
+
+        /// TCP_DEFER_ACCEPT: seconds a connection may stay in the kernel until its first data arrives,
+        /// the server is only woken up for connections that already sent a request
+        std::optional<int> defer_accept_seconds;
+
+        /// TCP_FASTOPEN: length of the pending TFO request queue, lets returning clients send the
+        /// request in the SYN and saves one round trip
+        std::optional<int> fastopen_queue_length;
+
+        /// SO_BUSY_POLL: microseconds a blocking receive busy-polls the device queue before sleeping
+        std::optional<int> busy_poll_microseconds;
+
+        /// SO_RCVBUF in bytes (the kernel doubles the value for bookkeeping)
+        std::optional<int> receive_buffer_bytes;
+
+        /// SO_SNDBUF in bytes (the kernel doubles the value for bookkeeping)
+        std::optional<int> send_buffer_bytes;
+
+        /// SO_INCOMING_CPU: with SO_REUSEPORT, prefer this listener for connections whose packets
+        /// are processed on that CPU, keeps RX processing and the handler on the same core
+        std::optional<int> incoming_cpu;
+
+        /**
+         * @brief Apply the set options to a listening socket.
+         * @note Failing options are logged and skipped, the others are still applied.
+         * @param fd Listening socket
+         * @return true if every set option was applied
+         */
+        bool apply_to_listener(int fd) const;
+    };
+}
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../libs/http-server/http-lib.hpp"
+#include "peer_credentials.hpp"
+#include "canned_response.hpp"
+
+namespace hh_web
+{
+    /**
+     * @brief A request that did not come through hh_http, e.g. one HTTP/2 stream.
+     */
+    struct synthetic_request
+    {
+        std::string method;
+
+        /// Path and query, as in the request line
+        std::string uri;
+        std::string version = "HTTP/2";
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string body;
+
+        /// Credentials of the connecting process, for requests received on a Unix domain socket
+        std::optional<peer_credentials> peer;
+
+        /// Set on the sub-requests of a batch, which may not start another batch
+        bool batch_entry = false;
+    };
+
+    /**
+     * @brief A response that is handed to a callback instead of being written by hh_http.
+     */
+    struct synthetic_response
+    {
+        int status = 200;
+        std::string message = "OK";
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::vector<std::pair<std::string, std::string>> trailers;
+        std::string body;
+
+        /// Set when a canned response was sent: it supplies Content-Type, Content-Length and the
+        /// body, headers holds only the ones added besides it
+        std::shared_ptr<const canned_response> canned;
+    };
+
+    namespace detail
+    {
+        inline bool iequals(const std::string &a, const std::string &b)
+        {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](unsigned char x, unsigned char y)
+                                                      { return std::tolower(x) == std::tolower(y); });
+        }
+    }
+
+    /**
+     * @brief The request behind a web_request: an hh_http request or a synthetic one.
+     * @note Offers the getters of hh_http::http_request, header names are matched case-insensitively.
+     */
+    class request_source
+    {
+    private:
+        std::optional<hh_http::http_request> wire;
+        synthetic_request local;
+
+    public:
+        request_source(hh_http::http_request &&request) : wire(std::move(request))
+        {
+        }
+
+        request_source(synthetic_request &&request) : local(std::move(request))
+        {
+        }
+
+        request_source(request_source &&) = default;
+        request_source &operator=(request_source &&) = default;
+
+        /// @brief true when the request did not come through hh_http
+        bool is_synthetic() const
+        {
+            return !wire.has_value();
+        }
+
+        std::string get_method() const
+        {
+            return wire ? wire->get_method() : local.method;
+        }
+
+        std::string get_uri() const
+        {
+            return wire ? wire->get_uri() : local.uri;
+        }
+
+        std::string get_version() const
+        {
+            return wire ? wire->get_version() : local.version;
+        }
+
+        std::vector<std::string> get_header(const std::string &name) const
+        {
+            if (wire)
+                return wire->get_header(name);
+
+            std::vector<std::string> values;
+            for (const auto &header : local.headers)
+            {
+                if (detail::iequals(header.first, name))
+                    values.push_back(header.second);
+            }
+            return values;
+        }
+
+        std::vector<std::pair<std::string, std::string>> get_headers() const
+        {
+            return wire ? wire->get_headers() : local.headers;
+        }
+
+        std::string get_body() const
+        {
+            return wire ? wire->get_body() : local.body;
+        }
+
+        std::optional<peer_credentials> get_peer_credentials() const
+        {
+            return wire ? std::nullopt : local.peer;
+        }
+
+        bool is_batch_entry() const
+        {
+            return !wire && local.batch_entry;
+        }
+    };
+
+    /**
+     * @brief The response behind a web_response: an hh_http response or a synthetic one.
+     *
+     * Offers the methods of hh_http::http_response. A synthetic response is delivered to the
+     * send callback on send() and the end callback is told on end() whether anything was sent,
+     * so the owner of the stream can finish it either way.
+     */
+    class response_target
+    {
+    public:
+        using send_callback = std::function<void(synthetic_response &&)>;
+        using end_callback = std::function<void(bool)>;
+
+    private:
+        std::optional<hh_http::http_response> wire;
+        synthetic_response local;
+        send_callback on_send;
+        end_callback on_end;
+        bool sent = false;
+
+        /// Turn a canned synthetic response into an ordinary one before it is changed or read
+        void expand_canned()
+        {
+            if (!local.canned)
+                return;
+            for (const auto &header : local.canned->get_headers())
+                local.headers.push_back(header);
+            local.body = std::string(local.canned->get_body());
+            local.canned.reset();
+        }
+
+    public:
+        response_target(hh_http::http_response &&response) : wire(std::move(response))
+        {
+        }
+
+        response_target(send_callback on_send, end_callback on_end = nullptr)
+            : on_send(std::move(on_send)), on_end(std::move(on_end))
+        {
+        }
+
+        response_target(response_target &&) = default;
+        response_target &operator=(response_target &&) = default;
+
+        bool is_synthetic() const
+        {
+            return !wire.has_value();
+        }
+
+        void set_status(int status, const std::string &message)
+        {
+            if (wire)
+                return wire->set_status(status, message);
+            expand_canned();
+            local.status = status;
+            local.message = message;
+        }
+
+        void add_header(const std::string &name, const std::string &value)
+        {
+            if (wire)
+                return wire->add_header(name, value);
+            local.headers.emplace_back(name, value);
+        }
+
+        void add_trailer(const std::string &name, const std::string &value)
+        {
+            if (wire)
+                return wire->add_trailer(name, value);
+            local.trailers.emplace_back(name, value);
+        }
+
+        void set_body(const std::string &body)
+        {
+            if (wire)
+                return wire->set_body(body);
+            local.canned.reset();
+            local.body = body;
+        }
+
+        void set_body(std::string &&body)
+        {
+            if (wire)
+                return wire->set_body(std::move(body));
+            local.canned.reset();
+            local.body = std::move(body);
+        }
+
+        std::string get_body() const
+        {
+            if (wire)
+                return wire->get_body();
+            return local.canned ? std::string(local.canned->get_body()) : local.body;
+        }
+
+        /**
+         * @brief Make a canned response the response, keeping the headers added so far.
+         * @note A synthetic response keeps the canned response as it is, so a writer owning the
+         *       bytes can send its pre-serialized buffer; an hh_http response takes a copy.
+         */
+        void set_canned(const std::shared_ptr<const canned_response> &canned)
+        {
+            if (wire)
+            {
+                wire->set_status(canned->get_status_code(), canned->get_status_message());
+                wire->clear_header_values("Content-Type");
+                wire->clear_header_values("Content-Length");
+                for (const auto &header : canned->get_headers())
+                    wire->add_header(header.first, header.second);
+                wire->set_body(std::string(canned->get_body()));
+                return;
+            }
+            local.status = canned->get_status_code();
+            local.message = canned->get_status_message();
+            local.body.clear();
+            local.headers.erase(std::remove_if(local.headers.begin(), local.headers.end(), [](const auto &header)
+                                               { return detail::iequals(header.first, "Content-Type") || detail::iequals(header.first, "Content-Length"); }),
+                                local.headers.end());
+            local.canned = canned;
+        }
+
+        std::vector<std::string> get_header(const std::string &name) const
+        {
+            if (wire)
+                return wire->get_header(name);
+
+            std::vector<std::string> values;
+            for (const auto &header : local.headers)
+            {
+                if (detail::iequals(header.first, name))
+                    values.push_back(header.second);
+            }
+            if (local.canned)
+            {
+                for (const auto &header : local.canned->get_headers())
+                {
+                    if (detail::iequals(header.first, name))
+                        values.push_back(header.second);
+                }
+            }
+            return values;
+        }
+
+        void clear_header_values(const std::string &name)
+        {
+            if (wire)
+                return wire->clear_header_values(name);
+            expand_canned();
+            local.headers.erase(std::remove_if(local.headers.begin(), local.headers.end(), [&name](const auto &header)
+                                               { return detail::iequals(header.first, name); }),
+                                local.headers.end());
+        }
+
+        void send()
+        {
+            if (wire)
+                return wire->send();
+            if (sent)
+                return;
+            sent = true;
+            if (on_send)
+                on_send(std::move(local));
+        }
+
+        void end()
+        {
+            if (wire)
+                return wire->end();
+            if (on_end)
+                on_end(sent);
+        }
+    };
+}
@@ -5,9 +5,12 @@
 #include <mutex>
 #include <condition_variable>
 #include <queue>
+#include <list>
 #include <functional>
 #include <vector>
 #include <atomic>
+#include <chrono>
+#include <algorithm>
 #include <iostream>
 namespace hh_web
 {
@@ -15,38 +18,149 @@ namespace hh_web
     class thread_pool
     {
     public:
-        thread_pool(unsigned int num_threads)
+        /**
+         * @brief Sizing rules of an elastic pool (set_elastic).
+         *
+         * The pool grows by one worker when the oldest queued task has waited longer than
+         * grow_after on grow_hysteresis consecutive monitor checks, and shrinks when a worker
+         * above min_threads found no task for idle_timeout. A worker running one task for longer
+         * than blocked_after is treated as blocked and does not count against max_threads.
+         */
+        struct elastic_config
         {
+            unsigned int min_threads = 1;
+            unsigned int max_threads = 1;
+
+            /// Queue wait that counts as a sign of too few workers
+            std::chrono::milliseconds grow_after{5};
+
+            /// Consecutive monitor checks the queue wait has to stay above grow_after
+            unsigned int grow_hysteresis = 2;
+
+            /// How long a surplus worker may stay idle before it exits
+            std::chrono::milliseconds idle_timeout{2000};
+
+            /// Time in one task after which a worker is considered blocked
+            std::chrono::milliseconds blocked_after{20};
+
+            /// Period of the monitor thread
+            std::chrono::milliseconds monitor_interval{2};
+
+            /// Workers that may exist on top of max_threads to replace blocked ones
+            unsigned int max_compensating = 64;
+        };
+
+        /**
+         * @brief Declares that the current task is about to block (I/O, a lock, a remote call).
+         *
+         * While a scope is alive its worker does not count as available: the pool starts a
+         * compensating worker if that leaves fewer than min_threads available workers or tasks
+         * are waiting. The extra worker retires once it stayed idle for idle_timeout.
+         * Constructed outside a pool worker the scope does nothing.
+         *
+         * @code
+         * {
+         *     hh_web::thread_pool::blocking_scope blocking;
+         *     auto rows = database.query(sql);
+         * }
+         * @endcode
+         */
+        class blocking_scope
+        {
+        private:
+            thread_pool *pool;
+
+        public:
+            blocking_scope() : pool(current_pool)
+            {
+                if (pool)
+                    pool->begin_blocking();
+            }
+
+            ~blocking_scope()
+            {
+                if (pool)
+                    pool->end_blocking();
+            }
+
+            blocking_scope(const blocking_scope &) = delete;
+            blocking_scope &operator=(const blocking_scope &) = delete;
+        };
+
+        /**
+         * @brief Create the pool.
+         * @param num_threads Number of worker threads
+         * @param start_now Start the workers right away, pass false to start them later with start()
+         *                  (e.g. after fork(), a process must not fork while owning threads)
+         */
+        thread_pool(unsigned int num_threads, bool start_now = true)
+        {
+            config.min_threads = config.max_threads = std::max(1u, num_threads);
             stop.store(false);
+            if (start_now)
+                start();
+        }
+
+        /**
+         * @brief Run a function at the start of every worker thread, before it takes tasks.
+         * @note Set it before start(). Used to pin workers to CPUs; memory a worker allocates and
+         *       touches in it after pinning is placed on that CPU's NUMA node (first-touch).
+         * @param init Called with the worker's index (0..num_threads-1)
+         */
+        void set_thread_init(std::function<void(unsigned int)> init)
+        {
+            std::lock_guard<std::mutex> start_lock(start_mutex);
+            thread_init = std::move(init);
+        }
+
+        /**
+         * @brief Let the pool size itself between min_threads and max_threads.
+         * @note Call before start(). start() then launches min_threads workers and a monitor thread.
+         * @param elastic The sizing rules
+         */
+        void set_elastic(const elastic_config &elastic)
+        {
+            std::lock_guard<std::mutex> start_lock(start_mutex);
+            config = elastic;
+            config.min_threads = std::max(1u, config.min_threads);
+            config.max_threads = std::max(config.min_threads, config.max_threads);
+            config.grow_hysteresis = std::max(1u, config.grow_hysteresis);
+        }
 
-            for (unsigned int i = 0; i < num_threads; ++i)
+        /// @brief Start the worker threads, does nothing if they are already running
+        void start()
+        {
+            std::lock_guard<std::mutex> start_lock(start_mutex);
+            if (started)
+                return;
+            started = true;
+
+            for (unsigned int i = 0; i < config.min_threads; ++i)
+                spawn_worker();
+            if (config.max_threads > config.min_threads)
             {
-                workers.emplace_back([this]()
-                                     {
-                                         while (!stop.load())
-                                         {
-                                             std::function<void()> task;
-                                             {
-                                                 std::unique_lock<std::mutex> lock(queue_mutex);
-                                                 condition.wait(lock, [this] { return stop.load() || !tasks.empty(); });
-                                                 if (stop.load() && tasks.empty())
-                                                     return;
-                                                 task = std::move(tasks.front());
-                                                 tasks.pop();
-                                             }
-                                             task();
-                                         } });
+                monitor = std::thread([this]()
+                                      { run_monitor(); });
             }
         }
+
         ~thread_pool()
         {
             std::cout << "Stopping thread pool..." << std::endl;
-            stop.store(true);
-            condition.notify_all();
-            for (std::thread &worker : workers)
+            stop_workers();
+            if (monitor.joinable())
+                monitor.join();
+
+            // workers entering a blocking scope see stop and spawn nothing, so the list is final
+            std::list<worker_slot> stopping;
+            {
+                std::lock_guard<std::mutex> start_lock(start_mutex);
+                stopping.splice(stopping.end(), workers);
+            }
+            for (worker_slot &worker : stopping)
             {
-                if (worker.joinable())
-                    worker.join();
+                if (worker.thread.joinable())
+                    worker.thread.join();
             }
         }
 
@@ -55,23 +169,241 @@ namespace hh_web
         {
             {
                 std::unique_lock<std::mutex> lock(queue_mutex);
-                tasks.emplace(std::forward<F>(f));
+                tasks.push(queued_task{std::function<void()>(std::forward<F>(f)), std::chrono::steady_clock::now()});
             }
             condition.notify_one();
         }
 
         void stop_workers()
         {
-            stop.store(true);
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                stop.store(true);
+            }
             condition.notify_all();
+            monitor_condition.notify_all();
+        }
+
+        /// @brief Number of live worker threads
+        unsigned int get_thread_count() const
+        {
+            return live.load();
+        }
+
+        /// @brief Number of workers inside a blocking_scope
+        unsigned int get_blocked_count() const
+        {
+            return blocked.load();
+        }
+
+        /// @brief Highest number of live workers so far
+        unsigned int get_peak_thread_count() const
+        {
+            return peak.load();
         }
 
     private:
-        std::vector<std::thread> workers;
-        std::queue<std::function<void()>> tasks;
+        struct queued_task
+        {
+            std::function<void()> run;
+            std::chrono::steady_clock::time_point queued;
+        };
+
+        struct worker_slot
+        {
+            std::thread thread;
+
+            /// Start of the running task in steady clock ticks, 0 while waiting for one
+            std::atomic<std::chrono::steady_clock::rep> busy_since{0};
+
+            /// Set by the worker as its last action, the monitor then joins it
+            std::atomic<bool> finished{false};
+        };
+
+        /// Pool the calling thread works for, used by blocking_scope
+        inline static thread_local thread_pool *current_pool = nullptr;
+
+        elastic_config config;
+        bool started = false;
+        unsigned int next_index = 0;
+
+        /// Guards workers, config, thread_init and started
+        std::mutex start_mutex;
+        std::function<void(unsigned int)> thread_init;
+        std::list<worker_slot> workers;
+
+        std::queue<queued_task> tasks;
         std::mutex queue_mutex;
         std::condition_variable condition;
         std::atomic<bool> stop;
+
+        std::atomic<unsigned int> live{0};
+        std::atomic<unsigned int> blocked{0};
+        std::atomic<unsigned int> peak{0};
+
+        std::thread monitor;
+        std::mutex monitor_mutex;
+        std::condition_variable monitor_condition;
+
+        /// Join the workers that retired, called with start_mutex held
+        void reap_finished()
+        {
+            for (auto it = workers.begin(); it != workers.end();)
+            {
+                if (it->finished.load())
+                {
+                    it->thread.join();
+                    it = workers.erase(it);
+                }
+                else
+                    ++it;
+            }
+        }
+
+        /// Start one worker, called with start_mutex held
+        void spawn_worker()
+        {
+            reap_finished();
+            workers.emplace_back();
+            worker_slot *slot = &workers.back();
+            unsigned int index = next_index++;
+            unsigned int count = ++live;
+            unsigned int highest = peak.load();
+            while (count > highest && !peak.compare_exchange_weak(highest, count))
+            {
+            }
+            slot->thread = std::thread([this, slot, index]()
+                                       { run_worker(*slot, index); });
+        }
+
+        /// Leave the pool if it has more workers than its minimum, false if this worker must stay
+        bool try_retire()
+        {
+            unsigned int count = live.load();
+            while (count > config.min_threads)
+            {
+                if (live.compare_exchange_weak(count, count - 1))
+                    return true;
+            }
+            return false;
+        }
+
+        void run_worker(worker_slot &slot, unsigned int index)
+        {
+            current_pool = this;
+            if (thread_init)
+                thread_init(index);
+
+            bool retired = false;
+            while (!stop.load())
+            {
+                queued_task task;
+                {
+                    std::unique_lock<std::mutex> lock(queue_mutex);
+                    bool ready = condition.wait_for(lock, config.idle_timeout, [this]
+                                                    { return stop.load() || !tasks.empty(); });
+                    if (!ready)
+                    {
+                        if (try_retire())
+                        {
+                            retired = true;
+                            break;
+                        }
+                        continue;
+                    }
+                    if (stop.load() && tasks.empty())
+                        break;
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                slot.busy_since.store(std::chrono::steady_clock::now().time_since_epoch().count());
+                task.run();
+                slot.busy_since.store(0);
+            }
+
+            if (!retired)
+                live--;
+            current_pool = nullptr;
+            slot.finished.store(true);
+        }
+
+        /// Workers that may exist right now: max_threads plus replacements for blocked workers
+        unsigned int thread_limit(unsigned int unavailable) const
+        {
+            return config.max_threads + std::min(unavailable, config.max_compensating);
+        }
+
+        void begin_blocking()
+        {
+            unsigned int now_blocked = ++blocked;
+            bool waiting;
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                waiting = !tasks.empty();
+            }
+
+            std::lock_guard<std::mutex> start_lock(start_mutex);
+            if (stop.load())
+                return;
+            unsigned int count = live.load();
+            unsigned int available = count > now_blocked ? count - now_blocked : 0;
+            if ((available < config.min_threads || waiting) && count < thread_limit(now_blocked))
+                spawn_worker();
+        }
+
+        void end_blocking()
+        {
+            blocked--;
+        }
+
+        /**
+         * Monitor loop of an elastic pool
+         * - Joins workers that retired
+         * - Counts workers stuck in one task for blocked_after as unavailable, like blocking scopes
+         * - Grows by one worker after grow_hysteresis consecutive checks with a queue wait above
+         *   grow_after, shrinking is left to the workers' idle timeout
+         */
+        void run_monitor()
+        {
+            unsigned int slow_checks = 0;
+            while (!stop.load())
+            {
+                {
+                    std::unique_lock<std::mutex> lock(monitor_mutex);
+                    monitor_condition.wait_for(lock, config.monitor_interval, [this]
+                                               { return stop.load(); });
+                }
+                if (stop.load())
+                    return;
+
+                auto now = std::chrono::steady_clock::now();
+                std::chrono::steady_clock::duration oldest_wait{0};
+                {
+                    std::lock_guard<std::mutex> lock(queue_mutex);
+                    if (!tasks.empty())
+                        oldest_wait = now - tasks.front().queued;
+                }
+
+                std::lock_guard<std::mutex> start_lock(start_mutex);
+                reap_finished();
+                unsigned int stuck = 0;
+                auto blocked_since = (now - config.blocked_after).time_since_epoch().count();
+                for (const worker_slot &worker : workers)
+                {
+                    auto since = worker.busy_since.load();
+                    if (since != 0 && since < blocked_since)
+                        stuck++;
+                }
+
+                slow_checks = oldest_wait > config.grow_after ? slow_checks + 1 : 0;
+                if (slow_checks >= config.grow_hysteresis && !stop.load() &&
+                    live.load() < thread_limit(std::max(stuck, blocked.load())))
+                {
+                    spawn_worker();
+                    slow_checks = 0;
+                }
+            }
+        }
     };
 
-};
\ No newline at end of file
+};
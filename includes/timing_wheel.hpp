@@ -0,0 +1,322 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "logger.hpp"
+
+namespace hh_web
+{
+    /**
+     * @brief Hierarchical timing wheel for large numbers of coarse timers.
+     *
+     * Timers are kept in intrusive doubly linked lists hanging off the wheel slots,
+     * so scheduling, cancelling and re-arming a timer are O(1) no matter how many
+     * timers exist. This is what idle timeouts and request deadlines need: a timer
+     * that gets pushed back on every read must not cost O(log n) each time.
+     *
+     * The wheel has 4 levels of 64 slots. With the default 10ms resolution level 0
+     * covers 640ms, and the whole wheel covers about 46 hours; longer timers are parked
+     * in the last level and re-placed when they cascade down.
+     *
+     * The wheel does not own a thread, the owner drives it by calling advance() from its
+     * loop (web_server runs it from a ticker thread at the wheel's resolution).
+     *
+     * @note All methods are thread-safe. Callbacks run on the thread calling advance(),
+     *       after the internal lock was released, so they may schedule or cancel timers.
+     */
+    class timing_wheel
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        /// Handle of a scheduled timer, 0 is never a valid id
+        using timer_id = std::uint64_t;
+
+    private:
+        static constexpr unsigned LEVEL_BITS = 6;
+        static constexpr unsigned SLOTS = 1u << LEVEL_BITS;
+        static constexpr unsigned LEVELS = 4;
+        static constexpr std::uint64_t SLOT_MASK = SLOTS - 1;
+        static constexpr std::uint64_t MAX_SPAN = (1ull << (LEVEL_BITS * LEVELS)) - 1;
+        static constexpr std::uint32_t NIL = std::numeric_limits<std::uint32_t>::max();
+
+        struct node
+        {
+            std::uint64_t expires = 0;  ///< Tick at which the timer fires
+            std::uint32_t prev = NIL;   ///< Previous node in the slot list
+            std::uint32_t next = NIL;   ///< Next node in the slot list (or in the free list)
+            std::uint32_t generation = 1;
+            std::uint32_t slot = NIL;   ///< Index in heads, NIL when not linked
+            std::function<void()> callback;
+        };
+
+        /// Tick length
+        const std::chrono::milliseconds resolution;
+        /// Time of tick 0
+        const clock::time_point start;
+
+        /// Next tick to be processed
+        std::uint64_t current_tick = 0;
+        /// Number of armed timers
+        std::size_t active = 0;
+
+        std::vector<node> nodes;
+        std::uint32_t free_head = NIL;
+        std::array<std::uint32_t, SLOTS * LEVELS> heads;
+
+        mutable std::mutex wheel_mutex;
+
+        static timer_id make_id(std::uint32_t index, std::uint32_t generation)
+        {
+            return (static_cast<timer_id>(generation) << 32) | (static_cast<timer_id>(index) + 1);
+        }
+
+        /// Resolve an id to its node index, NIL if the timer already fired or was cancelled
+        std::uint32_t find(timer_id id) const
+        {
+            std::uint32_t low = static_cast<std::uint32_t>(id & 0xffffffffu);
+            if (low == 0 || low > nodes.size())
+                return NIL;
+            std::uint32_t index = low - 1;
+            const node &n = nodes[index];
+            if (n.generation != static_cast<std::uint32_t>(id >> 32) || n.slot == NIL)
+                return NIL;
+            return index;
+        }
+
+        std::uint64_t ticks_for(std::chrono::milliseconds delay) const
+        {
+            if (delay.count() <= 0)
+                return 0;
+            return static_cast<std::uint64_t>((delay.count() + resolution.count() - 1) / resolution.count());
+        }
+
+        /// First tick processed at or after delay from now, counted from the clock rather than current_tick so a tick still pending does not fire the timer early
+        std::uint64_t expiry_for(std::chrono::milliseconds delay) const
+        {
+            if (delay.count() < 0)
+                delay = std::chrono::milliseconds(0);
+            clock::time_point now = clock::now();
+            std::chrono::milliseconds elapsed = now > start ? std::chrono::ceil<std::chrono::milliseconds>(now - start) : std::chrono::milliseconds(0);
+            return ticks_for(elapsed + delay);
+        }
+
+        void link(std::uint32_t index)
+        {
+            node &n = nodes[index];
+            std::uint64_t expires = n.expires < current_tick ? current_tick : n.expires;
+            std::uint64_t delta = expires - current_tick;
+            if (delta > MAX_SPAN)
+            {
+                // parked in the last level, re-placed with the real expiry when it cascades
+                expires = current_tick + MAX_SPAN;
+                delta = MAX_SPAN;
+            }
+
+            unsigned level = 0;
+            while (level + 1 < LEVELS && delta >= (1ull << (LEVEL_BITS * (level + 1))))
+                ++level;
+
+            std::uint32_t slot = level * SLOTS + static_cast<std::uint32_t>((expires >> (LEVEL_BITS * level)) & SLOT_MASK);
+            n.slot = slot;
+            n.prev = NIL;
+            n.next = heads[slot];
+            if (n.next != NIL)
+                nodes[n.next].prev = index;
+            heads[slot] = index;
+        }
+
+        void unlink(std::uint32_t index)
+        {
+            node &n = nodes[index];
+            if (n.prev != NIL)
+                nodes[n.prev].next = n.next;
+            else
+                heads[n.slot] = n.next;
+            if (n.next != NIL)
+                nodes[n.next].prev = n.prev;
+            n.prev = n.next = NIL;
+            n.slot = NIL;
+        }
+
+        void release(std::uint32_t index)
+        {
+            node &n = nodes[index];
+            n.generation++;
+            n.callback = nullptr;
+            n.next = free_head;
+            free_head = index;
+            active--;
+        }
+
+        /// Move every timer of one higher-level slot down to where it belongs now
+        void cascade(unsigned level)
+        {
+            std::uint32_t slot = level * SLOTS + static_cast<std::uint32_t>((current_tick >> (LEVEL_BITS * level)) & SLOT_MASK);
+            std::uint32_t index = heads[slot];
+            heads[slot] = NIL;
+            while (index != NIL)
+            {
+                std::uint32_t next = nodes[index].next;
+                link(index);
+                index = next;
+            }
+        }
+
+    public:
+        /**
+         * @brief Create an empty wheel.
+         * @param resolution Length of one tick, timers fire at most one tick late
+         */
+        explicit timing_wheel(std::chrono::milliseconds resolution = std::chrono::milliseconds(10))
+            : resolution(resolution.count() > 0 ? resolution : std::chrono::milliseconds(1)), start(clock::now())
+        {
+            heads.fill(NIL);
+        }
+
+        timing_wheel(const timing_wheel &) = delete;
+        timing_wheel &operator=(const timing_wheel &) = delete;
+
+        /**
+         * @brief Schedule a callback to run after a delay.
+         * @param delay Time from now until the timer fires, rounded up to the resolution
+         * @param callback Function to run when the timer fires
+         * @return Handle to cancel or re-arm the timer
+         */
+        timer_id schedule(std::chrono::milliseconds delay, std::function<void()> callback)
+        {
+            std::lock_guard<std::mutex> lock(wheel_mutex);
+            std::uint32_t index;
+            if (free_head != NIL)
+            {
+                index = free_head;
+                free_head = nodes[index].next;
+            }
+            else
+            {
+                index = static_cast<std::uint32_t>(nodes.size());
+                nodes.emplace_back();
+            }
+
+            node &n = nodes[index];
+            n.expires = expiry_for(delay);
+            n.callback = std::move(callback);
+            link(index);
+            active++;
+            return make_id(index, n.generation);
+        }
+
+        /**
+         * @brief Cancel a timer.
+         * @param id Handle returned by schedule()
+         * @return true if the timer was armed and is now cancelled, false if it already fired or was cancelled
+         */
+        bool cancel(timer_id id)
+        {
+            std::lock_guard<std::mutex> lock(wheel_mutex);
+            std::uint32_t index = find(id);
+            if (index == NIL)
+                return false;
+            unlink(index);
+            release(index);
+            return true;
+        }
+
+        /**
+         * @brief Push an armed timer back so it fires after a new delay from now.
+         * @param id Handle returned by schedule()
+         * @param delay New delay from now
+         * @return true if the timer was re-armed, false if it already fired or was cancelled
+         */
+        bool reset(timer_id id, std::chrono::milliseconds delay)
+        {
+            std::lock_guard<std::mutex> lock(wheel_mutex);
+            std::uint32_t index = find(id);
+            if (index == NIL)
+                return false;
+            unlink(index);
+            nodes[index].expires = expiry_for(delay);
+            link(index);
+            return true;
+        }
+
+        /**
+         * @brief Process all ticks up to the given time and run the expired callbacks.
+         * @param now Current time, usually clock::now()
+         * @return Number of callbacks run
+         */
+        std::size_t advance(clock::time_point now = clock::now())
+        {
+            std::vector<std::function<void()>> expired;
+            {
+                std::lock_guard<std::mutex> lock(wheel_mutex);
+                if (now < start)
+                    return 0;
+                std::uint64_t target = static_cast<std::uint64_t>((now - start) / resolution) + 1;
+
+                if (active == 0 && target > current_tick)
+                    current_tick = target;
+
+                while (current_tick < target)
+                {
+                    // when a lower level wraps around, the next slot of the level above moves down
+                    for (unsigned level = 1; level < LEVELS; ++level)
+                    {
+                        if ((current_tick & ((1ull << (LEVEL_BITS * level)) - 1)) != 0)
+                            break;
+                        cascade(level);
+                    }
+
+                    std::uint32_t slot = static_cast<std::uint32_t>(current_tick & SLOT_MASK);
+                    std::uint32_t index = heads[slot];
+                    heads[slot] = NIL;
+                    while (index != NIL)
+                    {
+                        std::uint32_t next = nodes[index].next;
+                        node &n = nodes[index];
+                        n.prev = n.next = NIL;
+                        n.slot = NIL;
+                        expired.push_back(std::move(n.callback));
+                        release(index);
+                        index = next;
+                    }
+                    current_tick++;
+                }
+            }
+
+            for (auto &callback : expired)
+            {
+                try
+                {
+                    if (callback)
+                        callback();
+                }
+                catch (const std::exception &e)
+                {
+                    logger::error("Error in timer callback: " + std::string(e.what()));
+                }
+            }
+            return expired.size();
+        }
+
+        /// @brief Number of armed timers
+        std::size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(wheel_mutex);
+            return active;
+        }
+
+        /// @brief Length of one tick
+        std::chrono::milliseconds get_resolution() const
+        {
+            return resolution;
+        }
+    };
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "json_validator.hpp"
+#include "json_writer.hpp"
+#include "logger.hpp"
+#include "synthetic_message.hpp"
+#include "thread_pool.hpp"
+#include "web_result.hpp"
+#include "web_route.hpp"
+#include "web_types.hpp"
+
+namespace hh_web
+{
+    /// @brief Limits and scheduling of a batch route
+    struct batch_config
+    {
+        /// Most sub-requests one batch may hold, larger batches are answered with 413
+        std::size_t max_requests = 20;
+
+        /// Run sub-requests concurrently on the worker pool, otherwise one after the other
+        bool parallel = true;
+
+        /// Most workers helping with one batch, the worker handling the batch included
+        unsigned int max_parallel = 4;
+    };
+
+    /// @brief One sub-request of a batch, as parsed from its JSON form
+    struct batch_request
+    {
+        std::string method = "GET";
+
+        /// Path and query
+        std::string uri;
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string body;
+    };
+
+    /**
+     * @brief Parse a batch body: {"requests": [...]} or the bare array.
+     *
+     * Each sub-request is an object with "method" (default GET), "path", optional "headers"
+     * (an object of strings) and an optional "body": a string is taken as it is, any other
+     * JSON value as its JSON text, so a JSON body can be written inline.
+     *
+     * @param body The batch body, validated JSON
+     * @param max_requests Most sub-requests allowed
+     * @return The sub-requests, or 400 / 413 errors naming the offending entry
+     */
+    web_expected<std::vector<batch_request>> parse_batch(std::string_view body, std::size_t max_requests);
+
+    /**
+     * @brief Write the answers of a batch: {"responses": [{"status", "headers", "body"}, ...]}.
+     *
+     * Bodies of JSON responses are embedded as JSON, others as strings. Content-Length and
+     * Connection are left out of the headers.
+     */
+    void write_batch_responses(json_writer &json, const std::vector<synthetic_response> &responses);
+
+    /**
+     * @brief POST route running many sub-requests in one round trip.
+     *
+     * The sub-requests go through the pipeline the route was given, web_server's routers,
+     * static files and default route, as synthetic requests: no socket, parser or second
+     * connection is involved. Headers of the batch request (Authorization, cookies) are passed
+     * on to every sub-request, its own headers take precedence. Sub-requests share the batch
+     * request's deadline and are flagged, so a batch route answers them with 400 instead of nesting.
+     *
+     * With parallel set, up to max_parallel - 1 helper tasks are queued on the worker pool.
+     * The worker handling the batch takes sub-requests too, so the batch completes even when
+     * no helper gets a worker; helpers that start late find nothing left and return.
+     *
+     * @tparam T Type for request objects (needs the synthetic constructor of web_request)
+     * @tparam G Type for response objects (needs the synthetic constructor of web_response)
+     */
+    template <typename T = web_request, typename G = web_response>
+    class web_batch_route : public web_route<T, G>
+    {
+    public:
+        /// Runs one request through the whole pipeline and sends its response
+        using pipeline_t = std::function<void(std::shared_ptr<T>, std::shared_ptr<G>)>;
+
+    private:
+        /// Shared with the helpers, which may start after the batch was answered
+        struct batch_state
+        {
+            pipeline_t pipeline;
+            std::vector<batch_request> requests;
+            std::vector<synthetic_response> responses;
+            std::vector<std::pair<std::string, std::string>> inherited;
+            std::shared_ptr<cancellation_token> token;
+
+            std::atomic<std::size_t> next{0};
+            std::atomic<std::size_t> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+
+        static bool inherited_header(const std::string &name)
+        {
+            return !detail::iequals(name, "content-length") && !detail::iequals(name, "content-type") &&
+                   !detail::iequals(name, "transfer-encoding") && !detail::iequals(name, "connection") &&
+                   !detail::iequals(name, "expect") && !detail::iequals(name, "upgrade");
+        }
+
+        static void run_one(batch_state &state, std::size_t index)
+        {
+            batch_request &entry = state.requests[index];
+            synthetic_response &answer = state.responses[index];
+
+            synthetic_request message;
+            message.method = std::move(entry.method);
+            message.uri = std::move(entry.uri);
+            message.version = "HTTP/1.1";
+            message.body = std::move(entry.body);
+            message.batch_entry = true;
+            message.headers = state.inherited;
+            bool has_content_type = false;
+            for (const auto &header : entry.headers)
+            {
+                has_content_type = has_content_type || detail::iequals(header.first, "content-type");
+                message.headers.erase(std::remove_if(message.headers.begin(), message.headers.end(), [&header](const auto &existing)
+                                                     { return detail::iequals(existing.first, header.first); }),
+                                      message.headers.end());
+            }
+            for (auto &header : entry.headers)
+                message.headers.push_back(std::move(header));
+            if (!message.body.empty() && !has_content_type)
+                message.headers.emplace_back("content-type", "application/json");
+
+            auto request = std::make_shared<T>(std::move(message));
+            if (state.token->has_deadline())
+                request->get_cancellation_token()->set_timeout(state.token->remaining());
+            auto response = std::make_shared<G>([&answer](synthetic_response &&sent)
+                                                { answer = std::move(sent); });
+            answer.status = 500;
+            answer.message = "Internal Server Error";
+            state.pipeline(request, response);
+        }
+
+        /// Take sub-requests until none is left
+        static void work(const std::shared_ptr<batch_state> &state)
+        {
+            std::size_t count = state->requests.size();
+            for (std::size_t index = state->next++; index < count; index = state->next++)
+            {
+                try
+                {
+                    run_one(*state, index);
+                }
+                catch (const std::exception &e)
+                {
+                    logger::error("Batch sub-request failed: " + std::string(e.what()));
+                }
+                if (++state->done == count)
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->finished.notify_all();
+                }
+            }
+        }
+
+        static web_request_handler_t<T, G> make_handler(batch_config config, pipeline_t pipeline, thread_pool *pool)
+        {
+            return [config, pipeline, pool](std::shared_ptr<T> request, std::shared_ptr<G> response) -> exit_code
+            {
+                // flagged rather than matched by path, so no spelling of the batch path slips through
+                if (request->is_batch_entry())
+                {
+                    write_error(response, web_error::bad_request("Batches cannot be nested"));
+                    return exit_code::EXIT;
+                }
+
+                std::string body = request->get_body();
+                json_validation valid = validate_json(body);
+                if (!valid)
+                {
+                    write_error(response, web_error::bad_request("Invalid JSON: " + valid.describe()));
+                    return exit_code::EXIT;
+                }
+                auto parsed = parse_batch(body, config.max_requests);
+                if (!parsed)
+                {
+                    write_error(response, parsed.error());
+                    return exit_code::EXIT;
+                }
+
+                auto state = std::make_shared<batch_state>();
+                state->pipeline = pipeline;
+                state->requests = std::move(*parsed);
+                state->responses.resize(state->requests.size());
+                state->token = request->get_cancellation_token();
+                for (auto &header : request->get_headers())
+                {
+                    if (inherited_header(header.first))
+                        state->inherited.push_back(std::move(header));
+                }
+
+                std::size_t count = state->requests.size();
+                if (config.parallel && pool && count > 1 && config.max_parallel > 1)
+                {
+                    std::size_t helpers = std::min<std::size_t>(count, config.max_parallel) - 1;
+                    for (std::size_t i = 0; i < helpers; ++i)
+                        pool->enqueue([state]()
+                                      { work(state); });
+                }
+                work(state);
+
+                if (state->done.load() < count)
+                {
+                    // the rest is being run by helpers right now
+                    thread_pool::blocking_scope blocking;
+                    std::unique_lock<std::mutex> lock(state->mutex);
+                    state->finished.wait(lock, [&state, count]()
+                                         { return state->done.load() == count; });
+                }
+
+                json_writer json;
+                write_batch_responses(json, state->responses);
+                response->set_status(200, "OK");
+                response->send_json(json);
+                return exit_code::EXIT;
+            };
+        }
+
+    public:
+        /**
+         * @brief Create the route.
+         * @param expression Path of the batch endpoint, e.g. "/api/batch"
+         * @param config Limits and scheduling
+         * @param pipeline Runs a sub-request through the routers and sends its response
+         * @param pool Workers for parallel sub-requests, null to run them one after the other
+         */
+        web_batch_route(const std::string &expression, const batch_config &config, pipeline_t pipeline, thread_pool *pool)
+            : web_route<T, G>("POST", expression, {make_handler(config, std::move(pipeline), pool)})
+        {
+        }
+    };
+}
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "hpack.hpp"
+#include "mpsc_queue.hpp"
+#include "timing_wheel.hpp"
+
+namespace hh_web
+{
+    /// An outbound request
+    struct client_request
+    {
+        std::string method = "GET";
+
+        /// Absolute http:// URL, e.g. http://127.0.0.1:8080/items?page=2
+        std::string url;
+
+        /// Extra headers, Host and Content-Length are added by the client
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string body;
+
+        /// Deadline for the whole exchange including queueing and connecting, 0 for the client's default
+        std::chrono::milliseconds timeout{0};
+    };
+
+    /// The answer to a client_request, or the reason there is none
+    struct client_response
+    {
+        /// HTTP status, 0 when the request failed (see error)
+        int status = 0;
+        std::string reason;
+
+        /// Header names as received (lowercase over HTTP/2), trailers are appended after them
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string body;
+
+        /// Empty on success, otherwise why the request failed (timeout, connection refused, ...)
+        std::string error;
+
+        /// @brief Whether a response was received, whatever its status
+        bool ok() const
+        {
+            return error.empty() && status != 0;
+        }
+
+        /// @brief Get the first header with the given name (case-insensitive), empty if absent
+        std::string get_header(const std::string &name) const;
+    };
+
+    /// Limits and timeouts of a web_client
+    struct web_client_config
+    {
+        /// Connections per host:port, HTTP/2 hosts normally use a single one
+        std::size_t max_connections_per_host = 8;
+
+        /// Requests in flight on one HTTP/1.1 connection. Above 1, idempotent requests are pipelined
+        std::size_t max_pipeline_depth = 1;
+
+        std::chrono::milliseconds connect_timeout{std::chrono::seconds(5)};
+        std::chrono::milliseconds request_timeout{std::chrono::seconds(30)};
+
+        /// Keep-alive connections without requests are closed after this long
+        std::chrono::milliseconds idle_timeout{std::chrono::seconds(60)};
+
+        /// Responses with a larger body fail instead of growing without bound
+        std::size_t max_response_size = 64 * 1024 * 1024;
+    };
+
+    /**
+     * @brief Asynchronous HTTP client with per-host keep-alive connection pools.
+     *
+     * Handlers that call other services hand the request to the client and either get a
+     * callback or wait on a future; no worker sits in connect() or recv() meanwhile. All
+     * sockets live on one epoll loop thread owned by the client:
+     * - every host:port has a pool of up to max_connections_per_host connections, which are
+     *   kept alive between requests and closed after idle_timeout
+     * - with max_pipeline_depth above 1, idempotent requests are pipelined on busy HTTP/1.1
+     *   connections instead of waiting for a free one
+     * - hosts registered with use_http2() are spoken to in cleartext HTTP/2 with prior
+     *   knowledge, all their requests share one multiplexed connection
+     * - each request has a deadline on the client's timing wheel covering queueing,
+     *   connecting and the response
+     *
+     * Requests are submitted from any thread through a lock-free queue and an eventfd, the
+     * same way workers hand responses to http2_listener.
+     *
+     * @note Only http:// URLs are supported. Host names are resolved once per host:port, on
+     *       the loop thread.
+     * @note Idempotent requests whose reused connection turns out to be closed by the server
+     *       are retried once on a new connection.
+     */
+    class web_client
+    {
+    public:
+        /// Receives the response, on the client's loop thread
+        using response_callback = std::function<void(client_response &&)>;
+
+    private:
+        /// A request from submission until its callback ran
+        struct exchange
+        {
+            std::uint64_t id = 0;
+            client_request request;
+            response_callback callback;
+
+            std::string pool_key;
+            std::string path;
+            timing_wheel::timer_id timer = 0;
+
+            /// Connection (and HTTP/2 stream) carrying it, 0 while waiting in its pool
+            std::uint64_t connection = 0;
+            std::uint32_t stream_id = 0;
+            bool retried = false;
+
+            client_response response;
+
+            /// HTTP/2 request body still to send and the stream's send window
+            std::size_t body_offset = 0;
+            std::int64_t send_window = 0;
+            /// HTTP/2 response bytes not credited back to the server yet
+            std::uint32_t unacknowledged = 0;
+        };
+
+        /// How the body of the HTTP/1.1 response in progress is delimited
+        enum class body_mode
+        {
+            NONE,
+            LENGTH,
+            CHUNKED,
+            UNTIL_CLOSE
+        };
+
+        struct connection
+        {
+            int fd = -1;
+            std::uint64_t id = 0;
+            std::string pool_key;
+            bool http2 = false;
+            bool connected = false;
+            /// No new requests, closed once the ones in flight are done
+            bool draining = false;
+
+            std::string output;
+            std::size_t output_offset = 0;
+            bool writable_armed = false;
+            std::string input;
+
+            timing_wheel::timer_id connect_timer = 0;
+            /// Responses completed on this connection, a reused connection may be stale
+            std::size_t completed = 0;
+            /// Closes the connection after idle_timeout, armed when its last request completes and cancelled on checkout
+            timing_wheel::timer_id idle_timer = 0;
+
+            /// HTTP/1.1: requests in flight in send order, and the state of the first one's response
+            std::deque<std::uint64_t> in_flight;
+            bool headers_done = false;
+            body_mode mode = body_mode::NONE;
+            std::size_t remaining = 0;
+            bool chunk_trailer = false;
+            bool close_after = false;
+
+            /// HTTP/2
+            std::unique_ptr<hpack_encoder> encoder;
+            std::unique_ptr<hpack_decoder> decoder;
+            std::unordered_map<std::uint32_t, std::uint64_t> streams;
+            std::uint32_t next_stream = 1;
+            std::int64_t send_window = 65535;
+            std::uint32_t peer_initial_window = 65535;
+            std::uint32_t peer_max_frame = 16384;
+            std::uint32_t peer_max_streams = 100;
+            std::uint32_t unacknowledged = 0;
+            std::string header_block;
+            std::uint32_t header_stream = 0;
+            bool header_end_stream = false;
+        };
+
+        /// The connections and waiting requests of one host:port
+        struct host_pool
+        {
+            std::string host;
+            std::string port;
+            bool http2 = false;
+
+            bool resolved = false;
+            sockaddr_storage address{};
+            socklen_t address_length = 0;
+
+            std::deque<std::uint64_t> waiting;
+            std::vector<std::uint64_t> connections;
+        };
+
+        struct submission
+        {
+            client_request request;
+            response_callback callback;
+        };
+
+        web_client_config config;
+        std::unordered_set<std::string> http2_hosts;
+
+        int epoll_fd = -1;
+        int event_fd = -1;
+        std::thread loop;
+        std::atomic<bool> running{false};
+
+        mpsc_queue<submission> submissions;
+        std::atomic<bool> signalled{false};
+
+        /// Request deadlines and connect timeouts, advanced by the loop
+        timing_wheel timers;
+
+        std::unordered_map<std::uint64_t, exchange> exchanges;
+        std::unordered_map<std::uint64_t, connection> connections;
+        std::unordered_map<std::string, host_pool> pools;
+        std::uint64_t next_exchange_id = 1;
+        std::uint64_t next_connection_id = 1;
+
+        std::atomic<std::size_t> connections_opened{0};
+        std::atomic<std::size_t> requests_completed{0};
+
+        void run();
+        void drain_submissions();
+        void arm_idle(connection &conn);
+
+        /// Send waiting requests of a pool over free connections, opening new ones as allowed
+        void pump(const std::string &pool_key);
+        bool open_connection(host_pool &pool, const std::string &pool_key);
+        bool can_accept(const connection &conn, const exchange &ex) const;
+        void assign(connection &conn, exchange &ex);
+
+        void handle_event(std::uint64_t connection_id, std::uint32_t events);
+        void handle_connected(connection &conn);
+        void handle_readable(connection &conn);
+        void flush(connection &conn);
+        void update_events(connection &conn, bool want_write);
+
+        /// Parse responses at the front of the HTTP/1.1 pipeline, false on a malformed response
+        bool parse_http1(connection &conn);
+        void finish_http1(connection &conn);
+
+        void start_http2(connection &conn);
+        /// Process complete frames in conn.input, false on a connection error
+        bool receive_http2(connection &conn);
+        bool handle_http2_headers(connection &conn);
+        void send_http2_bodies(connection &conn);
+
+        /// Close a connection; requests in flight are retried when allowed, otherwise failed with error
+        void close_connection(std::uint64_t id, const std::string &error);
+        void requeue_or_fail(std::uint64_t exchange_id, bool retry, const std::string &error);
+
+        void complete(std::uint64_t exchange_id);
+        void fail(std::uint64_t exchange_id, const std::string &error);
+        void expire(std::uint64_t exchange_id);
+        void deliver(response_callback &callback, client_response &&response);
+
+    public:
+        web_client(const web_client_config &config = web_client_config{});
+        ~web_client();
+
+        web_client(const web_client &) = delete;
+        web_client &operator=(const web_client &) = delete;
+
+        /**
+         * @brief Talk cleartext HTTP/2 (prior knowledge) to a host, before start().
+         * @param authority host:port as it appears in the URLs, e.g. "127.0.0.1:8081"
+         */
+        void use_http2(const std::string &authority)
+        {
+            http2_hosts.insert(authority);
+        }
+
+        /**
+         * @brief Start the loop thread.
+         * @return false if the event loop could not be created, the error is logged
+         */
+        bool start();
+
+        /// @brief Stop the loop, requests still in flight fail with "client stopped"
+        void stop();
+
+        /**
+         * @brief Send a request, callable from any thread.
+         * @param request The request
+         * @param callback Receives the response on the loop thread; keep it short or hand the
+         *                 response off (e.g. to a worker pool)
+         * @note Fails right away, on the calling thread, when the client is not running.
+         */
+        void request(client_request request, response_callback callback);
+
+        /// @brief Send a request, the future is ready once the response (or the error) arrived
+        std::future<client_response> request(client_request request);
+
+        /**
+         * @brief Send a request and wait for its response.
+         * @note The waiting worker is inside a thread_pool::blocking_scope, so an elastic request
+         *       pool may start a compensating worker meanwhile.
+         */
+        client_response request_and_wait(client_request request);
+
+        /// @brief GET a URL
+        std::future<client_response> get(const std::string &url);
+
+        /// @brief POST a body to a URL
+        std::future<client_response> post(const std::string &url, const std::string &body, const std::string &content_type = "application/json");
+
+        bool is_running() const
+        {
+            return running.load();
+        }
+
+        std::size_t get_connections_opened() const
+        {
+            return connections_opened.load();
+        }
+
+        std::size_t get_requests_completed() const
+        {
+            return requests_completed.load();
+        }
+    };
+}
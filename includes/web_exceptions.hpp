@@ -20,8 +20,19 @@ namespace hh_web
     {
         int status_code = 500;                                ///< HTTP status code (default: 500 Internal Server Error)
         std::string status_message = "Internal Server Error"; ///< HTTP status message
-        std::string _formatted_message;                       ///< Cached formatted message for what()
+        std::string _message;                                 ///< Message as given, without status
+        std::string _formatted_message;                       ///< Formatted once on construction, returned by what()
+
     public:
+        /**
+         * @brief Format a message the way what() reports it.
+         * @return "Web Exception [<status_code> - <status_message>]: <message>"
+         */
+        static std::string format(int status_code, const std::string &status_message, const std::string &message)
+        {
+            return "Web Exception [" + std::to_string(status_code) + " - " + status_message + "]: " + message;
+        }
+
         /**
          * @brief Construct web exception with error message.
          * @param message Descriptive error message explaining the web operation failure
@@ -29,7 +40,7 @@ namespace hh_web
          * Creates a web exception with default HTTP 500 status code and "Internal Server Error" message.
          * Uses default type "WEB_EXCEPTION" and function "web_function".
          */
-        explicit web_exception(const std::string &message) : socket_exception(message, "WEB_EXCEPTION", "web_function"), _formatted_message(message)
+        explicit web_exception(const std::string &message) : socket_exception(message, "WEB_EXCEPTION", "web_function"), _message(message), _formatted_message(format(500, "Internal Server Error", message))
         {
         }
 
@@ -42,7 +53,7 @@ namespace hh_web
          * Creates a web exception with custom HTTP status information for proper client response.
          */
         explicit web_exception(const std::string &message, int status_code, const std::string &status_message)
-            : socket_exception(message, "", ""), status_code(status_code), status_message(status_message), _formatted_message(message) {}
+            : socket_exception(message, "", ""), status_code(status_code), status_message(status_message), _message(message), _formatted_message(format(status_code, status_message, message)) {}
 
         /**
          * @brief Construct web exception with type and function information.
@@ -53,7 +64,7 @@ namespace hh_web
          * Creates a web exception with custom type and function information while maintaining
          * default HTTP 500 status code.
          */
-        explicit web_exception(const std::string &message, const std::string &type, const std::string &function) : socket_exception(message, type, function), _formatted_message(message) {}
+        explicit web_exception(const std::string &message, const std::string &type, const std::string &function) : socket_exception(message, type, function), _message(message), _formatted_message(format(500, "Internal Server Error", message)) {}
 
         /**
          * @brief Construct web exception with full customization.
@@ -65,7 +76,7 @@ namespace hh_web
          * Creates a web exception with complete customization of all parameters including
          * HTTP status code while using default status message.
          */
-        explicit web_exception(const std::string &message, const std::string &type, const std::string &function, int status_code = 500, std::string status_message = "Internal Server Error") : socket_exception(message, type, function), status_code(status_code), status_message(status_message), _formatted_message(message) {}
+        explicit web_exception(const std::string &message, const std::string &type, const std::string &function, int status_code = 500, std::string status_message = "Internal Server Error") : socket_exception(message, type, function), status_code(status_code), status_message(status_message), _message(message), _formatted_message(format(status_code, status_message, message)) {}
 
         /**
          * @brief Get the HTTP status message.
@@ -96,7 +107,7 @@ namespace hh_web
         /**
          * @brief Get the formatted error message string.
          * @return C-style string containing the formatted error message with HTTP status information
-         * @note Thread-safe and returns a persistent pointer to the formatted message
+         * @note Thread-safe, the message is formatted once when the exception is constructed
          *
          * Overrides the base class what() method to include HTTP status code and message
          * in the formatted error output. The format includes status code, status message,
@@ -104,9 +115,25 @@ namespace hh_web
          */
         std::string what() noexcept override
         {
-            std::string formatted_message = "Web Exception [" + std::to_string(status_code) + " - " + status_message + "]: " + _formatted_message;
+            return _formatted_message;
+        }
 
-            return formatted_message;
+        /**
+         * @brief Get the message the exception was constructed with.
+         * @return Reference to the message, without the status what() adds
+         */
+        const std::string &get_message() const noexcept
+        {
+            return _message;
+        }
+
+        /**
+         * @brief Get the formatted error message without copying it.
+         * @return Reference to the message what() returns, valid as long as the exception
+         */
+        const std::string &get_formatted_message() const noexcept
+        {
+            return _formatted_message;
         }
     };
 
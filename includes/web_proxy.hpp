@@ -0,0 +1,265 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.hpp"
+#include "synthetic_message.hpp"
+#include "web_types.hpp"
+#include "web_exceptions.hpp"
+#include "web_utilities.hpp"
+#include "web_route.hpp"
+#include "web_client.hpp"
+
+namespace hh_web
+{
+    /// How a proxy_upstream spreads requests over its servers
+    enum class proxy_balance
+    {
+        /// Each request goes to the next healthy server
+        ROUND_ROBIN,
+        /// Each request goes to the healthy server with the fewest requests in flight
+        LEAST_IN_FLIGHT
+    };
+
+    /// Servers, balancing and health checking of a proxy_upstream
+    struct proxy_config
+    {
+        /// Base URLs of the servers, e.g. "http://10.0.0.5:8080" or "http://10.0.0.6:8080/api"
+        std::vector<std::string> servers;
+        proxy_balance balance = proxy_balance::ROUND_ROBIN;
+
+        /// Path probed with GET on every server, empty to rely on passive checks only
+        std::string health_path = "/health";
+        std::chrono::milliseconds health_interval{std::chrono::seconds(5)};
+        std::chrono::milliseconds health_timeout{std::chrono::seconds(1)};
+
+        /// Consecutive failures after which a server is taken out, and successes after which it is back
+        unsigned int unhealthy_after = 3;
+        unsigned int healthy_after = 2;
+
+        /// Deadline of a forwarded request, the request's own deadline wins when it is earlier
+        std::chrono::milliseconds request_timeout{std::chrono::seconds(30)};
+
+        /// Remove the route's prefix ("/legacy" of "/legacy/*") before forwarding
+        bool strip_prefix = true;
+
+        /// Speak cleartext HTTP/2 to the servers (prior knowledge)
+        bool http2 = false;
+
+        /// Connection pools towards the servers
+        web_client_config client;
+    };
+
+    /**
+     * @brief A group of upstream servers behind a proxy route.
+     *
+     * Forwards requests over the keep-alive connection pools of its own web_client and
+     * spreads them over the servers that are currently healthy:
+     * - active checks: every health_interval each server gets a GET health_path, a 2xx or
+     *   3xx answer counts as success
+     * - passive checks: a forwarded request failing without response (refused, reset,
+     *   timeout) counts as failure
+     * After unhealthy_after consecutive failures a server gets no more requests, after
+     * healthy_after consecutive successful checks it is back. When no server is healthy,
+     * requests are spread over all of them rather than refused.
+     *
+     * An idempotent request that fails without response is retried once on another server.
+     *
+     * @note One instance may back several routes, routers and servers.
+     */
+    class proxy_upstream
+    {
+    private:
+        struct server_state
+        {
+            std::string base;
+            std::atomic<bool> healthy{true};
+            std::atomic<unsigned int> failures{0};
+            std::atomic<unsigned int> successes{0};
+            std::atomic<std::size_t> in_flight{0};
+            std::atomic<std::size_t> requests{0};
+            std::atomic<std::size_t> errors{0};
+        };
+
+        proxy_config config;
+        std::vector<std::unique_ptr<server_state>> servers;
+        std::atomic<std::size_t> next{0};
+
+        web_client client;
+
+        std::thread health_thread;
+        std::mutex health_mutex;
+        std::condition_variable health_wakeup;
+        bool stopping = false;
+        /// Set once the client and the health checks run, see start()
+        std::atomic<bool> started{false};
+
+        /// Start the client and the health checks on first use, never before use_processes() forks
+        void start();
+        /// Index of the server for the next request, skipping exclude (SIZE_MAX for none)
+        std::size_t pick(std::size_t exclude);
+        void record(std::size_t index, bool success);
+        void run_health_checks();
+
+    public:
+        /// Health and counters of one server, see get_servers()
+        struct server_status
+        {
+            std::string base;
+            bool healthy = true;
+            std::size_t in_flight = 0;
+            std::size_t requests = 0;
+            std::size_t errors = 0;
+        };
+
+        /**
+         * @brief Create the group. Its client and its health checks start with the first forward().
+         * @throws web_exception if no server is given or a server URL is not http://
+         */
+        explicit proxy_upstream(const proxy_config &config);
+        ~proxy_upstream();
+
+        proxy_upstream(const proxy_upstream &) = delete;
+        proxy_upstream &operator=(const proxy_upstream &) = delete;
+
+        /**
+         * @brief Send a request to one of the servers and wait for the answer.
+         * @param request Method, headers and body; url is set from the chosen server
+         * @param target Path and query appended to the server's base URL
+         * @note Waits inside a thread_pool::blocking_scope, like web_client::request_and_wait(), but
+         *       no longer than the request's deadline.
+         * @return The server's response, or a response with error set when every attempt failed
+         * @throws web_exception if the client cannot be started
+         */
+        client_response forward(client_request request, const std::string &target);
+
+        /// @brief Whether a header is connection-specific and must not be forwarded (RFC 9110 section 7.6.1)
+        static bool is_hop_by_hop(const std::string &name);
+
+        const proxy_config &get_config() const
+        {
+            return config;
+        }
+
+        /// @brief Number of servers currently taking requests
+        std::size_t get_healthy_count() const;
+
+        /// @brief Health and counters of every server
+        std::vector<server_status> get_servers() const;
+    };
+
+    /**
+     * @brief Route forwarding every method under a path to a proxy_upstream.
+     *
+     * The request's method, headers (without hop-by-hop ones) and body go to the upstream,
+     * with X-Forwarded-Host and X-Forwarded-Proto added. The upstream's status, headers and
+     * body become the response. An upstream that cannot be reached answers 502, one that
+     * does not answer in time 504.
+     *
+     * @tparam T Type for request objects (must derive from web_request)
+     * @tparam G Type for response objects (must derive from web_response)
+     */
+    template <typename T = web_request, typename G = web_response>
+    class web_proxy_route : public web_route<T, G>
+    {
+    private:
+        /// "/legacy/*" -> "/legacy"
+        static std::string prefix_of(const std::string &expression)
+        {
+            std::string prefix = expression;
+            if (prefix.size() >= 2 && prefix.compare(prefix.size() - 2, 2, "/*") == 0)
+                prefix.erase(prefix.size() - 2);
+            return prefix;
+        }
+
+        static web_request_handler_t<T, G> make_handler(std::shared_ptr<proxy_upstream> upstream, std::string prefix)
+        {
+            return [upstream, prefix](std::shared_ptr<T> request, std::shared_ptr<G> response) -> exit_code
+            {
+                std::string target = request->get_uri();
+                if (upstream->get_config().strip_prefix && !prefix.empty() && target.compare(0, prefix.size(), prefix) == 0)
+                    target.erase(0, prefix.size());
+                if (target.empty() || target[0] != '/')
+                    target.insert(0, "/");
+
+                client_request call;
+                call.method = request->get_method();
+                call.body = request->get_body();
+                for (const auto &header : request->get_headers())
+                {
+                    if (!proxy_upstream::is_hop_by_hop(header.first))
+                        call.headers.push_back(header);
+                }
+                auto host = request->get_header("host");
+                if (!host.empty())
+                    call.headers.emplace_back("X-Forwarded-Host", host.front());
+                call.headers.emplace_back("X-Forwarded-Proto", "http");
+
+                auto token = request->get_cancellation_token();
+                if (token->has_deadline())
+                {
+                    call.timeout = token->remaining();
+                    if (call.timeout.count() <= 0)
+                        throw web_exception("Request deadline exceeded", "DEADLINE_EXCEEDED", "web_proxy_route::handle_request", 504, "Gateway Timeout");
+                }
+
+                client_response answer = upstream->forward(std::move(call), target);
+                if (!answer.ok())
+                {
+                    // answered here, request_handler would turn an exception into a 500
+                    logger::error("Proxy " + request->get_method() + " " + target + " failed: " + answer.error);
+                    if (answer.error == "timeout")
+                    {
+                        response->set_status(504, "Gateway Timeout");
+                        response->send_text("504 Gateway Timeout");
+                    }
+                    else
+                    {
+                        response->set_status(502, "Bad Gateway");
+                        response->send_text("502 Bad Gateway");
+                    }
+                    return exit_code::EXIT;
+                }
+
+                response->set_status(answer.status, answer.reason);
+                for (const auto &header : answer.headers)
+                {
+                    if (!proxy_upstream::is_hop_by_hop(header.first) && !detail::iequals(header.first, "content-length"))
+                        response->add_header(header.first, header.second);
+                }
+                response->set_body(answer.body);
+                response->send();
+                return exit_code::EXIT;
+            };
+        }
+
+    public:
+        /**
+         * @brief Create the route.
+         * @param expression Path pattern, usually a prefix followed by the wildcard segment *
+         * @param upstream Servers the requests are forwarded to
+         */
+        web_proxy_route(const std::string &expression, std::shared_ptr<proxy_upstream> upstream)
+            : web_route<T, G>("*", expression, {make_handler(upstream, prefix_of(expression))})
+        {
+        }
+
+        /// @brief Match the path only, a proxy route takes every method
+        bool match(std::shared_ptr<T> request) const override
+        {
+            auto [matched, path_params] = match_path(this->expression, request->get_path());
+            if (matched)
+            {
+                request->set_path_params(path_params);
+            }
+            return matched;
+        }
+    };
+}
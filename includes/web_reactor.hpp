@@ -0,0 +1,146 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "../libs/http-server/http-lib.hpp"
+
+#include "web_types.hpp"
+#include "thread_pool.hpp"
+#include "completion_queue.hpp"
+#include "cpu_topology.hpp"
+
+namespace hh_web
+{
+    template <typename T, typename G, typename R>
+    class web_server;
+
+    /**
+     * @brief Additional listen loop that feeds a web_server's request pipeline.
+     *
+     * In multi-reactor mode (web_server::use_reactors) the server starts one extra
+     * reactor per additional event loop. Each reactor is a full hh_http::http_server,
+     * so it has its own listening socket on the same host:port and its own epoll
+     * instance, and runs on its own thread. Accept, read and parse of a connection
+     * therefore stay on the reactor that accepted it.
+     *
+     * A reactor may own a local worker set, then handlers for its connections run on
+     * those workers only instead of on the server's shared worker_pool.
+     *
+     * @note The kernel spreads connections over the reactors only if the listening
+     *       sockets are bound with SO_REUSEPORT by the hh_http layer. The server checks
+     *       its own socket before creating reactors and keeps serving on the base reactor
+     *       when the option is missing or a reactor fails to bind.
+     * @note Reactors are created and owned by web_server, never construct one directly.
+     */
+    template <typename T, typename G, typename R>
+    class web_reactor : public hh_http::http_server
+    {
+    protected:
+        /// Server whose routers, hooks and counters handle the requests
+        web_server<T, G, R> &owner;
+
+        /// Workers private to this reactor, null to use the server's worker_pool
+        std::unique_ptr<thread_pool> local_workers;
+
+        /// Position of this reactor, the base reactor (the server itself) is 0
+        unsigned int index;
+
+        /// Responses finished by the workers, written by this reactor's flusher (completion queue mode)
+        std::shared_ptr<completion_queue> completions = std::make_shared<completion_queue>();
+
+        /// Pass the request to the owning server's pipeline, on this reactor's workers if it has any
+        virtual void on_request_received(hh_http::http_request &request, hh_http::http_response &response) override
+        {
+            owner.dispatch_request(request, response, local_workers ? *local_workers : owner.worker_pool, completions);
+        }
+
+        /// Set by this reactor's thread once its listener is up
+        bool listened = false;
+
+        /// Only the base reactor reports the listen success, extra reactors tune their listener and count in
+        virtual void on_listen_success() override
+        {
+            listened = true;
+            owner.apply_socket_options();
+            owner.on_reactor_listening(true);
+        }
+
+        /// @brief Forward low level errors to the owning server
+        /// @param e The exception that occurred
+        virtual void on_exception_occurred(const std::exception &e) override
+        {
+            owner.on_exception_occurred(e);
+        }
+
+        /// Forward header callbacks to the owning server
+        virtual void on_headers_received(HEADER_RECEIVED_PARAMS) override
+        {
+            owner.on_headers_received(conn, headers, method, uri, version, body);
+        }
+
+    public:
+        /**
+         * @brief Construct a reactor bound to the same endpoint as its server.
+         * @param owner Server the requests are dispatched to
+         * @param port Port number to listen on
+         * @param host Host address to listen on
+         * @param index Position of the reactor (1..N-1)
+         * @param local_threads Number of workers private to this reactor, 0 to share the server's pool
+         */
+        web_reactor(web_server<T, G, R> &owner, int port, const std::string &host, unsigned int index, unsigned int local_threads)
+            : hh_http::http_server(port, host), owner(owner), index(index)
+        {
+            if (local_threads > 0)
+            {
+                local_workers = std::make_unique<thread_pool>(local_threads, false);
+            }
+        }
+
+        web_reactor(const web_reactor &) = delete;
+        web_reactor &operator=(const web_reactor &) = delete;
+
+        /// @brief Get the position of this reactor
+        unsigned int get_index() const
+        {
+            return index;
+        }
+
+        /// @brief Check whether the listen loop got its listener up, read from the reactor's thread
+        bool has_listened() const
+        {
+            return listened;
+        }
+
+        /**
+         * @brief Start the reactor's local workers, does nothing when it shares the server's pool.
+         * @param cpus CPUs the workers are pinned to (the reactor's NUMA node), empty to leave them unpinned
+         */
+        void start_workers(const std::vector<int> &cpus)
+        {
+            if (!local_workers)
+                return;
+            if (!cpus.empty())
+            {
+                local_workers->set_thread_init([cpus](unsigned int)
+                                               { cpu_topology::pin_current_thread(cpus); });
+            }
+            local_workers->start();
+        }
+
+        /// @brief Start the flusher of this reactor's completion queue
+        void start_completions()
+        {
+            completions->start();
+        }
+
+        /// @brief Stop the reactor's listen loop, its local workers and its completion queue
+        virtual void stop()
+        {
+            hh_http::http_server::stop_server();
+            if (local_workers)
+                local_workers->stop_workers();
+            completions->stop();
+        }
+    };
+}
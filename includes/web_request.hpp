@@ -5,11 +5,15 @@
 #include <utility>
 #include <mutex>
 #include <algorithm>
+#include <memory>
+#include <optional>
 
 #include "../libs/http-server/http-lib.hpp"
 
 #include "web_exceptions.hpp"
 #include "web_utilities.hpp"
+#include "cancellation_token.hpp"
+#include "synthetic_message.hpp"
 namespace hh_web
 {
     template <typename T, typename G>
@@ -39,8 +43,8 @@ namespace hh_web
     class web_request
     {
     protected:
-        /// Underlying HTTP request object
-        hh_http::http_request request;
+        /// Underlying HTTP request object (or a synthetic request, e.g. an HTTP/2 stream)
+        request_source request;
 
         /// Path parameters extracted from the request URI, in the form of key-value pairs
         /// http://localhost/users/:id/posts/:postID
@@ -54,6 +58,9 @@ namespace hh_web
         /// Custom request parameters (e.g., from query string)
         std::map<std::string, std::string> request_params;
 
+        /// Deadline and cancellation state of this request, shared with anyone polling it
+        std::shared_ptr<cancellation_token> token;
+
     public:
         /// Allow web_server to access private members
         template <typename T, typename G, typename R>
@@ -68,7 +75,18 @@ namespace hh_web
          * ownership semantics. This constructor is typically called by the web
          * server when processing incoming requests.
          */
-        web_request(hh_http::http_request &&req) : request(std::move(req))
+        web_request(hh_http::http_request &&req) : request(std::move(req)), token(std::make_shared<cancellation_token>())
+        {
+        }
+
+        /**
+         * @brief Construct web request from a request that did not come through hh_http.
+         * @param req Method, URI, headers and body of the request (moved)
+         *
+         * Used for requests received on other transports (HTTP/2 streams) so they run through
+         * the same routers, middleware and handlers.
+         */
+        web_request(synthetic_request &&req) : request(std::move(req)), token(std::make_shared<cancellation_token>())
         {
         }
 
@@ -237,6 +255,25 @@ namespace hh_web
             return request.get_body();
         }
 
+        /**
+         * @brief Get the credentials of the process that sent the request.
+         * @return pid, uid and gid of the peer for requests received on a Unix domain socket
+         *         (web_server::use_unix_socket), empty for requests received over TCP
+         *
+         * The kernel records them when the peer connects, middleware can rely on them to
+         * admit only a known local process (e.g. the proxy in front of the server).
+         */
+        virtual std::optional<peer_credentials> get_peer_credentials() const
+        {
+            return request.get_peer_credentials();
+        }
+
+        /// @brief true for a sub-request of a batch (web_server::batch), which batch routes refuse
+        virtual bool is_batch_entry() const
+        {
+            return request.is_batch_entry();
+        }
+
         /**
          * @brief Get the Content-Type header values.
          * @return Vector of strings containing Content-Type header values
@@ -264,6 +301,29 @@ namespace hh_web
             return request.get_header(hh_http::HEADER_COOKIE);
         }
 
+        /**
+         * @brief Get the value of one cookie.
+         * @param name Cookie name (case-sensitive)
+         * @return Value of the first cookie with that name over all Cookie headers, or an empty string if not found
+         *
+         * The headers are parsed with parse_cookies(), e.g. for "Cookie: session=3f2a; theme=dark"
+         * get_cookie("session") returns "3f2a".
+         */
+        virtual std::string get_cookie(const std::string &name) const
+        {
+            for (const auto &header : get_cookies())
+            {
+                for (auto &cookie : hh_web::parse_cookies(header))
+                {
+                    if (cookie.first == name)
+                    {
+                        return std::move(cookie.second);
+                    }
+                }
+            }
+            return "";
+        }
+
         /**
          * @brief Get the Authorization header values.
          * @return Vector of strings containing Authorization header values
@@ -352,5 +412,29 @@ namespace hh_web
         {
             request_params.erase(key);
         }
+
+        /**
+         * @brief Get the cancellation token of this request.
+         *
+         * The token carries the request deadline (server default, timeout header or
+         * route timeout, whichever is earliest). Handlers doing long work should poll
+         * it and stop early, the token may be passed to other threads.
+         *
+         * @return std::shared_ptr<cancellation_token> The request's token, never null.
+         */
+        virtual std::shared_ptr<cancellation_token> get_cancellation_token() const
+        {
+            return token;
+        }
+
+        /**
+         * @brief Check whether the request got cancelled or its deadline passed.
+         *
+         * @return true if the handler should stop working on this request.
+         */
+        virtual bool is_cancelled() const
+        {
+            return token->is_cancelled();
+        }
     };
 }
\ No newline at end of file
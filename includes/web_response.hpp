@@ -2,11 +2,16 @@
 
 #include "../libs/http-server/http-lib.hpp"
 #include "logger.hpp"
+#include "synthetic_message.hpp"
+#include "canned_response.hpp"
+#include "html_template.hpp"
+#include "json_writer.hpp"
 
 #include <string>
 #include <vector>
 #include <iostream>
 #include <atomic>
+#include <memory>
 #include <mutex>
 namespace hh_web
 {
@@ -16,6 +21,8 @@ namespace hh_web
     template <typename T, typename G, typename R>
     class web_server;
 
+    class completion_queue;
+
     /**
      * @brief High-level web response wrapper with enhanced functionality.
      *
@@ -39,8 +46,8 @@ namespace hh_web
     class web_response
     {
     protected:
-        /// Underlying HTTP response object
-        hh_http::http_response response;
+        /// Underlying HTTP response object (or a synthetic response handed to a callback)
+        response_target response;
 
         /// Flag to prevent double-sending of response
         std::atomic<bool> did_end = false;
@@ -56,6 +63,12 @@ namespace hh_web
 
         /// Mutex For ending response
         mutable std::mutex end_response_mutex;
+
+        /// Set when a completion_queue writes this response, send() and end() then only record the intent
+        std::atomic<bool> deferred = false;
+
+        /// send() was called on a deferred response and the write is still due
+        std::atomic<bool> send_pending = false;
         /**
          * @brief Internal method to end connection with the client, must only be called within web_server or it's derived classes.
          *
@@ -63,6 +76,10 @@ namespace hh_web
          */
         void end() noexcept
         {
+            /// A deferred response is ended by complete() on the reactor's flusher
+            if (deferred.load())
+                return;
+
             /// Only one thread is guaranteed to end the response,
             /// exchange works as follows:
             /// it sets the value to true and returns the old value, so if the old value was true,
@@ -81,11 +98,38 @@ namespace hh_web
             }
         }
 
+        /**
+         * @brief Perform the deferred write (if send() was called) and end the response.
+         * @note Called by the completion_queue flusher once the request's handlers are done.
+         */
+        void complete() noexcept
+        {
+            // under the send lock, a send() racing with this either recorded its intent before
+            // or finds the response ended after
+            std::lock_guard<std::mutex> lock(send_response_mutex);
+            if (send_pending.exchange(false))
+            {
+                try
+                {
+                    response.send();
+                }
+                catch (const std::exception &e)
+                {
+                    logger::error("Error sending response: " + std::string(e.what()));
+                }
+            }
+            deferred.store(false);
+            end();
+        }
+
     public:
         /// Allow web_server to access private members
         template <typename T, typename G, typename R>
         friend class web_server;
 
+        /// Allow the completion queue to complete deferred responses
+        friend class completion_queue;
+
         /**
          * @brief Private constructor for internal use by web_server.
          * @param response HTTP response object to wrap (moved)
@@ -98,6 +142,18 @@ namespace hh_web
         {
             response.set_status(200, "OK");
         }
+
+        /**
+         * @brief Construct a web response whose result is handed to callbacks instead of a socket.
+         * @param on_send Receives status, headers, body and trailers when the response is sent
+         * @param on_end Called when the response ends, with whether it was sent
+         *
+         * Used for requests received on other transports (HTTP/2 streams).
+         */
+        web_response(response_target::send_callback on_send, response_target::end_callback on_end = nullptr)
+            : response(std::move(on_send), std::move(on_end))
+        {
+        }
         // Copy operations - DELETED for resource safety and unique ownership
         web_response(const web_response &) = delete;
         web_response &operator=(const web_response &) = delete;
@@ -208,6 +264,57 @@ namespace hh_web
             send();
         }
 
+        /**
+         * @brief Send what a json_writer wrote as a JSON response.
+         * @param json The writer, its output is moved into the body and it starts over
+         *
+         * Like send_json(), without copying the document: the writer's buffer becomes the body.
+         */
+        virtual void send_json(json_writer &json)
+        {
+            {
+                std::lock_guard<std::mutex> lock(modify_headers_mutex);
+                std::string body = json.take();
+                response.add_header(hh_http::HEADER_CONTENT_TYPE, "application/json");
+                response.add_header(hh_http::HEADER_CONTENT_LENGTH, std::to_string(body.size()));
+                response.set_body(std::move(body));
+            }
+            send();
+        }
+
+        /**
+         * @brief Send a canned response (see canned_responses).
+         * @param canned The pre-rendered response
+         *
+         * Status, Content-Type, Content-Length and body come from the canned response, headers
+         * added before (e.g. by CORS middleware) are kept. Nothing is rendered per request:
+         * requests received by the HTTP/2 or Unix socket listener over HTTP/1.1 are answered
+         * with the canned response's pre-serialized bytes, hh_http responses take a copy.
+         */
+        virtual void send_canned(const std::shared_ptr<const canned_response> &canned)
+        {
+            {
+                std::lock_guard<std::mutex> lock(modify_headers_mutex);
+                response.set_canned(canned);
+            }
+            send();
+        }
+
+        /**
+         * @brief Render a compiled template and send it as HTML.
+         * @param page The template, compiled at startup (html_template::compile())
+         * @param values The values of this rendering
+         *
+         * The page is rendered in one pass into a buffer reserved for the template's static
+         * markup up front, which becomes the body.
+         */
+        virtual void send_template(const html_template &page, const template_context &values)
+        {
+            std::string body;
+            page.render(values, body);
+            send_html(body);
+        }
+
         /**
          * @brief Add an HTTP header to the response.
          * @param key Header name (e.g., "Cache-Control", "X-Custom-Header")
@@ -315,6 +422,8 @@ namespace hh_web
          * @note This method is automatically called by send_json(), send_html(),
          * and send_text() convenience methods.
          * @note You can call this method only once, as subsequent calls will be ignored.
+         * @note With web_server::use_completion_queue() the write itself happens on the reactor's
+         *       completion queue once the request's handlers returned.
          *
          * @note Body may be set beforehand, but it can also be passed as an argument to this method.
          * @param body (optional) The response body content to send.
@@ -357,16 +466,30 @@ namespace hh_web
                 }
             }
 
-            try
+            bool failed = false;
             {
                 std::lock_guard<std::mutex> lock(send_response_mutex);
-                response.send();
+                /// A deferred response already completed by the flusher is over
+                if (did_end.load())
+                    return;
+                if (deferred.load())
+                {
+                    send_pending.store(true);
+                    return;
+                }
+
+                try
+                {
+                    response.send();
+                }
+                catch (const std::exception &e)
+                {
+                    logger::error("Error sending response: " + std::string(e.what()));
+                    failed = true;
+                }
             }
-            catch (const std::exception &e)
-            {
-                logger::error("Error sending response: " + std::string(e.what()));
+            if (failed)
                 end();
-            }
         }
         /**
          * @brief Set the keep alive object
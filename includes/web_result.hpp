@@ -0,0 +1,196 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "web_types.hpp"
+#include "web_exceptions.hpp"
+
+namespace hh_web
+{
+    /**
+     * @brief An expected error, returned instead of thrown.
+     *
+     * The non-throwing counterpart of web_exception for errors a handler anticipates (bad
+     * IDs, malformed bodies, missing items): status, the body sent to the client and a log
+     * message formatted once when the error is made. Returning it through a web_expected
+     * costs a move, where throwing costs an allocation, the unwinder and a string per what().
+     */
+    struct web_error
+    {
+        int status_code = 500;
+        std::string status_message = "Internal Server Error";
+
+        /// What went wrong, as given
+        std::string message;
+
+        /// Response body, {"error": "<message>"} unless given
+        std::string body;
+        std::string content_type = "application/json";
+
+        /// "Web Exception [404 - Not Found]: Item not found", as web_exception::what() has it
+        std::string formatted_message;
+
+        web_error() = default;
+
+        /**
+         * @brief Make an error answered with a JSON body {"error": "<message>"}.
+         * @param status_code HTTP status code of the response
+         * @param status_message HTTP status message of the response
+         * @param message What went wrong, sent to the client and logged
+         */
+        web_error(int status_code, std::string status_message, const std::string &message);
+
+        /// @brief Take status and message of a web_exception, e.g. one thrown by code that still throws
+        explicit web_error(const web_exception &exception);
+
+        /// @brief Replace the body, e.g. by an HTML page
+        web_error &with_body(std::string body, std::string content_type);
+
+        /// @brief The error as a web_exception, for code paths that have to throw
+        web_exception to_exception() const;
+
+        /// @brief Shorthands for the common statuses
+        static web_error bad_request(const std::string &message);
+        static web_error not_found(const std::string &message);
+        static web_error conflict(const std::string &message);
+        static web_error unprocessable(const std::string &message);
+        static web_error internal(const std::string &message);
+    };
+
+    /**
+     * @brief A value or a web_error, in the manner of std::expected.
+     *
+     * Lets helpers report expected failures without throwing:
+     * @code
+     * web_expected<int> id = parse_id(req);
+     * if (!id)
+     *     return id.error();
+     * store.get(*id);
+     * @endcode
+     *
+     * @tparam V Type of the value
+     */
+    template <typename V>
+    class web_expected
+    {
+    private:
+        std::variant<V, web_error> state;
+
+    public:
+        web_expected(V value) : state(std::in_place_index<0>, std::move(value))
+        {
+        }
+
+        web_expected(web_error error) : state(std::in_place_index<1>, std::move(error))
+        {
+        }
+
+        /// @brief Whether a value is held
+        bool has_value() const noexcept
+        {
+            return state.index() == 0;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return has_value();
+        }
+
+        /// @note Only valid with has_value()
+        V &value() &
+        {
+            return *std::get_if<0>(&state);
+        }
+
+        const V &value() const &
+        {
+            return *std::get_if<0>(&state);
+        }
+
+        V &operator*() &
+        {
+            return value();
+        }
+
+        const V &operator*() const &
+        {
+            return value();
+        }
+
+        V *operator->()
+        {
+            return &value();
+        }
+
+        const V *operator->() const
+        {
+            return &value();
+        }
+
+        /// @note Only valid without has_value()
+        web_error &error() &
+        {
+            return *std::get_if<1>(&state);
+        }
+
+        const web_error &error() const &
+        {
+            return *std::get_if<1>(&state);
+        }
+    };
+
+    /// What a result handler returns: how the chain goes on, or the error to answer with
+    using web_result = web_expected<exit_code>;
+
+    template <typename T = web_request, typename G = web_response>
+    using web_result_handler_t = std::function<web_result(std::shared_ptr<T>, std::shared_ptr<G>)>;
+
+    /**
+     * @brief Write an error to a response: status, content type and body.
+     * @note The response is sent by the server once the chain is done, as for any handler that sets a body.
+     */
+    template <typename G>
+    void write_error(const std::shared_ptr<G> &response, const web_error &error)
+    {
+        response->set_status(error.status_code, error.status_message);
+        response->set_content_type(error.content_type);
+        response->set_body(error.body);
+    }
+
+    /**
+     * @brief Adapt a result handler to the handler type routes and routers take.
+     *
+     * An error is written to the response and ends the chain (EXIT), nothing is thrown:
+     * @code
+     * router->get("/api/items/:id", {hh_web::result_handler<>([](auto req, auto res) -> hh_web::web_result {
+     *     auto item = store.find(id);
+     *     if (!item)
+     *         return hh_web::web_error::not_found("Item not found");
+     *     res->send_json(item->to_json());
+     *     return hh_web::exit_code::EXIT;
+     * })});
+     * @endcode
+     *
+     * The handler parameter is not deduced, so plain functions and lambdas convert to it directly.
+     *
+     * @tparam T Type for request objects (must derive from web_request)
+     * @tparam G Type for response objects (must derive from web_response)
+     */
+    template <typename T = web_request, typename G = web_response>
+    web_request_handler_t<T, G> result_handler(typename std::common_type<web_result_handler_t<T, G>>::type handler)
+    {
+        return [handler = std::move(handler)](std::shared_ptr<T> request, std::shared_ptr<G> response) -> exit_code
+        {
+            web_result result = handler(request, response);
+            if (result)
+                return *result;
+            write_error(response, result.error());
+            return exit_code::EXIT;
+        };
+    }
+}
@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <chrono>
 #include <type_traits>
 #include "web_types.hpp"
 #include "web_exceptions.hpp"
@@ -46,6 +47,9 @@ namespace hh_web
         /// Collection of request handlers executed in sequence for this route
         std::vector<web_request_handler_t<T, G>> handlers;
 
+        /// Maximum time a request may take on this route, measured from its arrival (0 = no route timeout)
+        std::chrono::milliseconds timeout{0};
+
     public:
         /// Allow web_router to access private members
         friend class web_router<T, G>;
@@ -102,6 +106,27 @@ namespace hh_web
             return method;
         }
 
+        /**
+         * @brief Set a timeout for requests handled by this route.
+         * @param timeout Maximum time from request arrival until the handlers must be done, 0 disables it
+         *
+         * The route timeout can only tighten the request deadline, if the server default
+         * or the request's timeout header already gives an earlier deadline, that one wins.
+         */
+        virtual void set_timeout(std::chrono::milliseconds timeout)
+        {
+            this->timeout = timeout;
+        }
+
+        /**
+         * @brief Get the timeout configured for this route.
+         * @return The route timeout, 0 if none is set
+         */
+        virtual std::chrono::milliseconds get_timeout() const
+        {
+            return timeout;
+        }
+
         /**
          * @brief Check if this route matches the given method and path.
          * @param request Shared pointer to the request object
@@ -136,13 +161,25 @@ namespace hh_web
          * - EXIT: Stop processing and finalize the response
          * - ERROR: Indicate an error condition
          *
+         * The route timeout (if any) is applied to the request's cancellation token first,
+         * and the token is checked before every handler. An expired request stops the chain
+         * without a response, the server then answers 504; nothing is thrown.
+         *
          *@note This function is called by the web_router class if a matching route is found.
          *@note This is a const member function, meaning it does not modify the state of the web_route instance.
          */
         virtual exit_code handle_request(std::shared_ptr<T> request, std::shared_ptr<G> response) const
         {
+            auto token = request->get_cancellation_token();
+            token->set_timeout(timeout);
+
             for (const auto &handler : handlers)
             {
+                if (token->is_cancelled())
+                {
+                    return exit_code::EXIT;
+                }
+
                 auto resp = handler(request, response);
                 if (resp == exit_code::EXIT)
                 {
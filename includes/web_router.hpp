@@ -8,9 +8,11 @@
 
 #include "web_types.hpp"
 #include "web_exceptions.hpp"
+#include "web_result.hpp"
 #include "web_request.hpp"
 #include "web_response.hpp"
 #include "web_methods.hpp"
+#include "web_proxy.hpp"
 
 namespace hh_web
 {
@@ -67,6 +69,9 @@ namespace hh_web
          * If any middleware returns EXIT or ERROR, processing stops immediately.
          * All middleware must return a valid exit_code or a runtime_error is thrown.
          *
+         * The request's cancellation token is checked before every middleware, an expired
+         * request stops the chain without a response and the server answers 504.
+         *
          * Common middleware use cases:
          * - Authentication and authorization
          * - Request logging and metrics
@@ -78,6 +83,11 @@ namespace hh_web
         {
             for (const auto &middleware : middlewares)
             {
+                if (request->is_cancelled())
+                {
+                    return exit_code::EXIT;
+                }
+
                 auto result = middleware(request, response);
                 if (result == exit_code::EXIT)
                 {
@@ -134,55 +144,39 @@ namespace hh_web
          *
          * 1. **Middleware Processing**: Executes all registered middleware in order
          * 2. **Route Matching**: If middleware allows, attempts to match and execute routes
-         * 3. **Exception Handling**: Catches and converts exceptions to HTTP responses
-         * 4. **Status Reporting**: Returns whether the request was successfully handled
+         * 3. **Status Reporting**: Returns whether the request was successfully handled
          *
-         * The method provides comprehensive error handling for both web-specific
-         * exceptions (with proper HTTP status codes) and general exceptions
-         * (converted to 500 Internal Server Error).
+         * Expected errors travel as values: result handlers (result_handler()) write their
+         * web_error to the response and end the chain, expired requests end it without
+         * response. Nothing on this path throws or catches.
          *
          * Return value semantics:
          * - true: Request was handled (middleware or route processed it)
          * - false: No routes matched and middleware didn't handle the request
          *
-         * Exception handling:
-         * - web_exception: Converted to HTTP response with proper status code
-         * - std::exception: Converted to 500 Internal Server Error response
+         * Exceptions thrown by middleware or handlers pass through untouched, the server
+         * logs them once and answers 500 (web_server::request_handler).
          *
          * @note This method is typically called by the web_server for each incoming request
          */
         virtual bool handle_request(std::shared_ptr<T> request, std::shared_ptr<G> response)
         {
-            try
+            exit_code middleware_result = middleware_handle_request(request, response);
+            if (middleware_result != exit_code::CONTINUE)
             {
-                exit_code middleware_result = middleware_handle_request(request, response);
-                if (middleware_result != exit_code::CONTINUE)
+                return true;
+            }
+            // If middleware allows, try to match routes
+            for (const auto &route : routes)
+            {
+                if (route->match(request))
                 {
+                    route->handle_request(request, response);
                     return true;
                 }
-                // If middleware allows, try to match routes
-                for (const auto &route : routes)
-                {
-                    if (route->match(request))
-                    {
-                        route->handle_request(request, response);
-                        return true;
-                    }
-                }
-
-                return false;
-            }
-            catch (web_exception &e) // Unhandled exception thrown from middleware/route handler
-            {
-                logger::error("Web error in router: " + std::string(e.what()));
-                logger::error("Status code: " + std::to_string(e.get_status_code()) + " Message: " + e.get_status_message());
-                throw;
-            }
-            catch (const std::exception &e) // Unhandled exception
-            {
-                logger::error("Unhandled exception in router: " + std::string(e.what()));
-                throw;
             }
+
+            return false;
         }
 
         /**
@@ -250,5 +244,13 @@ namespace hh_web
         {
             add_route(std::make_shared<web_route<T, G>>("DELETE", path, handlers));
         }
+
+        /// @brief Register a route forwarding every method under a path to an upstream.
+        /// @param path The path for the route, usually ending in "/*" (e.g. "/legacy/*")
+        /// @param upstream The servers requests are forwarded to
+        void proxy(const std::string &path, std::shared_ptr<proxy_upstream> upstream)
+        {
+            add_route(std::make_shared<web_proxy_route<T, G>>(path, upstream));
+        }
     };
 }
@@ -1,7 +1,18 @@
 #pragma once
 
+#include <algorithm>
 #include <thread>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <condition_variable>
+#include <mutex>
+#include <csignal>
+#include <future>
+#include <type_traits>
+
+#include <sys/socket.h>
 
 #include "../libs/http-server/http-lib.hpp"
 
@@ -10,17 +21,24 @@
 #include "web_methods.hpp"
 #include "web_request.hpp"
 #include "web_response.hpp"
+#include "canned_response.hpp"
 #include "web_router.hpp"
 #include "web_exceptions.hpp"
 #include "web_utilities.hpp"
 #include "thread_pool.hpp"
+#include "timing_wheel.hpp"
+#include "web_reactor.hpp"
+#include "process_supervisor.hpp"
+#include "listener_handoff.hpp"
+#include "io_uring_ring.hpp"
+#include "completion_queue.hpp"
+#include "socket_options.hpp"
+#include "cpu_topology.hpp"
+#include "http2_listener.hpp"
+#include "web_client.hpp"
+#include "web_batch.hpp"
+#include "shard_group.hpp"
 
-#define HEADER_RECEIVED_PARAMS std::shared_ptr<hh_socket::connection> conn,            \
-                               const std::multimap<std::string, std::string> &headers, \
-                               const std::string &method,                              \
-                               const std::string &uri,                                 \
-                               const std::string &version,                             \
-                               const std::string &body
 namespace hh_web
 {
     /**
@@ -45,9 +63,56 @@ namespace hh_web
     class web_server : public hh_http::http_server
     {
     protected:
+        /// Timers for request deadlines (and anything else registered through get_timers()), declared before the pool so it outlives the workers
+        timing_wheel timers;
+
+        /// Thread driving the timing wheel at its resolution while the server is listening
+        std::thread timer_thread;
+
+        /// Flag to keep the timer thread running
+        std::atomic<bool> timers_running{false};
+
+        /// Responses finished by the workers, written by the base reactor's flusher (completion queue mode)
+        std::shared_ptr<completion_queue> completions = std::make_shared<completion_queue>();
+
+        /// Whether responses go through the reactors' completion queues instead of being written by the workers
+        bool completion_queue_enabled = false;
+
+        /// Cleartext HTTP/2 endpoint, null when not configured. Declared before worker_pool so it
+        /// outlives the workers posting responses to it.
+        std::unique_ptr<http2_listener> http2;
+
+        /// Unix domain socket endpoint, null when not configured. Declared before worker_pool for
+        /// the same reason as http2.
+        std::unique_ptr<http2_listener> unix_listener;
+
+        /// Whether the server listens on host:port, false to serve the Unix domain socket only
+        bool tcp_enabled = true;
+
+        /// Wakes serve() once stop() is called while serving the Unix domain socket only
+        std::mutex unix_only_mutex;
+        std::condition_variable unix_only_stopped;
+        bool unix_only_serving = false;
+
+        /// Outbound HTTP client for handlers, null when not configured. Declared before worker_pool
+        /// so workers waiting on a response are joined before it goes away.
+        std::unique_ptr<web_client> client;
+
+        /// Shards owning partitioned application data (use_shards()), null when not configured.
+        /// Declared before worker_pool so workers waiting on a shard are joined before it goes away.
+        std::unique_ptr<shard_group> shards;
+
         /// Thread pool for handling requests concurrently
         thread_pool worker_pool;
 
+        /// Executor for CPU-heavy sections handed off by handlers (offload()), null when not configured.
+        /// Declared after worker_pool so it is destroyed first: workers still waiting on an offloaded
+        /// task then get a broken_promise instead of waiting forever.
+        std::unique_ptr<thread_pool> offload_pool;
+
+        /// CPUs the offload workers are pinned to, empty to leave them unpinned
+        std::vector<int> offload_cpus;
+
         /// Server port number
         int port;
         /// Server host/IP address
@@ -73,16 +138,100 @@ namespace hh_web
 
         std::function<void(HEADER_RECEIVED_PARAMS)> headers_callback = nullptr;
 
+        /// Pre-rendered answers for unmatched routes, unknown methods, deadlines and unhandled exceptions
+        canned_responses canned;
+
         /// Handler for unmatched routes (404 responses)
-        web_request_handler_t<T, G> handle_default_route = []([[maybe_unused]] std::shared_ptr<T> req, std::shared_ptr<G> res) -> exit_code
+        web_request_handler_t<T, G> handle_default_route = [this]([[maybe_unused]] std::shared_ptr<T> req, std::shared_ptr<G> res) -> exit_code
         {
-            res->set_status(404, "Not Found");
-            res->send_text("404 Not Found");
+            res->send_canned(canned.get(404));
             return exit_code::EXIT;
         };
 
         web_unhandled_exception_callback_t<T, G> unhandled_exception_callback = nullptr;
 
+        /// Deadline applied to every request, measured from its arrival (0 = no default deadline)
+        std::chrono::milliseconds default_request_timeout{0};
+
+        /// Request header (value in milliseconds) a client may use to ask for an earlier deadline, empty to ignore
+        std::string request_timeout_header = "X-Request-Timeout";
+
+        /// Longest timeout taken from request_timeout_header when there is no default deadline
+        static constexpr std::chrono::milliseconds max_client_timeout = std::chrono::hours(24);
+
+        /// Requests dropped with 503 because their deadline passed while waiting in the worker queue
+        std::atomic<std::size_t> expired_in_queue{0};
+
+        /// Requests answered with 504 because their deadline passed during middleware or handlers
+        std::atomic<std::size_t> expired_in_pipeline{0};
+
+        /// Number of listen loops, the server itself is reactor 0 (1 = classic single loop)
+        unsigned int reactor_count = 1;
+
+        /// Workers private to each extra reactor, 0 to share worker_pool
+        unsigned int reactor_local_threads = 0;
+
+        /// Extra reactors started by listen() in multi-reactor mode
+        std::vector<std::unique_ptr<web_reactor<T, G, R>>> reactors;
+
+        /// One thread per extra reactor running its listen loop
+        std::vector<std::thread> reactor_threads;
+
+        /// Reactors, the server's own loop included, that have not reported their listener yet
+        std::atomic<unsigned int> reactors_not_listening{1};
+
+        /// Reactors whose listener joined the port's reuseport group in this run
+        std::atomic<unsigned int> reactors_listening{0};
+
+        /// Number of worker processes in prefork mode (1 = serve from this process)
+        unsigned int process_count = 1;
+
+        /// Time a stopping server (or retiring worker process) gets to finish in-flight requests
+        std::chrono::milliseconds drain_timeout{10000};
+
+        /// Requests accepted by the pipeline and not finished yet
+        std::atomic<std::size_t> in_flight{0};
+
+        /// Set while shutting down, responses then ask clients to close their keep-alive connections
+        std::atomic<bool> draining{false};
+
+        /// Unix socket path used for hot restarts, empty when disabled
+        std::string hot_restart_path;
+
+        /// Offers this process' listening sockets to the next process started with the same path
+        listener_handoff handoff;
+
+        /// Sockets received from the process this one replaces
+        listener_handoff predecessor;
+
+        /// Options applied to the listening sockets once they listen, unset when not configured
+        std::optional<socket_options> listener_options;
+
+        /// Thread draining this process after its listeners were taken over
+        std::thread handoff_drain_thread;
+
+        /// Backend asked for with use_io_backend()
+        io_backend requested_io_backend = io_backend::EPOLL;
+
+        /// Backend hh_web's own listen loops (HTTP/2, Unix socket) run on, resolved when serving starts
+        io_backend active_io_backend = io_backend::EPOLL;
+
+        /// Thread placement asked for with use_cpu_affinity(), unset to leave threads unpinned
+        std::optional<cpu_affinity> affinity;
+
+        /// Machine layout, read when serving starts with affinity set
+        cpu_topology topology;
+
+        /// CPUs for this process' threads in placement order (reactor i runs on cpu_plan[i])
+        std::vector<int> cpu_plan;
+
+        /// Slot of this worker process in prefork mode, selects its share of the CPUs
+        unsigned int process_slot = 0;
+
+        /// Allow the reactors to dispatch into the pipeline
+        template <typename, typename, typename>
+        friend class web_reactor;
+
     public:
         /**
          * @brief Construct a web server with specified port and host.
@@ -90,7 +239,7 @@ namespace hh_web
          * @param host Host address (default: "0.0.0.0" for all interfaces)
          */
         explicit web_server(int port, const std::string &host = "0.0.0.0")
-            : worker_pool(std::thread::hardware_concurrency()), port(port), host(host), hh_http::http_server(port, host)
+            : worker_pool(std::thread::hardware_concurrency(), false), port(port), host(host), hh_http::http_server(port, host)
         {
             static_assert(std::is_base_of<web_request, T>::value, "T must derive from web_request");
             static_assert(std::is_base_of<web_response, G>::value, "G must derive from web_response");
@@ -100,6 +249,15 @@ namespace hh_web
             this->routers.push_back(base_router);
         }
 
+        /// Stops the timer thread and the extra reactors, the worker pool joins its workers on destruction
+        virtual ~web_server()
+        {
+            if (handoff_drain_thread.joinable())
+                handoff_drain_thread.join();
+            stop_reactors();
+            stop_timers();
+        }
+
         // Disable copy and move for resource safety
         web_server(const web_server &) = delete;
         web_server &operator=(const web_server &) = delete;
@@ -132,6 +290,18 @@ namespace hh_web
         {
             handle_default_route = handler;
         }
+
+        /**
+         * @brief The server's canned responses, rendered once and sent without per-request work.
+         * @note The server answers unmatched routes (404), unknown methods (400), expired
+         *       deadlines (503/504) and unhandled exceptions (by status) with them. Replace an
+         *       entry to change the answer, e.g. with an HTML 404 page, before calling listen().
+         * @return The registry, owned by the server
+         */
+        canned_responses &get_canned_responses()
+        {
+            return canned;
+        }
         /**
          * @brief Register a callback for when headers are received.
          * @note default is no action
@@ -152,6 +322,335 @@ namespace hh_web
             unhandled_exception_callback = callback;
         }
 
+        /**
+         * @brief Set the default deadline for every request.
+         * @note The deadline is measured from the moment the request was received, so time spent
+         *       waiting in the worker queue counts. Routes may tighten it with web_route::set_timeout().
+         * @param timeout Maximum request time, 0 disables the default deadline
+         */
+        virtual void use_request_timeout(std::chrono::milliseconds timeout)
+        {
+            default_request_timeout = timeout;
+        }
+
+        /**
+         * @brief Set the header clients use to send their own timeout (in milliseconds).
+         * @note A header value can only make the deadline earlier, never later than the server default.
+         *       Values at or above the default, or above 24 hours without one, are ignored.
+         * @param header_name Header name, default is "X-Request-Timeout", pass an empty string to ignore client timeouts
+         */
+        virtual void use_request_timeout_header(const std::string &header_name)
+        {
+            request_timeout_header = header_name;
+        }
+
+        /// @brief Number of requests dropped (503) because they expired while queued for a worker
+        std::size_t get_expired_in_queue() const
+        {
+            return expired_in_queue.load();
+        }
+
+        /// @brief Number of requests stopped (504) because they expired during middleware or handlers
+        std::size_t get_expired_in_pipeline() const
+        {
+            return expired_in_pipeline.load();
+        }
+
+        /**
+         * @brief Run several listen loops (reactors) instead of one.
+         * @note Each reactor has its own listening socket on host:port, its own epoll instance and
+         *       thread, so a connection is accepted, read and parsed by a single reactor.
+         *       The server itself is reactor 0 and keeps using worker_pool.
+         * @note Spreading connections relies on the listening sockets being bound with SO_REUSEPORT
+         *       by the hh_http layer. listen() checks the server's socket and stays with one reactor
+         *       (logged) without it; a reactor that fails to bind or start reports through the error
+         *       callback, and the reactors already started are stopped again.
+         * @param count Total number of reactors, typically the number of cores (values below 1 mean 1)
+         * @param local_threads Workers private to each extra reactor, 0 to share worker_pool
+         */
+        virtual void use_reactors(unsigned int count, unsigned int local_threads = 0)
+        {
+            reactor_count = count > 0 ? count : 1;
+            reactor_local_threads = local_threads;
+        }
+
+        /**
+         * @brief Serve from several forked worker processes (prefork mode).
+         * @note listen() then turns this process into a master that forks the workers and supervises
+         *       them: crashed workers are restarted, SIGHUP performs a rolling reload and SIGTERM/SIGINT
+         *       a graceful shutdown (see process_supervisor). Everything registered before listen()
+         *       is inherited copy-on-write, workers start their threads only after the fork.
+         * @note Workers share the listening socket if hh_http binds it in its constructor, otherwise each
+         *       worker binds its own, which requires SO_REUSEPORT like multi-reactor mode.
+         * @param count Number of worker processes, 1 disables prefork mode
+         * @param drain_timeout Time a retiring worker gets to finish its in-flight requests
+         */
+        virtual void use_processes(unsigned int count, std::chrono::milliseconds drain_timeout = std::chrono::milliseconds(10000))
+        {
+            process_count = count > 0 ? count : 1;
+            this->drain_timeout = drain_timeout;
+        }
+
+        /**
+         * @brief Enable zero-downtime restarts through a Unix socket path.
+         * @note A server started with a path that a running server offers on receives that server's
+         *       listening sockets (SCM_RIGHTS), steers new connections to its own listeners once they
+         *       are bound and tells the old server, which stops getting connections, drains within
+         *       drain_timeout and returns from listen(). The new server then offers on the same path.
+         * @note Requires SO_REUSEPORT listeners (hh_http binds its own socket, the received ones are
+         *       used to steer the shared reuseport group). Not available in prefork mode.
+         * @param path Filesystem path of the handoff socket, e.g. "/run/app/handoff.sock"
+         */
+        virtual void use_hot_restart(const std::string &path)
+        {
+            hot_restart_path = path;
+        }
+
+        /**
+         * @brief Choose the networking backend of the listen loops hh_web runs itself.
+         * @note Applies to the HTTP/2 listener (use_http2) and the Unix socket listener (use_unix_socket),
+         *       which then accept, receive and send through io_uring. The HTTP/1.1 loops belong to
+         *       hh_http and stay on epoll.
+         * @note IO_URING and AUTO fall back to epoll (logged for IO_URING) when the kernel lacks
+         *       multishot accept and recv or provided buffer rings. The request and response API is
+         *       the same on every backend.
+         * @param backend EPOLL (default), IO_URING or AUTO
+         */
+        virtual void use_io_backend(io_backend backend)
+        {
+            requested_io_backend = backend;
+        }
+
+        /**
+         * @brief Write responses from the reactors instead of from the workers.
+         * @note A handler's send() then only finalizes the response, when the request is done the
+         *       worker pushes it onto its reactor's lock-free completion queue and the reactor's
+         *       flusher thread, woken through an eventfd, writes everything that accumulated in one
+         *       batch. The write happens after the handler returned instead of at send().
+         * @note The flusher is a thread next to the reactor's loop (hh_http does not expose the loop),
+         *       it writes through hh_http from that thread like the workers otherwise do.
+         * @param enabled true to route responses through the completion queues
+         */
+        virtual void use_completion_queue(bool enabled = true)
+        {
+            completion_queue_enabled = enabled;
+        }
+
+        /**
+         * @brief Tune the listening sockets (TCP_NODELAY, TCP_DEFER_ACCEPT, TCP_FASTOPEN, SO_BUSY_POLL,
+         *        buffer sizes, SO_INCOMING_CPU).
+         * @note Applied to every listener of the port in this process (each reactor's, each prefork
+         *       worker's) as soon as it listens. Accepted connections inherit the per-connection options
+         *       from their listener. Options the kernel rejects are logged and skipped.
+         * @param options The options to set, unset fields keep the kernel defaults
+         */
+        virtual void use_socket_options(const socket_options &options)
+        {
+            listener_options = options;
+        }
+
+        /**
+         * @brief Size the shared worker pool between bounds instead of hardware_concurrency() workers.
+         * @note The pool grows while queued requests wait longer than grow_after (with hysteresis) and
+         *       while workers are blocked, and shrinks as surplus workers stay idle. Handlers declare
+         *       blocking work with thread_pool::blocking_scope, which starts a compensating worker.
+         * @param elastic Bounds and timing, see thread_pool::elastic_config
+         */
+        virtual void use_elastic_workers(const thread_pool::elastic_config &elastic)
+        {
+            worker_pool.set_elastic(elastic);
+        }
+
+        /**
+         * @brief Create the executor for CPU-heavy sections (JSON parsing, rendering, compression).
+         * @note Its workers are separate from the request workers, so heavy sections queue behind each
+         *       other instead of in front of short requests. Started when the server starts serving.
+         * @param threads Number of offload workers
+         * @param cpus CPUs to pin them to (e.g. cores kept away from the reactors), empty for no pinning
+         */
+        virtual void use_offload_executor(unsigned int threads, const std::vector<int> &cpus = {})
+        {
+            offload_pool = std::make_unique<thread_pool>(threads, false);
+            offload_cpus = cpus;
+        }
+
+        /**
+         * @brief Create shards that own partitions of application data, shared-nothing style.
+         * @note Handlers reach a partition through get_shards()->invoke_on(shard, ...): parsing and
+         *       routing stay on the request workers, the data operation runs on the shard owning the
+         *       key. The shard threads are started when the server starts serving, before that
+         *       messages run on the calling thread (to load data in main()).
+         * @param count Number of shards, e.g. one per core given to the application
+         * @param cpus CPUs to pin them to, shard i on cpus[i % cpus.size()], empty for no pinning
+         */
+        virtual void use_shards(unsigned int count, const std::vector<int> &cpus = {})
+        {
+            shards = std::make_unique<shard_group>(count, false);
+            shards->set_cpus(cpus);
+        }
+
+        /// @brief The shards of use_shards(), null without it
+        shard_group *get_shards()
+        {
+            return shards.get();
+        }
+
+        /**
+         * @brief Run a function on the offload executor.
+         * @note Without use_offload_executor(), or before the server serves, the function runs
+         *       right away on the calling thread and the returned future is ready.
+         * @param task Callable without arguments
+         * @return Future of the task's result, exceptions are delivered through it
+         */
+        template <typename F>
+        auto offload(F &&task) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+        {
+            using result_type = std::invoke_result_t<std::decay_t<F>>;
+            auto packaged = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(task));
+            std::future<result_type> result = packaged->get_future();
+
+            if (offload_pool && offload_pool->get_thread_count() > 0)
+                offload_pool->enqueue([packaged]()
+                                      { (*packaged)(); });
+            else
+                (*packaged)();
+            return result;
+        }
+
+        /**
+         * @brief Run a function on the offload executor and resume the handler with its result.
+         * @note The waiting worker is inside a thread_pool::blocking_scope, the request pool may start
+         *       a compensating worker meanwhile so short requests keep being served.
+         * @param task Callable without arguments
+         * @return The task's result, its exception is rethrown here
+         */
+        template <typename F>
+        auto offload_and_wait(F &&task) -> std::invoke_result_t<std::decay_t<F>>
+        {
+            auto result = offload(std::forward<F>(task));
+            if (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                thread_pool::blocking_scope blocking;
+                result.wait();
+            }
+            return result.get();
+        }
+
+        /**
+         * @brief Serve cleartext HTTP/2 (h2c) on a second port.
+         * @note Clients connect with prior knowledge or upgrade from HTTP/1.1 (Upgrade: h2c); plain
+         *       HTTP/1.1 requests on that port are served over keep-alive connections. Requests run through
+         *       the same routers, middleware and workers as the main port. The listener has its own
+         *       event loop thread and is started when the server starts serving.
+         * @note T and G need the synthetic constructors of web_request and web_response.
+         * @param port Port for HTTP/2 connections
+         * @param settings Stream limit, flow control windows and size limits of every connection
+         */
+        virtual void use_http2(int port, const http2_settings &settings = http2_settings{})
+        {
+            http2 = std::make_unique<http2_listener>(port, host, settings);
+            http2->set_request_callback([this](const http2_stream_ref &ref, http2_request &&request)
+                                        { return dispatch_http2(http2.get(), ref, std::move(request)); });
+        }
+
+        /// @brief Get the HTTP/2 listener, null without use_http2()
+        http2_listener *get_http2_listener()
+        {
+            return http2.get();
+        }
+
+        /**
+         * @brief Also serve on a Unix domain socket, e.g. for a proxy on the same machine.
+         * @note Saves the loopback TCP stack per request. Requests run through the same routers,
+         *       middleware and workers as the main port, over HTTP/1.1 keep-alive or h2c, and carry
+         *       the connecting process' credentials (web_request::get_peer_credentials()). The
+         *       socket has its own event loop thread and is created when the server starts serving;
+         *       a stale socket file at the path is replaced and removed again on stop().
+         * @note T and G need the synthetic constructors of web_request and web_response.
+         * @param path Filesystem path of the socket
+         * @param permissions Mode of the socket file, decides which users may connect
+         * @param settings Limits of the connections, as for use_http2()
+         */
+        virtual void use_unix_socket(const std::string &path, unsigned int permissions = 0660, const http2_settings &settings = http2_settings{})
+        {
+            unix_listener = std::make_unique<http2_listener>(0, host, settings);
+            unix_listener->set_unix_socket(path, permissions);
+            unix_listener->set_request_callback([this](const http2_stream_ref &ref, http2_request &&request)
+                                                { return dispatch_http2(unix_listener.get(), ref, std::move(request)); });
+        }
+
+        /// @brief Get the Unix domain socket listener, null without use_unix_socket()
+        http2_listener *get_unix_listener()
+        {
+            return unix_listener.get();
+        }
+
+        /**
+         * @brief Choose whether the server listens on host:port.
+         * @note With use_unix_socket() and TCP disabled, listen() serves the Unix domain socket only
+         *       and returns once the server is stopped.
+         * @param enabled false to leave host:port alone
+         */
+        virtual void use_tcp(bool enabled = true)
+        {
+            tcp_enabled = enabled;
+        }
+
+        /**
+         * @brief Create the outbound HTTP client handlers use to call other services.
+         * @note The client keeps per-host keep-alive pools on its own event loop thread, started
+         *       when the server starts serving. Register HTTP/2 upstreams on get_http_client()
+         *       with web_client::use_http2() before that.
+         * @param config Pool sizes, pipelining depth and timeouts
+         */
+        virtual void use_http_client(const web_client_config &config = web_client_config{})
+        {
+            client = std::make_unique<web_client>(config);
+        }
+
+        /// @brief Get the outbound HTTP client, null without use_http_client()
+        web_client *get_http_client()
+        {
+            return client.get();
+        }
+
+        /// @brief Get the shared worker pool, e.g. for its thread counts
+        thread_pool &get_worker_pool()
+        {
+            return worker_pool;
+        }
+
+        /**
+         * @brief Pin the listen loops and workers to CPUs, NUMA node by node.
+         * @note Reactor i runs on the i-th CPU of the plan (the CPUs handling the NIC's queue interrupts
+         *       first when nic_interface is set), shared pool worker j on the j-th CPU, and workers local
+         *       to a reactor on the CPUs of that reactor's NUMA node. In prefork mode each process gets
+         *       its own contiguous share of the plan. The thread calling listen() runs reactor 0.
+         * @param placement The CPUs to use and what to pin
+         */
+        virtual void use_cpu_affinity(const cpu_affinity &placement)
+        {
+            affinity = placement;
+        }
+
+        /// @brief CPUs of this process in placement order, filled when serving starts with affinity set
+        const std::vector<int> &get_cpu_plan() const
+        {
+            return cpu_plan;
+        }
+
+        /// @brief Backend of the HTTP/2 and Unix socket listeners, meaningful once listen() was called
+        io_backend get_io_backend() const
+        {
+            return active_io_backend;
+        }
+
+        /// @brief Number of requests currently being queued or handled
+        std::size_t get_in_flight() const
+        {
+            return in_flight.load();
+        }
+
         /**
          * @brief Start the server and begin listening for requests.
          * @param listen_callback Optional callback for listen success
@@ -167,7 +666,36 @@ namespace hh_web
             {
                 this->error_callback = error_callback;
             }
-            hh_http::http_server::listen();
+
+            if (process_count > 1)
+            {
+                if (!hot_restart_path.empty())
+                    logger::error("Hot restart is not supported in prefork mode, use SIGHUP for a rolling reload");
+
+                process_supervisor supervisor(process_count, [this](unsigned int slot)
+                                              {
+                                                  process_slot = slot;
+                                                  return serve_worker_process(); }, drain_timeout);
+                supervisor.run();
+                return;
+            }
+            serve();
+        }
+
+        /**
+         * @brief Stop gracefully, waiting for in-flight requests first.
+         * @note New connections may still be accepted while draining, the wait is bounded by the timeout.
+         * @param timeout Maximum time to wait for in-flight requests before stopping anyway
+         */
+        virtual void shutdown(std::chrono::milliseconds timeout)
+        {
+            draining.store(true);
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (in_flight.load() > 0 && std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            stop();
         }
 
         /**
@@ -176,7 +704,37 @@ namespace hh_web
         virtual void stop()
         {
             hh_http::http_server::stop_server();
+            if (http2)
+                http2->stop();
+            if (unix_listener)
+                unix_listener->stop();
+            {
+                std::lock_guard<std::mutex> lock(unix_only_mutex);
+                unix_only_serving = false;
+            }
+            unix_only_stopped.notify_all();
+            stop_reactors();
+            // workers waiting on an outbound request get "client stopped" instead of their timeout
+            if (client)
+                client->stop();
             worker_pool.stop_workers();
+            if (offload_pool)
+                offload_pool->stop_workers();
+            completions->stop();
+            stop_timers();
+            handoff.close();
+            predecessor.close();
+        }
+
+        /**
+         * @brief Get the server's timing wheel.
+         * @note The wheel is advanced by the server every resolution tick while listening,
+         *       applications and middleware may schedule their own O(1) timers on it.
+         * @return Reference to the timing wheel
+         */
+        timing_wheel &get_timers()
+        {
+            return timers;
         }
 
         /// @brief Register a GET route for the base router.
@@ -211,6 +769,36 @@ namespace hh_web
             routers[0]->add_route(std::make_shared<web_route<T, G>>("DELETE", path, handlers));
         }
 
+        /// @brief Register a route forwarding every method under a path to an upstream, on the base router.
+        /// @param path The path for the route, usually ending in "/*" (e.g. "/legacy/*")
+        /// @param upstream The servers requests are forwarded to
+        void proxy(const std::string &path, std::shared_ptr<proxy_upstream> upstream)
+        {
+            routers[0]->add_route(std::make_shared<web_proxy_route<T, G>>(path, upstream));
+        }
+
+        /**
+         * @brief Register a batch endpoint on the base router (see web_batch_route).
+         * @note Sub-requests run through the same routers, static files and default route as
+         *       any request, in-process; with config.parallel, on the worker pool.
+         * @note T and G need the synthetic constructors of web_request and web_response.
+         * @param path Path of the endpoint
+         * @param config Limits and scheduling
+         */
+        virtual void use_batch(const std::string &path = "/api/batch", const batch_config &config = batch_config{})
+        {
+            if constexpr (std::is_constructible_v<T, synthetic_request &&> &&
+                          std::is_constructible_v<G, response_target::send_callback, response_target::end_callback>)
+            {
+                routers[0]->add_route(std::make_shared<web_batch_route<T, G>>(path, config, [this](std::shared_ptr<T> req, std::shared_ptr<G> res)
+                                                                              { request_handler(req, res); }, &worker_pool));
+            }
+            else
+            {
+                logger::error("Batch route not registered: the request/response types lack the synthetic constructors");
+            }
+        }
+
     protected:
         /**
          * @brief Serve static files from registered directories.
@@ -237,8 +825,7 @@ namespace hh_web
                 /// No file, bad, return 404
                 if (file_path.empty() || !std::ifstream(file_path))
                 {
-                    res->set_status(404, "Not Found");
-                    res->send_text("404 Not Found");
+                    res->send_canned(canned.get(404));
                     return;
                 }
 
@@ -302,21 +889,36 @@ namespace hh_web
                 if (!handled) // not handled yet, fallback to 404, user may add custom handlers
                     handle_default_route(req, res);
 
+                // A handler that noticed the cancellation may return without answering
+                if (req->is_cancelled() && !res->did_send.load())
+                {
+                    expired_in_pipeline++;
+                    on_deadline_exceeded(req, res, 504, "Gateway Timeout");
+                }
+
                 res->send();
                 res->end();
             }
             catch (const std::exception &e)
             {
-                logger::error("Error in request handler thread: " + std::string(e.what()));
+                if (req->is_cancelled()) // deadline hit between middleware/handler steps
+                {
+                    expired_in_pipeline++;
+                    on_deadline_exceeded(req, res, 504, "Gateway Timeout");
+                }
+                else
+                {
+                    logger::error("Error in request handler thread: " + std::string(e.what()));
 
-                web_exception exp(
-                    "Error in request handler thread",
-                    "INTERNAL_ERROR",
-                    "request_handler",
-                    500,
-                    "Internal Server Error");
+                    web_exception exp(
+                        "Error in request handler thread",
+                        "INTERNAL_ERROR",
+                        "request_handler",
+                        500,
+                        "Internal Server Error");
 
-                on_unhandled_exception(req, res, exp);
+                    on_unhandled_exception(req, res, exp);
+                }
             }
 
             res->send();
@@ -333,10 +935,101 @@ namespace hh_web
          * @note Intended to just pass the HTTP request, response to another thread to handle it
          */
         virtual void on_request_received(hh_http::http_request &request, hh_http::http_response &response) override
+        {
+            dispatch_request(request, response, worker_pool, completions);
+        }
+
+        /**
+         * @brief Convert the HTTP objects to web objects and enqueue them on the given workers.
+         * @note Shared by the base reactor (the server itself, using worker_pool) and the extra
+         *       reactors, which pass their local workers when they have any.
+         * @param request Low-level HTTP request object
+         * @param response Low-level HTTP response object
+         * @param pool Workers that should run the request handler
+         * @param completions Completion queue of the reactor that received the request
+         */
+        virtual void dispatch_request(hh_http::http_request &request, hh_http::http_response &response, thread_pool &pool, std::shared_ptr<completion_queue> completions)
         {
             auto req = std::make_shared<T>(std::move(request));
             auto res = std::make_shared<G>(std::move(response));
+            dispatch(req, res, pool, completions);
+        }
+
+        /**
+         * @brief Pass a request received by the HTTP/2 or Unix domain socket listener to the pipeline.
+         * @note Runs on the listener's loop thread. The response is posted back to the listener
+         *       when the handlers send it, a response ended without being sent resets the stream.
+         * @param listener The listener that received the request
+         * @param ref Connection and stream of the request
+         * @param request The decoded request
+         * @return The request's cancellation token, cancelled by the listener if the client resets the stream
+         */
+        virtual std::shared_ptr<cancellation_token> dispatch_http2(http2_listener *listener, const http2_stream_ref &ref, http2_request &&request)
+        {
+            if constexpr (std::is_constructible_v<T, synthetic_request &&> &&
+                          std::is_constructible_v<G, response_target::send_callback, response_target::end_callback>)
+            {
+                synthetic_request message;
+                message.method = std::move(request.method);
+                message.uri = std::move(request.path);
+                message.version = ref.stream_id == 0 ? "HTTP/1.1" : "HTTP/2";
+                message.headers = std::move(request.headers);
+                message.body = std::move(request.body);
+                message.peer = request.peer;
+
+                // handlers reading Host keep working, HTTP/2 carries it as :authority
+                bool has_host = std::any_of(message.headers.begin(), message.headers.end(), [](const auto &header)
+                                            { return header.first == "host"; });
+                if (!has_host && !request.authority.empty())
+                    message.headers.emplace_back("host", request.authority);
+
+                auto req = std::make_shared<T>(std::move(message));
+                auto res = std::make_shared<G>([listener, ref](synthetic_response &&sent)
+                                               {
+                                                   http2_response answer;
+                                                   answer.status = sent.status;
+                                                   answer.headers = std::move(sent.headers);
+                                                   answer.body = std::move(sent.body);
+                                                   answer.trailers = std::move(sent.trailers);
+                                                   if (sent.canned && ref.stream_id == 0)
+                                                   {
+                                                       // HTTP/1.1: the listener writes the canned bytes as they are
+                                                       answer.canned = std::move(sent.canned);
+                                                   }
+                                                   else if (sent.canned)
+                                                   {
+                                                       for (const auto &header : sent.canned->get_headers())
+                                                           answer.headers.push_back(header);
+                                                       answer.body = std::string(sent.canned->get_body());
+                                                   }
+                                                   listener->post(ref, std::move(answer)); },
+                                               [listener, ref](bool sent)
+                                               {
+                                                   if (!sent)
+                                                       listener->post_reset(ref); });
+
+                auto token = req->get_cancellation_token();
+                dispatch(req, res, worker_pool, nullptr);
+                return token;
+            }
+            else
+            {
+                logger::error("HTTP/2 request dropped: the request/response types lack the synthetic constructors");
+                listener->post_reset(ref);
+                return nullptr;
+            }
+        }
 
+        /**
+         * @brief Validate a request and enqueue its handling on the given workers.
+         * @param req The request
+         * @param res Its response
+         * @param pool Workers that should run the request handler
+         * @param completions Completion queue of the receiving reactor, null for responses that
+         *                    are not written by a reactor (HTTP/2 streams)
+         */
+        virtual void dispatch(std::shared_ptr<T> req, std::shared_ptr<G> res, thread_pool &pool, std::shared_ptr<completion_queue> completions)
+        {
             // If the pointers somehow was not created
             if (!res || !req)
             {
@@ -350,19 +1043,42 @@ namespace hh_web
                 logger::error("Unknown HTTP method: " + req->get_method());
 
                 // Send back bad Request
-                res->set_status(400, "Bad Request");
-                res->send_text("400 Bad Request: " + req->get_method());
+                res->send_canned(canned.get(400));
                 res->end();
                 return;
             }
+            if (draining.load())
+                res->set_keep_alive(false);
+
+            if (completion_queue_enabled && completions)
+                res->deferred.store(true);
+
+            apply_request_deadline(req);
+            auto deadline_timer = arm_deadline_timer(req);
+            in_flight++;
+
             try
             {
-                // Enqueue the request handler for processing
-                worker_pool.enqueue([this, req, res]()
-                                    { request_handler(req, res); });
+                // Enqueue the request handler for processing, requests that expired while queued are dropped
+                pool.enqueue([this, req, res, deadline_timer, completions]()
+                                    {
+                                        if (req->is_cancelled())
+                                        {
+                                            expired_in_queue++;
+                                            on_deadline_exceeded(req, res, 503, "Service Unavailable");
+                                        }
+                                        else
+                                        {
+                                            request_handler(req, res);
+                                            timers.cancel(deadline_timer);
+                                        }
+                                        if (res->deferred.load())
+                                            completions->push(res);
+                                        in_flight--; });
             }
             catch (web_exception &e) // Unhandled web_exception
             {
+                in_flight--;
 
                 logger::error("Error in request handler thread: " + std::string(e.what()));
 
@@ -370,9 +1086,12 @@ namespace hh_web
 
                 res->send();
                 res->end();
+                if (res->deferred.load())
+                    completions->push(res);
             }
             catch (const std::exception &e) // unexpected exception
             {
+                in_flight--;
                 logger::error("Error in request handler thread: " + std::string(e.what()));
 
                 web_exception exp(
@@ -385,15 +1104,417 @@ namespace hh_web
                 on_unhandled_exception(req, res, exp);
                 res->send();
                 res->end();
+                if (res->deferred.load())
+                    completions->push(res);
             }
         };
 
+        /**
+         * @brief Apply the server default and the client's timeout header to the request deadline.
+         * @param req The request whose cancellation token should be configured
+         */
+        virtual void apply_request_deadline(std::shared_ptr<T> req)
+        {
+            auto token = req->get_cancellation_token();
+            token->set_timeout(default_request_timeout);
+
+            if (request_timeout_header.empty())
+                return;
+
+            auto values = req->get_header(request_timeout_header);
+            if (values.empty())
+                return;
+
+            std::string value = trim(values[0]);
+            long long milliseconds = 0;
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), milliseconds);
+            if (ec != std::errc() || ptr != value.data() + value.size())
+                return;
+
+            // a client may only shorten the deadline: values at or past the default (or the
+            // fixed maximum without one) are ignored, they could not tighten it anyway
+            std::chrono::milliseconds limit = default_request_timeout.count() > 0 ? default_request_timeout : max_client_timeout;
+            if (milliseconds > 0 && milliseconds < limit.count())
+                token->set_timeout(std::chrono::milliseconds(milliseconds));
+        }
+
+        /**
+         * @brief Arm a timer that cancels the request's token when its deadline passes.
+         * @note Cancelling through the wheel lets helper threads waiting on the token see the
+         *       cancellation without reading the clock. The timer is cancelled when the handler returns.
+         * @param req The request whose deadline should be enforced
+         * @return The timer id, 0 when the request has no deadline
+         */
+        virtual timing_wheel::timer_id arm_deadline_timer(std::shared_ptr<T> req)
+        {
+            auto token = req->get_cancellation_token();
+            if (!token->has_deadline())
+                return 0;
+
+            std::weak_ptr<cancellation_token> weak_token = token;
+            return timers.schedule(token->remaining(), [weak_token]()
+                                   {
+                                       if (auto expired = weak_token.lock())
+                                           expired->cancel(); });
+        }
+
+        /// @brief Start the workers, timers and reactors, then run the listen loop until stopped
+        void serve()
+        {
+            resolve_io_backend();
+            if (!hot_restart_path.empty() && process_count == 1)
+                predecessor.take_over(hot_restart_path, port);
+
+            prepare_cpu_affinity();
+            worker_pool.start();
+            start_offload_executor();
+            if (shards)
+                shards->start();
+            if (completion_queue_enabled)
+                completions->start();
+            start_timers();
+            if (tcp_enabled)
+                start_reactors();
+            if (client && !client->start())
+                logger::error("HTTP client could not start, outbound requests will fail");
+            if (http2 && !http2->start())
+                logger::error("HTTP/2 listener could not start, serving HTTP/1.1 only");
+            if (unix_listener && !unix_listener->start())
+                logger::error("Unix socket listener could not start on " + unix_listener->get_unix_path());
+            // a listener whose ring could not be set up runs on epoll (it logged why)
+            if ((http2 && http2->is_running() && !http2->is_io_uring()) ||
+                (unix_listener && unix_listener->is_running() && !unix_listener->is_io_uring()))
+                active_io_backend = io_backend::EPOLL;
+
+            if (tcp_enabled || !unix_listener)
+            {
+                hh_http::http_server::listen();
+                return;
+            }
+
+            // the Unix domain socket only: its loop runs on its own thread, wait for stop()
+            std::unique_lock<std::mutex> lock(unix_only_mutex);
+            unix_only_serving = unix_listener->is_running();
+            if (unix_only_serving)
+                this->listen_callback();
+            unix_only_stopped.wait(lock, [this]()
+                                   { return !unix_only_serving; });
+        }
+
+        /**
+         * @brief Body of a prefork worker process.
+         * @note SIGTERM/SIGINT are blocked before any thread starts and consumed by a watcher thread,
+         *       which drains the in-flight requests (drain_timeout) and stops the server.
+         * @return Exit code of the worker process
+         */
+        virtual int serve_worker_process()
+        {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, SIGTERM);
+            sigaddset(&set, SIGINT);
+            pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+            std::thread([this, set]()
+                        {
+                            int sig = 0;
+                            if (sigwait(&set, &sig) == 0)
+                                shutdown(drain_timeout); })
+                .detach();
+
+            serve();
+            return 0;
+        }
+
+        /// @brief Pick the backend for this run from the requested one and the kernel, and hand it to the listeners
+        void resolve_io_backend()
+        {
+            active_io_backend = io_backend::EPOLL;
+            if (requested_io_backend != io_backend::EPOLL)
+            {
+                if (io_uring_ring::probe().socket_loop())
+                    active_io_backend = io_backend::IO_URING;
+                else if (requested_io_backend == io_backend::IO_URING)
+                    logger::error("io_uring is not available or lacks required features on this kernel, falling back to epoll");
+            }
+
+            bool uring = active_io_backend == io_backend::IO_URING;
+            if (uring && requested_io_backend == io_backend::IO_URING && tcp_enabled)
+                logger::info("The HTTP/1.1 listen loops stay on epoll, io_uring serves the HTTP/2 and Unix socket listeners");
+            if (http2)
+                http2->set_io_uring(uring);
+            if (unix_listener)
+                unix_listener->set_io_uring(uring);
+        }
+
+        /**
+         * @brief Read the topology, compute this process' CPU plan and pin reactor 0 and the shared workers.
+         * @note Does nothing without use_cpu_affinity(). Workers pin themselves when they start, so what
+         *       they allocate afterwards is local to their node.
+         */
+        void prepare_cpu_affinity()
+        {
+            if (!affinity)
+                return;
+
+            topology = cpu_topology::detect(affinity->root);
+            std::vector<int> plan = topology.plan(*affinity);
+            if (plan.empty())
+            {
+                logger::error("None of the CPUs given to use_cpu_affinity() is online, threads stay unpinned");
+                return;
+            }
+
+            // prefork workers take disjoint contiguous shares of the plan
+            if (process_count > 1 && plan.size() >= process_count)
+            {
+                std::size_t first = plan.size() * process_slot / process_count;
+                std::size_t last = plan.size() * (process_slot + 1) / process_count;
+                plan = std::vector<int>(plan.begin() + first, plan.begin() + last);
+            }
+            cpu_plan = plan;
+
+            if (affinity->pin_reactors)
+                cpu_topology::pin_current_thread(reactor_cpus(0));
+            if (affinity->pin_workers)
+            {
+                worker_pool.set_thread_init([this](unsigned int worker)
+                                            { cpu_topology::pin_current_thread({cpu_plan[worker % cpu_plan.size()]}); });
+            }
+        }
+
+        /// @brief Start the offload workers, pinned to offload_cpus, does nothing without use_offload_executor()
+        void start_offload_executor()
+        {
+            if (!offload_pool)
+                return;
+            if (!offload_cpus.empty())
+            {
+                offload_pool->set_thread_init([this](unsigned int)
+                                              { cpu_topology::pin_current_thread(offload_cpus); });
+            }
+            offload_pool->start();
+        }
+
+        /// @brief CPU set of a reactor's listen loop, empty when reactors are not pinned
+        std::vector<int> reactor_cpus(unsigned int index) const
+        {
+            if (!affinity || !affinity->pin_reactors || cpu_plan.empty())
+                return {};
+            return {cpu_plan[index % cpu_plan.size()]};
+        }
+
+        /// @brief CPUs for a reactor's local workers: the planned CPUs on the reactor's NUMA node
+        std::vector<int> reactor_worker_cpus(unsigned int index) const
+        {
+            if (!affinity || !affinity->pin_workers || cpu_plan.empty())
+                return {};
+
+            int node = topology.node_of(cpu_plan[index % cpu_plan.size()]);
+            std::vector<int> cpus;
+            for (int cpu : cpu_plan)
+            {
+                if (topology.node_of(cpu) == node)
+                    cpus.push_back(cpu);
+            }
+            return cpus;
+        }
+
+        /**
+         * @brief Check whether the listening sockets of the port can share it with more listeners.
+         * @note hh_http binds its socket itself, so SO_REUSEPORT cannot be set from here. Sockets
+         *       bound without it make the extra reactors' binds fail.
+         * @return false if a socket of this process bound to the port lacks SO_REUSEPORT
+         */
+        bool listeners_reuse_port() const
+        {
+            for (int fd : listener_handoff::find_listeners(port, false))
+            {
+                int enabled = 0;
+                socklen_t length = sizeof(enabled);
+                if (getsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enabled, &length) == 0 && !enabled)
+                    return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Create and start the extra reactors, does nothing in single reactor mode.
+         * @note Every reactor binds in its constructor, so all of them are bound before any thread
+         *       starts. A failure is reported through on_exception_occurred, the reactors created
+         *       so far are stopped and joined, and the server keeps serving on its own loop.
+         */
+        void start_reactors()
+        {
+            reactors_not_listening.store(1);
+            reactors_listening.store(0);
+            if (reactor_count < 2)
+                return;
+            if (!listeners_reuse_port())
+            {
+                logger::error("The listening socket of port " + std::to_string(port) +
+                              " is not bound with SO_REUSEPORT, serving with a single reactor");
+                return;
+            }
+
+            try
+            {
+                for (unsigned int i = 1; i < reactor_count; ++i)
+                    reactors.push_back(std::make_unique<web_reactor<T, G, R>>(*this, port, host, i, reactor_local_threads));
+
+                // counted before any reactor can report, the server's own loop listens after this
+                reactors_not_listening.store(static_cast<unsigned int>(reactors.size()) + 1);
+                for (auto &reactor : reactors)
+                {
+                    auto *raw = reactor.get();
+                    if (completion_queue_enabled)
+                        raw->start_completions();
+                    raw->start_workers(reactor_worker_cpus(raw->get_index()));
+                    reactor_threads.emplace_back([this, raw]()
+                                                 {
+                                                     std::vector<int> cpus = reactor_cpus(raw->get_index());
+                                                     if (!cpus.empty())
+                                                         cpu_topology::pin_current_thread(cpus);
+                                                     try
+                                                     {
+                                                         raw->listen();
+                                                     }
+                                                     catch (const std::exception &e)
+                                                     {
+                                                         on_exception_occurred(e);
+                                                     }
+                                                     // a loop that failed before listening must not hold the handoff back
+                                                     if (!raw->has_listened())
+                                                         on_reactor_listening(false); });
+                }
+            }
+            catch (const std::exception &e)
+            {
+                on_exception_occurred(e);
+                logger::error("Could not start the extra reactors, serving with a single reactor");
+                stop_reactors();
+                reactors_not_listening.store(1);
+                reactors_listening.store(0);
+            }
+        }
+
+        /// @brief Stop the extra reactors and join their threads
+        void stop_reactors()
+        {
+            for (auto &reactor : reactors)
+                reactor->stop();
+            for (auto &thread : reactor_threads)
+            {
+                if (thread.joinable())
+                    thread.join();
+            }
+            reactor_threads.clear();
+            reactors.clear();
+        }
+
+        /// @brief Start the thread advancing the timing wheel, does nothing if it is already running
+        void start_timers()
+        {
+            if (timers_running.exchange(true))
+                return;
+
+            timer_thread = std::thread([this]()
+                                       {
+                                           while (timers_running.load())
+                                           {
+                                               std::this_thread::sleep_for(timers.get_resolution());
+                                               timers.advance();
+                                           } });
+        }
+
+        /// @brief Stop and join the timer thread
+        void stop_timers()
+        {
+            timers_running.store(false);
+            if (timer_thread.joinable() && timer_thread.get_id() != std::this_thread::get_id())
+                timer_thread.join();
+        }
+
+        /**
+         * @brief Answer a request whose deadline has passed.
+         * @note Called with 503 when the request expired in the worker queue (it never ran),
+         *       and with 504 when it expired while middleware or handlers were running.
+         * @param req The expired request
+         * @param res The response to send the error on
+         * @param status_code 503 or 504
+         * @param status_message The matching status message
+         */
+        virtual void on_deadline_exceeded([[maybe_unused]] std::shared_ptr<T> req, std::shared_ptr<G> res, int status_code, const std::string &status_message)
+        {
+            res->send_canned(canned.get(status_code, status_message));
+            res->end();
+        }
+
         /// HTTP server callback for successful listen
         virtual void on_listen_success() override
         {
+            apply_socket_options();
+            on_reactor_listening(true);
             this->listen_callback();
         }
 
+        /**
+         * @brief Count a reactor that listens now (or failed before it could).
+         * @note The last one completes a hot restart: the steering program may only target
+         *       listeners that are in the reuseport group, so it waits for all of them.
+         * @param listening false for a reactor whose loop ended without listening
+         */
+        void on_reactor_listening(bool listening)
+        {
+            if (listening)
+                reactors_listening.fetch_add(1);
+            if (reactors_not_listening.fetch_sub(1) != 1)
+                return;
+
+            if (!hot_restart_path.empty() && process_count == 1)
+            {
+                predecessor.complete(reactors_listening.load());
+                handoff.offer(hot_restart_path, port, [this](const std::vector<int> &listeners)
+                              { on_listeners_taken_over(listeners); });
+            }
+        }
+
+        /**
+         * @brief Apply the configured socket options to this process' listeners of the port.
+         * @note Called by each reactor once it listens, setting an option twice is harmless.
+         */
+        virtual void apply_socket_options()
+        {
+            if (!listener_options)
+                return;
+
+            for (int fd : listener_handoff::find_listeners(port))
+                listener_options->apply_to_listener(fd);
+        }
+
+        /**
+         * @brief Called once a new process took this server's listening sockets over.
+         * @note The old listeners get no new connections anymore. The server keeps accepting until
+         *       their accept queues stayed empty for a moment, then drains its in-flight requests and
+         *       stops, all within drain_timeout.
+         * @param listeners This process' listening sockets
+         */
+        virtual void on_listeners_taken_over(const std::vector<int> &listeners)
+        {
+            handoff_drain_thread = std::thread([this, listeners]()
+                                               {
+                                                   draining.store(true);
+                                                   auto deadline = std::chrono::steady_clock::now() + drain_timeout;
+                                                   int quiet_checks = 0;
+                                                   while (quiet_checks < 5 && std::chrono::steady_clock::now() < deadline)
+                                                   {
+                                                       std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                                                       quiet_checks = listener_handoff::pending_connections(listeners) == 0 ? quiet_checks + 1 : 0;
+                                                   }
+                                                   auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                                                   shutdown(std::max(left, std::chrono::milliseconds(0))); });
+        }
+
         /// @brief HTTP server callback for exceptions
         /// @param e The exception that occurred
         virtual void on_exception_occurred(const std::exception &e) override
@@ -430,9 +1551,8 @@ namespace hh_web
                 unhandled_exception_callback(req, res, e);
                 return;
             }
-            res->set_status(e.get_status_code(), e.get_status_message());
-            res->send_text("Internal Server Error");
-            logger::error("Unhandled Web exception: " + std::string(e.what()));
+            res->send_canned(canned.get(e.get_status_code(), e.get_status_message()));
+            logger::error("Unhandled Web exception: " + e.get_formatted_message());
             res->end();
         }
     };
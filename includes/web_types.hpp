@@ -8,6 +8,13 @@
 #include "web_request.hpp"
 #include "web_exceptions.hpp"
 
+#define HEADER_RECEIVED_PARAMS std::shared_ptr<hh_socket::connection> conn,            \
+                               const std::multimap<std::string, std::string> &headers, \
+                               const std::string &method,                              \
+                               const std::string &uri,                                 \
+                               const std::string &version,                             \
+                               const std::string &body
+
 namespace hh_web
 {
     enum class exit_code
@@ -16,6 +23,14 @@ namespace hh_web
         CONTINUE = 0,
         _ERROR = -1
     };
+
+    /// Kernel interface of the listen loops hh_web runs itself (HTTP/2 and Unix socket listeners)
+    enum class io_backend
+    {
+        EPOLL,
+        IO_URING,
+        AUTO ///< io_uring when the kernel supports what the loops need, epoll otherwise
+    };
     using http_request_callback_t = std::function<void(hh_http::http_request &, hh_http::http_response &)>;
     using web_listen_callback_t = std::function<void()>;
     using web_error_callback_t = std::function<void(const std::exception &)>;
@@ -92,6 +92,21 @@ namespace hh_web
      */
     std::string trim(const std::string &str);
 
+    /**
+     * @brief Lowercase a string, ASCII only.
+     * @param value Input string, e.g. a header name
+     * @return Lowercase copy
+     */
+    std::string lowercase(std::string value);
+
+    /**
+     * @brief Check whether a comma-separated header value lists a token.
+     * @param list Header value, e.g. "keep-alive, Upgrade"
+     * @param token Lowercase token to look for
+     * @return true if one element, trimmed and lowercased, equals token
+     */
+    bool has_token(const std::string &list, const std::string &token);
+
     /**
      * @brief Check whether a URI points to a static resource by extension.
      * @param uri Request URI
@@ -111,6 +126,16 @@ namespace hh_web
      */
     std::vector<std::pair<std::string, std::string>> get_path_params(const std::string &uri);
 
+    /**
+     * @brief Parse the value of a Cookie header into name-value pairs.
+     * @param header Cookie header value, e.g. "session=3f2a; theme=dark"
+     * @return Pairs in header order, names and values trimmed, quotes around a value removed
+     *
+     * Follows the cookie-string of RFC 6265: pairs are separated by ';' and split at the first
+     * '='. Pairs without '=' or with an empty name are skipped. Values are not URL-decoded.
+     */
+    std::vector<std::pair<std::string, std::string>> parse_cookies(const std::string &header);
+
     /**
      * @brief Extract the path component (without query) from a URI.
      * @param uri Full request URI
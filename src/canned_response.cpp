@@ -0,0 +1,96 @@
+#include <mutex>
+
+#include "../includes/canned_response.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        const std::pair<int, const char *> default_statuses[] = {
+            {400, "Bad Request"},
+            {404, "Not Found"},
+            {405, "Method Not Allowed"},
+            {408, "Request Timeout"},
+            {413, "Payload Too Large"},
+            {429, "Too Many Requests"},
+            {500, "Internal Server Error"},
+            {502, "Bad Gateway"},
+            {503, "Service Unavailable"},
+            {504, "Gateway Timeout"},
+        };
+
+        std::shared_ptr<const canned_response> plain(int status_code, const std::string &status_message)
+        {
+            return std::make_shared<const canned_response>(status_code, status_message, std::to_string(status_code) + " " + status_message);
+        }
+    }
+
+    canned_response::canned_response(int status_code, std::string status_message, const std::string &body,
+                                     const std::string &content_type, std::vector<std::pair<std::string, std::string>> headers)
+        : status_code(status_code), status_message(std::move(status_message)), headers(std::move(headers))
+    {
+        this->headers.emplace_back("Content-Type", content_type);
+        this->headers.emplace_back("Content-Length", std::to_string(body.size()));
+
+        wire = "HTTP/1.1 " + std::to_string(status_code) + " " + this->status_message + "\r\n";
+        for (const auto &[name, value] : this->headers)
+            wire += name + ": " + value + "\r\n";
+        head_size = wire.size();
+        wire += body;
+    }
+
+    void canned_response::append_http1(std::string &out, bool keep_alive, bool head_only) const
+    {
+        out.append(wire, 0, head_size);
+        out += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+        if (!head_only)
+            out.append(wire, head_size, std::string::npos);
+    }
+
+    canned_responses::canned_responses()
+    {
+        for (const auto &[status_code, status_message] : default_statuses)
+            by_status[status_code] = plain(status_code, status_message);
+    }
+
+    void canned_responses::set(int status_code, const std::string &status_message, const std::string &body, const std::string &content_type)
+    {
+        set(std::make_shared<const canned_response>(status_code, status_message, body, content_type));
+    }
+
+    void canned_responses::set(std::shared_ptr<const canned_response> response)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        by_status[response->get_status_code()] = std::move(response);
+    }
+
+    void canned_responses::set_page(const std::string &name, std::shared_ptr<const canned_response> response)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        pages[name] = std::move(response);
+    }
+
+    std::shared_ptr<const canned_response> canned_responses::get(int status_code, const std::string &status_message) const
+    {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = by_status.find(status_code);
+            if (it != by_status.end())
+                return it->second;
+            if (status_code < 100 || status_code > 599)
+                return by_status.at(500);
+        }
+
+        // rendered once per status code, the set of codes is small
+        auto response = plain(status_code, status_message);
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        return by_status.emplace(status_code, std::move(response)).first->second;
+    }
+
+    std::shared_ptr<const canned_response> canned_responses::get_page(const std::string &name) const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = pages.find(name);
+        return it == pages.end() ? nullptr : it->second;
+    }
+}
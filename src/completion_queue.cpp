@@ -0,0 +1,119 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "../includes/logger.hpp"
+#include "../includes/completion_queue.hpp"
+
+namespace hh_web
+{
+    completion_queue::~completion_queue()
+    {
+        stop();
+        // late pushes from workers that outlived stop() still get their response ended
+        flush();
+        if (event_fd >= 0)
+            close(event_fd);
+    }
+
+    /**
+     * Producer side
+     * - The node is linked before the signalled flag is checked, so a flusher that cleared the
+     *   flag before draining always sees the item
+     */
+    void completion_queue::push(std::shared_ptr<web_response> response)
+    {
+        if (!response)
+            return;
+
+        if (!running.load())
+        {
+            response->complete();
+            return;
+        }
+
+        queue.push(std::move(response));
+        if (!signalled.exchange(true))
+        {
+            std::uint64_t one = 1;
+            if (write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+                logger::error("Failed to signal the completion queue: " + std::string(std::strerror(errno)));
+        }
+    }
+
+    std::size_t completion_queue::flush()
+    {
+        std::size_t count = 0;
+        std::shared_ptr<web_response> response;
+        while (queue.pop(response))
+        {
+            response->complete();
+            response.reset();
+            count++;
+        }
+
+        if (count > 0)
+        {
+            flushed += count;
+            batches++;
+        }
+        return count;
+    }
+
+    void completion_queue::start()
+    {
+        if (running.load())
+            return;
+
+        if (event_fd < 0)
+            event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd < 0)
+        {
+            logger::error("Failed to create the completion queue eventfd, workers keep writing responses: " + std::string(std::strerror(errno)));
+            return;
+        }
+
+        running.store(true);
+        flusher = std::thread([this]()
+                              { run(); });
+    }
+
+    /**
+     * Flusher loop
+     * - The timeout only bounds how long stop() waits, every completion is signalled
+     * - The flag is cleared before draining, a push that lands during the drain signals again
+     */
+    void completion_queue::run()
+    {
+        while (running.load())
+        {
+            pollfd ready{event_fd, POLLIN, 0};
+            if (poll(&ready, 1, 100) <= 0)
+                continue;
+
+            std::uint64_t count = 0;
+            if (read(event_fd, &count, sizeof(count)) < 0)
+                continue;
+
+            signalled.store(false);
+            flush();
+        }
+    }
+
+    void completion_queue::stop()
+    {
+        if (!running.exchange(false))
+            return;
+
+        if (flusher.joinable() && flusher.get_id() != std::this_thread::get_id())
+            flusher.join();
+
+        // complete what was pushed before the flag flipped
+        flush();
+    }
+}
@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../includes/logger.hpp"
+#include "../includes/cpu_topology.hpp"
+
+namespace hh_web
+{
+    static std::string read_first_line(const std::string &path)
+    {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    std::vector<int> cpu_topology::parse_cpu_list(const std::string &list)
+    {
+        std::vector<int> cpus;
+        std::stringstream ranges(list);
+        std::string range;
+        while (std::getline(ranges, range, ','))
+        {
+            range.erase(std::remove_if(range.begin(), range.end(), [](unsigned char c)
+                                       { return std::isspace(c); }),
+                        range.end());
+            if (range.empty())
+                continue;
+
+            try
+            {
+                std::size_t dash = range.find('-');
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                if (first < 0 || last < first)
+                    return {};
+                for (int cpu = first; cpu <= last; ++cpu)
+                    cpus.push_back(cpu);
+            }
+            catch (const std::exception &)
+            {
+                return {};
+            }
+        }
+
+        std::sort(cpus.begin(), cpus.end());
+        cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+        return cpus;
+    }
+
+    /**
+     * Read the topology
+     * - Online CPUs from cpu/online, falling back to hardware_concurrency()
+     * - Nodes from node/node<N>/cpulist, offline CPUs are left out; no node directory means one node
+     */
+    cpu_topology cpu_topology::detect(const std::string &root)
+    {
+        cpu_topology topology;
+        topology.root = root;
+
+        topology.online = parse_cpu_list(read_first_line(root + "/sys/devices/system/cpu/online"));
+        if (topology.online.empty())
+        {
+            for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+                topology.online.push_back(static_cast<int>(cpu));
+        }
+
+        std::vector<std::pair<int, std::vector<int>>> found;
+        std::string node_directory = root + "/sys/devices/system/node";
+        if (DIR *directory = opendir(node_directory.c_str()))
+        {
+            while (dirent *entry = readdir(directory))
+            {
+                const char *name = entry->d_name;
+                if (std::strncmp(name, "node", 4) != 0 || !std::isdigit(static_cast<unsigned char>(name[4])))
+                    continue;
+
+                std::vector<int> cpus;
+                for (int cpu : parse_cpu_list(read_first_line(node_directory + "/" + name + "/cpulist")))
+                {
+                    if (std::binary_search(topology.online.begin(), topology.online.end(), cpu))
+                        cpus.push_back(cpu);
+                }
+                if (!cpus.empty())
+                    found.emplace_back(std::atoi(name + 4), std::move(cpus));
+            }
+            closedir(directory);
+        }
+        std::sort(found.begin(), found.end());
+
+        for (auto &node : found)
+            topology.nodes.push_back(std::move(node.second));
+        if (topology.nodes.empty())
+            topology.nodes.push_back(topology.online);
+
+        topology.cpu_node.assign(topology.online.back() + 1, -1);
+        for (std::size_t node = 0; node < topology.nodes.size(); ++node)
+        {
+            for (int cpu : topology.nodes[node])
+                topology.cpu_node[cpu] = static_cast<int>(node);
+        }
+        return topology;
+    }
+
+    bool cpu_topology::pin_thread(std::thread::native_handle_type thread, const std::vector<int> &cpus)
+    {
+        if (cpus.empty())
+            return false;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+        {
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+
+        int result = pthread_setaffinity_np(thread, sizeof(set), &set);
+        if (result != 0)
+        {
+            logger::error("Failed to set the CPU affinity of a thread: " + std::string(std::strerror(result)));
+            return false;
+        }
+        return true;
+    }
+
+    bool cpu_topology::pin_current_thread(const std::vector<int> &cpus)
+    {
+        return pin_thread(pthread_self(), cpus);
+    }
+
+    std::vector<int> cpu_topology::cpus_of_node(std::size_t node) const
+    {
+        return node < nodes.size() ? nodes[node] : std::vector<int>{};
+    }
+
+    int cpu_topology::node_of(int cpu) const
+    {
+        return cpu >= 0 && static_cast<std::size_t>(cpu) < cpu_node.size() ? cpu_node[cpu] : -1;
+    }
+
+    /**
+     * Interface queue CPUs
+     * - An IRQ belongs to the interface when its action name is the interface or starts with
+     *   "<interface>-" (mlx5, ixgbe, virtio style names)
+     * - effective_affinity_list is what the interrupt controller actually uses, smp_affinity_list
+     *   the request, older kernels only have the latter
+     */
+    std::vector<int> cpu_topology::nic_queue_cpus(const std::string &interface) const
+    {
+        std::vector<int> cpus;
+        if (interface.empty())
+            return cpus;
+
+        std::ifstream interrupts(root + "/proc/interrupts");
+        std::string line;
+        while (std::getline(interrupts, line))
+        {
+            std::stringstream fields(line);
+            std::string irq;
+            fields >> irq;
+            if (irq.empty() || irq.back() != ':' || !std::isdigit(static_cast<unsigned char>(irq[0])))
+                continue;
+            irq.pop_back();
+
+            std::string field, name;
+            while (fields >> field)
+                name = field;
+            if (name != interface && name.compare(0, interface.size() + 1, interface + "-") != 0)
+                continue;
+
+            std::string irq_directory = root + "/proc/irq/" + irq;
+            std::vector<int> affinity = parse_cpu_list(read_first_line(irq_directory + "/effective_affinity_list"));
+            if (affinity.empty())
+                affinity = parse_cpu_list(read_first_line(irq_directory + "/smp_affinity_list"));
+            if (!affinity.empty() && std::find(cpus.begin(), cpus.end(), affinity.front()) == cpus.end())
+                cpus.push_back(affinity.front());
+        }
+        return cpus;
+    }
+
+    std::vector<int> cpu_topology::plan(const cpu_affinity &affinity) const
+    {
+        auto allowed = [&](int cpu)
+        {
+            bool is_online = std::binary_search(online.begin(), online.end(), cpu);
+            return is_online && (affinity.cpus.empty() || std::find(affinity.cpus.begin(), affinity.cpus.end(), cpu) != affinity.cpus.end());
+        };
+
+        std::vector<int> order;
+        for (int cpu : nic_queue_cpus(affinity.nic_interface))
+        {
+            if (allowed(cpu))
+                order.push_back(cpu);
+        }
+        for (const auto &node : nodes)
+        {
+            for (int cpu : node)
+            {
+                if (allowed(cpu) && std::find(order.begin(), order.end(), cpu) == order.end())
+                    order.push_back(cpu);
+            }
+        }
+        return order;
+    }
+}
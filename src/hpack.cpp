@@ -0,0 +1,537 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include "../includes/hpack.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        struct huffman_symbol
+        {
+            std::uint32_t code;
+            std::uint8_t bits;
+        };
+
+        /// RFC 7541 Appendix B, index 256 is EOS
+        const huffman_symbol HUFFMAN_CODES[257] = {
+            {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+            {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28}, {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+            {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+            {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+            {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+            {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+            {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+            {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+            {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+            {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+            {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7}, {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+            {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+            {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+            {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+            {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+            {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+            {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+            {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+            {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+            {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+            {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+            {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+            {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+            {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+            {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+            {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+            {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+            {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+            {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+            {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+            {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+            {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+            {0x3fffffff, 30},
+        };
+
+        /// RFC 7541 Appendix A
+        const hpack_header STATIC_TABLE[hpack::STATIC_TABLE_SIZE] = {
+            {":authority", ""},
+            {":method", "GET"},
+            {":method", "POST"},
+            {":path", "/"},
+            {":path", "/index.html"},
+            {":scheme", "http"},
+            {":scheme", "https"},
+            {":status", "200"},
+            {":status", "204"},
+            {":status", "206"},
+            {":status", "304"},
+            {":status", "400"},
+            {":status", "404"},
+            {":status", "500"},
+            {"accept-charset", ""},
+            {"accept-encoding", "gzip, deflate"},
+            {"accept-language", ""},
+            {"accept-ranges", ""},
+            {"accept", ""},
+            {"access-control-allow-origin", ""},
+            {"age", ""},
+            {"allow", ""},
+            {"authorization", ""},
+            {"cache-control", ""},
+            {"content-disposition", ""},
+            {"content-encoding", ""},
+            {"content-language", ""},
+            {"content-length", ""},
+            {"content-location", ""},
+            {"content-range", ""},
+            {"content-type", ""},
+            {"cookie", ""},
+            {"date", ""},
+            {"etag", ""},
+            {"expect", ""},
+            {"expires", ""},
+            {"from", ""},
+            {"host", ""},
+            {"if-match", ""},
+            {"if-modified-since", ""},
+            {"if-none-match", ""},
+            {"if-range", ""},
+            {"if-unmodified-since", ""},
+            {"last-modified", ""},
+            {"link", ""},
+            {"location", ""},
+            {"max-forwards", ""},
+            {"proxy-authenticate", ""},
+            {"proxy-authorization", ""},
+            {"range", ""},
+            {"referer", ""},
+            {"refresh", ""},
+            {"retry-after", ""},
+            {"server", ""},
+            {"set-cookie", ""},
+            {"strict-transport-security", ""},
+            {"transfer-encoding", ""},
+            {"user-agent", ""},
+            {"vary", ""},
+            {"via", ""},
+            {"www-authenticate", ""}
+        };
+
+        /// Binary decoding tree of the Huffman code, node 0 is the root
+        struct huffman_node
+        {
+            std::int16_t child[2] = {-1, -1};
+            std::int16_t symbol = -1;
+        };
+
+        const std::vector<huffman_node> &huffman_tree()
+        {
+            static const std::vector<huffman_node> tree = []()
+            {
+                std::vector<huffman_node> nodes(1);
+                for (int symbol = 0; symbol < 257; ++symbol)
+                {
+                    std::size_t node = 0;
+                    for (int bit = HUFFMAN_CODES[symbol].bits - 1; bit >= 0; --bit)
+                    {
+                        int branch = (HUFFMAN_CODES[symbol].code >> bit) & 1;
+                        if (nodes[node].child[branch] < 0)
+                        {
+                            nodes[node].child[branch] = static_cast<std::int16_t>(nodes.size());
+                            nodes.emplace_back();
+                        }
+                        node = nodes[node].child[branch];
+                    }
+                    nodes[node].symbol = static_cast<std::int16_t>(symbol);
+                }
+                return nodes;
+            }();
+            return tree;
+        }
+
+        /// Static table entries by name, [first, last] index range
+        const std::unordered_map<std::string, std::pair<std::size_t, std::size_t>> &static_names()
+        {
+            static const auto names = []()
+            {
+                std::unordered_map<std::string, std::pair<std::size_t, std::size_t>> map;
+                for (std::size_t i = 0; i < hpack::STATIC_TABLE_SIZE; ++i)
+                {
+                    auto it = map.find(STATIC_TABLE[i].first);
+                    if (it == map.end())
+                        map.emplace(STATIC_TABLE[i].first, std::make_pair(i + 1, i + 1));
+                    else
+                        it->second.second = i + 1;
+                }
+                return map;
+            }();
+            return names;
+        }
+
+        /// Headers whose values change with every message, indexing them would only churn the table
+        bool unindexed_name(const std::string &name)
+        {
+            return name == ":path" || name == "content-length" || name == "etag" || name == "age" ||
+                   name == "last-modified" || name == "if-modified-since" || name == "if-none-match" ||
+                   name == "location" || name == "content-range";
+        }
+
+        /// Credentials, sent never-indexed so intermediaries do not compress them either
+        bool sensitive_name(const std::string &name)
+        {
+            return name == "authorization" || name == "proxy-authorization" || name == "cookie" || name == "set-cookie";
+        }
+    }
+
+    const hpack_header &hpack::static_entry(std::size_t index)
+    {
+        return STATIC_TABLE[index - 1];
+    }
+
+    std::size_t hpack::find_static(const std::string &name, const std::string &value, std::size_t &name_index)
+    {
+        name_index = 0;
+        auto it = static_names().find(name);
+        if (it == static_names().end())
+            return 0;
+
+        name_index = it->second.first;
+        for (std::size_t index = it->second.first; index <= it->second.second; ++index)
+        {
+            if (STATIC_TABLE[index - 1].second == value)
+                return index;
+        }
+        return 0;
+    }
+
+    void hpack::encode_integer(std::string &out, std::uint64_t value, int prefix_bits, std::uint8_t first_byte_flags)
+    {
+        std::uint64_t limit = (1u << prefix_bits) - 1;
+        if (value < limit)
+        {
+            out.push_back(static_cast<char>(first_byte_flags | value));
+            return;
+        }
+
+        out.push_back(static_cast<char>(first_byte_flags | limit));
+        value -= limit;
+        while (value >= 128)
+        {
+            out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    /**
+     * Integer decoding
+     * - Values are capped at 2^32, nothing in HTTP/2 needs more
+     * - At most 5 continuation bytes (shift 28) are read: zero-valued ones (0x80) do not grow
+     *   the value, so without this bound the shift would pass 63 on peer-controlled input
+     */
+    bool hpack::decode_integer(const std::uint8_t *data, std::size_t size, std::size_t &pos, int prefix_bits, std::uint64_t &value)
+    {
+        if (pos >= size)
+            return false;
+
+        std::uint64_t limit = (1u << prefix_bits) - 1;
+        value = data[pos++] & limit;
+        if (value < limit)
+            return true;
+
+        for (int shift = 0; pos < size && shift <= 28; shift += 7)
+        {
+            std::uint8_t byte = data[pos++];
+            value += static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if (value > 0xffffffffull)
+                return false;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    std::size_t hpack::huffman_length(const std::string &value)
+    {
+        std::size_t bits = 0;
+        for (unsigned char c : value)
+            bits += HUFFMAN_CODES[c].bits;
+        return (bits + 7) / 8;
+    }
+
+    void hpack::huffman_encode(std::string &out, const std::string &value)
+    {
+        std::uint64_t pending = 0;
+        int pending_bits = 0;
+        for (unsigned char c : value)
+        {
+            pending = (pending << HUFFMAN_CODES[c].bits) | HUFFMAN_CODES[c].code;
+            pending_bits += HUFFMAN_CODES[c].bits;
+            while (pending_bits >= 8)
+            {
+                pending_bits -= 8;
+                out.push_back(static_cast<char>(pending >> pending_bits));
+            }
+            pending &= (1ull << pending_bits) - 1;
+        }
+
+        if (pending_bits > 0)
+        {
+            int padding = 8 - pending_bits;
+            out.push_back(static_cast<char>((pending << padding) | ((1u << padding) - 1)));
+        }
+    }
+
+    bool hpack::huffman_decode(const std::uint8_t *data, std::size_t size, std::string &out)
+    {
+        const std::vector<huffman_node> &tree = huffman_tree();
+        std::size_t node = 0;
+        int partial_bits = 0;
+        bool partial_ones = true;
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            for (int bit = 7; bit >= 0; --bit)
+            {
+                int branch = (data[i] >> bit) & 1;
+                std::int16_t next = tree[node].child[branch];
+                if (next < 0)
+                    return false;
+                node = next;
+
+                if (tree[node].symbol >= 0)
+                {
+                    if (tree[node].symbol == 256)
+                        return false;
+                    out.push_back(static_cast<char>(tree[node].symbol));
+                    node = 0;
+                    partial_bits = 0;
+                    partial_ones = true;
+                }
+                else
+                {
+                    partial_bits++;
+                    partial_ones = partial_ones && branch == 1;
+                }
+            }
+        }
+        return partial_bits <= 7 && partial_ones;
+    }
+
+    void hpack::encode_string(std::string &out, const std::string &value)
+    {
+        std::size_t encoded = huffman_length(value);
+        if (encoded < value.size())
+        {
+            encode_integer(out, encoded, 7, 0x80);
+            huffman_encode(out, value);
+        }
+        else
+        {
+            encode_integer(out, value.size(), 7, 0x00);
+            out += value;
+        }
+    }
+
+    bool hpack::decode_string(const std::uint8_t *data, std::size_t size, std::size_t &pos, std::string &value)
+    {
+        if (pos >= size)
+            return false;
+
+        bool huffman = data[pos] & 0x80;
+        std::uint64_t length = 0;
+        if (!decode_integer(data, size, pos, 7, length) || length > size - pos)
+            return false;
+
+        value.clear();
+        bool ok = true;
+        if (huffman)
+            ok = huffman_decode(data + pos, length, value);
+        else
+            value.assign(reinterpret_cast<const char *>(data + pos), length);
+        pos += length;
+        return ok;
+    }
+
+    void hpack_table::evict_to(std::size_t limit)
+    {
+        while (size > limit && !entries.empty())
+        {
+            size -= entries.back().first.size() + entries.back().second.size() + hpack::ENTRY_OVERHEAD;
+            entries.pop_back();
+        }
+    }
+
+    void hpack_table::add(const hpack_header &header)
+    {
+        std::size_t entry_size = header.first.size() + header.second.size() + hpack::ENTRY_OVERHEAD;
+        if (entry_size > max_size)
+        {
+            evict_to(0);
+            return;
+        }
+        evict_to(max_size - entry_size);
+        entries.push_front(header);
+        size += entry_size;
+    }
+
+    void hpack_table::set_max_size(std::size_t bytes)
+    {
+        max_size = bytes;
+        evict_to(max_size);
+    }
+
+    const hpack_header *hpack_table::get(std::size_t index) const
+    {
+        if (index == 0)
+            return nullptr;
+        if (index <= hpack::STATIC_TABLE_SIZE)
+            return &hpack::static_entry(index);
+
+        index -= hpack::STATIC_TABLE_SIZE + 1;
+        return index < entries.size() ? &entries[index] : nullptr;
+    }
+
+    std::size_t hpack_table::find(const std::string &name, const std::string &value, std::size_t &name_index) const
+    {
+        std::size_t match = hpack::find_static(name, value, name_index);
+        if (match)
+            return match;
+
+        for (std::size_t i = 0; i < entries.size(); ++i)
+        {
+            if (entries[i].first != name)
+                continue;
+            if (entries[i].second == value)
+                return hpack::STATIC_TABLE_SIZE + 1 + i;
+            if (!name_index)
+                name_index = hpack::STATIC_TABLE_SIZE + 1 + i;
+        }
+        return 0;
+    }
+
+    /**
+     * Header block decoding
+     * - Table size updates are only valid before the first field of a block
+     * - Any malformed representation is a connection level COMPRESSION_ERROR for the caller
+     */
+    bool hpack_decoder::decode(const std::uint8_t *data, std::size_t size, std::vector<hpack_header> &headers, std::size_t max_list_size)
+    {
+        std::size_t pos = 0;
+        std::size_t list_size = 0;
+        bool seen_field = false;
+
+        while (pos < size)
+        {
+            std::uint8_t first = data[pos];
+            std::uint64_t index = 0;
+
+            if (first & 0x80)
+            {
+                if (!hpack::decode_integer(data, size, pos, 7, index))
+                    return false;
+                const hpack_header *entry = table.get(index);
+                if (!entry)
+                    return false;
+                headers.push_back(*entry);
+            }
+            else if ((first & 0xe0) == 0x20)
+            {
+                if (seen_field || !hpack::decode_integer(data, size, pos, 5, index) || index > max_table_size)
+                    return false;
+                table.set_max_size(index);
+                continue;
+            }
+            else
+            {
+                bool incremental = first & 0x40;
+                if (!hpack::decode_integer(data, size, pos, incremental ? 6 : 4, index))
+                    return false;
+
+                hpack_header header;
+                if (index)
+                {
+                    const hpack_header *entry = table.get(index);
+                    if (!entry)
+                        return false;
+                    header.first = entry->first;
+                }
+                else if (!hpack::decode_string(data, size, pos, header.first))
+                {
+                    return false;
+                }
+                if (!hpack::decode_string(data, size, pos, header.second))
+                    return false;
+
+                if (incremental)
+                    table.add(header);
+                headers.push_back(std::move(header));
+            }
+
+            seen_field = true;
+            list_size += headers.back().first.size() + headers.back().second.size() + hpack::ENTRY_OVERHEAD;
+            if (list_size > max_list_size)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * Table size changes
+     * - When the peer lowers and raises the size between two blocks, the smallest size is
+     *   announced first so the decoder evicts what it has to
+     */
+    void hpack_encoder::set_max_table_size(std::size_t bytes)
+    {
+        std::size_t size = std::min(bytes, hpack::DEFAULT_TABLE_SIZE);
+        if (size == table.get_max_size())
+            return;
+        pending_minimum_size = std::min(pending_minimum_size, size);
+        pending_size_update = size;
+        table.set_max_size(size);
+    }
+
+    std::string hpack_encoder::encode(const std::vector<hpack_header> &headers)
+    {
+        std::string out;
+        if (pending_size_update != SIZE_MAX)
+        {
+            if (pending_minimum_size < pending_size_update)
+                hpack::encode_integer(out, pending_minimum_size, 5, 0x20);
+            hpack::encode_integer(out, pending_size_update, 5, 0x20);
+            pending_size_update = SIZE_MAX;
+            pending_minimum_size = SIZE_MAX;
+        }
+
+        for (const auto &header : headers)
+        {
+            std::size_t name_index = 0;
+            std::size_t index = table.find(header.first, header.second, name_index);
+            if (index)
+            {
+                hpack::encode_integer(out, index, 7, 0x80);
+                continue;
+            }
+
+            std::size_t entry_size = header.first.size() + header.second.size() + hpack::ENTRY_OVERHEAD;
+            int prefix_bits = 4;
+            std::uint8_t flags = 0x00;
+            if (sensitive_name(header.first))
+            {
+                flags = 0x10;
+            }
+            else if (!unindexed_name(header.first) && entry_size <= table.get_max_size() / 2)
+            {
+                prefix_bits = 6;
+                flags = 0x40;
+            }
+
+            hpack::encode_integer(out, name_index, prefix_bits, flags);
+            if (!name_index)
+                hpack::encode_string(out, header.first);
+            hpack::encode_string(out, header.second);
+
+            if (flags == 0x40)
+                table.add(header);
+        }
+        return out;
+    }
+}
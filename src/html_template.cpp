@@ -0,0 +1,453 @@
+#include <array>
+#include <fstream>
+#include <sstream>
+
+#include "../includes/html_template.hpp"
+#include "../includes/web_exceptions.hpp"
+
+namespace hh_web
+{
+    namespace detail
+    {
+        enum class template_op_kind
+        {
+            STATIC,
+            ESCAPED,
+            RAW,
+            SECTION,
+            INVERTED
+        };
+
+        struct template_op
+        {
+            template_op_kind kind;
+
+            /// STATIC: offset of the chunk in text, others: slot index
+            std::size_t index;
+
+            /// STATIC: size of the chunk, sections: index of the first op after the section
+            std::size_t size;
+        };
+
+        struct template_program
+        {
+            /// All static chunks back to back
+            std::string text;
+            std::vector<template_op> ops;
+            std::unordered_map<std::string, std::size_t> slots;
+        };
+    }
+
+    namespace
+    {
+        using detail::template_op;
+        using detail::template_op_kind;
+        using detail::template_program;
+
+        web_exception syntax_error(const std::string &message, std::size_t position)
+        {
+            return web_exception("Template syntax error at offset " + std::to_string(position) + ": " + message,
+                                 "TEMPLATE_SYNTAX", "html_template::compile", 500, "Internal Server Error");
+        }
+
+        std::string_view trim_view(std::string_view text)
+        {
+            std::size_t first = text.find_first_not_of(" \t\r\n");
+            if (first == std::string_view::npos)
+                return {};
+            std::size_t last = text.find_last_not_of(" \t\r\n");
+            return text.substr(first, last - first + 1);
+        }
+
+        struct string_sink
+        {
+            std::string &out;
+
+            void append(std::string_view text)
+            {
+                out.append(text.data(), text.size());
+            }
+
+            void append_escaped(std::string_view text)
+            {
+                append_escaped_html(out, text);
+            }
+        };
+
+        struct stream_sink
+        {
+            std::ostream &out;
+            std::string scratch;
+
+            void append(std::string_view text)
+            {
+                out.write(text.data(), static_cast<std::streamsize>(text.size()));
+            }
+
+            void append_escaped(std::string_view text)
+            {
+                scratch.clear();
+                append_escaped_html(scratch, text);
+                append(scratch);
+            }
+        };
+    }
+
+    void append_escaped_html(std::string &out, std::string_view text)
+    {
+        // most values have nothing to escape, the scan only tests one table entry per byte
+        static const auto special = []()
+        {
+            std::array<bool, 256> table{};
+            for (unsigned char c : {'&', '<', '>', '"', '\''})
+                table[c] = true;
+            return table;
+        }();
+
+        std::size_t run = 0;
+        for (std::size_t i = 0; i < text.size(); ++i)
+        {
+            if (!special[static_cast<unsigned char>(text[i])])
+                continue;
+            out.append(text.data() + run, i - run);
+            switch (text[i])
+            {
+            case '&':
+                out += "&amp;";
+                break;
+            case '<':
+                out += "&lt;";
+                break;
+            case '>':
+                out += "&gt;";
+                break;
+            case '"':
+                out += "&quot;";
+                break;
+            default:
+                out += "&#39;";
+            }
+            run = i + 1;
+        }
+        out.append(text.data() + run, text.size() - run);
+    }
+
+    template_context::template_context(std::shared_ptr<const detail::template_program> program)
+        : owned(std::move(program)), program(owned.get()), parent(nullptr)
+    {
+    }
+
+    template_context::template_context(const detail::template_program *program, const template_context *parent)
+        : program(program), parent(parent)
+    {
+    }
+
+    const std::string *template_context::find(std::size_t slot) const
+    {
+        for (const template_context *ctx = this; ctx; ctx = ctx->parent)
+        {
+            for (const auto &value : ctx->values)
+            {
+                if (value.first == slot)
+                    return &value.second;
+            }
+        }
+        return nullptr;
+    }
+
+    void template_context::set(std::string_view name, std::string value)
+    {
+        auto it = program->slots.find(std::string(name));
+        if (it != program->slots.end())
+            set(it->second, std::move(value));
+    }
+
+    void template_context::set(std::size_t slot, std::string value)
+    {
+        if (slot >= program->slots.size())
+            return;
+        for (auto &existing : values)
+        {
+            if (existing.first == slot)
+            {
+                existing.second = std::move(value);
+                return;
+            }
+        }
+        if (values.empty())
+            values.reserve(4);
+        values.emplace_back(slot, std::move(value));
+    }
+
+    template_context &template_context::add(std::string_view section)
+    {
+        auto it = program->slots.find(std::string(section));
+        if (it == program->slots.end())
+            throw web_exception("Unknown template section: " + std::string(section), "TEMPLATE_SLOT", "template_context::add", 500, "Internal Server Error");
+        return add(it->second);
+    }
+
+    template_context &template_context::add(std::size_t section)
+    {
+        if (section >= program->slots.size())
+            throw web_exception("Unknown template section", "TEMPLATE_SLOT", "template_context::add", 500, "Internal Server Error");
+        if (items.size() <= section)
+            items.resize(section + 1);
+        if (!items[section])
+            items[section] = std::make_unique<std::deque<template_context>>();
+        items[section]->push_back(template_context(program, this));
+        return items[section]->back();
+    }
+
+    void template_context::show(std::string_view section, bool visible)
+    {
+        auto it = program->slots.find(std::string(section));
+        if (it != program->slots.end())
+            show(it->second, visible);
+    }
+
+    void template_context::show(std::size_t section, bool visible)
+    {
+        if (section >= program->slots.size())
+            return;
+        if (shown.size() <= section)
+            shown.resize(section + 1, false);
+        shown[section] = visible;
+    }
+
+    html_template::html_template(std::shared_ptr<const detail::template_program> compiled) : compiled(std::move(compiled))
+    {
+    }
+
+    /**
+     * One pass over the source
+     * - Text between tags is appended to the program's text, consecutive text (and constants)
+     *   becomes one STATIC op unless a section starts or ends in between
+     * - A section op records where its body ends once its closing tag is found
+     */
+    html_template html_template::compile(std::string_view source, const std::unordered_map<std::string, std::string> &constants)
+    {
+        auto program = std::make_shared<template_program>();
+        bool can_merge = false;
+        std::vector<std::pair<std::string, std::size_t>> open_sections;
+
+        auto slot_of = [&program](std::string_view name)
+        {
+            return program->slots.emplace(std::string(name), program->slots.size()).first->second;
+        };
+        auto add_static = [&program, &can_merge](std::string_view text)
+        {
+            if (text.empty())
+                return;
+            if (can_merge)
+            {
+                program->ops.back().size += text.size();
+            }
+            else
+            {
+                program->ops.push_back({template_op_kind::STATIC, program->text.size(), text.size()});
+                can_merge = true;
+            }
+            program->text.append(text.data(), text.size());
+        };
+
+        std::size_t position = 0;
+        while (position < source.size())
+        {
+            std::size_t open = source.find("{{", position);
+            if (open == std::string_view::npos)
+            {
+                add_static(source.substr(position));
+                break;
+            }
+            add_static(source.substr(position, open - position));
+
+            bool triple = open + 2 < source.size() && source[open + 2] == '{';
+            std::size_t content_start = open + (triple ? 3 : 2);
+            std::size_t close = source.find(triple ? "}}}" : "}}", content_start);
+            if (close == std::string_view::npos)
+                throw syntax_error("unclosed tag", open);
+            position = close + (triple ? 3 : 2);
+
+            std::string_view tag = trim_view(source.substr(content_start, close - content_start));
+            char sigil = triple || tag.empty() ? '\0' : tag[0];
+            std::string_view name = sigil == '#' || sigil == '^' || sigil == '/' || sigil == '!' || sigil == '&'
+                                        ? trim_view(tag.substr(1))
+                                        : tag;
+            if (sigil == '!')
+                continue;
+            if (name.empty())
+                throw syntax_error("empty tag", open);
+
+            if (sigil == '#' || sigil == '^')
+            {
+                std::size_t slot = slot_of(name);
+                open_sections.emplace_back(std::string(name), program->ops.size());
+                program->ops.push_back({sigil == '#' ? template_op_kind::SECTION : template_op_kind::INVERTED, slot, 0});
+                can_merge = false;
+            }
+            else if (sigil == '/')
+            {
+                if (open_sections.empty() || open_sections.back().first != name)
+                    throw syntax_error("unexpected {{/" + std::string(name) + "}}", open);
+                program->ops[open_sections.back().second].size = program->ops.size();
+                open_sections.pop_back();
+                can_merge = false;
+            }
+            else
+            {
+                bool raw = triple || sigil == '&';
+                auto constant = constants.find(std::string(name));
+                if (constant != constants.end())
+                {
+                    if (raw)
+                    {
+                        add_static(constant->second);
+                    }
+                    else
+                    {
+                        std::string escaped;
+                        append_escaped_html(escaped, constant->second);
+                        add_static(escaped);
+                    }
+                    continue;
+                }
+                program->ops.push_back({raw ? template_op_kind::RAW : template_op_kind::ESCAPED, slot_of(name), 0});
+                can_merge = false;
+            }
+        }
+
+        if (!open_sections.empty())
+            throw syntax_error("section " + open_sections.back().first + " is not closed", source.size());
+
+        program->text.shrink_to_fit();
+        return html_template(std::move(program));
+    }
+
+    html_template html_template::from_file(const std::string &path, const std::unordered_map<std::string, std::string> &constants)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            throw web_exception("Cannot read template " + path, "TEMPLATE_NOT_FOUND", "html_template::from_file", 500, "Internal Server Error");
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return compile(buffer.str(), constants);
+    }
+
+    template_context html_template::context() const
+    {
+        return template_context(compiled);
+    }
+
+    std::size_t html_template::slot(std::string_view name) const
+    {
+        auto it = compiled->slots.find(std::string(name));
+        return it == compiled->slots.end() ? npos : it->second;
+    }
+
+    std::size_t html_template::static_size() const noexcept
+    {
+        return compiled->text.size();
+    }
+
+    struct detail::template_renderer
+    {
+        /// The nearest context, starting at ctx, that added items to or showed the section
+        static const template_context *section_owner(const template_context *ctx, std::size_t slot, const std::deque<template_context> *&items)
+        {
+            for (; ctx; ctx = ctx->parent)
+            {
+                if (slot < ctx->items.size() && ctx->items[slot] && !ctx->items[slot]->empty())
+                {
+                    items = ctx->items[slot].get();
+                    return ctx;
+                }
+                if (slot < ctx->shown.size() && ctx->shown[slot])
+                {
+                    items = nullptr;
+                    return ctx;
+                }
+            }
+            return nullptr;
+        }
+
+        /// Render ops [begin, end) with ctx; a section renders its body per item, or once with ctx when shown
+        template <typename Sink>
+        static void render_ops(const template_program &program, std::size_t begin, std::size_t end, const template_context &ctx, Sink &sink)
+        {
+            std::size_t i = begin;
+            while (i < end)
+            {
+                const template_op &op = program.ops[i];
+                switch (op.kind)
+                {
+                case template_op_kind::STATIC:
+                    sink.append(std::string_view(program.text.data() + op.index, op.size));
+                    ++i;
+                    break;
+                case template_op_kind::ESCAPED:
+                case template_op_kind::RAW:
+                    if (const std::string *value = ctx.find(op.index))
+                    {
+                        if (op.kind == template_op_kind::RAW)
+                            sink.append(*value);
+                        else
+                            sink.append_escaped(*value);
+                    }
+                    ++i;
+                    break;
+                case template_op_kind::SECTION:
+                case template_op_kind::INVERTED:
+                {
+                    const std::deque<template_context> *items = nullptr;
+                    const template_context *owner = section_owner(&ctx, op.index, items);
+                    if (op.kind == template_op_kind::INVERTED)
+                    {
+                        if (!owner)
+                            render_ops(program, i + 1, op.size, ctx, sink);
+                    }
+                    else if (items)
+                    {
+                        for (const template_context &item : *items)
+                            render_ops(program, i + 1, op.size, item, sink);
+                    }
+                    else if (owner)
+                    {
+                        render_ops(program, i + 1, op.size, ctx, sink);
+                    }
+                    i = op.size;
+                    break;
+                }
+                }
+            }
+        }
+
+        template <typename Sink>
+        static void render(const std::shared_ptr<const template_program> &program, const template_context &ctx, Sink &sink)
+        {
+            if (ctx.program != program.get())
+                throw web_exception("Template context belongs to another template", "TEMPLATE_CONTEXT", "html_template::render", 500, "Internal Server Error");
+            render_ops(*program, 0, program->ops.size(), ctx, sink);
+        }
+    };
+
+    void html_template::render(const template_context &ctx, std::string &out) const
+    {
+        out.reserve(out.size() + compiled->text.size() + 256);
+        string_sink sink{out};
+        detail::template_renderer::render(compiled, ctx, sink);
+    }
+
+    std::string html_template::render(const template_context &ctx) const
+    {
+        std::string out;
+        render(ctx, out);
+        return out;
+    }
+
+    void html_template::render(const template_context &ctx, std::ostream &out) const
+    {
+        stream_sink sink{out, {}};
+        detail::template_renderer::render(compiled, ctx, sink);
+    }
+}
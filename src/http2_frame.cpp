@@ -0,0 +1,89 @@
+#include <algorithm>
+
+#include "../includes/http2_frame.hpp"
+
+namespace hh_web
+{
+    http2_frame http2_frame::parse(const std::uint8_t *data)
+    {
+        http2_frame frame;
+        frame.length = (static_cast<std::uint32_t>(data[0]) << 16) | (static_cast<std::uint32_t>(data[1]) << 8) | data[2];
+        frame.type = data[3];
+        frame.flags = data[4];
+        frame.stream_id = read_u32(data + 5) & 0x7fffffff;
+        return frame;
+    }
+
+    void http2_frame::write_header(std::string &out, std::uint32_t length, http2_frame_type type, std::uint8_t flags, std::uint32_t stream_id)
+    {
+        out.push_back(static_cast<char>(length >> 16));
+        out.push_back(static_cast<char>(length >> 8));
+        out.push_back(static_cast<char>(length));
+        out.push_back(static_cast<char>(type));
+        out.push_back(static_cast<char>(flags));
+        write_u32(out, stream_id & 0x7fffffff);
+    }
+
+    void http2_frame::write_settings(std::string &out, const std::vector<std::pair<http2_setting, std::uint32_t>> &settings, bool ack)
+    {
+        write_header(out, ack ? 0 : static_cast<std::uint32_t>(settings.size() * 6), http2_frame_type::SETTINGS, ack ? http2_flags::ACK : 0, 0);
+        if (ack)
+            return;
+        for (const auto &setting : settings)
+        {
+            auto id = static_cast<std::uint16_t>(setting.first);
+            out.push_back(static_cast<char>(id >> 8));
+            out.push_back(static_cast<char>(id));
+            write_u32(out, setting.second);
+        }
+    }
+
+    void http2_frame::write_window_update(std::string &out, std::uint32_t stream_id, std::uint32_t increment)
+    {
+        write_header(out, 4, http2_frame_type::WINDOW_UPDATE, 0, stream_id);
+        write_u32(out, increment & 0x7fffffff);
+    }
+
+    void http2_frame::write_rst_stream(std::string &out, std::uint32_t stream_id, http2_error error)
+    {
+        write_header(out, 4, http2_frame_type::RST_STREAM, 0, stream_id);
+        write_u32(out, static_cast<std::uint32_t>(error));
+    }
+
+    void http2_frame::write_goaway(std::string &out, std::uint32_t last_stream_id, http2_error error, const std::string &debug)
+    {
+        write_header(out, static_cast<std::uint32_t>(8 + debug.size()), http2_frame_type::GOAWAY, 0, 0);
+        write_u32(out, last_stream_id & 0x7fffffff);
+        write_u32(out, static_cast<std::uint32_t>(error));
+        out += debug;
+    }
+
+    void http2_frame::write_ping(std::string &out, const std::uint8_t *opaque, bool ack)
+    {
+        write_header(out, 8, http2_frame_type::PING, ack ? http2_flags::ACK : 0, 0);
+        out.append(reinterpret_cast<const char *>(opaque), 8);
+    }
+
+    void http2_frame::write_data(std::string &out, std::uint32_t stream_id, const char *data, std::size_t size, bool end_stream)
+    {
+        write_header(out, static_cast<std::uint32_t>(size), http2_frame_type::DATA, end_stream ? http2_flags::END_STREAM : 0, stream_id);
+        out.append(data, size);
+    }
+
+    void http2_frame::write_headers(std::string &out, std::uint32_t stream_id, const std::string &block, bool end_stream, std::size_t max_frame_size)
+    {
+        std::size_t first = std::min(block.size(), max_frame_size);
+        std::uint8_t flags = (end_stream ? http2_flags::END_STREAM : 0) | (first == block.size() ? http2_flags::END_HEADERS : 0);
+        write_header(out, static_cast<std::uint32_t>(first), http2_frame_type::HEADERS, flags, stream_id);
+        out.append(block, 0, first);
+
+        for (std::size_t offset = first; offset < block.size();)
+        {
+            std::size_t chunk = std::min(block.size() - offset, max_frame_size);
+            bool last = offset + chunk == block.size();
+            write_header(out, static_cast<std::uint32_t>(chunk), http2_frame_type::CONTINUATION, last ? http2_flags::END_HEADERS : 0, stream_id);
+            out.append(block, offset, chunk);
+            offset += chunk;
+        }
+    }
+}
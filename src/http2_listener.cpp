@@ -0,0 +1,1355 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../includes/logger.hpp"
+#include "../includes/http2_listener.hpp"
+#include "../includes/web_utilities.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        constexpr int MAX_EVENTS = 256;
+        constexpr std::size_t READ_BUFFER_SIZE = 65536;
+
+        /// io_uring loop: ring size, and the provided buffers recv picks from
+        constexpr unsigned RING_ENTRIES = 512;
+        constexpr std::uint16_t RECV_GROUP = 0;
+        constexpr unsigned RECV_BUFFERS = 256;
+        constexpr unsigned RECV_BUFFER_SIZE = 16384;
+
+        /// Operation in the low bits of a completion's user_data, the connection id above them
+        enum : std::uint64_t
+        {
+            OP_ACCEPT = 1,
+            OP_RECV = 2,
+            OP_SEND = 3,
+            OP_WAKE = 4,
+            OP_TICK = 5,
+            OP_CANCEL = 6
+        };
+        constexpr unsigned OP_BITS = 3;
+
+        std::uint64_t tag(std::uint64_t op, std::uint64_t connection = 0)
+        {
+            return (connection << OP_BITS) | op;
+        }
+
+        /// Resolution of the connection timers, both loops wake up at least this often to advance them
+        constexpr std::chrono::milliseconds TIMER_RESOLUTION{250};
+
+        /// Timeout of the io_uring loop's tick
+        const __kernel_timespec TICK_INTERVAL{0, TIMER_RESOLUTION.count() * 1000000};
+
+        /// Time a connection closed on a timeout gets to take its GOAWAY
+        constexpr std::chrono::seconds CLOSE_GRACE{1};
+
+        const char *reason_phrase(int status)
+        {
+            switch (status)
+            {
+            case 200:
+                return "OK";
+            case 201:
+                return "Created";
+            case 204:
+                return "No Content";
+            case 301:
+                return "Moved Permanently";
+            case 302:
+                return "Found";
+            case 304:
+                return "Not Modified";
+            case 400:
+                return "Bad Request";
+            case 401:
+                return "Unauthorized";
+            case 403:
+                return "Forbidden";
+            case 404:
+                return "Not Found";
+            case 413:
+                return "Payload Too Large";
+            case 500:
+                return "Internal Server Error";
+            case 502:
+                return "Bad Gateway";
+            case 503:
+                return "Service Unavailable";
+            case 504:
+                return "Gateway Timeout";
+            default:
+                return "";
+            }
+        }
+
+        /// Answers to malformed requests, which scanners send plenty of
+        const canned_response &bad_request()
+        {
+            static const canned_response response(400, "Bad Request", "400 Bad Request");
+            return response;
+        }
+
+        const canned_response &bad_upgrade()
+        {
+            static const canned_response response(400, "Bad Request", "400 Bad Request: invalid HTTP2-Settings");
+            return response;
+        }
+    }
+
+    http2_listener::http2_listener(int port, const std::string &host, const http2_settings &settings)
+        : port(port), host(host), settings(settings), timers(TIMER_RESOLUTION)
+    {
+    }
+
+    http2_listener::~http2_listener()
+    {
+        stop();
+        if (event_fd >= 0)
+            close(event_fd);
+    }
+
+    bool http2_listener::start()
+    {
+        if (running.load())
+            return true;
+
+        if (!(unix_path.empty() ? listen_tcp() : listen_unix()))
+        {
+            if (listen_fd >= 0)
+                close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+
+        if (event_fd < 0)
+            event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (event_fd >= 0 && io_uring_requested && start_io_uring())
+        {
+            running.store(true);
+            loop = std::thread([this]()
+                               { run_io_uring(); });
+            return true;
+        }
+
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (event_fd < 0 || epoll_fd < 0)
+        {
+            logger::error("HTTP/2 listener: cannot create the event loop: " + std::string(std::strerror(errno)));
+            close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = listen_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+        event.data.fd = event_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event);
+
+        running.store(true);
+        loop = std::thread([this]()
+                           { run(); });
+        return true;
+    }
+
+    bool http2_listener::listen_tcp()
+    {
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0)
+        {
+            logger::error("HTTP/2 listener: socket() failed: " + std::string(std::strerror(errno)));
+            return false;
+        }
+
+        // prefork workers each bind the same port
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<std::uint16_t>(port));
+        if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1)
+        {
+            logger::error("HTTP/2 listener: invalid host " + host);
+            return false;
+        }
+        if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(listen_fd, SOMAXCONN) < 0)
+        {
+            logger::error("HTTP/2 listener: cannot listen on " + host + ":" + std::to_string(port) + ": " + std::strerror(errno));
+            return false;
+        }
+
+        socklen_t length = sizeof(address);
+        if (getsockname(listen_fd, reinterpret_cast<sockaddr *>(&address), &length) == 0)
+            port = ntohs(address.sin_port);
+        return true;
+    }
+
+    /**
+     * Unix domain socket
+     * - A socket file left behind by a previous run is removed. A socket someone still accepts
+     *   on, or any other file at the path, is an error rather than something to delete
+     * - The mode is set before listen(), so nobody connects while it is still too wide
+     */
+    bool http2_listener::listen_unix()
+    {
+        sockaddr_un address{};
+        if (unix_path.size() >= sizeof(address.sun_path))
+        {
+            logger::error("HTTP/2 listener: Unix socket path too long: " + unix_path);
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, unix_path.c_str(), unix_path.size() + 1);
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0)
+        {
+            logger::error("HTTP/2 listener: socket() failed: " + std::string(std::strerror(errno)));
+            return false;
+        }
+
+        struct stat existing;
+        if (lstat(unix_path.c_str(), &existing) == 0)
+        {
+            if (!S_ISSOCK(existing.st_mode))
+            {
+                logger::error("HTTP/2 listener: " + unix_path + " exists and is not a socket");
+                return false;
+            }
+            int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            bool live = probe >= 0 && connect(probe, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+            if (probe >= 0)
+                close(probe);
+            if (live)
+            {
+                logger::error("HTTP/2 listener: " + unix_path + " is in use by another process");
+                return false;
+            }
+            unlink(unix_path.c_str());
+        }
+
+        if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+            chmod(unix_path.c_str(), static_cast<mode_t>(unix_permissions)) < 0 || ::listen(listen_fd, SOMAXCONN) < 0)
+        {
+            logger::error("HTTP/2 listener: cannot listen on " + unix_path + ": " + std::strerror(errno));
+            unlink(unix_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void http2_listener::stop()
+    {
+        if (!running.exchange(false))
+            return;
+
+        std::uint64_t one = 1;
+        if (write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            logger::error("HTTP/2 listener: failed to wake the loop: " + std::string(std::strerror(errno)));
+        if (loop.joinable())
+            loop.join();
+
+        std::vector<std::uint64_t> ids;
+        for (const auto &entry : connections)
+            ids.push_back(entry.first);
+        for (std::uint64_t id : ids)
+            close_connection(id);
+
+        // tearing the ring down ends its operations, only then are their buffers free
+        ring.reset();
+        retired_sends.clear();
+
+        close(listen_fd);
+        if (epoll_fd >= 0)
+            close(epoll_fd);
+        listen_fd = -1;
+        epoll_fd = -1;
+        if (!unix_path.empty())
+            unlink(unix_path.c_str());
+    }
+
+    void http2_listener::post(const http2_stream_ref &ref, http2_response &&response)
+    {
+        push_completion(completion{ref, std::move(response)});
+    }
+
+    void http2_listener::post_reset(const http2_stream_ref &ref)
+    {
+        push_completion(completion{ref, std::nullopt});
+    }
+
+    /**
+     * Producer side, same protocol as completion_queue::push
+     * - The item is linked before the flag is checked, a loop that cleared the flag before
+     *   draining always sees it
+     */
+    void http2_listener::push_completion(completion &&item)
+    {
+        completions.push(std::move(item));
+        if (!signalled.exchange(true))
+        {
+            std::uint64_t one = 1;
+            if (write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+                logger::error("HTTP/2 listener: failed to wake the loop: " + std::string(std::strerror(errno)));
+        }
+    }
+
+    void http2_listener::run()
+    {
+        epoll_event events[MAX_EVENTS];
+
+        while (running.load())
+        {
+            int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, static_cast<int>(TIMER_RESOLUTION.count()));
+            if (ready < 0 && errno != EINTR)
+            {
+                logger::error("HTTP/2 listener: epoll_wait failed: " + std::string(std::strerror(errno)));
+                break;
+            }
+
+            for (int i = 0; i < ready; ++i)
+            {
+                int fd = events[i].data.fd;
+                if (fd == listen_fd)
+                {
+                    accept_connections();
+                    continue;
+                }
+                if (fd == event_fd)
+                {
+                    std::uint64_t count = 0;
+                    if (read(event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                        logger::error("HTTP/2 listener: eventfd read failed: " + std::string(std::strerror(errno)));
+                    continue;
+                }
+
+                auto found = connection_of_fd.find(fd);
+                if (found == connection_of_fd.end())
+                    continue;
+                auto it = connections.find(found->second);
+                if (it == connections.end())
+                    continue;
+
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                {
+                    close_connection(it->first);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT)
+                {
+                    handle_writable(it->second);
+                    it = connections.find(found->second);
+                    if (it == connections.end())
+                        continue;
+                }
+                if (events[i].events & EPOLLIN)
+                    handle_readable(it->second);
+            }
+
+            // every wakeup drains, the flag is cleared first so a concurrent post signals again
+            signalled.store(false);
+            drain_completions();
+            timers.advance();
+        }
+    }
+
+    void http2_listener::accept_connections()
+    {
+        while (true)
+        {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    logger::error("HTTP/2 listener: accept failed: " + std::string(std::strerror(errno)));
+                return;
+            }
+
+            add_connection(fd);
+        }
+    }
+
+    void http2_listener::add_connection(int fd)
+    {
+        std::optional<peer_credentials> peer;
+        if (unix_path.empty())
+        {
+            // small frames (SETTINGS acks, WINDOW_UPDATEs, short responses) must not wait for Nagle
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        else
+        {
+            ucred credentials{};
+            socklen_t length = sizeof(credentials);
+            if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0)
+                peer = peer_credentials{credentials.pid, credentials.uid, credentials.gid};
+        }
+
+        std::uint64_t id = next_connection_id++;
+        connection &conn = connections[id];
+        conn.fd = fd;
+        conn.id = id;
+        conn.peer = peer;
+        conn.last_activity = std::chrono::steady_clock::now();
+        // the first request's header timeout runs from the accept
+        conn.request_started = conn.last_activity;
+        connection_of_fd[fd] = id;
+        connections_accepted++;
+        arm_timer(conn);
+
+        if (ring)
+        {
+            arm_recv(conn);
+            return;
+        }
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    void http2_listener::handle_readable(connection &conn)
+    {
+        char buffer[READ_BUFFER_SIZE];
+        std::uint64_t id = conn.id;
+        conn.last_activity = std::chrono::steady_clock::now();
+
+        while (true)
+        {
+            ssize_t received = read(conn.fd, buffer, sizeof(buffer));
+            if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            {
+                close_connection(id);
+                return;
+            }
+            if (received < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+
+            if (!receive(conn, buffer, static_cast<std::size_t>(received)))
+            {
+                if (connections.count(id) == 0)
+                    return;
+                break;
+            }
+            // the rest waits in the socket until the client takes some of the output
+            if (static_cast<std::size_t>(received) < sizeof(buffer) || queued_output(conn) > max_queued_output)
+                break;
+        }
+
+        arm_timer(conn);
+        flush(conn);
+    }
+
+    bool http2_listener::receive(connection &conn, const char *data, std::size_t size)
+    {
+        bool keep = true;
+        switch (conn.mode)
+        {
+        case protocol::HTTP2:
+            keep = conn.session->receive(data, size);
+            break;
+        case protocol::DETECT:
+            conn.input.append(data, size);
+            keep = detect(conn);
+            break;
+        case protocol::HTTP1:
+            // requests behind the one in flight wait in input, up to one full request
+            conn.input.append(data, size);
+            if (conn.input.size() > settings.max_header_list_size + settings.max_body_size)
+            {
+                close_connection(conn.id);
+                return false;
+            }
+            next_http1(conn);
+            break;
+        }
+
+        if (!keep)
+        {
+            // flush what was queued (e.g. GOAWAY) and close
+            conn.close_after_write = true;
+            return false;
+        }
+        return true;
+    }
+
+    void http2_listener::handle_writable(connection &conn)
+    {
+        flush(conn);
+    }
+
+    /**
+     * Protocol detection
+     * - Bytes matching a prefix of the preface wait for the rest, so a preface split over
+     *   several reads still selects HTTP/2
+     * - Anything else is HTTP/1.1: an h2c upgrade or a single request
+     */
+    bool http2_listener::detect(connection &conn)
+    {
+        std::size_t compare = std::min(conn.input.size(), http2_frame::PREFACE_SIZE);
+        if (std::memcmp(conn.input.data(), http2_frame::PREFACE, compare) == 0)
+        {
+            // the header timeout started at the accept
+            if (compare < http2_frame::PREFACE_SIZE)
+                return true;
+
+            std::string received = std::move(conn.input);
+            conn.input.clear();
+            conn.mode = protocol::HTTP2;
+            create_session(conn);
+            conn.session->start();
+            return conn.session->receive(received.data(), received.size());
+        }
+
+        http2_request request;
+        std::size_t consumed = 0;
+        bool keep_alive = true;
+        int parsed = parse_http1(conn, request, consumed, keep_alive);
+        if (parsed == 0)
+        {
+            await_request(conn);
+            return true;
+        }
+        if (parsed < 0)
+        {
+            conn.mode = protocol::HTTP1;
+            conn.close_after_response = true;
+            conn.head_request = false;
+            respond_canned(conn, bad_request(), {});
+            return true;
+        }
+
+        std::string settings_header;
+        bool upgrade = false;
+        for (const auto &header : request.headers)
+        {
+            if (header.first == "upgrade" && has_token(header.second, "h2c"))
+                upgrade = true;
+            else if (header.first == "http2-settings")
+                settings_header = header.second;
+        }
+
+        std::string rest = conn.input.substr(consumed);
+        conn.input.clear();
+
+        if (upgrade && !settings_header.empty())
+        {
+            // the upgraded request continues as stream 1 without the hop-by-hop headers
+            request.headers.erase(std::remove_if(request.headers.begin(), request.headers.end(), [](const hpack_header &header)
+                                                 { return header.first == "connection" || header.first == "upgrade" || header.first == "http2-settings"; }),
+                                  request.headers.end());
+
+            conn.mode = protocol::HTTP2;
+            create_session(conn);
+            if (!conn.session->start_upgraded(settings_header, std::move(request)))
+            {
+                conn.mode = protocol::HTTP1;
+                conn.close_after_response = true;
+                conn.session.reset();
+                respond_canned(conn, bad_upgrade(), {});
+                return true;
+            }
+
+            // flush() writes the 101 ahead of the session's preface and the response of stream 1
+            conn.output = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+            conn.output_offset = 0;
+            return rest.empty() || conn.session->receive(rest.data(), rest.size());
+        }
+
+        conn.mode = protocol::HTTP1;
+        conn.input = std::move(rest);
+        conn.head_request = request.method == "HEAD";
+        conn.close_after_response = !keep_alive;
+        dispatch(conn, 0, std::move(request));
+        return true;
+    }
+
+    /**
+     * HTTP/1.1 keep-alive
+     * - One request is in flight at a time; pipelined requests wait in input and are
+     *   dispatched as soon as the previous response is queued, so answers keep their order
+     * - After a request asking to close, the rest of the input is ignored
+     */
+    void http2_listener::next_http1(connection &conn)
+    {
+        if (conn.close_after_response || !conn.pending.empty() || conn.input.empty())
+            return;
+
+        http2_request request;
+        std::size_t consumed = 0;
+        bool keep_alive = true;
+        int parsed = parse_http1(conn, request, consumed, keep_alive);
+        if (parsed == 0)
+        {
+            await_request(conn);
+            return;
+        }
+        if (parsed < 0)
+        {
+            conn.close_after_response = true;
+            conn.head_request = false;
+            respond_canned(conn, bad_request(), {});
+            return;
+        }
+
+        conn.input.erase(0, consumed);
+        conn.head_request = request.method == "HEAD";
+        conn.close_after_response = !keep_alive;
+        dispatch(conn, 0, std::move(request));
+    }
+
+    /**
+     * Session of a connection
+     * - Requests of the session are dispatched, streams the client resets get their token cancelled
+     * - A reset stream stays pending until its completion comes back: the session keeps it
+     *   counted against max_concurrent_streams until then, and the completion frees it
+     */
+    void http2_listener::create_session(connection &conn)
+    {
+        // from now on the session tells which requests are incomplete
+        conn.request_started = conn.body_started = std::chrono::steady_clock::time_point();
+        std::uint64_t id = conn.id;
+        conn.session = std::make_unique<http2_session>([this, id](http2_request &&request)
+                                                       {
+                                                           auto it = connections.find(id);
+                                                           if (it != connections.end())
+                                                               dispatch(it->second, request.stream_id, std::move(request)); },
+                                                       settings);
+        conn.session->set_reset_callback([this, id](std::uint32_t stream_id)
+                                         {
+                                             auto it = connections.find(id);
+                                             if (it == connections.end())
+                                                 return;
+                                             auto pending = it->second.pending.find(stream_id);
+                                             if (pending == it->second.pending.end())
+                                                 return;
+                                             if (auto token = pending->second.lock())
+                                                 token->cancel(); });
+    }
+
+    int http2_listener::parse_http1(connection &conn, http2_request &request, std::size_t &consumed, bool &keep_alive) const
+    {
+        std::size_t end = conn.input.find("\r\n\r\n");
+        if (end == std::string::npos)
+            return conn.input.size() > settings.max_header_list_size ? -1 : 0;
+
+        std::size_t line_end = conn.input.find("\r\n");
+        std::string request_line = conn.input.substr(0, line_end);
+        std::size_t first_space = request_line.find(' ');
+        std::size_t second_space = request_line.find(' ', first_space + 1);
+        if (first_space == std::string::npos || second_space == std::string::npos)
+            return -1;
+
+        request.method = request_line.substr(0, first_space);
+        request.path = request_line.substr(first_space + 1, second_space - first_space - 1);
+        request.scheme = "http";
+        bool http10 = request_line.compare(second_space + 1, std::string::npos, "HTTP/1.0") == 0;
+        if (!http10 && request_line.compare(second_space + 1, std::string::npos, "HTTP/1.1") != 0)
+            return -1;
+        keep_alive = !http10;
+
+        std::size_t content_length = 0;
+        std::size_t position = line_end + 2;
+        while (position < end)
+        {
+            std::size_t next = conn.input.find("\r\n", position);
+            std::string line = conn.input.substr(position, next - position);
+            position = next + 2;
+
+            std::size_t colon = line.find(':');
+            if (colon == std::string::npos || colon == 0)
+                return -1;
+            std::string name = lowercase(line.substr(0, colon));
+            std::string value = trim(line.substr(colon + 1));
+
+            if (name == "host")
+                request.authority = value;
+            else if (name == "connection")
+            {
+                if (has_token(value, "close"))
+                    keep_alive = false;
+                else if (has_token(value, "keep-alive"))
+                    keep_alive = true;
+            }
+            else if (name == "transfer-encoding")
+                return -1;
+            else if (name == "content-length")
+            {
+                try
+                {
+                    content_length = std::stoul(value);
+                }
+                catch (const std::exception &)
+                {
+                    return -1;
+                }
+            }
+            request.headers.emplace_back(std::move(name), std::move(value));
+        }
+
+        if (content_length > settings.max_body_size)
+            return -1;
+        std::size_t body_start = end + 4;
+        if (conn.input.size() - body_start < content_length)
+            return 0;
+
+        request.body = conn.input.substr(body_start, content_length);
+        consumed = body_start + content_length;
+        return 1;
+    }
+
+    void http2_listener::dispatch(connection &conn, std::uint32_t stream_id, http2_request &&request)
+    {
+        requests_received++;
+        request.peer = conn.peer;
+        if (stream_id == 0)
+            conn.request_started = conn.body_started = std::chrono::steady_clock::time_point();
+
+        // answers are matched against pending, so even a refused request is tracked
+        std::shared_ptr<cancellation_token> token;
+        if (on_request)
+            token = on_request({conn.id, stream_id}, std::move(request));
+        else
+            post_reset({conn.id, stream_id});
+        conn.pending[stream_id] = token;
+    }
+
+    void http2_listener::drain_completions()
+    {
+        completion item;
+        std::vector<std::uint64_t> touched;
+        while (completions.pop(item))
+        {
+            auto it = connections.find(item.ref.connection);
+            if (it == connections.end())
+                continue;
+            connection &conn = it->second;
+
+            // answered streams are not tracked anymore, streams reset by the client only once their completion is back
+            if (conn.pending.erase(item.ref.stream_id) == 0)
+                continue;
+
+            if (conn.mode == protocol::HTTP1)
+            {
+                if (item.response)
+                {
+                    respond_http1(conn, *item.response);
+                    next_http1(conn);
+                }
+                else
+                {
+                    conn.close_after_write = true;
+                }
+            }
+            else if (conn.session)
+            {
+                if (item.response)
+                    conn.session->respond(item.ref.stream_id, *item.response);
+                else
+                    conn.session->reset(item.ref.stream_id, http2_error::INTERNAL_ERROR);
+            }
+            touched.push_back(item.ref.connection);
+        }
+
+        // one write per connection for the whole batch
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (std::uint64_t id : touched)
+        {
+            auto it = connections.find(id);
+            if (it != connections.end())
+                flush(it->second);
+        }
+    }
+
+    void http2_listener::respond_http1(connection &conn, const http2_response &response)
+    {
+        std::string &out = conn.output;
+        if (response.canned)
+        {
+            respond_canned(conn, *response.canned, response.headers);
+            return;
+        }
+        out += "HTTP/1.1 " + std::to_string(response.status) + " " + reason_phrase(response.status) + "\r\n";
+
+        bool has_length = false;
+        for (const auto &header : response.headers)
+        {
+            std::string name = lowercase(header.first);
+            if (name == "connection" || name == "transfer-encoding" || name == "keep-alive")
+                continue;
+            if (name == "content-length")
+                has_length = true;
+            out += header.first + ": " + header.second + "\r\n";
+        }
+        if (!has_length)
+            out += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+        // spelled out either way, HTTP/1.0 clients only keep the connection when told so
+        out += conn.close_after_response ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+        if (!conn.head_request)
+            out += response.body;
+        if (conn.close_after_response)
+            conn.close_after_write = true;
+    }
+
+    /// The canned bytes as they are, with only the extra headers and Connection spliced in
+    void http2_listener::respond_canned(connection &conn, const canned_response &canned, const std::vector<hpack_header> &headers)
+    {
+        if (headers.empty())
+        {
+            canned.append_http1(conn.output, !conn.close_after_response, conn.head_request);
+        }
+        else
+        {
+            std::string &out = conn.output;
+            out += canned.get_head();
+            for (const auto &header : headers)
+            {
+                std::string name = lowercase(header.first);
+                if (name == "connection" || name == "transfer-encoding" || name == "keep-alive" ||
+                    name == "content-length" || name == "content-type")
+                    continue;
+                out += header.first + ": " + header.second + "\r\n";
+            }
+            out += conn.close_after_response ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+            if (!conn.head_request)
+                out += canned.get_body();
+        }
+        if (conn.close_after_response)
+            conn.close_after_write = true;
+    }
+
+    /**
+     * Write out
+     * - HTTP/1.1 bytes (a response or the 101 of an upgrade) go before the session's frames
+     * - Whatever the socket does not take is written when it becomes writable again
+     */
+    void http2_listener::flush(connection &conn)
+    {
+        std::uint64_t id = conn.id;
+        if (ring)
+        {
+            // one send at a time, what queues up meanwhile goes out with the next one
+            if (conn.send_in_flight)
+            {
+                throttle(conn);
+                return;
+            }
+            if (conn.output_offset < conn.output.size())
+            {
+                conn.sending.assign(conn.output, conn.output_offset, std::string::npos);
+                conn.output.clear();
+                conn.output_offset = 0;
+            }
+            if (conn.session && conn.session->get_output_size() > 0)
+            {
+                conn.sending.append(conn.session->get_output(), conn.session->get_output_size());
+                conn.session->consume_output(conn.session->get_output_size());
+            }
+            throttle(conn);
+            if (!conn.sending.empty())
+            {
+                submit_send(conn);
+                return;
+            }
+            if (conn.close_after_write || (conn.session && conn.session->is_done()))
+                close_connection(id);
+            return;
+        }
+
+        while (true)
+        {
+            const char *data;
+            std::size_t size;
+            bool from_session = false;
+            if (conn.output_offset < conn.output.size())
+            {
+                data = conn.output.data() + conn.output_offset;
+                size = conn.output.size() - conn.output_offset;
+            }
+            else if (conn.session && conn.session->get_output_size() > 0)
+            {
+                data = conn.session->get_output();
+                size = conn.session->get_output_size();
+                from_session = true;
+            }
+            else
+            {
+                break;
+            }
+
+            ssize_t written = send(conn.fd, data, size, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    throttle(conn);
+                    update_events(conn, true);
+                    return;
+                }
+                close_connection(id);
+                return;
+            }
+
+            conn.last_activity = std::chrono::steady_clock::now();
+            if (from_session)
+            {
+                conn.session->consume_output(static_cast<std::size_t>(written));
+            }
+            else
+            {
+                conn.output_offset += static_cast<std::size_t>(written);
+                if (conn.output_offset == conn.output.size())
+                {
+                    conn.output.clear();
+                    conn.output_offset = 0;
+                }
+            }
+        }
+
+        throttle(conn);
+        update_events(conn, false);
+        if (conn.close_after_write || (conn.session && conn.session->is_done()))
+            close_connection(id);
+    }
+
+    void http2_listener::update_events(connection &conn, bool want_write)
+    {
+        bool want_read = !conn.reading_paused;
+        if (ring || (conn.writable_armed == want_write && conn.readable_armed == want_read))
+            return;
+        conn.writable_armed = want_write;
+        conn.readable_armed = want_read;
+
+        // EPOLLRDHUP goes with EPOLLIN, level triggered it would fire until reading resumes
+        epoll_event event{};
+        event.events = (want_read ? static_cast<std::uint32_t>(EPOLLIN | EPOLLRDHUP) : 0u) |
+                       (want_write ? static_cast<std::uint32_t>(EPOLLOUT) : 0u);
+        event.data.fd = conn.fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &event);
+    }
+
+    /// Requests still in flight on a closed connection are cancelled
+    void http2_listener::close_connection(std::uint64_t id)
+    {
+        auto it = connections.find(id);
+        if (it == connections.end())
+            return;
+
+        for (auto &pending : it->second.pending)
+        {
+            if (auto token = pending.second.lock())
+                token->cancel();
+        }
+        if (it->second.timer)
+            timers.cancel(it->second.timer);
+
+        int fd = it->second.fd;
+        if (ring)
+        {
+            // the pending recv holds the socket open, shutdown() ends it; a send in flight
+            // keeps its bytes until its completion arrives
+            shutdown(fd, SHUT_RDWR);
+            if (it->second.send_in_flight)
+                retired_sends[id] = std::move(it->second.sending);
+        }
+        else
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        }
+        close(fd);
+        connection_of_fd.erase(fd);
+        connections.erase(it);
+    }
+
+    /**
+     * Deadlines
+     * - A request the client is still sending has its header and body deadlines however busy
+     *   the connection is otherwise, an open stream does not hold the connection
+     * - The idle timeout runs while none of the connection's requests is being handled
+     */
+    std::chrono::steady_clock::time_point http2_listener::next_deadline(const connection &conn) const
+    {
+        using clock = std::chrono::steady_clock;
+        clock::time_point deadline = clock::time_point::max();
+        if (conn.session)
+        {
+            if (auto since = conn.session->get_incomplete_since())
+                deadline = std::min(deadline, *since + header_timeout);
+            if (auto since = conn.session->get_body_started())
+                deadline = std::min(deadline, *since + body_timeout);
+        }
+        else if (conn.request_started != clock::time_point())
+        {
+            deadline = conn.body_started != clock::time_point() ? conn.body_started + body_timeout : conn.request_started + header_timeout;
+        }
+
+        if (conn.pending.empty())
+            deadline = std::min(deadline, conn.last_activity + idle_timeout);
+        return deadline;
+    }
+
+    void http2_listener::arm_timer(connection &conn)
+    {
+        if (conn.expiring)
+            return;
+
+        // a deadline that did not move keeps its timer, re-arming one already due would push it back
+        auto deadline = next_deadline(conn);
+        if (conn.timer && deadline == conn.timer_deadline)
+            return;
+        conn.timer_deadline = deadline;
+
+        // nothing is timed while a request is handled, the timer checks again after the idle timeout
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::milliseconds delay = idle_timeout;
+        if (deadline != std::chrono::steady_clock::time_point::max())
+            delay = deadline > now ? std::chrono::ceil<std::chrono::milliseconds>(deadline - now) : std::chrono::milliseconds(0);
+
+        if (conn.timer && timers.reset(conn.timer, delay))
+            return;
+        std::uint64_t id = conn.id;
+        conn.timer = timers.schedule(delay, [this, id]()
+                                     { on_timer(id); });
+    }
+
+    /// Runs on the loop thread, from timers.advance()
+    void http2_listener::on_timer(std::uint64_t id)
+    {
+        auto it = connections.find(id);
+        if (it == connections.end())
+            return;
+        connection &conn = it->second;
+        conn.timer = 0;
+
+        // reads and writes since the timer was armed may have moved the deadline
+        if (!conn.expiring && next_deadline(conn) > std::chrono::steady_clock::now())
+        {
+            arm_timer(conn);
+            return;
+        }
+        expire(conn);
+    }
+
+    void http2_listener::expire(connection &conn)
+    {
+        if (!conn.session || conn.expiring)
+        {
+            close_connection(conn.id);
+            return;
+        }
+
+        // GOAWAY tells the client the connection was closed on purpose
+        std::uint64_t id = conn.id;
+        conn.expiring = true;
+        conn.session->shutdown();
+        conn.close_after_write = true;
+        conn.timer = timers.schedule(CLOSE_GRACE, [this, id]()
+                                     { on_timer(id); });
+        flush(conn);
+    }
+
+    /// The request line and headers run against the header timeout until "\r\n\r\n" arrived, the body against the body timeout
+    void http2_listener::await_request(connection &conn)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (conn.request_started == std::chrono::steady_clock::time_point())
+            conn.request_started = now;
+        if (conn.body_started == std::chrono::steady_clock::time_point() && conn.input.find("\r\n\r\n") != std::string::npos)
+            conn.body_started = now;
+    }
+
+    std::size_t http2_listener::queued_output(const connection &conn) const
+    {
+        std::size_t queued = conn.output.size() - conn.output_offset + conn.sending.size() - conn.sending_offset;
+        if (conn.session)
+            queued += conn.session->get_output_size();
+        return queued;
+    }
+
+    /**
+     * Backpressure
+     * - A client that sends without reading (PING or SETTINGS floods, pipelined requests)
+     *   stops being read once its answers pile up, TCP holds it back from then on
+     * - On epoll, update_events() drops EPOLLIN; on io_uring the multishot recv is cancelled,
+     *   data it delivered before the cancel is still processed
+     */
+    void http2_listener::throttle(connection &conn)
+    {
+        bool over = queued_output(conn) > max_queued_output;
+        if (over == conn.reading_paused)
+            return;
+        conn.reading_paused = over;
+        if (!ring)
+            return;
+        if (over && conn.recv_armed)
+            cancel_recv(conn);
+        else if (!over && !conn.recv_armed)
+            arm_recv(conn);
+    }
+
+    /**
+     * io_uring loop
+     * - Registered files are not used: TCP_NODELAY and SO_PEERCRED need a real descriptor
+     * - Without multishot recv or buffer rings the loop stays on epoll, never half on each
+     */
+    bool http2_listener::start_io_uring()
+    {
+        if (!io_uring_ring::probe().socket_loop())
+        {
+            logger::error("HTTP/2 listener: io_uring lacks multishot accept/recv or buffer rings on this kernel, using epoll");
+            return false;
+        }
+
+        try
+        {
+            ring = std::make_unique<io_uring_ring>(RING_ENTRIES);
+        }
+        catch (const std::exception &e)
+        {
+            logger::error("HTTP/2 listener: cannot set up io_uring, using epoll: " + std::string(e.what()));
+            return false;
+        }
+        if (!ring->register_buffer_ring(RECV_GROUP, RECV_BUFFERS, RECV_BUFFER_SIZE))
+        {
+            logger::error("HTTP/2 listener: cannot register the receive buffers, using epoll");
+            ring.reset();
+            return false;
+        }
+
+        arm_accept();
+        arm_wake();
+        arm_tick();
+        return true;
+    }
+
+    void http2_listener::run_io_uring()
+    {
+        while (running.load())
+        {
+            // the sends queued by the last round go out with the wait for the next completions
+            int result = ring->submit(1);
+            if (result < 0 && result != -EINTR && result != -EBUSY)
+            {
+                logger::error("HTTP/2 listener: io_uring_enter failed: " + std::string(std::strerror(-result)));
+                break;
+            }
+
+            ring->for_each_completion([this](const io_uring_cqe &cqe)
+                                      { on_io_uring_completion(cqe); });
+
+            signalled.store(false);
+            drain_completions();
+            timers.advance();
+        }
+    }
+
+    void http2_listener::on_io_uring_completion(const io_uring_cqe &cqe)
+    {
+        std::uint64_t op = cqe.user_data & ((1u << OP_BITS) - 1);
+        std::uint64_t id = cqe.user_data >> OP_BITS;
+        bool more = cqe.flags & IORING_CQE_F_MORE;
+
+        switch (op)
+        {
+        case OP_ACCEPT:
+            if (cqe.res >= 0)
+                add_connection(cqe.res);
+            else if (cqe.res != -EAGAIN && cqe.res != -EINTR && cqe.res != -ECANCELED)
+                logger::error("HTTP/2 listener: accept failed: " + std::string(std::strerror(-cqe.res)));
+            if (!more && running.load())
+                arm_accept();
+            return;
+
+        case OP_WAKE:
+            // the count itself does not matter, drain_completions() runs after every round
+            if (running.load())
+                arm_wake();
+            return;
+
+        case OP_TICK:
+            if (running.load())
+                arm_tick();
+            return;
+
+        case OP_CANCEL:
+            // the recv it cancelled reports itself with -ECANCELED
+            return;
+
+        case OP_SEND:
+        {
+            auto it = connections.find(id);
+            if (it == connections.end())
+            {
+                retired_sends.erase(id);
+                return;
+            }
+            connection &conn = it->second;
+            if (cqe.res < 0)
+            {
+                conn.send_in_flight = false;
+                close_connection(id);
+                return;
+            }
+            conn.last_activity = std::chrono::steady_clock::now();
+            conn.sending_offset += static_cast<std::size_t>(cqe.res);
+            if (conn.sending_offset < conn.sending.size())
+            {
+                submit_send(conn);
+                return;
+            }
+            conn.sending.clear();
+            conn.sending_offset = 0;
+            conn.send_in_flight = false;
+            flush(conn);
+            return;
+        }
+
+        case OP_RECV:
+        {
+            auto it = connections.find(id);
+            bool has_buffer = cqe.flags & IORING_CQE_F_BUFFER;
+            auto buffer_id = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (it == connections.end())
+            {
+                if (has_buffer)
+                    ring->recycle_buffer(RECV_GROUP, buffer_id);
+                return;
+            }
+
+            connection &conn = it->second;
+            if (!more)
+                conn.recv_armed = false;
+            if (cqe.res > 0 && has_buffer)
+            {
+                conn.last_activity = std::chrono::steady_clock::now();
+                bool open = receive(conn, ring->buffer_data(RECV_GROUP, buffer_id), static_cast<std::size_t>(cqe.res));
+                ring->recycle_buffer(RECV_GROUP, buffer_id);
+                if (connections.count(id) == 0)
+                    return;
+                arm_timer(conn);
+                flush(conn);
+                if (connections.count(id) == 0)
+                    return;
+                if (open && !conn.recv_armed && !conn.reading_paused)
+                    arm_recv(conn);
+                return;
+            }
+            if (has_buffer)
+                ring->recycle_buffer(RECV_GROUP, buffer_id);
+
+            // out of buffers, or cancelled by throttle(): the multishot recv ended, the data waits in the socket
+            if (cqe.res == -ENOBUFS || cqe.res == -EINTR || cqe.res == -EAGAIN || cqe.res == -ECANCELED)
+            {
+                if (!conn.recv_armed && !conn.reading_paused)
+                    arm_recv(conn);
+                return;
+            }
+            close_connection(id);
+            return;
+        }
+        }
+    }
+
+    void http2_listener::arm_accept()
+    {
+        io_uring_sqe *sqe = ring->get_sqe();
+        if (!sqe)
+            return;
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        sqe->user_data = tag(OP_ACCEPT);
+    }
+
+    void http2_listener::arm_recv(connection &conn)
+    {
+        io_uring_sqe *sqe = ring->get_sqe();
+        if (!sqe)
+            return;
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = conn.fd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->buf_group = RECV_GROUP;
+        sqe->user_data = tag(OP_RECV, conn.id);
+        conn.recv_armed = true;
+    }
+
+    void http2_listener::cancel_recv(const connection &conn)
+    {
+        io_uring_sqe *sqe = ring->get_sqe();
+        if (!sqe)
+            return;
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = tag(OP_RECV, conn.id);
+        sqe->user_data = tag(OP_CANCEL);
+    }
+
+    void http2_listener::arm_wake()
+    {
+        io_uring_sqe *sqe = ring->get_sqe();
+        if (!sqe)
+            return;
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = event_fd;
+        sqe->addr = reinterpret_cast<std::uint64_t>(&wake_count);
+        sqe->len = sizeof(wake_count);
+        sqe->user_data = tag(OP_WAKE);
+    }
+
+    void http2_listener::arm_tick()
+    {
+        io_uring_sqe *sqe = ring->get_sqe();
+        if (!sqe)
+            return;
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = reinterpret_cast<std::uint64_t>(&TICK_INTERVAL);
+        sqe->len = 1;
+        sqe->user_data = tag(OP_TICK);
+    }
+
+    void http2_listener::submit_send(connection &conn)
+    {
+        io_uring_sqe *sqe = ring->get_sqe();
+        if (!sqe)
+        {
+            close_connection(conn.id);
+            return;
+        }
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = conn.fd;
+        sqe->addr = reinterpret_cast<std::uint64_t>(conn.sending.data() + conn.sending_offset);
+        sqe->len = static_cast<std::uint32_t>(std::min<std::size_t>(conn.sending.size() - conn.sending_offset, 1u << 30));
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = tag(OP_SEND, conn.id);
+        conn.send_in_flight = true;
+    }
+}
@@ -0,0 +1,808 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "../includes/http2_session.hpp"
+#include "../includes/web_utilities.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        /// Headers that only make sense for one HTTP/1.1 hop and are malformed in HTTP/2
+        bool connection_specific(const std::string &name)
+        {
+            return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+                   name == "transfer-encoding" || name == "upgrade";
+        }
+
+        bool decode_base64url(const std::string &text, std::string &out)
+        {
+            std::uint32_t buffer = 0;
+            int bits = 0;
+            for (char c : text)
+            {
+                int value;
+                if (c >= 'A' && c <= 'Z')
+                    value = c - 'A';
+                else if (c >= 'a' && c <= 'z')
+                    value = c - 'a' + 26;
+                else if (c >= '0' && c <= '9')
+                    value = c - '0' + 52;
+                else if (c == '-' || c == '+')
+                    value = 62;
+                else if (c == '_' || c == '/')
+                    value = 63;
+                else if (c == '=')
+                    break;
+                else
+                    return false;
+
+                buffer = ((buffer << 6) | static_cast<std::uint32_t>(value)) & 0xffffff;
+                bits += 6;
+                if (bits >= 8)
+                {
+                    bits -= 8;
+                    out.push_back(static_cast<char>((buffer >> bits) & 0xff));
+                }
+            }
+            return true;
+        }
+    }
+
+    http2_session::http2_session(request_callback on_request, const settings &local)
+        : local(local), on_request(std::move(on_request))
+    {
+        this->local.initial_window_size = std::clamp<std::uint32_t>(this->local.initial_window_size, http2_frame::DEFAULT_WINDOW_SIZE, http2_frame::MAX_WINDOW_SIZE);
+        this->local.connection_window_size = std::clamp<std::uint32_t>(this->local.connection_window_size, http2_frame::DEFAULT_WINDOW_SIZE, http2_frame::MAX_WINDOW_SIZE);
+        this->local.max_frame_size = std::clamp<std::uint32_t>(this->local.max_frame_size, http2_frame::DEFAULT_MAX_FRAME_SIZE, http2_frame::MAX_FRAME_SIZE_LIMIT);
+    }
+
+    /**
+     * Server preface
+     * - SETTINGS with what differs from the protocol defaults
+     * - The connection window can only be raised with WINDOW_UPDATE
+     */
+    void http2_session::start()
+    {
+        http2_frame::write_settings(output, {{http2_setting::MAX_CONCURRENT_STREAMS, local.max_concurrent_streams},
+                                             {http2_setting::INITIAL_WINDOW_SIZE, local.initial_window_size},
+                                             {http2_setting::MAX_FRAME_SIZE, local.max_frame_size},
+                                             {http2_setting::MAX_HEADER_LIST_SIZE, local.max_header_list_size}});
+        if (local.connection_window_size > http2_frame::DEFAULT_WINDOW_SIZE)
+            http2_frame::write_window_update(output, 0, local.connection_window_size - http2_frame::DEFAULT_WINDOW_SIZE);
+        connection_receive_window = local.connection_window_size;
+    }
+
+    /**
+     * Upgrade from HTTP/1.1
+     * - The HTTP2-Settings values are the client's first SETTINGS, acknowledged by the 101 itself
+     * - Stream 1 is half-closed by the client, the HTTP/1.1 request was complete
+     */
+    bool http2_session::start_upgraded(const std::string &settings_header, http2_request &&first)
+    {
+        std::string payload;
+        if (!decode_base64url(settings_header, payload) || payload.size() % 6 != 0)
+            return false;
+
+        const auto *bytes = reinterpret_cast<const std::uint8_t *>(payload.data());
+        for (std::size_t i = 0; i < payload.size(); i += 6)
+        {
+            std::uint16_t id = static_cast<std::uint16_t>((bytes[i] << 8) | bytes[i + 1]);
+            if (!apply_setting(id, http2_frame::read_u32(bytes + i + 2)))
+                return false;
+        }
+
+        start();
+        stream &state = streams[1];
+        state.request = std::move(first);
+        state.request.stream_id = 1;
+        state.head_request = state.request.method == "HEAD";
+        state.remote_closed = true;
+        state.send_window = peer_initial_window_size;
+        state.receive_window = 0;
+        last_stream_id = 1;
+        dispatch(1, state);
+        return true;
+    }
+
+    bool http2_session::receive(const char *data, std::size_t size)
+    {
+        if (failed)
+            return false;
+
+        input.append(data, size);
+        if (!preface_received)
+        {
+            std::size_t compare = std::min(input.size() - input_offset, http2_frame::PREFACE_SIZE);
+            if (std::memcmp(input.data() + input_offset, http2_frame::PREFACE, compare) != 0)
+                return connection_error(http2_error::PROTOCOL_ERROR, "invalid connection preface");
+            if (compare < http2_frame::PREFACE_SIZE)
+                return true;
+            input_offset += http2_frame::PREFACE_SIZE;
+            preface_received = true;
+        }
+
+        while (input.size() - input_offset >= http2_frame::HEADER_SIZE)
+        {
+            const auto *bytes = reinterpret_cast<const std::uint8_t *>(input.data() + input_offset);
+            http2_frame frame = http2_frame::parse(bytes);
+            if (frame.length > local.max_frame_size)
+                return connection_error(http2_error::FRAME_SIZE_ERROR, "frame larger than SETTINGS_MAX_FRAME_SIZE");
+            if (input.size() - input_offset < http2_frame::HEADER_SIZE + frame.length)
+                break;
+
+            if (!settings_received && static_cast<http2_frame_type>(frame.type) != http2_frame_type::SETTINGS)
+                return connection_error(http2_error::PROTOCOL_ERROR, "first frame must be SETTINGS");
+            if (!handle_frame(frame, bytes + http2_frame::HEADER_SIZE))
+                return false;
+            input_offset += http2_frame::HEADER_SIZE + frame.length;
+        }
+
+        if (input_offset == input.size())
+        {
+            input.clear();
+            input_offset = 0;
+        }
+        else if (input_offset > 65536)
+        {
+            input.erase(0, input_offset);
+            input_offset = 0;
+        }
+
+        // the transport times out frames and header blocks that do not complete
+        if (input_offset == input.size() && !continuation_stream)
+            incomplete_since = std::chrono::steady_clock::time_point();
+        else if (incomplete_since == std::chrono::steady_clock::time_point())
+            incomplete_since = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    bool http2_session::handle_frame(const http2_frame &frame, const std::uint8_t *payload)
+    {
+        auto type = static_cast<http2_frame_type>(frame.type);
+        if (continuation_stream && type != http2_frame_type::CONTINUATION)
+            return connection_error(http2_error::PROTOCOL_ERROR, "header block interrupted");
+
+        switch (type)
+        {
+        case http2_frame_type::DATA:
+            return handle_data(frame, payload);
+        case http2_frame_type::HEADERS:
+            return handle_headers(frame, payload);
+        case http2_frame_type::CONTINUATION:
+            return handle_continuation(frame, payload);
+        case http2_frame_type::SETTINGS:
+            return handle_settings(frame, payload);
+        case http2_frame_type::WINDOW_UPDATE:
+            return handle_window_update(frame, payload);
+        case http2_frame_type::RST_STREAM:
+            return handle_rst_stream(frame, payload);
+        case http2_frame_type::PRIORITY:
+            if (frame.stream_id == 0)
+                return connection_error(http2_error::PROTOCOL_ERROR, "PRIORITY on stream 0");
+            if (frame.length != 5)
+                stream_error(frame.stream_id, http2_error::FRAME_SIZE_ERROR);
+            return true;
+        case http2_frame_type::PING:
+            if (frame.stream_id != 0)
+                return connection_error(http2_error::PROTOCOL_ERROR, "PING on a stream");
+            if (frame.length != 8)
+                return connection_error(http2_error::FRAME_SIZE_ERROR, "PING must carry 8 bytes");
+            if (!(frame.flags & http2_flags::ACK))
+                http2_frame::write_ping(output, payload, true);
+            return true;
+        case http2_frame_type::GOAWAY:
+            if (frame.stream_id != 0)
+                return connection_error(http2_error::PROTOCOL_ERROR, "GOAWAY on a stream");
+            goaway_received = true;
+            return true;
+        case http2_frame_type::PUSH_PROMISE:
+            return connection_error(http2_error::PROTOCOL_ERROR, "clients cannot push");
+        default:
+            // unknown frame types are ignored
+            return true;
+        }
+    }
+
+    /**
+     * DATA
+     * - Counts against the connection window even for streams that are gone, so both
+     *   sides keep the same view of it
+     */
+    bool http2_session::handle_data(const http2_frame &frame, const std::uint8_t *payload)
+    {
+        if (frame.stream_id == 0)
+            return connection_error(http2_error::PROTOCOL_ERROR, "DATA on stream 0");
+        if (frame.length > connection_receive_window)
+            return connection_error(http2_error::FLOW_CONTROL_ERROR, "connection window exceeded");
+        connection_receive_window -= frame.length;
+
+        std::size_t offset = 0;
+        std::size_t size = frame.length;
+        if (frame.flags & http2_flags::PADDED)
+        {
+            if (size < 1 || payload[0] >= size)
+                return connection_error(http2_error::PROTOCOL_ERROR, "invalid padding");
+            offset = 1;
+            size -= 1 + payload[0];
+        }
+
+        auto it = streams.find(frame.stream_id);
+        if (it == streams.end() || it->second.remote_closed)
+        {
+            if (frame.stream_id > last_stream_id)
+                return connection_error(http2_error::PROTOCOL_ERROR, "DATA on an idle stream");
+            credit_receive_windows(nullptr);
+            stream_error(frame.stream_id, http2_error::STREAM_CLOSED);
+            return true;
+        }
+
+        stream &state = it->second;
+        if (frame.length > state.receive_window)
+        {
+            credit_receive_windows(nullptr);
+            stream_error(frame.stream_id, http2_error::FLOW_CONTROL_ERROR);
+            return true;
+        }
+        state.receive_window -= frame.length;
+
+        bool end_stream = frame.flags & http2_flags::END_STREAM;
+        if (state.request.body.size() + size > local.max_body_size)
+        {
+            // answered right away, the 413 ends the stream with RST_STREAM(NO_ERROR) unless the body was complete
+            state.rejected = true;
+            state.remote_closed = end_stream;
+            state.request.body.clear();
+            credit_receive_windows(nullptr);
+            dispatch(frame.stream_id, state);
+            return true;
+        }
+        state.request.body.append(reinterpret_cast<const char *>(payload + offset), size);
+
+        credit_receive_windows(end_stream ? nullptr : &state);
+        if (end_stream)
+        {
+            state.remote_closed = true;
+            dispatch(frame.stream_id, state);
+        }
+        return true;
+    }
+
+    /**
+     * Window replenishment
+     * - Bodies are buffered as they arrive, so received bytes are credited back once half of
+     *   a window was used, one WINDOW_UPDATE per half window instead of one per frame
+     */
+    void http2_session::credit_receive_windows(stream *state)
+    {
+        if (connection_receive_window < local.connection_window_size / 2)
+        {
+            http2_frame::write_window_update(output, 0, static_cast<std::uint32_t>(local.connection_window_size - connection_receive_window));
+            connection_receive_window = local.connection_window_size;
+        }
+
+        if (state && state->receive_window < local.initial_window_size / 2)
+        {
+            http2_frame::write_window_update(output, state->request.stream_id, static_cast<std::uint32_t>(local.initial_window_size - state->receive_window));
+            state->receive_window = local.initial_window_size;
+        }
+    }
+
+    bool http2_session::handle_headers(const http2_frame &frame, const std::uint8_t *payload)
+    {
+        if (frame.stream_id == 0 || frame.stream_id % 2 == 0)
+            return connection_error(http2_error::PROTOCOL_ERROR, "HEADERS on an invalid stream id");
+
+        std::size_t offset = 0;
+        std::size_t size = frame.length;
+        std::size_t padding = 0;
+        if (frame.flags & http2_flags::PADDED)
+        {
+            if (size < 1)
+                return connection_error(http2_error::PROTOCOL_ERROR, "invalid padding");
+            padding = payload[0];
+            offset = 1;
+        }
+        if (frame.flags & http2_flags::PRIORITY)
+            offset += 5;
+        if (offset + padding > size)
+            return connection_error(http2_error::PROTOCOL_ERROR, "invalid padding");
+        size -= offset + padding;
+
+        header_block.assign(reinterpret_cast<const char *>(payload + offset), size);
+        continuation_end_stream = frame.flags & http2_flags::END_STREAM;
+        if (!(frame.flags & http2_flags::END_HEADERS))
+        {
+            continuation_stream = frame.stream_id;
+            return true;
+        }
+        return handle_header_block(frame.stream_id, continuation_end_stream);
+    }
+
+    bool http2_session::handle_continuation(const http2_frame &frame, const std::uint8_t *payload)
+    {
+        if (!continuation_stream || frame.stream_id != continuation_stream)
+            return connection_error(http2_error::PROTOCOL_ERROR, "unexpected CONTINUATION");
+        if (header_block.size() + frame.length > local.max_header_list_size * 2)
+            return connection_error(http2_error::ENHANCE_YOUR_CALM, "header block too large");
+
+        header_block.append(reinterpret_cast<const char *>(payload), frame.length);
+        if (!(frame.flags & http2_flags::END_HEADERS))
+            return true;
+
+        continuation_stream = 0;
+        return handle_header_block(frame.stream_id, continuation_end_stream);
+    }
+
+    /**
+     * Complete header block
+     * - Always decoded, even for refused streams, to keep the HPACK context in sync
+     * - On an open stream it is a trailer block and must end the stream
+     */
+    bool http2_session::handle_header_block(std::uint32_t stream_id, bool end_stream)
+    {
+        std::vector<hpack_header> headers;
+        bool decoded = decoder.decode(reinterpret_cast<const std::uint8_t *>(header_block.data()), header_block.size(), headers, local.max_header_list_size);
+        header_block.clear();
+        if (!decoded)
+            return connection_error(http2_error::COMPRESSION_ERROR, "malformed header block");
+
+        auto it = streams.find(stream_id);
+        if (it != streams.end())
+        {
+            stream &state = it->second;
+            if (state.remote_closed)
+            {
+                stream_error(stream_id, http2_error::STREAM_CLOSED);
+                return true;
+            }
+            if (!end_stream)
+            {
+                stream_error(stream_id, http2_error::PROTOCOL_ERROR);
+                return true;
+            }
+            for (auto &header : headers)
+            {
+                if (!header.first.empty() && header.first[0] != ':')
+                    state.request.headers.push_back(std::move(header));
+            }
+            state.remote_closed = true;
+            dispatch(stream_id, state);
+            return true;
+        }
+
+        if (stream_id <= last_stream_id)
+            return connection_error(http2_error::PROTOCOL_ERROR, "stream id reused");
+        last_stream_id = stream_id;
+
+        if (goaway_sent)
+            return true;
+        if (streams.size() + detached.size() >= local.max_concurrent_streams)
+        {
+            stream_error(stream_id, http2_error::REFUSED_STREAM);
+            return true;
+        }
+
+        http2_request request;
+        if (!build_request(std::move(headers), request))
+        {
+            stream_error(stream_id, http2_error::PROTOCOL_ERROR);
+            return true;
+        }
+
+        stream &state = streams[stream_id];
+        state.request = std::move(request);
+        state.request.stream_id = stream_id;
+        state.head_request = state.request.method == "HEAD";
+        state.send_window = peer_initial_window_size;
+        state.receive_window = local.initial_window_size;
+        if (end_stream)
+        {
+            state.remote_closed = true;
+            dispatch(stream_id, state);
+        }
+        else
+        {
+            receiving.emplace(stream_id, std::chrono::steady_clock::now());
+        }
+        return true;
+    }
+
+    /**
+     * Request validation (RFC 9113 section 8.3)
+     * - Pseudo-headers first, each once, only the request ones
+     * - Lowercase names, no connection-specific headers, TE only "trailers"
+     */
+    bool http2_session::build_request(std::vector<hpack_header> &&headers, http2_request &request) const
+    {
+        bool regular_seen = false;
+        for (auto &header : headers)
+        {
+            const std::string &name = header.first;
+            if (name.empty())
+                return false;
+
+            if (name[0] == ':')
+            {
+                if (regular_seen)
+                    return false;
+
+                std::string *target = nullptr;
+                if (name == ":method")
+                    target = &request.method;
+                else if (name == ":scheme")
+                    target = &request.scheme;
+                else if (name == ":authority")
+                    target = &request.authority;
+                else if (name == ":path")
+                    target = &request.path;
+                if (!target || !target->empty())
+                    return false;
+                *target = std::move(header.second);
+                continue;
+            }
+
+            regular_seen = true;
+            if (std::any_of(name.begin(), name.end(), [](unsigned char c)
+                            { return std::isupper(c); }))
+                return false;
+            if (connection_specific(name) || (name == "te" && header.second != "trailers"))
+                return false;
+            request.headers.push_back(std::move(header));
+        }
+
+        if (request.method.empty())
+            return false;
+        if (request.method != "CONNECT" && (request.scheme.empty() || request.path.empty()))
+            return false;
+        return true;
+    }
+
+    void http2_session::dispatch(std::uint32_t stream_id, stream &state)
+    {
+        if (state.dispatched)
+            return;
+        state.dispatched = true;
+        requests_received++;
+        receiving.erase(stream_id);
+
+        if (state.rejected)
+        {
+            http2_response too_large;
+            too_large.status = 413;
+            too_large.headers = {{"content-type", "text/plain"}};
+            too_large.body = "413 Payload Too Large";
+            respond(stream_id, too_large);
+            return;
+        }
+
+        http2_request request = std::move(state.request);
+        state.request = http2_request();
+        state.request.stream_id = stream_id;
+        if (on_request)
+            on_request(std::move(request));
+    }
+
+    /**
+     * SETTINGS
+     * - A change of SETTINGS_INITIAL_WINDOW_SIZE shifts the send window of every open stream
+     *   by the difference, which may unblock pending bodies
+     */
+    bool http2_session::handle_settings(const http2_frame &frame, const std::uint8_t *payload)
+    {
+        if (frame.stream_id != 0)
+            return connection_error(http2_error::PROTOCOL_ERROR, "SETTINGS on a stream");
+        if (frame.flags & http2_flags::ACK)
+        {
+            if (frame.length != 0)
+                return connection_error(http2_error::FRAME_SIZE_ERROR, "SETTINGS ack with payload");
+            return true;
+        }
+        if (frame.length % 6 != 0)
+            return connection_error(http2_error::FRAME_SIZE_ERROR, "SETTINGS length not a multiple of 6");
+
+        settings_received = true;
+        for (std::size_t i = 0; i < frame.length; i += 6)
+        {
+            std::uint16_t id = static_cast<std::uint16_t>((payload[i] << 8) | payload[i + 1]);
+            if (!apply_setting(id, http2_frame::read_u32(payload + i + 2)))
+                return false;
+        }
+
+        http2_frame::write_settings(output, {}, true);
+        flush_blocked_streams();
+        return true;
+    }
+
+    bool http2_session::apply_setting(std::uint16_t id, std::uint32_t value)
+    {
+        switch (static_cast<http2_setting>(id))
+        {
+        case http2_setting::HEADER_TABLE_SIZE:
+            encoder.set_max_table_size(value);
+            return true;
+        case http2_setting::ENABLE_PUSH:
+            if (value > 1)
+                return connection_error(http2_error::PROTOCOL_ERROR, "invalid SETTINGS_ENABLE_PUSH");
+            return true;
+        case http2_setting::INITIAL_WINDOW_SIZE:
+        {
+            if (value > http2_frame::MAX_WINDOW_SIZE)
+                return connection_error(http2_error::FLOW_CONTROL_ERROR, "invalid SETTINGS_INITIAL_WINDOW_SIZE");
+            std::int64_t delta = static_cast<std::int64_t>(value) - peer_initial_window_size;
+            for (auto &entry : streams)
+            {
+                entry.second.send_window += delta;
+                if (entry.second.send_window > http2_frame::MAX_WINDOW_SIZE)
+                    return connection_error(http2_error::FLOW_CONTROL_ERROR, "stream window overflow");
+            }
+            peer_initial_window_size = value;
+            return true;
+        }
+        case http2_setting::MAX_FRAME_SIZE:
+            if (value < http2_frame::DEFAULT_MAX_FRAME_SIZE || value > http2_frame::MAX_FRAME_SIZE_LIMIT)
+                return connection_error(http2_error::PROTOCOL_ERROR, "invalid SETTINGS_MAX_FRAME_SIZE");
+            peer_max_frame_size = value;
+            return true;
+        default:
+            // MAX_CONCURRENT_STREAMS limits our pushes (never sent), the rest is advisory or unknown
+            return true;
+        }
+    }
+
+    bool http2_session::handle_window_update(const http2_frame &frame, const std::uint8_t *payload)
+    {
+        if (frame.length != 4)
+            return connection_error(http2_error::FRAME_SIZE_ERROR, "WINDOW_UPDATE must carry 4 bytes");
+
+        std::uint32_t increment = http2_frame::read_u32(payload) & 0x7fffffff;
+        if (frame.stream_id == 0)
+        {
+            if (increment == 0)
+                return connection_error(http2_error::PROTOCOL_ERROR, "zero WINDOW_UPDATE");
+            connection_send_window += increment;
+            if (connection_send_window > http2_frame::MAX_WINDOW_SIZE)
+                return connection_error(http2_error::FLOW_CONTROL_ERROR, "connection window overflow");
+            flush_blocked_streams();
+            return true;
+        }
+
+        auto it = streams.find(frame.stream_id);
+        if (it == streams.end())
+        {
+            if (frame.stream_id > last_stream_id)
+                return connection_error(http2_error::PROTOCOL_ERROR, "WINDOW_UPDATE on an idle stream");
+            return true;
+        }
+        if (increment == 0)
+        {
+            stream_error(frame.stream_id, http2_error::PROTOCOL_ERROR);
+            return true;
+        }
+
+        it->second.send_window += increment;
+        if (it->second.send_window > http2_frame::MAX_WINDOW_SIZE)
+        {
+            stream_error(frame.stream_id, http2_error::FLOW_CONTROL_ERROR);
+            return true;
+        }
+        flush_stream(frame.stream_id, it->second);
+        return true;
+    }
+
+    bool http2_session::handle_rst_stream(const http2_frame &frame, const std::uint8_t *)
+    {
+        if (frame.stream_id == 0)
+            return connection_error(http2_error::PROTOCOL_ERROR, "RST_STREAM on stream 0");
+        if (frame.length != 4)
+            return connection_error(http2_error::FRAME_SIZE_ERROR, "RST_STREAM must carry 4 bytes");
+        if (frame.stream_id > last_stream_id)
+            return connection_error(http2_error::PROTOCOL_ERROR, "RST_STREAM on an idle stream");
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - reset_window >= std::chrono::seconds(1))
+        {
+            reset_window = now;
+            resets_in_window = 0;
+        }
+        if (++resets_in_window > local.max_resets_per_second)
+            return connection_error(http2_error::ENHANCE_YOUR_CALM, "too many stream resets");
+
+        auto it = streams.find(frame.stream_id);
+        if (it == streams.end())
+            return true;
+
+        if (abandon_stream(it) && on_reset)
+            on_reset(frame.stream_id);
+        return true;
+    }
+
+    /**
+     * Response
+     * - HEAD responses keep their headers (content-length included) but carry no body
+     * - A response sent before the request body ended closes the client's side with
+     *   RST_STREAM(NO_ERROR), so it stops uploading
+     */
+    void http2_session::respond(std::uint32_t stream_id, const http2_response &response)
+    {
+        if (detached.erase(stream_id))
+            return;
+        auto it = streams.find(stream_id);
+        if (it == streams.end() || it->second.local_closed || it->second.sending || failed)
+            return;
+        stream &state = it->second;
+
+        std::vector<hpack_header> headers;
+        headers.reserve(response.headers.size() + 1);
+        headers.emplace_back(":status", std::to_string(response.status));
+        for (const auto &header : response.headers)
+        {
+            std::string name = lowercase(header.first);
+            if (name.empty() || name[0] == ':' || connection_specific(name))
+                continue;
+            headers.emplace_back(std::move(name), header.second);
+        }
+
+        bool has_body = !state.head_request && !response.body.empty();
+        bool end_stream = !has_body && response.trailers.empty();
+        http2_frame::write_headers(output, stream_id, encoder.encode(headers), end_stream, peer_max_frame_size);
+
+        if (end_stream)
+        {
+            state.local_closed = true;
+            try_close(stream_id);
+            return;
+        }
+
+        state.sending = true;
+        if (has_body)
+            state.pending_body = response.body;
+        for (const auto &trailer : response.trailers)
+        {
+            std::string name = lowercase(trailer.first);
+            if (!name.empty() && name[0] != ':' && !connection_specific(name))
+                state.pending_trailers.emplace_back(std::move(name), trailer.second);
+        }
+        flush_stream(stream_id, state);
+    }
+
+    /// Send as much of a pending body as the windows allow, then the trailers
+    void http2_session::flush_stream(std::uint32_t stream_id, stream &state)
+    {
+        if (!state.sending)
+            return;
+
+        while (state.pending_offset < state.pending_body.size())
+        {
+            std::int64_t window = std::min(connection_send_window, state.send_window);
+            if (window <= 0)
+                return;
+
+            std::size_t chunk = std::min<std::size_t>({state.pending_body.size() - state.pending_offset,
+                                                       static_cast<std::size_t>(window), peer_max_frame_size});
+            bool last = state.pending_offset + chunk == state.pending_body.size();
+            http2_frame::write_data(output, stream_id, state.pending_body.data() + state.pending_offset, chunk,
+                                    last && state.pending_trailers.empty());
+            state.pending_offset += chunk;
+            state.send_window -= chunk;
+            connection_send_window -= chunk;
+        }
+
+        if (!state.pending_trailers.empty())
+            http2_frame::write_headers(output, stream_id, encoder.encode(state.pending_trailers), true, peer_max_frame_size);
+
+        state.sending = false;
+        state.local_closed = true;
+        state.pending_body.clear();
+        state.pending_trailers.clear();
+        try_close(stream_id);
+    }
+
+    void http2_session::flush_blocked_streams()
+    {
+        std::vector<std::uint32_t> blocked;
+        for (const auto &entry : streams)
+        {
+            if (entry.second.sending)
+                blocked.push_back(entry.first);
+        }
+        std::sort(blocked.begin(), blocked.end());
+
+        for (std::uint32_t stream_id : blocked)
+        {
+            if (connection_send_window <= 0)
+                return;
+            auto it = streams.find(stream_id);
+            if (it != streams.end())
+                flush_stream(stream_id, it->second);
+        }
+    }
+
+    void http2_session::try_close(std::uint32_t stream_id)
+    {
+        auto it = streams.find(stream_id);
+        if (it == streams.end() || !it->second.local_closed)
+            return;
+
+        if (!it->second.remote_closed)
+            http2_frame::write_rst_stream(output, stream_id, http2_error::NO_ERROR);
+        close_stream(it);
+    }
+
+    void http2_session::close_stream(std::unordered_map<std::uint32_t, stream>::iterator it)
+    {
+        receiving.erase(it->first);
+        streams.erase(it);
+    }
+
+    void http2_session::reset(std::uint32_t stream_id, http2_error error)
+    {
+        if (detached.erase(stream_id))
+            return;
+        auto it = streams.find(stream_id);
+        if (it == streams.end())
+            return;
+        http2_frame::write_rst_stream(output, stream_id, error);
+        close_stream(it);
+    }
+
+    void http2_session::stream_error(std::uint32_t stream_id, http2_error error)
+    {
+        http2_frame::write_rst_stream(output, stream_id, error);
+        auto it = streams.find(stream_id);
+        if (it == streams.end())
+            return;
+
+        if (abandon_stream(it) && on_reset)
+            on_reset(stream_id);
+    }
+
+    /**
+     * Reset streams
+     * - A request reported and not answered yet may still be queued or running, its stream
+     *   keeps counting against max_concurrent_streams until respond() or reset() comes back
+     * - A stream sending its response was answered already, nothing is pending for it
+     */
+    bool http2_session::abandon_stream(std::unordered_map<std::uint32_t, stream>::iterator it)
+    {
+        const stream &state = it->second;
+        bool notify = state.dispatched && !state.local_closed;
+        if (notify && !state.sending)
+            detached.insert(it->first);
+        close_stream(it);
+        return notify;
+    }
+
+    bool http2_session::connection_error(http2_error error, const std::string &reason)
+    {
+        if (!failed)
+            http2_frame::write_goaway(output, last_stream_id, error, reason);
+        failed = true;
+        goaway_sent = true;
+        return false;
+    }
+
+    void http2_session::shutdown()
+    {
+        if (goaway_sent)
+            return;
+        http2_frame::write_goaway(output, last_stream_id, http2_error::NO_ERROR);
+        goaway_sent = true;
+    }
+
+    void http2_session::consume_output(std::size_t bytes)
+    {
+        output_offset += std::min(bytes, get_output_size());
+        if (output_offset == output.size())
+        {
+            output.clear();
+            output_offset = 0;
+        }
+        else if (output_offset > 65536)
+        {
+            output.erase(0, output_offset);
+            output_offset = 0;
+        }
+    }
+}
@@ -0,0 +1,267 @@
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../includes/web_exceptions.hpp"
+#include "../includes/io_uring_ring.hpp"
+
+namespace hh_web
+{
+    static int sys_io_uring_setup(unsigned entries, io_uring_params *params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    static int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    /// Entries of a provided buffer ring. Not ring->bufs: in C++ the empty struct that
+    /// __DECLARE_FLEX_ARRAY puts in front of the array has a size, which shifts it by 8 bytes
+    static io_uring_buf *ring_entries(io_uring_buf_ring *ring)
+    {
+        return reinterpret_cast<io_uring_buf *>(ring);
+    }
+
+    /**
+     * Ring setup
+     * - The SQ ring, the CQ ring and the SQE array are mapped separately, which works with
+     *   and without IORING_FEAT_SINGLE_MMAP
+     * - The SQ index array is filled once with the identity mapping, get_sqe() then only
+     *   moves the tail
+     */
+    io_uring_ring::io_uring_ring(unsigned entries, unsigned flags)
+    {
+        io_uring_params params{};
+        params.flags = flags;
+        ring_fd = sys_io_uring_setup(entries, &params);
+        if (ring_fd < 0)
+        {
+            throw web_exception("io_uring_setup failed: " + std::string(std::strerror(errno)), "IO_URING_UNAVAILABLE", "io_uring_ring::io_uring_ring", 500, "Internal Server Error");
+        }
+
+        sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+        sq_map = mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        cq_map = mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        void *sqe_map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (sq_map == MAP_FAILED || cq_map == MAP_FAILED || sqe_map == MAP_FAILED)
+        {
+            int error = errno;
+            sq_map = sq_map == MAP_FAILED ? nullptr : sq_map;
+            cq_map = cq_map == MAP_FAILED ? nullptr : cq_map;
+            sqes = sqe_map == MAP_FAILED ? nullptr : static_cast<io_uring_sqe *>(sqe_map);
+            unmap();
+            throw web_exception("Failed to map io_uring rings: " + std::string(std::strerror(error)), "IO_URING_UNAVAILABLE", "io_uring_ring::io_uring_ring", 500, "Internal Server Error");
+        }
+        sqes = static_cast<io_uring_sqe *>(sqe_map);
+
+        char *sq = static_cast<char *>(sq_map);
+        sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_entries = params.sq_entries;
+        sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sq_entries; ++i)
+            sq_array[i] = i;
+        sqe_tail = *sq_tail;
+
+        char *cq = static_cast<char *>(cq_map);
+        cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    }
+
+    io_uring_ring::~io_uring_ring()
+    {
+        unmap();
+    }
+
+    void io_uring_ring::unmap()
+    {
+        for (auto &group : groups)
+        {
+            if (group.ring)
+                munmap(group.ring, group.ring_size);
+        }
+        groups.clear();
+
+        if (sqes)
+            munmap(sqes, sqes_size);
+        if (cq_map)
+            munmap(cq_map, cq_map_size);
+        if (sq_map)
+            munmap(sq_map, sq_map_size);
+        sqes = nullptr;
+        cq_map = sq_map = nullptr;
+
+        if (ring_fd >= 0)
+            close(ring_fd);
+        ring_fd = -1;
+    }
+
+    /**
+     * Feature probe
+     * - Opcode support comes from IORING_REGISTER_PROBE
+     * - Multishot accept, direct descriptors and provided buffer rings arrived together in 5.19,
+     *   a successful buffer ring registration stands for all three
+     * - Multishot recv arrived in 6.0 together with IORING_OP_SEND_ZC
+     */
+    io_uring_features io_uring_ring::probe()
+    {
+        io_uring_features features;
+        try
+        {
+            io_uring_ring ring(4);
+            features.available = true;
+
+            std::vector<char> storage(sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op));
+            auto *probe = reinterpret_cast<io_uring_probe *>(storage.data());
+            if (sys_io_uring_register(ring.ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0)
+                return features;
+
+            auto supported = [probe](unsigned op)
+            {
+                return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+            };
+            features.accept = supported(IORING_OP_ACCEPT);
+            features.recv_send = supported(IORING_OP_RECV) && supported(IORING_OP_SEND);
+            features.provided_buffers = ring.register_buffer_ring(0, 2, 64);
+            features.multishot_accept = features.provided_buffers && features.accept;
+            features.registered_files = features.provided_buffers && ring.register_sparse_files(2);
+            features.multishot_recv = features.provided_buffers && supported(IORING_OP_SEND_ZC);
+        }
+        catch (const std::exception &)
+        {
+        }
+        return features;
+    }
+
+    io_uring_sqe *io_uring_ring::get_sqe()
+    {
+        unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (sqe_tail - head >= sq_entries)
+        {
+            submit();
+            head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            if (sqe_tail - head >= sq_entries)
+                return nullptr;
+        }
+        io_uring_sqe *sqe = &sqes[sqe_tail & sq_mask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe_tail++;
+        return sqe;
+    }
+
+    int io_uring_ring::submit(unsigned wait_nr)
+    {
+        unsigned to_submit = sqe_tail - *sq_tail;
+        __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+        if (to_submit == 0 && wait_nr == 0)
+            return 0;
+
+        enter_calls++;
+        int result = sys_io_uring_enter(ring_fd, to_submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+        return result < 0 ? -errno : result;
+    }
+
+    bool io_uring_ring::register_sparse_files(unsigned count)
+    {
+        io_uring_rsrc_register request{};
+        request.nr = count;
+        request.flags = IORING_RSRC_REGISTER_SPARSE;
+        return sys_io_uring_register(ring_fd, IORING_REGISTER_FILES2, &request, sizeof(request)) == 0;
+    }
+
+    /**
+     * Provided buffer ring
+     * - The ring itself must be page aligned, it is mapped anonymously and touched before registering
+     * - All buffers are published at once, the tail lives in the first entry's reserved field
+     */
+    bool io_uring_ring::register_buffer_ring(std::uint16_t group, unsigned count, unsigned size)
+    {
+        if (count == 0 || (count & (count - 1)) != 0 || count > 32768 || find_group(group))
+            return false;
+
+        buffer_group entry;
+        entry.id = group;
+        entry.count = count;
+        entry.size = size;
+        entry.ring_size = count * sizeof(io_uring_buf);
+        void *memory = mmap(nullptr, entry.ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (memory == MAP_FAILED)
+            return false;
+        entry.ring = static_cast<io_uring_buf_ring *>(memory);
+        // fault the pages in before the kernel pins them, otherwise it may pin the shared zero page
+        std::memset(memory, 0, entry.ring_size);
+
+        io_uring_buf_reg request{};
+        request.ring_addr = reinterpret_cast<std::uint64_t>(entry.ring);
+        request.ring_entries = count;
+        request.bgid = group;
+        if (sys_io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &request, 1) != 0)
+        {
+            munmap(entry.ring, entry.ring_size);
+            return false;
+        }
+
+        entry.storage.resize(static_cast<std::size_t>(count) * size);
+        for (unsigned i = 0; i < count; ++i)
+        {
+            io_uring_buf &buffer = ring_entries(entry.ring)[i];
+            buffer.addr = reinterpret_cast<std::uint64_t>(entry.storage.data() + static_cast<std::size_t>(i) * size);
+            buffer.len = size;
+            buffer.bid = static_cast<std::uint16_t>(i);
+        }
+        entry.tail = static_cast<unsigned short>(count);
+        __atomic_store_n(&entry.ring->tail, entry.tail, __ATOMIC_RELEASE);
+
+        groups.push_back(std::move(entry));
+        return true;
+    }
+
+    io_uring_ring::buffer_group *io_uring_ring::find_group(std::uint16_t group)
+    {
+        for (auto &entry : groups)
+        {
+            if (entry.id == group)
+                return &entry;
+        }
+        return nullptr;
+    }
+
+    const char *io_uring_ring::buffer_data(std::uint16_t group, std::uint16_t buffer_id)
+    {
+        buffer_group *entry = find_group(group);
+        if (!entry || buffer_id >= entry->count)
+            return nullptr;
+        return entry->storage.data() + static_cast<std::size_t>(buffer_id) * entry->size;
+    }
+
+    void io_uring_ring::recycle_buffer(std::uint16_t group, std::uint16_t buffer_id)
+    {
+        buffer_group *entry = find_group(group);
+        if (!entry || buffer_id >= entry->count)
+            return;
+
+        io_uring_buf &buffer = ring_entries(entry->ring)[entry->tail & (entry->count - 1)];
+        buffer.addr = reinterpret_cast<std::uint64_t>(entry->storage.data() + static_cast<std::size_t>(buffer_id) * entry->size);
+        buffer.len = entry->size;
+        buffer.bid = buffer_id;
+        entry->tail++;
+        __atomic_store_n(&entry->ring->tail, entry->tail, __ATOMIC_RELEASE);
+    }
+}
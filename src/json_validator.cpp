@@ -0,0 +1,459 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "../includes/json_validator.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        bool is_whitespace(unsigned char c)
+        {
+            return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+        }
+
+        bool is_digit(unsigned char c)
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        bool is_hex(unsigned char c)
+        {
+            return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        }
+
+        bool is_continuation(unsigned char c)
+        {
+            return (c & 0xC0) == 0x80;
+        }
+
+        /// What the next token has to be
+        enum class expect
+        {
+            VALUE,
+            KEY,
+            AFTER_VALUE
+        };
+
+        /**
+         * A cursor over the document and the open containers. Each step returns NONE or the
+         * error, p is left at the offending byte.
+         */
+        struct validator
+        {
+            const unsigned char *begin;
+            const unsigned char *p;
+            const unsigned char *end;
+            std::size_t max_depth;
+            std::size_t depth = 0;
+
+            /// Bit n set: the container opened at depth n is an object, clear: an array
+            std::uint64_t objects[json_max_supported_depth / 64] = {};
+
+            void skip_whitespace()
+            {
+                while (p < end && is_whitespace(*p))
+                {
+#if defined(__SSE2__)
+                    // indentation comes in runs, look at 16 bytes at a time
+                    if (end - p >= 16)
+                    {
+                        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                        __m128i space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))),
+                                                     _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))));
+                        unsigned other = ~static_cast<unsigned>(_mm_movemask_epi8(space)) & 0xFFFFu;
+                        if (other != 0)
+                        {
+                            p += __builtin_ctz(other);
+                            return;
+                        }
+                        p += 16;
+                        continue;
+                    }
+#endif
+                    ++p;
+                }
+            }
+
+            void push(bool object)
+            {
+                std::uint64_t bit = std::uint64_t(1) << (depth % 64);
+                if (object)
+                    objects[depth / 64] |= bit;
+                else
+                    objects[depth / 64] &= ~bit;
+                ++depth;
+            }
+
+            bool in_object() const
+            {
+                std::size_t top = depth - 1;
+                return (objects[top / 64] >> (top % 64)) & 1;
+            }
+
+            /// One UTF-8 sequence of two to four bytes, well-formed as Unicode's table 3-7 has it
+            json_error utf8_sequence()
+            {
+                unsigned char lead = *p;
+                std::size_t length;
+                unsigned char low = 0x80, high = 0xBF;
+                if (lead >= 0xC2 && lead <= 0xDF)
+                    length = 2;
+                else if (lead >= 0xE0 && lead <= 0xEF)
+                {
+                    length = 3;
+                    if (lead == 0xE0)
+                        low = 0xA0; // overlong
+                    else if (lead == 0xED)
+                        high = 0x9F; // surrogates
+                }
+                else if (lead >= 0xF0 && lead <= 0xF4)
+                {
+                    length = 4;
+                    if (lead == 0xF0)
+                        low = 0x90; // overlong
+                    else if (lead == 0xF4)
+                        high = 0x8F; // past U+10FFFF
+                }
+                else
+                    return json_error::INVALID_UTF8;
+
+                if (static_cast<std::size_t>(end - p) < length || p[1] < low || p[1] > high)
+                    return json_error::INVALID_UTF8;
+                for (std::size_t i = 2; i < length; ++i)
+                {
+                    if (!is_continuation(p[i]))
+                        return json_error::INVALID_UTF8;
+                }
+                p += length;
+                return json_error::NONE;
+            }
+
+            /// A string, p at its opening quote
+            json_error string()
+            {
+                ++p;
+                for (;;)
+                {
+#if defined(__SSE2__)
+                    // skip 16 bytes at a time while none is a quote, backslash, control or non-ASCII byte
+                    while (end - p >= 16)
+                    {
+                        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                        __m128i control_max = _mm_set1_epi8(0x1F);
+                        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))),
+                                                       _mm_cmpeq_epi8(_mm_max_epu8(chunk, control_max), control_max));
+                        // the sign bit of each byte marks the non-ASCII ones
+                        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(special) | _mm_movemask_epi8(chunk));
+                        if (mask != 0)
+                        {
+                            p += __builtin_ctz(mask);
+                            break;
+                        }
+                        p += 16;
+                    }
+#endif
+                    if (p >= end)
+                        return json_error::UNTERMINATED_STRING;
+
+                    unsigned char c = *p;
+                    if (c == '"')
+                    {
+                        ++p;
+                        return json_error::NONE;
+                    }
+                    if (c == '\\')
+                    {
+                        if (end - p < 2)
+                            return json_error::UNTERMINATED_STRING;
+                        switch (p[1])
+                        {
+                        case '"':
+                        case '\\':
+                        case '/':
+                        case 'b':
+                        case 'f':
+                        case 'n':
+                        case 'r':
+                        case 't':
+                            p += 2;
+                            break;
+                        case 'u':
+                            if (end - p < 6 || !is_hex(p[2]) || !is_hex(p[3]) || !is_hex(p[4]) || !is_hex(p[5]))
+                                return json_error::INVALID_ESCAPE;
+                            p += 6;
+                            break;
+                        default:
+                            return json_error::INVALID_ESCAPE;
+                        }
+                    }
+                    else if (c < 0x20)
+                    {
+                        return json_error::CONTROL_CHARACTER;
+                    }
+                    else if (c < 0x80)
+                    {
+                        ++p;
+                    }
+                    else if (json_error error = utf8_sequence(); error != json_error::NONE)
+                    {
+                        return error;
+                    }
+                }
+            }
+
+            /// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+            json_error number()
+            {
+                if (*p == '-')
+                    ++p;
+                if (p >= end)
+                    return json_error::INVALID_NUMBER;
+                if (*p == '0')
+                    ++p;
+                else if (is_digit(*p))
+                    while (p < end && is_digit(*p))
+                        ++p;
+                else
+                    return json_error::INVALID_NUMBER;
+
+                if (p < end && *p == '.')
+                {
+                    ++p;
+                    if (p >= end || !is_digit(*p))
+                        return json_error::INVALID_NUMBER;
+                    while (p < end && is_digit(*p))
+                        ++p;
+                }
+                if (p < end && (*p == 'e' || *p == 'E'))
+                {
+                    ++p;
+                    if (p < end && (*p == '+' || *p == '-'))
+                        ++p;
+                    if (p >= end || !is_digit(*p))
+                        return json_error::INVALID_NUMBER;
+                    while (p < end && is_digit(*p))
+                        ++p;
+                }
+                return json_error::NONE;
+            }
+
+            json_error literal(const char *word, std::size_t length)
+            {
+                if (static_cast<std::size_t>(end - p) < length || std::memcmp(p, word, length) != 0)
+                    return json_error::INVALID_LITERAL;
+                p += length;
+                return json_error::NONE;
+            }
+
+            json_error run()
+            {
+                skip_whitespace();
+                if (p == end)
+                    return json_error::EMPTY;
+
+                expect next = expect::VALUE;
+                for (;;)
+                {
+                    skip_whitespace();
+                    if (p == end)
+                        return depth == 0 && next == expect::AFTER_VALUE ? json_error::NONE : json_error::UNEXPECTED_END;
+
+                    json_error error = json_error::NONE;
+                    switch (next)
+                    {
+                    case expect::VALUE:
+                        switch (*p)
+                        {
+                        case '{':
+                        case '[':
+                            if (depth >= max_depth)
+                                return json_error::TOO_DEEP;
+                            push(*p == '{');
+                            ++p;
+                            skip_whitespace();
+                            if (p < end && (*p == '}' || *p == ']'))
+                            {
+                                // empty container, the closing byte is checked as after a value
+                                next = expect::AFTER_VALUE;
+                                continue;
+                            }
+                            next = in_object() ? expect::KEY : expect::VALUE;
+                            continue;
+                        case '"':
+                            error = string();
+                            break;
+                        case 't':
+                            error = literal("true", 4);
+                            break;
+                        case 'f':
+                            error = literal("false", 5);
+                            break;
+                        case 'n':
+                            error = literal("null", 4);
+                            break;
+                        default:
+                            if (*p != '-' && !is_digit(*p))
+                                return json_error::UNEXPECTED_CHARACTER;
+                            error = number();
+                        }
+                        if (error != json_error::NONE)
+                            return error;
+                        next = expect::AFTER_VALUE;
+                        break;
+
+                    case expect::KEY:
+                        if (*p != '"')
+                            return json_error::UNEXPECTED_CHARACTER;
+                        if ((error = string()) != json_error::NONE)
+                            return error;
+                        skip_whitespace();
+                        if (p == end)
+                            return json_error::UNEXPECTED_END;
+                        if (*p != ':')
+                            return json_error::UNEXPECTED_CHARACTER;
+                        ++p;
+                        next = expect::VALUE;
+                        break;
+
+                    case expect::AFTER_VALUE:
+                        if (depth == 0)
+                            return json_error::TRAILING_CONTENT;
+                        if (*p == ',')
+                        {
+                            ++p;
+                            next = in_object() ? expect::KEY : expect::VALUE;
+                        }
+                        else if (*p == (in_object() ? '}' : ']'))
+                        {
+                            ++p;
+                            --depth;
+                        }
+                        else
+                        {
+                            return json_error::UNEXPECTED_CHARACTER;
+                        }
+                        break;
+                    }
+                }
+            }
+        };
+
+        const char *error_text(json_error error)
+        {
+            switch (error)
+            {
+            case json_error::NONE:
+                return "valid";
+            case json_error::EMPTY:
+                return "empty document";
+            case json_error::TOO_DEEP:
+                return "nested too deeply";
+            case json_error::UNEXPECTED_CHARACTER:
+                return "unexpected character";
+            case json_error::UNEXPECTED_END:
+                return "unexpected end";
+            case json_error::UNTERMINATED_STRING:
+                return "unterminated string";
+            case json_error::CONTROL_CHARACTER:
+                return "control character in string";
+            case json_error::INVALID_ESCAPE:
+                return "invalid escape";
+            case json_error::INVALID_UTF8:
+                return "invalid UTF-8";
+            case json_error::INVALID_NUMBER:
+                return "invalid number";
+            case json_error::INVALID_LITERAL:
+                return "invalid literal";
+            case json_error::TRAILING_CONTENT:
+                return "content after the document";
+            }
+            return "unknown error";
+        }
+    }
+
+    std::string json_validation::describe() const
+    {
+        if (error == json_error::NONE)
+            return error_text(error);
+        return std::string(error_text(error)) + " at offset " + std::to_string(offset);
+    }
+
+    json_validation validate_json(std::string_view text, std::size_t max_depth)
+    {
+        validator state;
+        state.begin = reinterpret_cast<const unsigned char *>(text.data());
+        state.p = state.begin;
+        state.end = state.begin + text.size();
+        state.max_depth = std::min(max_depth, json_max_supported_depth);
+
+        json_validation result;
+        result.error = state.run();
+        if (result.error != json_error::NONE)
+            result.offset = static_cast<std::size_t>(state.p - state.begin);
+        return result;
+    }
+
+    std::optional<std::vector<std::string_view>> json_array_elements(std::string_view text)
+    {
+        std::size_t position = 0;
+        auto skip_whitespace = [&text, &position]()
+        {
+            while (position < text.size() && is_whitespace(static_cast<unsigned char>(text[position])))
+                ++position;
+        };
+
+        skip_whitespace();
+        if (position >= text.size() || text[position] != '[')
+            return std::nullopt;
+        ++position;
+
+        std::vector<std::string_view> elements;
+        std::size_t depth = 0;
+        std::size_t start = std::string_view::npos;
+        for (; position < text.size(); ++position)
+        {
+            char c = text[position];
+            if (is_whitespace(static_cast<unsigned char>(c)))
+                continue;
+            if (start == std::string_view::npos && c != ']' && c != ',')
+                start = position;
+            if (c == '"')
+            {
+                for (++position; position < text.size() && text[position] != '"'; ++position)
+                {
+                    if (text[position] == '\\')
+                        ++position;
+                }
+            }
+            else if (c == '{' || c == '[')
+            {
+                ++depth;
+            }
+            else if ((c == '}' || c == ']') && depth > 0)
+            {
+                --depth;
+            }
+            else if ((c == ',' || c == ']') && depth == 0)
+            {
+                if (start != std::string_view::npos)
+                {
+                    // the element ends at its last non-whitespace byte
+                    std::size_t end = position;
+                    while (end > start && is_whitespace(static_cast<unsigned char>(text[end - 1])))
+                        --end;
+                    elements.push_back(text.substr(start, end - start));
+                }
+                start = std::string_view::npos;
+                if (c == ']')
+                    break;
+            }
+        }
+        return elements;
+    }
+}
@@ -0,0 +1,152 @@
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "../includes/json_writer.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        const char hex[] = "0123456789abcdef";
+
+        /// Escape of a byte below 0x20, the short form where JSON has one
+        const char *control_escape(unsigned char c, char (&buffer)[7])
+        {
+            switch (c)
+            {
+            case '\b':
+                return "\\b";
+            case '\f':
+                return "\\f";
+            case '\n':
+                return "\\n";
+            case '\r':
+                return "\\r";
+            case '\t':
+                return "\\t";
+            default:
+                buffer[0] = '\\';
+                buffer[1] = 'u';
+                buffer[2] = '0';
+                buffer[3] = '0';
+                buffer[4] = hex[c >> 4];
+                buffer[5] = hex[c & 0xF];
+                buffer[6] = '\0';
+                return buffer;
+            }
+        }
+
+        bool needs_escape(unsigned char c)
+        {
+            return c < 0x20 || c == '"' || c == '\\';
+        }
+
+        /// Offset of the first byte needing an escape at or after from, text.size() if none
+        std::size_t next_special(std::string_view text, std::size_t from)
+        {
+            std::size_t i = from;
+#if defined(__SSE2__)
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i control_max = _mm_set1_epi8(0x1F);
+            for (; i + 16 <= text.size(); i += 16)
+            {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + i));
+                // unsigned c <= 0x1F exactly when max(c, 0x1F) == 0x1F
+                __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                               _mm_cmpeq_epi8(_mm_max_epu8(chunk, control_max), control_max));
+                int mask = _mm_movemask_epi8(special);
+                if (mask != 0)
+                    return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+            }
+#endif
+            for (; i < text.size(); ++i)
+            {
+                if (needs_escape(static_cast<unsigned char>(text[i])))
+                    return i;
+            }
+            return text.size();
+        }
+    }
+
+    void append_escaped_json(std::string &out, std::string_view text)
+    {
+        std::size_t run = 0;
+        for (std::size_t i = next_special(text, 0); i < text.size(); i = next_special(text, run))
+        {
+            out.append(text.data() + run, i - run);
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c == '"')
+            {
+                out.append("\\\"", 2);
+            }
+            else if (c == '\\')
+            {
+                out.append("\\\\", 2);
+            }
+            else
+            {
+                char buffer[7];
+                out += control_escape(c, buffer);
+            }
+            run = i + 1;
+        }
+        out.append(text.data() + run, text.size() - run);
+    }
+
+    void json_writer::write_signed(std::int64_t number)
+    {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+        out->append(buffer, static_cast<std::size_t>(result.ptr - buffer));
+    }
+
+    void json_writer::write_unsigned(std::uint64_t number)
+    {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+        out->append(buffer, static_cast<std::size_t>(result.ptr - buffer));
+    }
+
+    void json_writer::write_double(double number)
+    {
+        if (!std::isfinite(number))
+        {
+            out->append("null", 4);
+            return;
+        }
+        char buffer[32];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        // the shortest form that reads back as the same double
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+        out->append(buffer, static_cast<std::size_t>(result.ptr - buffer));
+#else
+        int size = std::snprintf(buffer, sizeof(buffer), "%.17g", number);
+        out->append(buffer, static_cast<std::size_t>(size));
+#endif
+    }
+
+    void json_writer::write_float(float number)
+    {
+        if (!std::isfinite(number))
+        {
+            out->append("null", 4);
+            return;
+        }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        // shortest for a float, 0.1f is 0.1 rather than 0.10000000149011612
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+        out->append(buffer, static_cast<std::size_t>(result.ptr - buffer));
+#else
+        char buffer[32];
+        int size = std::snprintf(buffer, sizeof(buffer), "%.9g", static_cast<double>(number));
+        out->append(buffer, static_cast<std::size_t>(size));
+#endif
+    }
+}
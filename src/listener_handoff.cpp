@@ -0,0 +1,401 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <string>
+
+#include <dirent.h>
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../includes/logger.hpp"
+#include "../includes/listener_handoff.hpp"
+
+namespace hh_web
+{
+    /// Upper bound of sockets handed over in one message
+    static const std::size_t MAX_HANDOFF_FDS = 64;
+
+    /// Byte sent by the new process once its listeners are in the reuseport group
+    static const char HANDOFF_READY = 'R';
+
+    /// Time the old process waits for the new one to become ready after sending its sockets
+    static const int HANDOFF_READY_TIMEOUT_SECONDS = 30;
+
+    static bool fill_address(sockaddr_un &address, const std::string &path)
+    {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+        {
+            logger::error("Invalid handoff socket path: " + path);
+            return false;
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size());
+        return true;
+    }
+
+    /// Only processes of the same user may take over or hand over sockets
+    static bool same_user(int fd)
+    {
+        ucred credentials{};
+        socklen_t length = sizeof(credentials);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0)
+            return false;
+        return credentials.uid == geteuid();
+    }
+
+    static void set_receive_timeout(int fd, std::chrono::milliseconds timeout)
+    {
+        timeval tv{};
+        tv.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+        tv.tv_usec = static_cast<suseconds_t>((timeout.count() % 1000) * 1000);
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
+    static bool send_fds(int connection, const std::vector<int> &fds)
+    {
+        std::uint32_t count = static_cast<std::uint32_t>(fds.size());
+        iovec payload{&count, sizeof(count)};
+
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+
+        cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+
+        return sendmsg(connection, &message, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(count));
+    }
+
+    static std::vector<int> receive_fds(int connection)
+    {
+        std::uint32_t count = 0;
+        iovec payload{&count, sizeof(count)};
+
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS));
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+
+        std::vector<int> fds;
+        if (recvmsg(connection, &message, MSG_CMSG_CLOEXEC) != static_cast<ssize_t>(sizeof(count)))
+            return fds;
+
+        for (cmsghdr *header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+        {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+                continue;
+            std::size_t received = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const unsigned char *data = CMSG_DATA(header);
+            for (std::size_t i = 0; i < received; ++i)
+            {
+                int fd;
+                std::memcpy(&fd, data + i * sizeof(int), sizeof(int));
+                fds.push_back(fd);
+            }
+        }
+
+        if (fds.size() != count || (message.msg_flags & MSG_CTRUNC))
+        {
+            logger::error("Incomplete listener handoff, expected " + std::to_string(count) + " sockets");
+            for (int fd : fds)
+                ::close(fd);
+            fds.clear();
+        }
+        return fds;
+    }
+
+    listener_handoff::~listener_handoff()
+    {
+        close();
+    }
+
+    std::vector<int> listener_handoff::find_listeners(int port, bool listening_only)
+    {
+        std::vector<int> result;
+        std::set<ino_t> seen;
+
+        DIR *directory = opendir("/proc/self/fd");
+        if (!directory)
+            return result;
+
+        int directory_fd = dirfd(directory);
+        while (dirent *entry = readdir(directory))
+        {
+            char *end = nullptr;
+            long fd = std::strtol(entry->d_name, &end, 10);
+            if (end == entry->d_name || *end != '\0' || fd == directory_fd)
+                continue;
+
+            struct stat info{};
+            if (fstat(static_cast<int>(fd), &info) < 0 || !S_ISSOCK(info.st_mode))
+                continue;
+
+            int accepting = 0;
+            socklen_t length = sizeof(accepting);
+            if (getsockopt(static_cast<int>(fd), SOL_SOCKET, SO_ACCEPTCONN, &accepting, &length) < 0 || (listening_only && !accepting))
+                continue;
+
+            int type = 0;
+            length = sizeof(type);
+            if (getsockopt(static_cast<int>(fd), SOL_SOCKET, SO_TYPE, &type, &length) < 0 || type != SOCK_STREAM)
+                continue;
+
+            // accepted connections share the port, a bound socket has no peer yet
+            sockaddr_storage peer{};
+            socklen_t peer_length = sizeof(peer);
+            if (!accepting && getpeername(static_cast<int>(fd), reinterpret_cast<sockaddr *>(&peer), &peer_length) == 0)
+                continue;
+
+            sockaddr_storage address{};
+            socklen_t address_length = sizeof(address);
+            if (getsockname(static_cast<int>(fd), reinterpret_cast<sockaddr *>(&address), &address_length) < 0)
+                continue;
+
+            int bound_port = -1;
+            if (address.ss_family == AF_INET)
+                bound_port = ntohs(reinterpret_cast<sockaddr_in *>(&address)->sin_port);
+            else if (address.ss_family == AF_INET6)
+                bound_port = ntohs(reinterpret_cast<sockaddr_in6 *>(&address)->sin6_port);
+
+            if (bound_port == port && seen.insert(info.st_ino).second)
+                result.push_back(static_cast<int>(fd));
+        }
+        closedir(directory);
+        return result;
+    }
+
+    std::size_t listener_handoff::pending_connections(const std::vector<int> &listeners)
+    {
+        std::size_t pending = 0;
+        for (int fd : listeners)
+        {
+            // for a listening socket tcpi_unacked is the current accept queue length
+            tcp_info info{};
+            socklen_t length = sizeof(info);
+            if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0)
+                pending += info.tcpi_unacked;
+        }
+        return pending;
+    }
+
+    bool listener_handoff::offer(const std::string &path, int port, taken_over_callback_t on_taken_over)
+    {
+        sockaddr_un address;
+        if (running.load() || !fill_address(address, path))
+            return false;
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            logger::error("Failed to create handoff socket: " + std::string(std::strerror(errno)));
+            return false;
+        }
+
+        ::unlink(path.c_str());
+        if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::chmod(path.c_str(), 0600) < 0 || ::listen(fd, 1) < 0)
+        {
+            logger::error("Failed to listen on handoff socket " + path + ": " + std::strerror(errno));
+            ::close(fd);
+            return false;
+        }
+
+        this->path = path;
+        this->port = port;
+        handoff_listener = fd;
+        running.store(true);
+        worker = std::thread([this, on_taken_over]()
+                             { serve_offer(on_taken_over); });
+        return true;
+    }
+
+    /**
+     * @brief Old side handoff thread.
+     *
+     * @note
+     * - Attempts that fail (wrong user, the new process dies before it is ready) are dropped
+     *   and the socket keeps waiting for the next one
+     * - After a successful handoff the connection stays open until close(), the new process
+     *   uses its end of file to learn that the old listeners are gone
+     */
+    void listener_handoff::serve_offer(taken_over_callback_t on_taken_over)
+    {
+        while (running.load())
+        {
+            pollfd ready{handoff_listener, POLLIN, 0};
+            if (poll(&ready, 1, 200) <= 0)
+                continue;
+
+            int peer = accept4(handoff_listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (peer < 0)
+                continue;
+
+            if (!same_user(peer))
+            {
+                logger::error("Rejected listener handoff to a process of another user");
+                ::close(peer);
+                continue;
+            }
+
+            std::vector<int> listeners = find_listeners(port);
+            if (listeners.empty() || listeners.size() > MAX_HANDOFF_FDS || !send_fds(peer, listeners))
+            {
+                logger::error("Failed to hand over the listening sockets of port " + std::to_string(port));
+                ::close(peer);
+                continue;
+            }
+
+            set_receive_timeout(peer, std::chrono::seconds(HANDOFF_READY_TIMEOUT_SECONDS));
+            char ack = 0;
+            if (recv(peer, &ack, 1, 0) != 1 || ack != HANDOFF_READY)
+            {
+                logger::error("New process did not take over the listening sockets, keep serving");
+                ::close(peer);
+                continue;
+            }
+
+            logger::info("Listening sockets taken over by a new process, draining");
+            connection = peer;
+            ::close(handoff_listener);
+            handoff_listener = -1;
+            running.store(false);
+
+            if (on_taken_over)
+                on_taken_over(listeners);
+            return;
+        }
+    }
+
+    std::size_t listener_handoff::take_over(const std::string &path, int port, std::chrono::milliseconds timeout)
+    {
+        sockaddr_un address;
+        if (!inherited.empty() || connection >= 0 || !fill_address(address, path))
+            return 0;
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return 0;
+
+        if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            // nobody to take over from: cold start
+            ::close(fd);
+            return 0;
+        }
+
+        if (!same_user(fd))
+        {
+            logger::error("Refused listener handoff from a process of another user");
+            ::close(fd);
+            return 0;
+        }
+
+        set_receive_timeout(fd, timeout);
+        inherited = receive_fds(fd);
+        if (inherited.empty())
+        {
+            ::close(fd);
+            return 0;
+        }
+
+        this->path = path;
+        this->port = port;
+        connection = fd;
+        logger::info("Received " + std::to_string(inherited.size()) + " listening sockets from the running process");
+        return inherited.size();
+    }
+
+    /**
+     * @brief New side: take the traffic over.
+     *
+     * @note
+     * - The reuseport group holds the old sockets at indexes [0, k) and ours at [k, k + n),
+     *   the steering program returns k + random % n. Indexes beyond the group (a listener not
+     *   bound yet, or after the old ones left) make the kernel fall back to its hash
+     * - The received descriptors are closed right away, the old sockets must disappear when the
+     *   old process exits
+     * - The program is detached once the old process closed the handoff connection
+     */
+    void listener_handoff::complete(unsigned int new_listeners)
+    {
+        if (inherited.empty())
+            return;
+
+        std::uint32_t old_count = static_cast<std::uint32_t>(inherited.size());
+        sock_filter code[] = {
+            {BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<std::uint32_t>(SKF_AD_OFF + SKF_AD_RANDOM)},
+            {BPF_ALU | BPF_MOD | BPF_K, 0, 0, new_listeners > 0 ? new_listeners : 1u},
+            {BPF_ALU | BPF_ADD | BPF_K, 0, 0, old_count},
+            {BPF_RET | BPF_A, 0, 0, 0},
+        };
+        sock_fprog program{static_cast<unsigned short>(sizeof(code) / sizeof(code[0])), code};
+        if (setsockopt(inherited[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0)
+            logger::error("Failed to steer connections to the new listeners: " + std::string(std::strerror(errno)));
+
+        for (int fd : inherited)
+            ::close(fd);
+        inherited.clear();
+
+        if (send(connection, &HANDOFF_READY, 1, MSG_NOSIGNAL) != 1)
+            logger::error("Failed to notify the old process: " + std::string(std::strerror(errno)));
+
+        running.store(true);
+        worker = std::thread([this]()
+                             {
+                                 char byte;
+                                 while (running.load())
+                                 {
+                                     pollfd ready{connection, POLLIN, 0};
+                                     if (poll(&ready, 1, 200) <= 0)
+                                         continue;
+                                     ssize_t received = recv(connection, &byte, 1, MSG_DONTWAIT);
+                                     if (received > 0 || (received < 0 && (errno == EAGAIN || errno == EINTR)))
+                                         continue;
+
+                                     // old process exited, balance over our own listeners again
+                                     std::vector<int> own = find_listeners(port);
+                                     int unused = 0;
+                                     if (!own.empty())
+                                         setsockopt(own[0], SOL_SOCKET, SO_DETACH_REUSEPORT_BPF, &unused, sizeof(unused));
+                                     logger::info("Previous process exited, hot restart finished");
+                                     break;
+                                 } });
+    }
+
+    void listener_handoff::close()
+    {
+        running.store(false);
+        if (worker.joinable() && worker.get_id() != std::this_thread::get_id())
+            worker.join();
+
+        if (handoff_listener >= 0)
+        {
+            ::close(handoff_listener);
+            handoff_listener = -1;
+            ::unlink(path.c_str());
+        }
+        if (connection >= 0)
+        {
+            ::close(connection);
+            connection = -1;
+        }
+        for (int fd : inherited)
+            ::close(fd);
+        inherited.clear();
+    }
+}
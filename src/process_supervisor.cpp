@@ -0,0 +1,200 @@
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../includes/logger.hpp"
+#include "../includes/process_supervisor.hpp"
+
+namespace hh_web
+{
+    /// Workers restarted sooner than this after their start are considered crash-looping
+    static const std::chrono::seconds MIN_WORKER_UPTIME(1);
+
+    process_supervisor::process_supervisor(unsigned int worker_count, worker_main_t worker_main, std::chrono::milliseconds drain_timeout)
+        : worker_count(worker_count > 0 ? worker_count : 1), worker_main(std::move(worker_main)), drain_timeout(drain_timeout), slots(this->worker_count)
+    {
+    }
+
+    /**
+     * @brief Fork a worker into a slot.
+     *
+     * @note
+     * - The child restores the signal mask the process had before run() blocked the supervisor signals
+     * - The child runs worker_main and leaves with _exit so the master's atexit handlers never run twice
+     */
+    pid_t process_supervisor::spawn(unsigned int slot)
+    {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            logger::error("Failed to fork worker process: " + std::string(std::strerror(errno)));
+            return -1;
+        }
+
+        if (pid == 0)
+        {
+            sigprocmask(SIG_SETMASK, &original_mask, nullptr);
+
+            int code = 1;
+            try
+            {
+                code = worker_main(slot);
+            }
+            catch (const std::exception &e)
+            {
+                logger::fatal("Worker process " + std::to_string(slot) + " failed: " + e.what());
+            }
+            std::cout.flush();
+            _exit(code);
+        }
+
+        slots[slot].pid = pid;
+        slots[slot].started = std::chrono::steady_clock::now();
+        slots[slot].retiring = false;
+        logger::info("Started worker process " + std::to_string(pid) + " in slot " + std::to_string(slot));
+        return pid;
+    }
+
+    /**
+     * @brief Reap exited workers.
+     *
+     * @note
+     * - Workers that exited on their own are restarted in the same slot unless shutting down
+     * - A worker that died within MIN_WORKER_UPTIME of its start is restarted after a back-off
+     */
+    void process_supervisor::reap()
+    {
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            for (unsigned int slot = 0; slot < slots.size(); ++slot)
+            {
+                if (slots[slot].pid != pid)
+                    continue;
+
+                slots[slot].pid = -1;
+                if (slots[slot].retiring || shutting_down)
+                    break;
+
+                logger::error("Worker process " + std::to_string(pid) + " exited unexpectedly (status " + std::to_string(status) + "), restarting");
+                if (std::chrono::steady_clock::now() - slots[slot].started < MIN_WORKER_UPTIME)
+                    std::this_thread::sleep_for(MIN_WORKER_UPTIME);
+                spawn(slot);
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief Ask a worker to stop and wait for it.
+     *
+     * @note
+     * - SIGTERM makes the worker drain its in-flight requests for up to drain_timeout
+     * - If it is still alive one second after that, it gets SIGKILL
+     */
+    void process_supervisor::retire(pid_t pid)
+    {
+        if (pid <= 0)
+            return;
+
+        kill(pid, SIGTERM);
+        auto deadline = std::chrono::steady_clock::now() + drain_timeout + std::chrono::seconds(1);
+        int status = 0;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            pid_t result = waitpid(pid, &status, WNOHANG);
+            if (result == pid || (result < 0 && errno == ECHILD))
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+
+        logger::error("Worker process " + std::to_string(pid) + " did not drain in time, killing it");
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+
+    /**
+     * @brief Rolling reload.
+     *
+     * @note
+     * - One slot at a time: fork the replacement first, then retire the old worker,
+     *   so the number of serving workers never drops below worker_count
+     * - The old pid leaves the slot table when the replacement is spawned, so reap() never restarts it
+     */
+    void process_supervisor::rolling_reload()
+    {
+        logger::info("Rolling reload of " + std::to_string(slots.size()) + " worker processes");
+        for (unsigned int slot = 0; slot < slots.size() && !shutting_down; ++slot)
+        {
+            pid_t old_pid = slots[slot].pid;
+            spawn(slot);
+            retire(old_pid);
+        }
+    }
+
+    void process_supervisor::shutdown()
+    {
+        shutting_down = true;
+        for (auto &slot : slots)
+        {
+            slot.retiring = true;
+            if (slot.pid > 0)
+                kill(slot.pid, SIGTERM);
+        }
+        for (auto &slot : slots)
+        {
+            retire(slot.pid);
+            slot.pid = -1;
+        }
+    }
+
+    /**
+     * @brief Master loop.
+     *
+     * @note
+     * - The supervisor signals are blocked and consumed synchronously with sigtimedwait,
+     *   so no async signal handler is involved
+     */
+    int process_supervisor::run()
+    {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGCHLD);
+        sigaddset(&set, SIGHUP);
+        sigaddset(&set, SIGTERM);
+        sigaddset(&set, SIGINT);
+        sigprocmask(SIG_BLOCK, &set, &original_mask);
+
+        for (unsigned int slot = 0; slot < slots.size(); ++slot)
+            spawn(slot);
+
+        while (!shutting_down)
+        {
+            timespec timeout{1, 0};
+            int sig = sigtimedwait(&set, nullptr, &timeout);
+            if (sig == SIGCHLD || sig < 0)
+            {
+                // also reap on timeout, SIGCHLD is not queued and may coalesce
+                reap();
+            }
+            else if (sig == SIGHUP)
+            {
+                rolling_reload();
+            }
+            else if (sig == SIGTERM || sig == SIGINT)
+            {
+                shutdown();
+            }
+        }
+
+        sigprocmask(SIG_SETMASK, &original_mask, nullptr);
+        return 0;
+    }
+}
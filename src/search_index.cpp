@@ -0,0 +1,532 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+
+#include "../includes/search_index.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        constexpr std::uint32_t end_of_list = std::numeric_limits<std::uint32_t>::max();
+
+        bool is_term_byte(unsigned char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+        }
+
+        void write_varint(std::vector<std::uint8_t> &out, std::uint32_t value)
+        {
+            while (value >= 0x80)
+            {
+                out.push_back(static_cast<std::uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<std::uint8_t>(value));
+        }
+
+        std::uint32_t read_varint(const std::uint8_t *&p)
+        {
+            std::uint32_t value = *p & 0x7F;
+            for (int shift = 7; *p++ & 0x80; shift += 7)
+                value |= static_cast<std::uint32_t>(*p & 0x7F) << shift;
+            return value;
+        }
+
+        /// BM25's term frequency part; grows with frequency and shrinks with length
+        double frequency_part(std::uint32_t frequency, std::uint32_t length, double average_length)
+        {
+            double f = frequency;
+            return f * (search_index::k1 + 1) / (f + search_index::k1 * (1 - search_index::b + search_index::b * length / average_length));
+        }
+    }
+
+    double search_index::block_bound(const block &entry, double average_length)
+    {
+        double bound = 0;
+        for (std::uint32_t i = 0; i < entry.point_count; ++i)
+            bound = std::max(bound, frequency_part(entry.points[i].frequency, entry.points[i].length, average_length));
+        return bound;
+    }
+
+    void search_index::add_bound(block &entry, std::uint32_t frequency, std::uint32_t length)
+    {
+        // points stay sorted by ascending frequency and so by ascending length, none dominating another
+        bound_point *points = entry.points;
+        std::uint32_t count = entry.point_count;
+        for (std::uint32_t i = 0; i < count; ++i)
+        {
+            if (points[i].frequency >= frequency && points[i].length <= length)
+                return;
+        }
+        std::uint32_t kept = 0;
+        for (std::uint32_t i = 0; i < count; ++i)
+        {
+            if (!(frequency >= points[i].frequency && length <= points[i].length))
+                points[kept++] = points[i];
+        }
+        std::uint32_t at = kept;
+        while (at > 0 && points[at - 1].frequency > frequency)
+            --at;
+        if (kept == max_bound_points)
+        {
+            // merge the new point with a neighbour into one bounding both
+            std::uint32_t other = at < kept ? at : at - 1;
+            points[other].frequency = std::max(points[other].frequency, frequency);
+            points[other].length = std::min(points[other].length, length);
+            // the merged point may now dominate its neighbours
+            std::uint32_t merged = 0;
+            bound_point widened = points[other];
+            for (std::uint32_t i = 0; i < kept; ++i)
+            {
+                if (i == other || !(widened.frequency >= points[i].frequency && widened.length <= points[i].length))
+                    points[merged++] = points[i];
+            }
+            entry.point_count = merged;
+            return;
+        }
+        for (std::uint32_t i = kept; i > at; --i)
+            points[i] = points[i - 1];
+        points[at] = bound_point{frequency, length};
+        entry.point_count = kept + 1;
+    }
+
+    class search_index::cursor
+    {
+    private:
+        const posting_list *list;
+
+        /// Block of the current posting, decoded when its postings are first looked at
+        std::size_t block_index = 0;
+        std::size_t position = 0;
+        std::size_t length = 0;
+        bool decoded = false;
+
+        /// Block last found by shallow(), never before one that was skipped, and its bound
+        std::size_t shallow_index = 0;
+        double shallow_bound = -1;
+
+        std::uint32_t docs[block_size];
+        std::uint32_t frequencies[block_size];
+
+        void enter(std::size_t index)
+        {
+            block_index = index;
+            position = 0;
+            decoded = false;
+            bound = index < list->blocks.size() ? idf * block_bound(list->blocks[index], average_length) : 0;
+        }
+
+        void decode()
+        {
+            const block &current = list->blocks[block_index];
+            length = block_index + 1 < list->blocks.size() ? block_size : list->count - block_index * block_size;
+            const std::uint8_t *p = list->data.data() + current.offset;
+            std::uint32_t doc = block_index == 0 ? 0 : list->blocks[block_index - 1].last_doc;
+            for (std::size_t i = 0; i < length; ++i)
+            {
+                doc += read_varint(p);
+                docs[i] = doc;
+                frequencies[i] = read_varint(p);
+            }
+            decoded = true;
+        }
+
+    public:
+        double idf;
+        double average_length;
+
+        /// Best score a document of the current block can get from this term
+        double bound = 0;
+
+        /// Best score any document can get from this term
+        double upper_bound = 0;
+
+        cursor(const posting_list &list, double idf, double average_length) : list(&list), idf(idf), average_length(average_length)
+        {
+            for (const block &entry : list.blocks)
+                upper_bound = std::max(upper_bound, idf * block_bound(entry, average_length));
+            enter(0);
+        }
+
+        std::uint32_t doc()
+        {
+            if (block_index >= list->blocks.size())
+                return end_of_list;
+            if (!decoded)
+                decode();
+            return docs[position];
+        }
+
+        /// No more than doc(), without decoding: the current block cannot start before the last one ended
+        std::uint32_t lower_doc() const
+        {
+            if (block_index >= list->blocks.size())
+                return end_of_list;
+            if (decoded)
+                return docs[position];
+            return block_index == 0 ? 0 : list->blocks[block_index - 1].last_doc + 1;
+        }
+
+        std::uint32_t frequency() const
+        {
+            return frequencies[position];
+        }
+
+        void next()
+        {
+            if (++position == length)
+                enter(block_index + 1);
+        }
+
+        /// Move to the first document at or after target, blocks before it are passed undecoded
+        void seek(std::uint32_t target)
+        {
+            if (block_index >= list->blocks.size())
+                return;
+            if (list->blocks[block_index].last_doc < target)
+            {
+                // targets only grow, blocks shallow() went past end before any later target
+                std::size_t index = std::max(block_index + 1, shallow_index);
+                while (index < list->blocks.size() && list->blocks[index].last_doc < target)
+                    ++index;
+                enter(index);
+                // every document of the block is past the previous one's last, no need to decode it yet
+                if (index >= list->blocks.size() || list->blocks[index - 1].last_doc + 1 >= target)
+                    return;
+            }
+            if (!decoded)
+                decode();
+            while (docs[position] < target)
+                ++position;
+        }
+
+        /**
+         * @brief Find the block that holds target if this term has it, without decoding anything.
+         * @param target Document looked for, never less than in earlier calls
+         * @param score Receives the block's bound, 0 past the end of the list
+         * @return Last document of the block, end_of_list past the end
+         */
+        std::uint32_t shallow(std::uint32_t target, double &score)
+        {
+            std::size_t index = std::max(block_index, shallow_index);
+            while (index < list->blocks.size() && list->blocks[index].last_doc < target)
+                ++index;
+            if (index >= list->blocks.size())
+            {
+                shallow_index = index;
+                score = 0;
+                return end_of_list;
+            }
+            if (index != shallow_index || shallow_bound < 0)
+            {
+                shallow_index = index;
+                shallow_bound = index == block_index ? bound : idf * block_bound(list->blocks[index], average_length);
+            }
+            score = shallow_bound;
+            return list->blocks[index].last_doc;
+        }
+    };
+
+    void search_index::tokenize(std::string_view text, std::vector<std::string> &out)
+    {
+        std::size_t i = 0;
+        while (i < text.size())
+        {
+            while (i < text.size() && !is_term_byte(static_cast<unsigned char>(text[i])))
+                ++i;
+            if (i == text.size())
+                break;
+            std::string term;
+            for (; i < text.size() && is_term_byte(static_cast<unsigned char>(text[i])); ++i)
+            {
+                char c = text[i];
+                if (term.size() < max_term_length)
+                    term.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c);
+            }
+            out.push_back(std::move(term));
+        }
+    }
+
+    void search_index::append(posting_list &list, std::uint32_t slot, std::uint32_t frequency, std::uint32_t length)
+    {
+        std::uint32_t previous;
+        if (list.count % block_size == 0)
+        {
+            previous = list.blocks.empty() ? 0 : list.blocks.back().last_doc;
+            block entry;
+            entry.offset = static_cast<std::uint32_t>(list.data.size());
+            list.blocks.push_back(entry);
+        }
+        else
+        {
+            previous = list.blocks.back().last_doc;
+        }
+        block &current = list.blocks.back();
+        current.last_doc = slot;
+        add_bound(current, frequency, length);
+        write_varint(list.data, slot - previous);
+        write_varint(list.data, frequency);
+        list.count++;
+    }
+
+    void search_index::rebuild_list(posting_list &list, const std::vector<std::uint32_t> *renumbered)
+    {
+        posting_list rebuilt;
+        rebuilt.data.reserve(list.data.size() - list.data.size() * list.dead / std::max<std::uint32_t>(list.count, 1));
+        const std::uint8_t *p = list.data.data();
+        std::uint32_t doc = 0;
+        for (std::uint32_t i = 0; i < list.count; ++i)
+        {
+            // gaps restart from the previous block's last document, which is where the last one ended
+            doc += read_varint(p);
+            std::uint32_t frequency = read_varint(p);
+            if (slot_alive[doc])
+                append(rebuilt, renumbered ? (*renumbered)[doc] : doc, frequency, slot_lengths[doc]);
+        }
+        list = std::move(rebuilt);
+    }
+
+    void search_index::compact()
+    {
+        std::vector<std::uint32_t> renumbered(slot_ids.size(), end_of_list);
+        std::vector<std::int64_t> ids;
+        std::vector<std::uint32_t> lengths;
+        ids.reserve(documents.size());
+        lengths.reserve(documents.size());
+        for (std::uint32_t slot = 0; slot < slot_ids.size(); ++slot)
+        {
+            if (!slot_alive[slot])
+                continue;
+            renumbered[slot] = static_cast<std::uint32_t>(ids.size());
+            ids.push_back(slot_ids[slot]);
+            lengths.push_back(slot_lengths[slot]);
+        }
+        for (posting_list &list : lists)
+            rebuild_list(list, &renumbered);
+        for (auto &[id, entry] : documents)
+            entry.slot = renumbered[entry.slot];
+
+        slot_ids = std::move(ids);
+        slot_lengths = std::move(lengths);
+        slot_alive.assign(slot_ids.size(), 1);
+    }
+
+    bool search_index::remove_locked(std::int64_t id)
+    {
+        auto it = documents.find(id);
+        if (it == documents.end())
+            return false;
+
+        std::uint32_t slot = it->second.slot;
+        slot_alive[slot] = 0;
+        total_length -= slot_lengths[slot];
+        for (std::uint32_t term : it->second.terms)
+        {
+            posting_list &list = lists[term];
+            // rebuilt once half dead: each rebuild is paid for by the removals since the last one
+            if (++list.dead * 2 > list.count)
+                rebuild_list(list, nullptr);
+        }
+        documents.erase(it);
+
+        // same for slots, which every replacement uses up
+        if (slot_ids.size() > 1024 && slot_ids.size() > documents.size() * 2)
+            compact();
+        return true;
+    }
+
+    void search_index::put_locked(std::int64_t id, std::initializer_list<search_field> fields)
+    {
+        remove_locked(id);
+
+        // term IDs with their weighted frequencies
+        std::vector<std::string> words;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> counts;
+        std::uint32_t length = 0;
+        for (const search_field &field : fields)
+        {
+            words.clear();
+            tokenize(field.text, words);
+            for (std::string &word : words)
+            {
+                auto [entry, added] = dictionary.try_emplace(std::move(word), static_cast<std::uint32_t>(lists.size()));
+                if (added)
+                    lists.emplace_back();
+                counts.emplace_back(entry->second, field.weight);
+                length += field.weight;
+            }
+        }
+        std::sort(counts.begin(), counts.end());
+
+        std::uint32_t slot = static_cast<std::uint32_t>(slot_ids.size());
+        slot_ids.push_back(id);
+        slot_lengths.push_back(length);
+        slot_alive.push_back(1);
+        total_length += length;
+
+        document entry{slot, {}};
+        for (std::size_t i = 0; i < counts.size();)
+        {
+            std::uint32_t term = counts[i].first;
+            std::uint32_t frequency = 0;
+            for (; i < counts.size() && counts[i].first == term; ++i)
+                frequency += counts[i].second;
+            append(lists[term], slot, frequency, length);
+            entry.terms.push_back(term);
+        }
+        documents.emplace(id, std::move(entry));
+    }
+
+    std::vector<search_hit> search_index::search(std::string_view query, std::size_t limit) const
+    {
+        std::vector<std::string> words;
+        tokenize(query, words);
+        std::sort(words.begin(), words.end());
+        words.erase(std::unique(words.begin(), words.end()), words.end());
+
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (documents.empty() || limit == 0)
+            return {};
+
+        double count = static_cast<double>(documents.size());
+        double average_length = std::max(1.0, static_cast<double>(total_length) / count);
+        std::vector<cursor> cursors;
+        cursors.reserve(words.size());
+        for (const std::string &word : words)
+        {
+            auto it = dictionary.find(word);
+            if (it == dictionary.end())
+                continue;
+            const posting_list &list = lists[it->second];
+            double live = list.count - list.dead;
+            if (live <= 0)
+                continue;
+            double idf = std::log(1 + (count - live + 0.5) / (live + 0.5));
+            cursors.emplace_back(list, idf, average_length);
+        }
+        if (cursors.empty())
+            return {};
+
+        // MaxScore: terms by ascending upper bound, prefix[i] is the most terms 0..i can add
+        std::sort(cursors.begin(), cursors.end(), [](const cursor &a, const cursor &c)
+                  { return a.upper_bound < c.upper_bound; });
+        std::vector<double> prefix(cursors.size()), block_bounds(cursors.size()), block_prefix(cursors.size());
+        double total_bound = 0;
+        for (std::size_t i = 0; i < cursors.size(); ++i)
+            prefix[i] = total_bound += cursors[i].upper_bound;
+
+        // the k best so far, the worst on top; a document has to beat it, ties keep the earlier one
+        using hit = std::pair<double, std::uint32_t>;
+        auto worse = [](const hit &a, const hit &c)
+        { return a.first > c.first || (a.first == c.first && a.second < c.second); };
+        std::priority_queue<hit, std::vector<hit>, decltype(worse)> best(worse);
+        auto threshold = [&best, limit]()
+        { return best.size() < limit ? -1.0 : best.top().first; };
+
+        // terms before essential cannot make a document a result on their own, they are only probed
+        std::size_t essential = 0;
+        std::uint32_t checked = 0;
+        for (;;)
+        {
+            double minimum = threshold();
+            while (essential < cursors.size() && prefix[essential] <= minimum)
+                ++essential;
+            if (essential == cursors.size())
+                break;
+
+            std::uint32_t doc = end_of_list;
+            for (std::size_t i = essential; i < cursors.size(); ++i)
+                doc = std::min(doc, cursors[i].lower_doc());
+            if (doc == end_of_list)
+                break;
+
+            if (minimum >= 0 && doc > checked)
+            {
+                // block-max: up to the first block end, no document scores more than the blocks' bounds
+                std::uint32_t last = end_of_list;
+                for (std::size_t i = 0; i < cursors.size(); ++i)
+                    last = std::min(last, cursors[i].shallow(doc, block_bounds[i]));
+                double bound = 0;
+                for (std::size_t i = 0; i < cursors.size(); ++i)
+                {
+                    // a term whose next document lies past the range adds nothing to it
+                    if (cursors[i].lower_doc() <= last)
+                        bound += block_bounds[i];
+                }
+                if (bound <= minimum)
+                {
+                    if (last == end_of_list)
+                        break;
+                    for (std::size_t i = essential; i < cursors.size(); ++i)
+                        cursors[i].seek(last + 1);
+                    continue;
+                }
+                // checked once per range, a threshold raised within it is used from the next one
+                checked = last;
+            }
+
+            doc = end_of_list;
+            for (std::size_t i = essential; i < cursors.size(); ++i)
+                doc = std::min(doc, cursors[i].doc());
+            if (doc == end_of_list)
+                break;
+
+            bool alive = slot_alive[doc];
+            std::uint32_t length = slot_lengths[doc];
+            double score = 0;
+            for (std::size_t i = essential; i < cursors.size(); ++i)
+            {
+                cursor &term = cursors[i];
+                if (term.doc() != doc)
+                    continue;
+                if (alive)
+                    score += term.idf * frequency_part(term.frequency(), length, average_length);
+                term.next();
+            }
+            if (!alive)
+                continue;
+
+            // what the other terms can add, from the blocks that would hold the document
+            double others = 0;
+            for (std::size_t i = 0; i < essential; ++i)
+            {
+                double bound;
+                cursors[i].shallow(doc, bound);
+                block_prefix[i] = others += bound;
+            }
+            for (std::size_t i = essential; i-- > 0;)
+            {
+                if (score + block_prefix[i] <= minimum)
+                    break;
+                cursor &term = cursors[i];
+                term.seek(doc);
+                if (term.doc() == doc)
+                    score += term.idf * frequency_part(term.frequency(), length, average_length);
+            }
+
+            if (best.size() < limit)
+                best.emplace(score, doc);
+            else if (score > minimum)
+            {
+                best.pop();
+                best.emplace(score, doc);
+            }
+        }
+
+        std::vector<search_hit> hits(best.size());
+        for (std::size_t i = hits.size(); i-- > 0; best.pop())
+            hits[i] = search_hit{slot_ids[best.top().second], best.top().first};
+        return hits;
+    }
+
+    std::size_t search_index::posting_bytes() const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        std::size_t bytes = 0;
+        for (const posting_list &list : lists)
+            bytes += list.data.size() + list.blocks.size() * sizeof(block);
+        return bytes;
+    }
+}
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <random>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <sys/random.h>
+#endif
+
+#include "../includes/session_store.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        /// Estimated bookkeeping of a session: the entry, its list node and its index node
+        constexpr std::size_t session_overhead = 192;
+
+        /// Estimated bookkeeping of one value: its map node
+        constexpr std::size_t value_overhead = 64;
+
+        std::chrono::milliseconds until(session_store::clock::time_point expires, session_store::clock::time_point now)
+        {
+            return std::chrono::ceil<std::chrono::milliseconds>(expires - now);
+        }
+
+        void secure_random(unsigned char *out, std::size_t size)
+        {
+#if defined(__linux__)
+            std::size_t filled = 0;
+            while (filled < size)
+            {
+                ssize_t got = getrandom(out + filled, size - filled, 0);
+                if (got > 0)
+                    filled += static_cast<std::size_t>(got);
+                else if (errno != EINTR)
+                    break;
+            }
+            if (filled == size)
+                return;
+#endif
+            std::random_device device;
+            for (std::size_t i = 0; i < size; ++i)
+                out[i] = static_cast<unsigned char>(device());
+        }
+    }
+
+    session_store::session_store(session_config config, timing_wheel *timers) : core(std::make_shared<state>())
+    {
+        config.shards = std::max(1u, config.shards);
+        core->shard_sessions = std::max<std::size_t>(1, config.max_sessions / config.shards);
+        core->shard_bytes = std::max<std::size_t>(1, config.max_bytes / config.shards);
+        core->timers = timers;
+        for (unsigned int i = 0; i < config.shards; ++i)
+            core->shards.push_back(std::make_unique<shard>());
+        core->config = std::move(config);
+    }
+
+    session_store::~session_store()
+    {
+        if (!core->timers)
+            return;
+        for (auto &part : core->shards)
+        {
+            std::lock_guard<std::mutex> lock(part->mutex);
+            for (const entry &session : part->lru)
+            {
+                if (session.timer)
+                    core->timers->cancel(session.timer);
+            }
+        }
+    }
+
+    std::string session_store::generate_id()
+    {
+        static const char digits[] = "0123456789abcdef";
+        unsigned char random[16];
+        secure_random(random, sizeof(random));
+
+        std::string id(sizeof(random) * 2, '0');
+        for (std::size_t i = 0; i < sizeof(random); ++i)
+        {
+            id[2 * i] = digits[random[i] >> 4];
+            id[2 * i + 1] = digits[random[i] & 0x0F];
+        }
+        return id;
+    }
+
+    std::size_t session_store::shard_of(const state &core, const std::string &id)
+    {
+        return std::hash<std::string>{}(id) % core.shards.size();
+    }
+
+    std::size_t session_store::estimate_bytes(const entry &session)
+    {
+        std::size_t bytes = session_overhead + session.id.size();
+        for (const auto &[key, value] : session.values)
+            bytes += value_overhead + key.size() + value.size();
+        return bytes;
+    }
+
+    void session_store::unlink(state &core, shard &part, std::list<entry>::iterator it)
+    {
+        if (core.timers && it->timer)
+            core.timers->cancel(it->timer);
+        part.bytes -= it->bytes;
+        part.index.erase(std::string_view(it->id));
+        part.lru.erase(it);
+    }
+
+    void session_store::enforce_limits(state &core, shard &part)
+    {
+        while (part.lru.size() > 1 && (part.lru.size() > core.shard_sessions || part.bytes > core.shard_bytes))
+        {
+            unlink(core, part, std::prev(part.lru.end()));
+            core.evicted.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    session_store::entry *session_store::use(state &core, shard &part, const std::string &id, clock::time_point now)
+    {
+        auto found = part.index.find(std::string_view(id));
+        if (found == part.index.end())
+            return nullptr;
+
+        auto it = found->second;
+        if (it->expires <= now)
+        {
+            unlink(core, part, it);
+            core.expired.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        // only the expiry moves, the timer finds out when it fires
+        it->expires = now + it->ttl;
+        part.lru.splice(part.lru.begin(), part.lru, it);
+        return &*it;
+    }
+
+    void session_store::arm(const std::shared_ptr<state> &core, std::size_t shard_index, entry &session, std::chrono::milliseconds delay)
+    {
+        if (!core->timers)
+            return;
+        std::weak_ptr<state> weak = core;
+        session.timer = core->timers->schedule(delay, [weak, shard_index, id = session.id]()
+                                               { on_timer(weak, shard_index, id); });
+    }
+
+    void session_store::on_timer(const std::weak_ptr<state> &weak, std::size_t shard_index, const std::string &id)
+    {
+        auto core = weak.lock();
+        if (!core)
+            return;
+
+        shard &part = *core->shards[shard_index];
+        std::lock_guard<std::mutex> lock(part.mutex);
+        auto found = part.index.find(std::string_view(id));
+        if (found == part.index.end())
+            return;
+
+        auto it = found->second;
+        it->timer = 0;
+        clock::time_point now = clock::now();
+        if (it->expires <= now)
+        {
+            unlink(*core, part, it);
+            core->expired.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // used since the timer was armed: one re-arm per TTL however often it was used
+        arm(core, shard_index, *it, until(it->expires, now));
+    }
+
+    std::string session_store::create(std::chrono::seconds ttl)
+    {
+        entry session;
+        session.id = generate_id();
+        session.ttl = ttl.count() > 0 ? ttl : core->config.ttl;
+        session.expires = clock::now() + session.ttl;
+        session.bytes = estimate_bytes(session);
+        std::string id = session.id;
+
+        std::size_t shard_index = shard_of(*core, id);
+        shard &part = *core->shards[shard_index];
+        std::lock_guard<std::mutex> lock(part.mutex);
+        part.lru.push_front(std::move(session));
+        auto it = part.lru.begin();
+        part.index.emplace(std::string_view(it->id), it);
+        part.bytes += it->bytes;
+        arm(core, shard_index, *it, it->ttl);
+        enforce_limits(*core, part);
+        return id;
+    }
+
+    bool session_store::touch(const std::string &id)
+    {
+        shard &part = *core->shards[shard_of(*core, id)];
+        std::lock_guard<std::mutex> lock(part.mutex);
+        return use(*core, part, id, clock::now()) != nullptr;
+    }
+
+    std::optional<std::string> session_store::get(const std::string &id, const std::string &key)
+    {
+        shard &part = *core->shards[shard_of(*core, id)];
+        std::lock_guard<std::mutex> lock(part.mutex);
+        entry *session = use(*core, part, id, clock::now());
+        if (!session)
+            return std::nullopt;
+        auto it = session->values.find(key);
+        if (it == session->values.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    std::optional<session_store::values_t> session_store::get_all(const std::string &id)
+    {
+        shard &part = *core->shards[shard_of(*core, id)];
+        std::lock_guard<std::mutex> lock(part.mutex);
+        entry *session = use(*core, part, id, clock::now());
+        if (!session)
+            return std::nullopt;
+        return session->values;
+    }
+
+    bool session_store::update(const std::string &id, const std::function<void(values_t &)> &change)
+    {
+        shard &part = *core->shards[shard_of(*core, id)];
+        std::lock_guard<std::mutex> lock(part.mutex);
+        entry *session = use(*core, part, id, clock::now());
+        if (!session)
+            return false;
+
+        change(session->values);
+        part.bytes -= session->bytes;
+        session->bytes = estimate_bytes(*session);
+        part.bytes += session->bytes;
+        // the session is at the front now, growing it evicts others
+        enforce_limits(*core, part);
+        return true;
+    }
+
+    bool session_store::set(const std::string &id, const std::string &key, std::string value)
+    {
+        return update(id, [&key, &value](values_t &values)
+                      { values[key] = std::move(value); });
+    }
+
+    bool session_store::erase(const std::string &id, const std::string &key)
+    {
+        bool erased = false;
+        bool found = update(id, [&key, &erased](values_t &values)
+                            { erased = values.erase(key) > 0; });
+        return found && erased;
+    }
+
+    bool session_store::set_ttl(const std::string &id, std::chrono::seconds ttl)
+    {
+        shard &part = *core->shards[shard_of(*core, id)];
+        std::lock_guard<std::mutex> lock(part.mutex);
+        clock::time_point now = clock::now();
+        entry *session = use(*core, part, id, now);
+        if (!session)
+            return false;
+
+        session->ttl = ttl;
+        session->expires = now + session->ttl;
+        // a timer firing late would keep the session past a shortened TTL; one that already fired re-arms itself
+        if (core->timers && session->timer)
+            core->timers->reset(session->timer, session->ttl);
+        return true;
+    }
+
+    bool session_store::destroy(const std::string &id)
+    {
+        shard &part = *core->shards[shard_of(*core, id)];
+        std::lock_guard<std::mutex> lock(part.mutex);
+        auto found = part.index.find(std::string_view(id));
+        if (found == part.index.end())
+            return false;
+        unlink(*core, part, found->second);
+        return true;
+    }
+
+    std::size_t session_store::size() const
+    {
+        std::size_t count = 0;
+        for (const auto &part : core->shards)
+        {
+            std::lock_guard<std::mutex> lock(part->mutex);
+            count += part->lru.size();
+        }
+        return count;
+    }
+
+    std::size_t session_store::bytes() const
+    {
+        std::size_t total = 0;
+        for (const auto &part : core->shards)
+        {
+            std::lock_guard<std::mutex> lock(part->mutex);
+            total += part->bytes;
+        }
+        return total;
+    }
+}
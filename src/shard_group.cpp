@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <exception>
+#include <string>
+
+#include "../includes/cpu_topology.hpp"
+#include "../includes/logger.hpp"
+#include "../includes/shard_group.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        /// Group and index of the shard the calling thread is, set by the shard threads
+        thread_local const shard_group *current_group = nullptr;
+        thread_local unsigned int current_index = shard_group::no_shard;
+    }
+
+    shard_group::shard_group(unsigned int count, bool start_now)
+    {
+        count = std::max(1u, count);
+        shards.reserve(count);
+        for (unsigned int i = 0; i < count; ++i)
+            shards.push_back(std::make_unique<shard>());
+        if (start_now)
+            start();
+    }
+
+    shard_group::~shard_group()
+    {
+        stop();
+    }
+
+    void shard_group::set_cpus(std::vector<int> cpu_list)
+    {
+        std::lock_guard<std::mutex> lock(start_mutex);
+        cpus = std::move(cpu_list);
+    }
+
+    void shard_group::start()
+    {
+        std::lock_guard<std::mutex> lock(start_mutex);
+        if (running.load())
+            return;
+        stopping.store(false);
+        // set before the threads exist: messages sent from now on are queued, not run inline
+        running.store(true);
+        for (unsigned int i = 0; i < shards.size(); ++i)
+        {
+            shards[i]->thread = std::thread([this, i]()
+                                            { run(i); });
+        }
+    }
+
+    void shard_group::stop()
+    {
+        std::lock_guard<std::mutex> lock(start_mutex);
+        if (!running.load())
+            return;
+        stopping.store(true);
+        for (auto &target : shards)
+        {
+            std::lock_guard<std::mutex> wake_lock(target->mutex);
+            target->wake.notify_one();
+        }
+        for (auto &target : shards)
+        {
+            if (target->thread.joinable())
+                target->thread.join();
+        }
+        running.store(false);
+    }
+
+    unsigned int shard_group::current_shard() const
+    {
+        return current_group == this ? current_index : no_shard;
+    }
+
+    bool shard_group::runs_here(unsigned int index) const
+    {
+        return !running.load(std::memory_order_acquire) || (current_group == this && current_index == index % shards.size());
+    }
+
+    void shard_group::post(unsigned int index, task_t task)
+    {
+        if (!running.load(std::memory_order_acquire))
+        {
+            try
+            {
+                task();
+            }
+            catch (const std::exception &e)
+            {
+                logger::error("Shard message failed: " + std::string(e.what()));
+            }
+            return;
+        }
+
+        shard &target = *shards[index % shards.size()];
+        target.inbox.push(std::move(task));
+        // pending before idle, the shard sets idle before checking pending: one of them sees the other
+        target.pending.fetch_add(1);
+        if (target.idle.load())
+        {
+            std::lock_guard<std::mutex> lock(target.mutex);
+            target.wake.notify_one();
+        }
+    }
+
+    void shard_group::run(unsigned int index)
+    {
+        current_group = this;
+        current_index = index;
+        if (!cpus.empty())
+            cpu_topology::pin_current_thread({cpus[index % cpus.size()]});
+
+        shard &self = *shards[index];
+        task_t task;
+        for (;;)
+        {
+            if (self.inbox.pop(task))
+            {
+                try
+                {
+                    task();
+                }
+                catch (const std::exception &e)
+                {
+                    logger::error("Shard message failed: " + std::string(e.what()));
+                }
+                task = nullptr;
+                self.pending.fetch_sub(1);
+                self.processed.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (self.pending.load() > 0)
+            {
+                // a producer is between pushing and linking its message, it is there in a moment
+                std::this_thread::yield();
+                continue;
+            }
+            if (stopping.load())
+                break;
+
+            std::unique_lock<std::mutex> lock(self.mutex);
+            self.idle.store(true);
+            self.wake.wait(lock, [this, &self]()
+                           { return self.pending.load() > 0 || stopping.load(); });
+            self.idle.store(false);
+        }
+
+        current_group = nullptr;
+        current_index = no_shard;
+    }
+}
@@ -0,0 +1,47 @@
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "../includes/logger.hpp"
+#include "../includes/socket_options.hpp"
+
+namespace hh_web
+{
+    static bool set_option(int fd, int level, int name, int value, const char *label)
+    {
+        if (setsockopt(fd, level, name, &value, sizeof(value)) == 0)
+            return true;
+
+        logger::error(std::string("Failed to set ") + label + " on socket " + std::to_string(fd) + ": " + std::strerror(errno));
+        return false;
+    }
+
+    /**
+     * Apply the set options
+     * - Each option is independent, one failing (e.g. SO_BUSY_POLL without CAP_NET_ADMIN above
+     *   the sysctl limit) does not prevent the others
+     */
+    bool socket_options::apply_to_listener(int fd) const
+    {
+        bool ok = true;
+        if (tcp_nodelay)
+            ok &= set_option(fd, IPPROTO_TCP, TCP_NODELAY, *tcp_nodelay ? 1 : 0, "TCP_NODELAY");
+        if (defer_accept_seconds)
+            ok &= set_option(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, *defer_accept_seconds, "TCP_DEFER_ACCEPT");
+        if (fastopen_queue_length)
+            ok &= set_option(fd, IPPROTO_TCP, TCP_FASTOPEN, *fastopen_queue_length, "TCP_FASTOPEN");
+        if (busy_poll_microseconds)
+            ok &= set_option(fd, SOL_SOCKET, SO_BUSY_POLL, *busy_poll_microseconds, "SO_BUSY_POLL");
+        if (receive_buffer_bytes)
+            ok &= set_option(fd, SOL_SOCKET, SO_RCVBUF, *receive_buffer_bytes, "SO_RCVBUF");
+        if (send_buffer_bytes)
+            ok &= set_option(fd, SOL_SOCKET, SO_SNDBUF, *send_buffer_bytes, "SO_SNDBUF");
+        if (incoming_cpu)
+            ok &= set_option(fd, SOL_SOCKET, SO_INCOMING_CPU, *incoming_cpu, "SO_INCOMING_CPU");
+        return ok;
+    }
+}
@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "../includes/web_batch.hpp"
+#include "../includes/web_utilities.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        /**
+         * Reads the parts of a batch body it is asked for. The body was validated before, so
+         * the reader only tracks positions; it still never reads past the end.
+         */
+        class batch_reader
+        {
+        private:
+            std::string_view text;
+            std::size_t position = 0;
+
+            static void append_utf8(std::string &out, std::uint32_t code)
+            {
+                if (code < 0x80)
+                {
+                    out.push_back(static_cast<char>(code));
+                }
+                else if (code < 0x800)
+                {
+                    out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                    out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                }
+                else if (code < 0x10000)
+                {
+                    out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                    out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                    out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                }
+                else
+                {
+                    out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+                    out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+                    out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                    out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                }
+            }
+
+            std::uint32_t hex4(std::size_t at) const
+            {
+                std::uint32_t code = 0;
+                for (std::size_t i = at; i < at + 4 && i < text.size(); ++i)
+                {
+                    char c = text[i];
+                    code = code * 16 + static_cast<std::uint32_t>(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+                }
+                return code;
+            }
+
+        public:
+            explicit batch_reader(std::string_view text) : text(text)
+            {
+            }
+
+            void skip_whitespace()
+            {
+                while (position < text.size() && (text[position] == ' ' || text[position] == '\n' || text[position] == '\r' || text[position] == '\t'))
+                    ++position;
+            }
+
+            char peek()
+            {
+                skip_whitespace();
+                return position < text.size() ? text[position] : '\0';
+            }
+
+            /// Consume c if it is next
+            bool take(char c)
+            {
+                if (peek() != c)
+                    return false;
+                ++position;
+                return true;
+            }
+
+            /// A string value, unescaped; position at its opening quote
+            std::string string()
+            {
+                std::string out;
+                ++position;
+                while (position < text.size() && text[position] != '"')
+                {
+                    char c = text[position++];
+                    if (c != '\\' || position >= text.size())
+                    {
+                        out.push_back(c);
+                        continue;
+                    }
+                    char escape = text[position++];
+                    switch (escape)
+                    {
+                    case 'b':
+                        out.push_back('\b');
+                        break;
+                    case 'f':
+                        out.push_back('\f');
+                        break;
+                    case 'n':
+                        out.push_back('\n');
+                        break;
+                    case 'r':
+                        out.push_back('\r');
+                        break;
+                    case 't':
+                        out.push_back('\t');
+                        break;
+                    case 'u':
+                    {
+                        std::uint32_t code = hex4(position);
+                        position += 4;
+                        if (code >= 0xD800 && code <= 0xDBFF && position + 6 <= text.size() && text.substr(position, 2) == "\\u")
+                        {
+                            std::uint32_t low = hex4(position + 2);
+                            if (low >= 0xDC00 && low <= 0xDFFF)
+                            {
+                                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                                position += 6;
+                            }
+                        }
+                        // a lone surrogate has no UTF-8 form
+                        append_utf8(out, code >= 0xD800 && code <= 0xDFFF ? 0xFFFD : code);
+                        break;
+                    }
+                    default:
+                        out.push_back(escape);
+                    }
+                }
+                ++position;
+                return out;
+            }
+
+            /// Skip a string, position at its opening quote
+            void skip_string()
+            {
+                for (++position; position < text.size() && text[position] != '"'; ++position)
+                {
+                    if (text[position] == '\\')
+                        ++position;
+                }
+                ++position;
+            }
+
+            /// Skip any value and return its JSON text
+            std::string_view value()
+            {
+                skip_whitespace();
+                std::size_t start = position;
+                if (position < text.size() && (text[position] == '{' || text[position] == '['))
+                {
+                    std::size_t depth = 0;
+                    do
+                    {
+                        char c = text[position];
+                        if (c == '"')
+                        {
+                            skip_string();
+                            continue;
+                        }
+                        if (c == '{' || c == '[')
+                            ++depth;
+                        else if (c == '}' || c == ']')
+                            --depth;
+                        ++position;
+                    } while (depth > 0 && position < text.size());
+                }
+                else if (position < text.size() && text[position] == '"')
+                {
+                    skip_string();
+                }
+                else
+                {
+                    while (position < text.size() && text[position] != ',' && text[position] != '}' && text[position] != ']' &&
+                           text[position] != ' ' && text[position] != '\n' && text[position] != '\r' && text[position] != '\t')
+                        ++position;
+                }
+                return text.substr(start, std::min(position, text.size()) - start);
+            }
+
+            /// Call member(name) for each member of the object that is next, which consumes the value
+            template <typename F>
+            bool object(F &&member)
+            {
+                if (!take('{'))
+                    return false;
+                if (take('}'))
+                    return true;
+                do
+                {
+                    if (peek() != '"')
+                        return false;
+                    std::string name = string();
+                    take(':');
+                    if (!member(name))
+                        return false;
+                } while (take(','));
+                return take('}');
+            }
+        };
+
+        web_error entry_error(std::size_t index, const std::string &message)
+        {
+            return web_error::bad_request("Batch request " + std::to_string(index) + ": " + message);
+        }
+
+        bool is_json_type(const std::string &content_type)
+        {
+            return content_type.find("json") != std::string::npos;
+        }
+    }
+
+    web_expected<std::vector<batch_request>> parse_batch(std::string_view body, std::size_t max_requests)
+    {
+        batch_reader reader(body);
+        if (reader.peek() == '{')
+        {
+            bool found = false;
+            bool ok = reader.object([&reader, &found](const std::string &name)
+                                    {
+                                        if (name == "requests" && reader.peek() == '[')
+                                        {
+                                            found = true;
+                                            return false; // stop at the array
+                                        }
+                                        reader.value();
+                                        return true; });
+            if (!found)
+                return web_error::bad_request(ok ? "Batch body has no \"requests\" array" : "Malformed batch body");
+        }
+        if (!reader.take('['))
+            return web_error::bad_request("Batch body must be an array of requests or {\"requests\": [...]}");
+
+        std::vector<batch_request> requests;
+        if (reader.take(']'))
+            return requests;
+        do
+        {
+            std::size_t index = requests.size();
+            if (index == max_requests)
+                return web_error(413, "Payload Too Large", "Batch holds more than " + std::to_string(max_requests) + " requests");
+
+            batch_request entry;
+            std::string problem;
+            bool ok = reader.object([&reader, &entry, &problem](const std::string &name)
+                                    {
+                                        char next = reader.peek();
+                                        if (name == "method" || name == "path")
+                                        {
+                                            if (next != '"')
+                                            {
+                                                problem = "\"" + name + "\" must be a string";
+                                                return false;
+                                            }
+                                            (name == "method" ? entry.method : entry.uri) = reader.string();
+                                        }
+                                        else if (name == "headers")
+                                        {
+                                            bool headers_ok = reader.object([&reader, &entry](const std::string &header)
+                                                                            {
+                                                                                if (reader.peek() != '"')
+                                                                                    return false;
+                                                                                entry.headers.emplace_back(header, reader.string());
+                                                                                return true; });
+                                            if (!headers_ok)
+                                            {
+                                                problem = "\"headers\" must be an object of strings";
+                                                return false;
+                                            }
+                                        }
+                                        else if (name == "body" && next == '"')
+                                        {
+                                            entry.body = reader.string();
+                                        }
+                                        else if (name == "body" && next != 'n')
+                                        {
+                                            entry.body = std::string(reader.value());
+                                        }
+                                        else
+                                        {
+                                            reader.value();
+                                        }
+                                        return true; });
+            if (!ok)
+                return entry_error(index, problem.empty() ? "must be an object" : problem);
+            if (entry.uri.empty() || entry.uri[0] != '/')
+                return entry_error(index, "\"path\" must start with /");
+            if (unknown_method(entry.method))
+                return entry_error(index, "unknown method " + entry.method);
+            requests.push_back(std::move(entry));
+        } while (reader.take(','));
+
+        if (!reader.take(']'))
+            return web_error::bad_request("Malformed batch body");
+        return requests;
+    }
+
+    void write_batch_responses(json_writer &json, const std::vector<synthetic_response> &responses)
+    {
+        json.begin_object();
+        json.key("responses").begin_array();
+        for (const synthetic_response &response : responses)
+        {
+            std::string_view body = response.canned ? response.canned->get_body() : std::string_view(response.body);
+            std::string content_type;
+
+            json.begin_object();
+            json.member("status", response.status);
+            json.key("headers").begin_object();
+            auto write_header = [&json, &content_type](const std::pair<std::string, std::string> &header)
+            {
+                if (detail::iequals(header.first, "content-length") || detail::iequals(header.first, "connection"))
+                    return;
+                if (detail::iequals(header.first, "content-type"))
+                    content_type = header.second;
+                json.member(header.first, header.second);
+            };
+            for (const auto &header : response.headers)
+                write_header(header);
+            if (response.canned)
+            {
+                for (const auto &header : response.canned->get_headers())
+                    write_header(header);
+            }
+            json.end_object();
+
+            json.key("body");
+            if (body.empty())
+                json.null();
+            else if (is_json_type(content_type) && validate_json(body))
+                json.raw(body);
+            else
+                json.value(body);
+            json.end_object();
+        }
+        json.end_array();
+        json.end_object();
+    }
+}
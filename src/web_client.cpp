@@ -0,0 +1,1415 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "../includes/logger.hpp"
+#include "../includes/http2_frame.hpp"
+#include "../includes/thread_pool.hpp"
+#include "../includes/web_client.hpp"
+#include "../includes/web_utilities.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        constexpr int MAX_EVENTS = 256;
+        constexpr std::size_t READ_BUFFER_SIZE = 65536;
+        constexpr std::size_t MAX_HEADER_SIZE = 65536;
+
+        /// epoll data of the eventfd, connection ids start at 1
+        constexpr std::uint64_t WAKE_ID = 0;
+
+        /// Receive windows advertised to HTTP/2 servers
+        constexpr std::uint32_t STREAM_WINDOW = 1u << 20;
+        constexpr std::uint32_t CONNECTION_WINDOW = 1u << 24;
+
+        /// Methods that may be pipelined and retried (RFC 9110 section 9.2.2)
+        bool is_idempotent(const std::string &method)
+        {
+            return method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" ||
+                   method == "OPTIONS" || method == "TRACE";
+        }
+
+        /**
+         * @brief Split an http:// URL.
+         * @return false for other schemes or a missing host
+         */
+        bool parse_url(const std::string &url, std::string &host, std::string &port, std::string &path)
+        {
+            const std::string scheme = "http://";
+            if (url.size() <= scheme.size() || lowercase(url.substr(0, scheme.size())) != scheme)
+                return false;
+
+            std::size_t authority_end = url.find_first_of("/?#", scheme.size());
+            std::string authority = url.substr(scheme.size(), authority_end == std::string::npos ? std::string::npos : authority_end - scheme.size());
+            path = authority_end == std::string::npos ? "/" : url.substr(authority_end);
+            std::size_t fragment = path.find('#');
+            if (fragment != std::string::npos)
+                path.erase(fragment);
+            if (path.empty() || path[0] != '/')
+                path.insert(0, "/");
+
+            port = "80";
+            std::size_t colon = authority.rfind(':');
+            if (!authority.empty() && authority[0] == '[')
+            {
+                // [v6 address]:port
+                std::size_t bracket = authority.find(']');
+                if (bracket == std::string::npos)
+                    return false;
+                host = authority.substr(1, bracket - 1);
+                if (bracket + 1 < authority.size() && authority[bracket + 1] == ':')
+                    port = authority.substr(bracket + 2);
+            }
+            else if (colon != std::string::npos)
+            {
+                host = authority.substr(0, colon);
+                port = authority.substr(colon + 1);
+            }
+            else
+            {
+                host = authority;
+            }
+            return !host.empty() && !port.empty() && port.find_first_not_of("0123456789") == std::string::npos;
+        }
+
+        /// Value of the Host header / :authority, the default port is left out
+        std::string authority_of(const std::string &host, const std::string &port)
+        {
+            std::string name = host.find(':') != std::string::npos ? "[" + host + "]" : host;
+            return port == "80" ? name : name + ":" + port;
+        }
+    }
+
+    std::string client_response::get_header(const std::string &name) const
+    {
+        std::string wanted = lowercase(name);
+        for (const auto &header : headers)
+        {
+            if (lowercase(header.first) == wanted)
+                return header.second;
+        }
+        return "";
+    }
+
+    web_client::web_client(const web_client_config &config) : config(config)
+    {
+    }
+
+    web_client::~web_client()
+    {
+        stop();
+        if (event_fd >= 0)
+            close(event_fd);
+    }
+
+    bool web_client::start()
+    {
+        if (running.load())
+            return true;
+
+        if (event_fd < 0)
+            event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (event_fd < 0 || epoll_fd < 0)
+        {
+            logger::error("HTTP client: cannot create the event loop: " + std::string(std::strerror(errno)));
+            if (epoll_fd >= 0)
+                close(epoll_fd);
+            epoll_fd = -1;
+            return false;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = WAKE_ID;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event);
+
+        running.store(true);
+        loop = std::thread([this]()
+                           { run(); });
+        return true;
+    }
+
+    /**
+     * Shutdown
+     * - The loop is joined first, everything below runs on the stopping thread alone
+     * - Requests in flight, waiting in a pool or still in the submission queue all get
+     *   their callback, so no future is left hanging
+     */
+    void web_client::stop()
+    {
+        if (!running.exchange(false))
+            return;
+
+        std::uint64_t one = 1;
+        if (write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            logger::error("HTTP client: failed to wake the loop: " + std::string(std::strerror(errno)));
+        if (loop.joinable())
+            loop.join();
+
+        for (auto &entry : connections)
+            close(entry.second.fd);
+        connections.clear();
+        pools.clear();
+
+        std::vector<std::uint64_t> ids;
+        for (const auto &entry : exchanges)
+            ids.push_back(entry.first);
+        for (std::uint64_t id : ids)
+            fail(id, "client stopped");
+
+        submission item;
+        while (submissions.pop(item))
+        {
+            client_response response;
+            response.error = "client stopped";
+            deliver(item.callback, std::move(response));
+        }
+
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+
+    void web_client::request(client_request request, response_callback callback)
+    {
+        if (!running.load())
+        {
+            client_response response;
+            response.error = "client not running";
+            deliver(callback, std::move(response));
+            return;
+        }
+
+        // same wakeup protocol as http2_listener::post
+        submissions.push(submission{std::move(request), std::move(callback)});
+        if (!signalled.exchange(true))
+        {
+            std::uint64_t one = 1;
+            if (write(event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+                logger::error("HTTP client: failed to wake the loop: " + std::string(std::strerror(errno)));
+        }
+    }
+
+    std::future<client_response> web_client::request(client_request request)
+    {
+        auto promise = std::make_shared<std::promise<client_response>>();
+        std::future<client_response> result = promise->get_future();
+        this->request(std::move(request), [promise](client_response &&response)
+                      { promise->set_value(std::move(response)); });
+        return result;
+    }
+
+    client_response web_client::request_and_wait(client_request request)
+    {
+        std::future<client_response> result = this->request(std::move(request));
+        if (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            thread_pool::blocking_scope blocking;
+            result.wait();
+        }
+        return result.get();
+    }
+
+    std::future<client_response> web_client::get(const std::string &url)
+    {
+        client_request request;
+        request.url = url;
+        return this->request(std::move(request));
+    }
+
+    std::future<client_response> web_client::post(const std::string &url, const std::string &body, const std::string &content_type)
+    {
+        client_request request;
+        request.method = "POST";
+        request.url = url;
+        request.headers = {{"Content-Type", content_type}};
+        request.body = body;
+        return this->request(std::move(request));
+    }
+
+    void web_client::run()
+    {
+        epoll_event events[MAX_EVENTS];
+
+        while (running.load())
+        {
+            // armed timers need the wheel's resolution, otherwise the loop only waits for events
+            int wait = timers.size() > 0 ? 10 : 1000;
+            int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, wait);
+            if (ready < 0 && errno != EINTR)
+            {
+                logger::error("HTTP client: epoll_wait failed: " + std::string(std::strerror(errno)));
+                break;
+            }
+
+            for (int i = 0; i < ready; ++i)
+            {
+                if (events[i].data.u64 == WAKE_ID)
+                {
+                    std::uint64_t count = 0;
+                    if (read(event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                        logger::error("HTTP client: eventfd read failed: " + std::string(std::strerror(errno)));
+                    continue;
+                }
+                handle_event(events[i].data.u64, events[i].events);
+            }
+
+            // the flag is cleared before draining so a concurrent request signals again
+            signalled.store(false);
+            drain_submissions();
+            timers.advance();
+        }
+    }
+
+    void web_client::drain_submissions()
+    {
+        submission item;
+        std::vector<std::string> touched;
+        while (submissions.pop(item))
+        {
+            std::string host, port, path;
+            if (!parse_url(item.request.url, host, port, path))
+            {
+                client_response response;
+                response.error = "unsupported URL: " + item.request.url;
+                deliver(item.callback, std::move(response));
+                continue;
+            }
+
+            std::uint64_t id = next_exchange_id++;
+            exchange &ex = exchanges[id];
+            ex.id = id;
+            ex.request = std::move(item.request);
+            ex.callback = std::move(item.callback);
+            ex.pool_key = authority_of(host, port);
+            ex.path = std::move(path);
+
+            auto timeout = ex.request.timeout.count() > 0 ? ex.request.timeout : config.request_timeout;
+            ex.timer = timers.schedule(timeout, [this, id]()
+                                       { expire(id); });
+
+            auto found = pools.find(ex.pool_key);
+            if (found == pools.end())
+            {
+                host_pool &pool = pools[ex.pool_key];
+                pool.host = host;
+                pool.port = port;
+                pool.http2 = http2_hosts.count(ex.pool_key) > 0 || http2_hosts.count(host + ":" + port) > 0;
+                found = pools.find(ex.pool_key);
+            }
+            found->second.waiting.push_back(id);
+            touched.push_back(ex.pool_key);
+        }
+
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (const auto &key : touched)
+            pump(key);
+    }
+
+    /**
+     * Scheduling
+     * - The first waiting request goes to the first connected connection that can take it
+     * - Otherwise a connection is opened while the pool is below its limit: HTTP/1.1 pools
+     *   open one per waiting request not covered by a connect in progress, HTTP/2 pools only
+     *   open another once every connection is at the peer's stream limit
+     * - Everything assigned in one pass is written with one send per connection
+     */
+    void web_client::pump(const std::string &pool_key)
+    {
+        auto pool_it = pools.find(pool_key);
+        if (pool_it == pools.end())
+            return;
+        host_pool &pool = pool_it->second;
+
+        std::vector<std::uint64_t> touched;
+        while (!pool.waiting.empty())
+        {
+            auto ex_it = exchanges.find(pool.waiting.front());
+            if (ex_it == exchanges.end())
+            {
+                pool.waiting.pop_front();
+                continue;
+            }
+            exchange &ex = ex_it->second;
+
+            connection *target = nullptr;
+            std::size_t connecting = 0;
+            for (std::uint64_t id : pool.connections)
+            {
+                connection &conn = connections.at(id);
+                if (!conn.connected)
+                {
+                    connecting++;
+                    continue;
+                }
+                if (can_accept(conn, ex))
+                {
+                    target = &conn;
+                    break;
+                }
+            }
+
+            if (target)
+            {
+                pool.waiting.pop_front();
+                assign(*target, ex);
+                touched.push_back(target->id);
+                continue;
+            }
+
+            bool open = pool.connections.size() < config.max_connections_per_host &&
+                        (pool.http2 ? connecting == 0 : connecting < pool.waiting.size());
+            if (!open || !open_connection(pool, pool_key))
+                break;
+        }
+
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (std::uint64_t id : touched)
+        {
+            auto it = connections.find(id);
+            if (it != connections.end())
+                flush(it->second);
+        }
+    }
+
+    /// Failing to resolve or to connect fails the waiting requests, unless another connection can serve them
+    bool web_client::open_connection(host_pool &pool, const std::string &pool_key)
+    {
+        auto fail_waiting = [this, &pool](const std::string &error)
+        {
+            for (std::uint64_t id : pool.connections)
+            {
+                if (connections.at(id).connected)
+                    return;
+            }
+            std::deque<std::uint64_t> waiting;
+            waiting.swap(pool.waiting);
+            for (std::uint64_t id : waiting)
+                fail(id, error);
+        };
+
+        if (!pool.resolved)
+        {
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo *result = nullptr;
+            int status = getaddrinfo(pool.host.c_str(), pool.port.c_str(), &hints, &result);
+            if (status != 0 || !result)
+            {
+                fail_waiting("cannot resolve " + pool.host + ": " + gai_strerror(status));
+                return false;
+            }
+            std::memcpy(&pool.address, result->ai_addr, result->ai_addrlen);
+            pool.address_length = result->ai_addrlen;
+            pool.resolved = true;
+            freeaddrinfo(result);
+        }
+
+        int fd = socket(pool.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            fail_waiting("socket() failed: " + std::string(std::strerror(errno)));
+            return false;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (connect(fd, reinterpret_cast<sockaddr *>(&pool.address), pool.address_length) < 0 && errno != EINPROGRESS)
+        {
+            std::string error = "connect to " + pool_key + " failed: " + std::strerror(errno);
+            close(fd);
+            fail_waiting(error);
+            return false;
+        }
+
+        std::uint64_t id = next_connection_id++;
+        connection &conn = connections[id];
+        conn.fd = fd;
+        conn.id = id;
+        conn.pool_key = pool_key;
+        conn.http2 = pool.http2;
+        conn.writable_armed = true;
+        pool.connections.push_back(id);
+        connections_opened++;
+
+        // writability reports the end of the connect
+        epoll_event event{};
+        event.events = EPOLLOUT;
+        event.data.u64 = id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+        conn.connect_timer = timers.schedule(config.connect_timeout, [this, id]()
+                                             { close_connection(id, "connect timeout"); });
+        return true;
+    }
+
+    /// HTTP/1.1 pipelines only idempotent requests behind each other, and never behind a closing response
+    bool web_client::can_accept(const connection &conn, const exchange &ex) const
+    {
+        if (conn.draining)
+            return false;
+        if (conn.http2)
+            return conn.streams.size() < conn.peer_max_streams && conn.next_stream < 0x7fffffff;
+
+        if (conn.in_flight.empty())
+            return true;
+        if (conn.in_flight.size() >= config.max_pipeline_depth || conn.close_after || !is_idempotent(ex.request.method))
+            return false;
+        for (std::uint64_t id : conn.in_flight)
+        {
+            auto it = exchanges.find(id);
+            if (it == exchanges.end() || !is_idempotent(it->second.request.method))
+                return false;
+        }
+        return true;
+    }
+
+    void web_client::assign(connection &conn, exchange &ex)
+    {
+        ex.connection = conn.id;
+        if (conn.idle_timer)
+        {
+            timers.cancel(conn.idle_timer);
+            conn.idle_timer = 0;
+        }
+        const host_pool &pool = pools.at(conn.pool_key);
+
+        if (conn.http2)
+        {
+            std::vector<hpack_header> headers = {{":method", ex.request.method},
+                                                 {":scheme", "http"},
+                                                 {":authority", conn.pool_key},
+                                                 {":path", ex.path}};
+            for (const auto &header : ex.request.headers)
+            {
+                std::string name = lowercase(header.first);
+                if (name == "host" || name == "connection" || name == "keep-alive" || name == "transfer-encoding" || name == "upgrade" || name == "content-length")
+                    continue;
+                headers.emplace_back(std::move(name), header.second);
+            }
+            if (!ex.request.body.empty())
+                headers.emplace_back("content-length", std::to_string(ex.request.body.size()));
+
+            ex.stream_id = conn.next_stream;
+            conn.next_stream += 2;
+            ex.send_window = conn.peer_initial_window;
+            conn.streams[ex.stream_id] = ex.id;
+            http2_frame::write_headers(conn.output, ex.stream_id, conn.encoder->encode(headers), ex.request.body.empty(), conn.peer_max_frame);
+            send_http2_bodies(conn);
+            return;
+        }
+
+        std::string &out = conn.output;
+        out += ex.request.method + " " + ex.path + " HTTP/1.1\r\nHost: " + authority_of(pool.host, pool.port) + "\r\n";
+        for (const auto &header : ex.request.headers)
+        {
+            std::string name = lowercase(header.first);
+            if (name == "host" || name == "content-length" || name == "transfer-encoding")
+                continue;
+            out += header.first + ": " + header.second + "\r\n";
+        }
+        const std::string &method = ex.request.method;
+        if (!ex.request.body.empty() || method == "POST" || method == "PUT" || method == "PATCH")
+            out += "Content-Length: " + std::to_string(ex.request.body.size()) + "\r\n";
+        out += "\r\n";
+        out += ex.request.body;
+        conn.in_flight.push_back(ex.id);
+    }
+
+    void web_client::handle_event(std::uint64_t connection_id, std::uint32_t events)
+    {
+        auto it = connections.find(connection_id);
+        if (it == connections.end())
+            return;
+
+        if (!it->second.connected)
+        {
+            handle_connected(it->second);
+            return;
+        }
+        if (events & EPOLLOUT)
+        {
+            flush(it->second);
+            it = connections.find(connection_id);
+            if (it == connections.end())
+                return;
+        }
+        // errors and hangups surface as read errors or end of stream
+        if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            handle_readable(it->second);
+    }
+
+    void web_client::handle_connected(connection &conn)
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+            error = errno;
+        if (error != 0)
+        {
+            close_connection(conn.id, "connect to " + conn.pool_key + " failed: " + std::strerror(error));
+            return;
+        }
+
+        timers.cancel(conn.connect_timer);
+        conn.connect_timer = 0;
+        conn.connected = true;
+        arm_idle(conn);
+        update_events(conn, false);
+        if (conn.http2)
+            start_http2(conn);
+
+        std::uint64_t id = conn.id;
+        pump(conn.pool_key);
+        auto it = connections.find(id);
+        if (it != connections.end())
+            flush(it->second);
+    }
+
+    void web_client::handle_readable(connection &conn)
+    {
+        char buffer[READ_BUFFER_SIZE];
+        std::uint64_t id = conn.id;
+        bool closed = false;
+        std::string error;
+
+        while (true)
+        {
+            ssize_t received = read(conn.fd, buffer, sizeof(buffer));
+            if (received == 0)
+            {
+                closed = true;
+                break;
+            }
+            if (received < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    closed = true;
+                    error = std::strerror(errno);
+                }
+                break;
+            }
+            conn.input.append(buffer, static_cast<std::size_t>(received));
+            if (static_cast<std::size_t>(received) < sizeof(buffer))
+                break;
+        }
+
+        bool valid = conn.http2 ? receive_http2(conn) : parse_http1(conn);
+        auto it = connections.find(id);
+        if (it == connections.end())
+            return;
+        if (!valid)
+        {
+            close_connection(id, conn.http2 ? "HTTP/2 protocol error" : "invalid response");
+            return;
+        }
+
+        if (closed)
+        {
+            // a response without length ends with the connection
+            connection &current = it->second;
+            if (!current.http2 && current.headers_done && current.mode == body_mode::UNTIL_CLOSE)
+                finish_http1(current);
+            close_connection(id, error.empty() ? "connection closed by server" : "connection error: " + error);
+            return;
+        }
+
+        // completed responses free the connection for requests waiting in its pool
+        pump(std::string(it->second.pool_key));
+        it = connections.find(id);
+        if (it != connections.end())
+            flush(it->second);
+    }
+
+    /**
+     * Write out
+     * - Whatever the socket does not take is written when it becomes writable again
+     */
+    void web_client::flush(connection &conn)
+    {
+        if (!conn.connected)
+            return;
+
+        std::uint64_t id = conn.id;
+        while (conn.output_offset < conn.output.size())
+        {
+            ssize_t written = send(conn.fd, conn.output.data() + conn.output_offset, conn.output.size() - conn.output_offset, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    update_events(conn, true);
+                    return;
+                }
+                close_connection(id, "write failed: " + std::string(std::strerror(errno)));
+                return;
+            }
+            conn.output_offset += static_cast<std::size_t>(written);
+        }
+        conn.output.clear();
+        conn.output_offset = 0;
+        update_events(conn, false);
+    }
+
+    void web_client::update_events(connection &conn, bool want_write)
+    {
+        if (conn.writable_armed == want_write)
+            return;
+        conn.writable_armed = want_write;
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP | (want_write ? static_cast<std::uint32_t>(EPOLLOUT) : 0u);
+        event.data.u64 = conn.id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &event);
+    }
+
+    /**
+     * HTTP/1.1 responses, in the order of conn.in_flight
+     * - Interim (1xx) responses are skipped
+     * - The body is delimited by Content-Length, chunked encoding or the end of the
+     *   connection; HEAD, 204 and 304 responses have none
+     * - Connection: close (or HTTP/1.0 without keep-alive) closes the connection after the
+     *   response, the requests pipelined behind it are retried
+     */
+    bool web_client::parse_http1(connection &conn)
+    {
+        while (!conn.in_flight.empty())
+        {
+            auto ex_it = exchanges.find(conn.in_flight.front());
+            if (ex_it == exchanges.end())
+                return false;
+            exchange &ex = ex_it->second;
+            client_response &response = ex.response;
+
+            if (!conn.headers_done)
+            {
+                std::size_t end = conn.input.find("\r\n\r\n");
+                if (end == std::string::npos)
+                    return conn.input.size() <= MAX_HEADER_SIZE;
+
+                std::size_t line_end = conn.input.find("\r\n");
+                std::string status_line = conn.input.substr(0, line_end);
+                if (status_line.size() < 12 || status_line.compare(0, 7, "HTTP/1.") != 0 || status_line[8] != ' ')
+                    return false;
+                int status = std::atoi(status_line.substr(9, 3).c_str());
+                if (status < 100 || status > 999)
+                    return false;
+                bool http10 = status_line[7] == '0';
+
+                std::vector<std::pair<std::string, std::string>> headers;
+                bool keep_alive = !http10;
+                bool chunked = false;
+                bool has_length = false;
+                std::size_t length = 0;
+                std::size_t position = line_end + 2;
+                while (position < end)
+                {
+                    std::size_t next = conn.input.find("\r\n", position);
+                    std::string line = conn.input.substr(position, next - position);
+                    position = next + 2;
+
+                    std::size_t colon = line.find(':');
+                    if (colon == std::string::npos || colon == 0)
+                        return false;
+                    std::string name = line.substr(0, colon);
+                    std::string value = trim(line.substr(colon + 1));
+                    std::string lower = lowercase(name);
+
+                    if (lower == "connection")
+                    {
+                        if (has_token(value, "close"))
+                            keep_alive = false;
+                        else if (has_token(value, "keep-alive"))
+                            keep_alive = true;
+                    }
+                    else if (lower == "transfer-encoding" && has_token(value, "chunked"))
+                    {
+                        chunked = true;
+                    }
+                    else if (lower == "content-length")
+                    {
+                        if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+                            return false;
+                        length = std::strtoull(value.c_str(), nullptr, 10);
+                        has_length = true;
+                    }
+                    headers.emplace_back(std::move(name), std::move(value));
+                }
+                conn.input.erase(0, end + 4);
+
+                if (status < 200)
+                    continue;
+
+                response.status = status;
+                response.reason = line_end > 13 ? status_line.substr(13) : "";
+                response.headers = std::move(headers);
+                conn.headers_done = true;
+                conn.close_after = !keep_alive;
+                conn.remaining = 0;
+                conn.chunk_trailer = false;
+
+                if (ex.request.method == "HEAD" || status == 204 || status == 304)
+                    conn.mode = body_mode::NONE;
+                else if (chunked)
+                    conn.mode = body_mode::CHUNKED;
+                else if (has_length)
+                {
+                    conn.mode = body_mode::LENGTH;
+                    conn.remaining = length;
+                }
+                else
+                {
+                    conn.mode = body_mode::UNTIL_CLOSE;
+                    conn.close_after = true;
+                }
+
+                if (conn.mode == body_mode::LENGTH && length > config.max_response_size)
+                {
+                    conn.in_flight.pop_front();
+                    fail(ex.id, "response too large");
+                    return false;
+                }
+            }
+
+            bool done = false;
+            switch (conn.mode)
+            {
+            case body_mode::NONE:
+                done = true;
+                break;
+            case body_mode::LENGTH:
+            {
+                std::size_t take = std::min(conn.remaining, conn.input.size());
+                response.body.append(conn.input, 0, take);
+                conn.input.erase(0, take);
+                conn.remaining -= take;
+                done = conn.remaining == 0;
+                break;
+            }
+            case body_mode::CHUNKED:
+                // remaining counts the chunk's data plus its closing CRLF
+                while (!done)
+                {
+                    if (conn.chunk_trailer)
+                    {
+                        std::size_t line_end = conn.input.find("\r\n");
+                        if (line_end == std::string::npos)
+                            break;
+                        std::size_t colon = conn.input.find(':');
+                        if (colon != std::string::npos && colon > 0 && colon < line_end)
+                            response.headers.emplace_back(conn.input.substr(0, colon), trim(conn.input.substr(colon + 1, line_end - colon - 1)));
+                        conn.input.erase(0, line_end + 2);
+                        done = line_end == 0;
+                        continue;
+                    }
+                    if (conn.remaining == 0)
+                    {
+                        std::size_t line_end = conn.input.find("\r\n");
+                        if (line_end == std::string::npos)
+                        {
+                            if (conn.input.size() > MAX_HEADER_SIZE)
+                                return false;
+                            break;
+                        }
+                        char *parsed = nullptr;
+                        std::size_t size = std::strtoull(conn.input.c_str(), &parsed, 16);
+                        if (parsed == conn.input.c_str())
+                            return false;
+                        conn.input.erase(0, line_end + 2);
+                        if (size == 0)
+                            conn.chunk_trailer = true;
+                        else
+                            conn.remaining = size + 2;
+                        continue;
+                    }
+                    if (conn.remaining > 2)
+                    {
+                        std::size_t take = std::min(conn.remaining - 2, conn.input.size());
+                        response.body.append(conn.input, 0, take);
+                        conn.input.erase(0, take);
+                        conn.remaining -= take;
+                        if (conn.remaining > 2)
+                            break;
+                    }
+                    if (conn.input.size() < 2)
+                        break;
+                    if (conn.input.compare(0, 2, "\r\n") != 0)
+                        return false;
+                    conn.input.erase(0, 2);
+                    conn.remaining = 0;
+                }
+                break;
+            case body_mode::UNTIL_CLOSE:
+                response.body += conn.input;
+                conn.input.clear();
+                break;
+            }
+
+            if (response.body.size() > config.max_response_size)
+            {
+                conn.in_flight.pop_front();
+                fail(ex.id, "response too large");
+                return false;
+            }
+            if (!done)
+                return true;
+
+            bool close_after = conn.close_after;
+            finish_http1(conn);
+            if (close_after)
+            {
+                close_connection(conn.id, "connection closed by server");
+                return true;
+            }
+        }
+        return true;
+    }
+
+    void web_client::finish_http1(connection &conn)
+    {
+        std::uint64_t id = conn.in_flight.front();
+        conn.in_flight.pop_front();
+        conn.headers_done = false;
+        conn.mode = body_mode::NONE;
+        conn.remaining = 0;
+        conn.chunk_trailer = false;
+        conn.completed++;
+        if (conn.in_flight.empty())
+            arm_idle(conn);
+        complete(id);
+    }
+
+    /// Client preface, push disabled and large receive windows so responses are not throttled
+    void web_client::start_http2(connection &conn)
+    {
+        conn.encoder = std::make_unique<hpack_encoder>();
+        conn.decoder = std::make_unique<hpack_decoder>();
+        conn.output.append(http2_frame::PREFACE, http2_frame::PREFACE_SIZE);
+        http2_frame::write_settings(conn.output, {{http2_setting::ENABLE_PUSH, 0}, {http2_setting::INITIAL_WINDOW_SIZE, STREAM_WINDOW}});
+        http2_frame::write_window_update(conn.output, 0, CONNECTION_WINDOW - http2_frame::DEFAULT_WINDOW_SIZE);
+    }
+
+    bool web_client::receive_http2(connection &conn)
+    {
+        std::size_t offset = 0;
+        bool reschedule = false;
+        std::vector<std::uint64_t> finished;
+
+        while (conn.input.size() - offset >= http2_frame::HEADER_SIZE)
+        {
+            auto *bytes = reinterpret_cast<const std::uint8_t *>(conn.input.data() + offset);
+            http2_frame frame = http2_frame::parse(bytes);
+            if (frame.length > http2_frame::DEFAULT_MAX_FRAME_SIZE)
+                return false;
+            if (conn.input.size() - offset < http2_frame::HEADER_SIZE + frame.length)
+                break;
+            const std::uint8_t *payload = bytes + http2_frame::HEADER_SIZE;
+            offset += http2_frame::HEADER_SIZE + frame.length;
+
+            auto type = static_cast<http2_frame_type>(frame.type);
+            if (conn.header_stream != 0 && type != http2_frame_type::CONTINUATION)
+                return false;
+
+            switch (type)
+            {
+            case http2_frame_type::DATA:
+            {
+                std::size_t start = 0;
+                std::size_t padding = 0;
+                if (frame.flags & http2_flags::PADDED)
+                {
+                    if (frame.length < 1)
+                        return false;
+                    padding = payload[0];
+                    start = 1;
+                }
+                if (start + padding > frame.length)
+                    return false;
+
+                conn.unacknowledged += frame.length;
+                if (conn.unacknowledged >= CONNECTION_WINDOW / 2)
+                {
+                    http2_frame::write_window_update(conn.output, 0, conn.unacknowledged);
+                    conn.unacknowledged = 0;
+                }
+
+                auto stream = conn.streams.find(frame.stream_id);
+                if (stream == conn.streams.end())
+                    break;
+                exchange &ex = exchanges.at(stream->second);
+                ex.response.body.append(reinterpret_cast<const char *>(payload + start), frame.length - start - padding);
+                ex.unacknowledged += frame.length;
+
+                if (ex.response.body.size() > config.max_response_size)
+                {
+                    http2_frame::write_rst_stream(conn.output, frame.stream_id, http2_error::CANCEL);
+                    conn.streams.erase(stream);
+                    fail(ex.id, "response too large");
+                }
+                else if (frame.flags & http2_flags::END_STREAM)
+                {
+                    conn.streams.erase(stream);
+                    finished.push_back(ex.id);
+                }
+                else if (ex.unacknowledged >= STREAM_WINDOW / 2)
+                {
+                    http2_frame::write_window_update(conn.output, frame.stream_id, ex.unacknowledged);
+                    ex.unacknowledged = 0;
+                }
+                break;
+            }
+            case http2_frame_type::HEADERS:
+            {
+                std::size_t start = 0;
+                std::size_t padding = 0;
+                if (frame.flags & http2_flags::PADDED)
+                {
+                    if (frame.length < 1)
+                        return false;
+                    padding = payload[0];
+                    start = 1;
+                }
+                if (frame.flags & http2_flags::PRIORITY)
+                    start += 5;
+                if (frame.stream_id == 0 || start + padding > frame.length)
+                    return false;
+
+                conn.header_block.assign(reinterpret_cast<const char *>(payload + start), frame.length - start - padding);
+                conn.header_stream = frame.stream_id;
+                conn.header_end_stream = frame.flags & http2_flags::END_STREAM;
+                if ((frame.flags & http2_flags::END_HEADERS) && !handle_http2_headers(conn))
+                    return false;
+                break;
+            }
+            case http2_frame_type::CONTINUATION:
+                if (conn.header_stream == 0 || frame.stream_id != conn.header_stream)
+                    return false;
+                conn.header_block.append(reinterpret_cast<const char *>(payload), frame.length);
+                if ((frame.flags & http2_flags::END_HEADERS) && !handle_http2_headers(conn))
+                    return false;
+                break;
+            case http2_frame_type::RST_STREAM:
+            {
+                if (frame.length != 4)
+                    return false;
+                auto stream = conn.streams.find(frame.stream_id);
+                if (stream == conn.streams.end())
+                    break;
+                std::uint64_t id = stream->second;
+                conn.streams.erase(stream);
+                // a refused stream was not processed and can go to another connection
+                auto error = static_cast<http2_error>(http2_frame::read_u32(payload));
+                requeue_or_fail(id, error == http2_error::REFUSED_STREAM, "stream reset by server");
+                reschedule = true;
+                break;
+            }
+            case http2_frame_type::SETTINGS:
+            {
+                if (frame.flags & http2_flags::ACK)
+                    break;
+                if (frame.length % 6 != 0)
+                    return false;
+                for (std::size_t i = 0; i < frame.length; i += 6)
+                {
+                    auto id = static_cast<http2_setting>((payload[i] << 8) | payload[i + 1]);
+                    std::uint32_t value = http2_frame::read_u32(payload + i + 2);
+                    switch (id)
+                    {
+                    case http2_setting::HEADER_TABLE_SIZE:
+                        conn.encoder->set_max_table_size(value);
+                        break;
+                    case http2_setting::MAX_CONCURRENT_STREAMS:
+                        conn.peer_max_streams = value;
+                        break;
+                    case http2_setting::INITIAL_WINDOW_SIZE:
+                    {
+                        if (value > http2_frame::MAX_WINDOW_SIZE)
+                            return false;
+                        std::int64_t delta = static_cast<std::int64_t>(value) - conn.peer_initial_window;
+                        for (const auto &stream : conn.streams)
+                            exchanges.at(stream.second).send_window += delta;
+                        conn.peer_initial_window = value;
+                        break;
+                    }
+                    case http2_setting::MAX_FRAME_SIZE:
+                        if (value < http2_frame::DEFAULT_MAX_FRAME_SIZE || value > http2_frame::MAX_FRAME_SIZE_LIMIT)
+                            return false;
+                        conn.peer_max_frame = value;
+                        break;
+                    default:
+                        break;
+                    }
+                }
+                http2_frame::write_settings(conn.output, {}, true);
+                reschedule = true;
+                break;
+            }
+            case http2_frame_type::PING:
+                if (frame.length != 8)
+                    return false;
+                if (!(frame.flags & http2_flags::ACK))
+                    http2_frame::write_ping(conn.output, payload, true);
+                break;
+            case http2_frame_type::GOAWAY:
+            {
+                if (frame.length < 8)
+                    return false;
+                // streams above the last one the server processed are safe to send elsewhere
+                std::uint32_t last = http2_frame::read_u32(payload) & 0x7fffffff;
+                conn.draining = true;
+                std::vector<std::uint32_t> unprocessed;
+                for (const auto &stream : conn.streams)
+                {
+                    if (stream.first > last)
+                        unprocessed.push_back(stream.first);
+                }
+                std::sort(unprocessed.rbegin(), unprocessed.rend());
+                for (std::uint32_t stream_id : unprocessed)
+                {
+                    std::uint64_t id = conn.streams[stream_id];
+                    conn.streams.erase(stream_id);
+                    requeue_or_fail(id, true, "connection closed by server");
+                }
+                reschedule = true;
+                break;
+            }
+            case http2_frame_type::WINDOW_UPDATE:
+            {
+                if (frame.length != 4)
+                    return false;
+                std::uint32_t increment = http2_frame::read_u32(payload) & 0x7fffffff;
+                if (frame.stream_id == 0)
+                {
+                    conn.send_window += increment;
+                }
+                else
+                {
+                    auto stream = conn.streams.find(frame.stream_id);
+                    if (stream != conn.streams.end())
+                        exchanges.at(stream->second).send_window += increment;
+                }
+                break;
+            }
+            case http2_frame_type::PUSH_PROMISE:
+                // disabled in our SETTINGS
+                return false;
+            default:
+                break;
+            }
+        }
+        conn.input.erase(0, offset);
+        send_http2_bodies(conn);
+
+        for (std::uint64_t id : finished)
+            complete(id);
+
+        if (conn.streams.empty())
+        {
+            arm_idle(conn);
+            if (conn.draining)
+            {
+                std::uint64_t id = conn.id;
+                flush(conn);
+                close_connection(id, "connection closed by server");
+                return true;
+            }
+        }
+        if (reschedule)
+            pump(std::string(conn.pool_key));
+        return true;
+    }
+
+    /**
+     * A complete header block
+     * - It is decoded even when its stream is gone (e.g. timed out), to keep the HPACK
+     *   context in sync
+     * - The first block with a final status carries the response headers, a later one the trailers
+     */
+    bool web_client::handle_http2_headers(connection &conn)
+    {
+        std::vector<hpack_header> headers;
+        bool decoded = conn.decoder->decode(reinterpret_cast<const std::uint8_t *>(conn.header_block.data()), conn.header_block.size(), headers, MAX_HEADER_SIZE);
+        std::uint32_t stream_id = conn.header_stream;
+        conn.header_block.clear();
+        conn.header_stream = 0;
+        if (!decoded)
+            return false;
+
+        auto stream = conn.streams.find(stream_id);
+        if (stream == conn.streams.end())
+            return true;
+        exchange &ex = exchanges.at(stream->second);
+
+        if (ex.response.status == 0)
+        {
+            int status = 0;
+            for (const auto &header : headers)
+            {
+                if (header.first == ":status")
+                    status = std::atoi(header.second.c_str());
+            }
+            if (status < 100 || status > 999)
+            {
+                http2_frame::write_rst_stream(conn.output, stream_id, http2_error::PROTOCOL_ERROR);
+                conn.streams.erase(stream);
+                fail(ex.id, "invalid response");
+                return true;
+            }
+            if (status < 200)
+                return true;
+            ex.response.status = status;
+        }
+        for (auto &header : headers)
+        {
+            if (!header.first.empty() && header.first[0] != ':')
+                ex.response.headers.emplace_back(std::move(header.first), std::move(header.second));
+        }
+
+        if (conn.header_end_stream)
+        {
+            conn.streams.erase(stream);
+            complete(ex.id);
+        }
+        return true;
+    }
+
+    /// Request bodies go out as far as the connection and stream windows allow
+    void web_client::send_http2_bodies(connection &conn)
+    {
+        for (const auto &stream : conn.streams)
+        {
+            exchange &ex = exchanges.at(stream.second);
+            const std::string &body = ex.request.body;
+            while (ex.body_offset < body.size() && conn.send_window > 0 && ex.send_window > 0)
+            {
+                std::size_t size = std::min<std::size_t>({body.size() - ex.body_offset, conn.peer_max_frame,
+                                                          static_cast<std::size_t>(conn.send_window), static_cast<std::size_t>(ex.send_window)});
+                bool last = ex.body_offset + size == body.size();
+                http2_frame::write_data(conn.output, stream.first, body.data() + ex.body_offset, size, last);
+                ex.body_offset += size;
+                conn.send_window -= static_cast<std::int64_t>(size);
+                ex.send_window -= static_cast<std::int64_t>(size);
+            }
+        }
+    }
+
+    /**
+     * Closing a connection
+     * - A failed connect fails the pool's waiting requests when no other connection is up
+     * - Requests in flight are retried once when that is safe: idempotent ones, and the
+     *   first request on a reused connection that got no byte of its response (the server
+     *   closed the keep-alive connection as the request went out)
+     */
+    void web_client::close_connection(std::uint64_t id, const std::string &error)
+    {
+        auto it = connections.find(id);
+        if (it == connections.end())
+            return;
+        connection conn = std::move(it->second);
+        connections.erase(it);
+
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+        close(conn.fd);
+        if (conn.connect_timer)
+            timers.cancel(conn.connect_timer);
+        if (conn.idle_timer)
+            timers.cancel(conn.idle_timer);
+
+        auto pool_it = pools.find(conn.pool_key);
+        if (pool_it == pools.end())
+            return;
+        host_pool &pool = pool_it->second;
+        pool.connections.erase(std::remove(pool.connections.begin(), pool.connections.end(), id), pool.connections.end());
+
+        if (!conn.connected)
+        {
+            for (std::uint64_t other : pool.connections)
+            {
+                if (connections.at(other).connected)
+                {
+                    pump(conn.pool_key);
+                    return;
+                }
+            }
+            std::deque<std::uint64_t> waiting;
+            waiting.swap(pool.waiting);
+            for (std::uint64_t waiting_id : waiting)
+                fail(waiting_id, error);
+            return;
+        }
+
+        if (conn.http2)
+        {
+            std::vector<std::pair<std::uint32_t, std::uint64_t>> streams(conn.streams.begin(), conn.streams.end());
+            std::sort(streams.rbegin(), streams.rend());
+            for (const auto &stream : streams)
+            {
+                auto ex = exchanges.find(stream.second);
+                if (ex != exchanges.end())
+                    requeue_or_fail(stream.second, is_idempotent(ex->second.request.method), error);
+            }
+        }
+        else
+        {
+            // back to front, so the requeued requests keep their order
+            for (std::size_t i = conn.in_flight.size(); i-- > 0;)
+            {
+                auto ex = exchanges.find(conn.in_flight[i]);
+                if (ex == exchanges.end())
+                    continue;
+                bool stale = i == 0 && conn.completed > 0 && !conn.headers_done && conn.input.empty();
+                requeue_or_fail(conn.in_flight[i], is_idempotent(ex->second.request.method) || stale, error);
+            }
+        }
+
+        if (!pool.waiting.empty())
+            pump(conn.pool_key);
+    }
+
+    void web_client::requeue_or_fail(std::uint64_t exchange_id, bool retry, const std::string &error)
+    {
+        auto it = exchanges.find(exchange_id);
+        if (it == exchanges.end())
+            return;
+        exchange &ex = it->second;
+        if (!retry || ex.retried)
+        {
+            fail(exchange_id, error);
+            return;
+        }
+
+        ex.retried = true;
+        ex.connection = 0;
+        ex.stream_id = 0;
+        ex.body_offset = 0;
+        ex.unacknowledged = 0;
+        ex.response = client_response{};
+        pools.at(ex.pool_key).waiting.push_front(exchange_id);
+    }
+
+    void web_client::complete(std::uint64_t exchange_id)
+    {
+        auto it = exchanges.find(exchange_id);
+        if (it == exchanges.end())
+            return;
+        timers.cancel(it->second.timer);
+        response_callback callback = std::move(it->second.callback);
+        client_response response = std::move(it->second.response);
+        exchanges.erase(it);
+
+        requests_completed++;
+        deliver(callback, std::move(response));
+    }
+
+    void web_client::fail(std::uint64_t exchange_id, const std::string &error)
+    {
+        auto it = exchanges.find(exchange_id);
+        if (it == exchanges.end())
+            return;
+        timers.cancel(it->second.timer);
+        response_callback callback = std::move(it->second.callback);
+        exchanges.erase(it);
+
+        client_response response;
+        response.error = error;
+        deliver(callback, std::move(response));
+    }
+
+    /**
+     * Deadline of a request
+     * - Waiting in its pool: it is taken out of the queue
+     * - On HTTP/2: its stream is cancelled, the connection stays up
+     * - On HTTP/1.1: the connection is closed, since the late response would answer the
+     *   next request; requests pipelined behind it are retried
+     */
+    void web_client::expire(std::uint64_t exchange_id)
+    {
+        auto it = exchanges.find(exchange_id);
+        if (it == exchanges.end())
+            return;
+        exchange &ex = it->second;
+        ex.timer = 0;
+
+        auto conn_it = connections.find(ex.connection);
+        if (ex.connection == 0 || conn_it == connections.end())
+        {
+            auto pool = pools.find(ex.pool_key);
+            if (pool != pools.end())
+            {
+                auto &waiting = pool->second.waiting;
+                waiting.erase(std::remove(waiting.begin(), waiting.end(), exchange_id), waiting.end());
+            }
+            fail(exchange_id, "timeout");
+            return;
+        }
+
+        connection &conn = conn_it->second;
+        if (conn.http2)
+        {
+            conn.streams.erase(ex.stream_id);
+            http2_frame::write_rst_stream(conn.output, ex.stream_id, http2_error::CANCEL);
+            fail(exchange_id, "timeout");
+            if (conn.streams.empty())
+                arm_idle(conn);
+            flush(conn);
+            return;
+        }
+
+        conn.in_flight.erase(std::remove(conn.in_flight.begin(), conn.in_flight.end(), exchange_id), conn.in_flight.end());
+        fail(exchange_id, "timeout");
+        close_connection(conn.id, "connection closed after a timeout");
+    }
+
+    void web_client::deliver(response_callback &callback, client_response &&response)
+    {
+        if (!callback)
+            return;
+        try
+        {
+            callback(std::move(response));
+        }
+        catch (const std::exception &e)
+        {
+            logger::error("Error in HTTP client callback: " + std::string(e.what()));
+        }
+    }
+
+    /// Keep-alive connections without requests are closed after the idle timeout, later server frames push it back
+    void web_client::arm_idle(connection &conn)
+    {
+        if (conn.idle_timer && timers.reset(conn.idle_timer, config.idle_timeout))
+            return;
+
+        std::uint64_t id = conn.id;
+        conn.idle_timer = timers.schedule(config.idle_timeout, [this, id]()
+                                          {
+            auto it = connections.find(id);
+            if (it == connections.end())
+                return;
+            it->second.idle_timer = 0;
+            if (it->second.http2)
+            {
+                http2_frame::write_goaway(it->second.output, 0, http2_error::NO_ERROR);
+                flush(it->second);
+            }
+            close_connection(id, "idle"); });
+    }
+}
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cctype>
+#include <future>
+#include <limits>
+
+#include "../includes/logger.hpp"
+#include "../includes/thread_pool.hpp"
+#include "../includes/web_proxy.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        /// "http://host:port/base/" -> "host:port", with the default port spelled out
+        std::string authority_of(const std::string &url)
+        {
+            std::size_t start = url.find("://");
+            start = start == std::string::npos ? 0 : start + 3;
+            std::string authority = url.substr(start, url.find('/', start) - start);
+            if (authority.find(':', authority.rfind(']') == std::string::npos ? 0 : authority.rfind(']')) == std::string::npos)
+                authority += ":80";
+            return authority;
+        }
+    }
+
+    proxy_upstream::proxy_upstream(const proxy_config &config) : config(config), client(config.client)
+    {
+        if (config.servers.empty())
+        {
+            throw web_exception("A proxy upstream needs at least one server", "INVALID_UPSTREAM", "proxy_upstream::proxy_upstream", 500, "Internal Server Error");
+        }
+
+        for (const auto &server : config.servers)
+        {
+            if (lowercase(server.substr(0, 7)) != "http://")
+            {
+                throw web_exception("Upstream server must be an http:// URL: " + server, "INVALID_UPSTREAM", "proxy_upstream::proxy_upstream", 500, "Internal Server Error");
+            }
+            auto state = std::make_unique<server_state>();
+            state->base = server;
+            while (state->base.size() > 7 && state->base.back() == '/')
+                state->base.pop_back();
+            if (config.http2)
+                client.use_http2(authority_of(state->base));
+            servers.push_back(std::move(state));
+        }
+    }
+
+    /// Health checks stop before the client, whose stop() still delivers their last callbacks
+    proxy_upstream::~proxy_upstream()
+    {
+        {
+            std::lock_guard<std::mutex> lock(health_mutex);
+            stopping = true;
+        }
+        health_wakeup.notify_all();
+        if (health_thread.joinable())
+            health_thread.join();
+        client.stop();
+    }
+
+    /**
+     * Lazy start
+     * - Upstreams are usually built while routes are set up, which is before use_processes()
+     *   forks; threads started there would not exist in the workers
+     * - The first forward() in each process starts the client loop and the health thread
+     */
+    void proxy_upstream::start()
+    {
+        if (started.load(std::memory_order_acquire))
+            return;
+
+        std::lock_guard<std::mutex> lock(health_mutex);
+        if (started.load(std::memory_order_relaxed))
+            return;
+        if (!client.start())
+        {
+            throw web_exception("Cannot start the upstream client", "INVALID_UPSTREAM", "proxy_upstream::start", 502, "Bad Gateway");
+        }
+        if (!config.health_path.empty())
+            health_thread = std::thread([this]()
+                                        { run_health_checks(); });
+        started.store(true, std::memory_order_release);
+    }
+
+    bool proxy_upstream::is_hop_by_hop(const std::string &name)
+    {
+        std::string lower = lowercase(name);
+        return lower == "connection" || lower == "keep-alive" || lower == "proxy-connection" ||
+               lower == "proxy-authenticate" || lower == "proxy-authorization" || lower == "te" ||
+               lower == "trailer" || lower == "transfer-encoding" || lower == "upgrade";
+    }
+
+    /**
+     * Balancing
+     * - Only healthy servers are considered; with none healthy, all of them are
+     * - exclude is the server a failed attempt went to, it is skipped when there is another
+     */
+    std::size_t proxy_upstream::pick(std::size_t exclude)
+    {
+        const std::size_t count = servers.size();
+        bool any_healthy = false;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (i != exclude && servers[i]->healthy.load(std::memory_order_relaxed))
+            {
+                any_healthy = true;
+                break;
+            }
+        }
+        auto eligible = [&](std::size_t i)
+        {
+            return (i != exclude || count == 1) && (!any_healthy || servers[i]->healthy.load(std::memory_order_relaxed));
+        };
+
+        if (config.balance == proxy_balance::LEAST_IN_FLIGHT)
+        {
+            // the rotating start spreads ties
+            std::size_t start = next.fetch_add(1, std::memory_order_relaxed);
+            std::size_t best = std::numeric_limits<std::size_t>::max();
+            std::size_t best_load = std::numeric_limits<std::size_t>::max();
+            for (std::size_t k = 0; k < count; ++k)
+            {
+                std::size_t i = (start + k) % count;
+                std::size_t load = servers[i]->in_flight.load(std::memory_order_relaxed);
+                if (eligible(i) && load < best_load)
+                {
+                    best = i;
+                    best_load = load;
+                }
+            }
+            if (best != std::numeric_limits<std::size_t>::max())
+                return best;
+        }
+
+        std::size_t start = next.fetch_add(1, std::memory_order_relaxed);
+        for (std::size_t k = 0; k < count; ++k)
+        {
+            std::size_t i = (start + k) % count;
+            if (eligible(i))
+                return i;
+        }
+        return start % count;
+    }
+
+    void proxy_upstream::record(std::size_t index, bool success)
+    {
+        server_state &server = *servers[index];
+        if (success)
+        {
+            server.failures.store(0);
+            if (!server.healthy.load() && server.successes.fetch_add(1) + 1 >= config.healthy_after)
+            {
+                server.healthy.store(true);
+                logger::info("Upstream " + server.base + " is healthy again");
+            }
+            return;
+        }
+
+        server.successes.store(0);
+        if (server.healthy.load() && server.failures.fetch_add(1) + 1 >= config.unhealthy_after)
+        {
+            server.healthy.store(false);
+            logger::error("Upstream " + server.base + " is unhealthy, taking it out of rotation");
+        }
+    }
+
+    /**
+     * Forwarding
+     * - A response of any status is passed on as is
+     * - Failing without response is recorded against the server; idempotent requests then
+     *   get one more attempt on another server
+     */
+    client_response proxy_upstream::forward(client_request request, const std::string &target)
+    {
+        start();
+        if (request.timeout.count() <= 0 || request.timeout > config.request_timeout)
+            request.timeout = config.request_timeout;
+
+        const std::string &method = request.method;
+        bool retry = servers.size() > 1 && (method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" || method == "OPTIONS");
+        std::size_t previous = std::numeric_limits<std::size_t>::max();
+        client_response answer;
+
+        for (int attempt = 0; attempt < (retry ? 2 : 1); ++attempt)
+        {
+            std::size_t index = pick(previous);
+            server_state &server = *servers[index];
+            request.url = server.base + target;
+
+            server.in_flight++;
+            server.requests++;
+            // the client's own deadline normally answers first, this bounds a stalled loop
+            std::future<client_response> pending = client.request(request);
+            if (pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                thread_pool::blocking_scope blocking;
+                pending.wait_for(request.timeout);
+            }
+            if (pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                answer = pending.get();
+            else
+            {
+                answer = client_response();
+                answer.error = "timeout";
+            }
+            server.in_flight--;
+
+            if (answer.ok())
+            {
+                record(index, true);
+                return answer;
+            }
+
+            server.errors++;
+            record(index, false);
+            // another attempt would overrun the request's deadline
+            if (answer.error == "timeout")
+                break;
+            previous = index;
+        }
+        return answer;
+    }
+
+    void proxy_upstream::run_health_checks()
+    {
+        std::unique_lock<std::mutex> lock(health_mutex);
+        while (!stopping)
+        {
+            for (std::size_t i = 0; i < servers.size(); ++i)
+            {
+                client_request probe;
+                probe.url = servers[i]->base + config.health_path;
+                probe.timeout = config.health_timeout;
+                client.request(std::move(probe), [this, i](client_response &&response)
+                               { record(i, response.ok() && response.status >= 200 && response.status < 400); });
+            }
+            health_wakeup.wait_for(lock, config.health_interval, [this]()
+                                   { return stopping; });
+        }
+    }
+
+    std::size_t proxy_upstream::get_healthy_count() const
+    {
+        std::size_t healthy = 0;
+        for (const auto &server : servers)
+        {
+            if (server->healthy.load())
+                healthy++;
+        }
+        return healthy;
+    }
+
+    std::vector<proxy_upstream::server_status> proxy_upstream::get_servers() const
+    {
+        std::vector<server_status> result;
+        for (const auto &server : servers)
+        {
+            server_status status;
+            status.base = server->base;
+            status.healthy = server->healthy.load();
+            status.in_flight = server->in_flight.load();
+            status.requests = server->requests.load();
+            status.errors = server->errors.load();
+            result.push_back(status);
+        }
+        return result;
+    }
+}
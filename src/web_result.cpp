@@ -0,0 +1,67 @@
+#include "../includes/json_writer.hpp"
+#include "../includes/web_result.hpp"
+
+namespace hh_web
+{
+    namespace
+    {
+        /// {"error":"<message>"}, escaped by json_writer
+        std::string error_body(const std::string &message)
+        {
+            json_writer json;
+            json.begin_object();
+            json.key("error").value(message);
+            json.end_object();
+            return json.take();
+        }
+    }
+
+    web_error::web_error(int status_code, std::string status_message, const std::string &message)
+        : status_code(status_code), status_message(std::move(status_message)), message(message), body(error_body(message)),
+          formatted_message(web_exception::format(status_code, this->status_message, message))
+    {
+    }
+
+    web_error::web_error(const web_exception &exception)
+        : status_code(exception.get_status_code()), status_message(exception.get_status_message()), message(exception.get_message()),
+          body(error_body(message)), formatted_message(exception.get_formatted_message())
+    {
+    }
+
+    web_error &web_error::with_body(std::string body, std::string content_type)
+    {
+        this->body = std::move(body);
+        this->content_type = std::move(content_type);
+        return *this;
+    }
+
+    web_exception web_error::to_exception() const
+    {
+        return web_exception(message, "WEB_ERROR", "web_error::to_exception", status_code, status_message);
+    }
+
+    web_error web_error::bad_request(const std::string &message)
+    {
+        return web_error(400, "Bad Request", message);
+    }
+
+    web_error web_error::not_found(const std::string &message)
+    {
+        return web_error(404, "Not Found", message);
+    }
+
+    web_error web_error::conflict(const std::string &message)
+    {
+        return web_error(409, "Conflict", message);
+    }
+
+    web_error web_error::unprocessable(const std::string &message)
+    {
+        return web_error(422, "Unprocessable Entity", message);
+    }
+
+    web_error web_error::internal(const std::string &message)
+    {
+        return web_error(500, "Internal Server Error", message);
+    }
+}
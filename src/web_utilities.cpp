@@ -300,6 +300,34 @@ namespace hh_web
         return (first == std::string::npos || last == std::string::npos) ? "" : str.substr(first, last - first + 1);
     }
 
+    std::string lowercase(std::string value)
+    {
+        std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c)
+                       { return static_cast<char>(std::tolower(c)); });
+        return value;
+    }
+
+    /**
+     * @brief Check whether a comma-separated header value lists a token.
+     *
+     * @note
+     * - Used for Connection, Upgrade and Transfer-Encoding, whose tokens are case-insensitive
+     */
+    bool has_token(const std::string &list, const std::string &token)
+    {
+        std::size_t start = 0;
+        while (start <= list.size())
+        {
+            std::size_t end = list.find(',', start);
+            if (end == std::string::npos)
+                end = list.size();
+            if (lowercase(trim(list.substr(start, end - start))) == token)
+                return true;
+            start = end + 1;
+        }
+        return false;
+    }
+
     /**
      * @brief Extract parameter names from a route expression.
      *
@@ -323,6 +351,39 @@ namespace hh_web
         return path_params;
     }
 
+    /**
+     * @brief Parse a Cookie header into name-value pairs.
+     *
+     * @note
+     * - Splits at ';', then each pair at its first '='
+     * - Trims spaces and tabs around names and values, strips one pair of double quotes
+     * - Skips pairs without '=' or with an empty name
+     */
+    std::vector<std::pair<std::string, std::string>> parse_cookies(const std::string &header)
+    {
+        std::vector<std::pair<std::string, std::string>> cookies;
+        size_t start = 0;
+        while (start < header.size())
+        {
+            size_t end = header.find(';', start);
+            if (end == std::string::npos)
+                end = header.size();
+
+            size_t equals = header.find('=', start);
+            if (equals != std::string::npos && equals < end)
+            {
+                std::string name = trim(header.substr(start, equals - start));
+                std::string value = trim(header.substr(equals + 1, end - equals - 1));
+                if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+                    value = value.substr(1, value.size() - 2);
+                if (!name.empty())
+                    cookies.emplace_back(std::move(name), std::move(value));
+            }
+            start = end + 1;
+        }
+        return cookies;
+    }
+
     /**
      * @brief Extract the path component (without query) from a URI.
      */
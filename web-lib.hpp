@@ -10,3 +10,28 @@
 #include "includes/web_types.hpp"
 #include "includes/web_utilities.hpp"
 #include "includes/web_exceptions.hpp"
+#include "includes/web_result.hpp"
+#include "includes/canned_response.hpp"
+#include "includes/html_template.hpp"
+#include "includes/json_writer.hpp"
+#include "includes/json_validator.hpp"
+#include "includes/search_index.hpp"
+#include "includes/cancellation_token.hpp"
+#include "includes/timing_wheel.hpp"
+#include "includes/session_store.hpp"
+#include "includes/process_supervisor.hpp"
+#include "includes/listener_handoff.hpp"
+#include "includes/io_uring_ring.hpp"
+#include "includes/mpsc_queue.hpp"
+#include "includes/completion_queue.hpp"
+#include "includes/socket_options.hpp"
+#include "includes/cpu_topology.hpp"
+#include "includes/hpack.hpp"
+#include "includes/http2_frame.hpp"
+#include "includes/http2_session.hpp"
+#include "includes/peer_credentials.hpp"
+#include "includes/http2_listener.hpp"
+#include "includes/web_client.hpp"
+#include "includes/web_proxy.hpp"
+#include "includes/web_batch.hpp"
+#include "includes/shard_group.hpp"